@@ -18,9 +18,12 @@
 */
 
 #include "katedocument_test.h"
+#include "benchmarklines.h"
 #include "moc_katedocument_test.cpp"
 
 #include <katedocument.h>
+#include <katebuffer.h>
+#include <katehighlightingscheduler.h>
 #include <ktexteditor/movingcursor.h>
 #include <kateconfig.h>
 #include <kateview.h>
@@ -258,6 +261,102 @@ void KateDocumentTest::testRemoveTextPerformance()
     }
 }
 
+void KateDocumentTest::testReplaceTexts()
+{
+    const QString text = QLatin1String("foo bar foo\n"
+                                       "foofoo\n"
+                                       "x foo y foo\n"
+                                       "foo\n");
+
+    // single line replacements, adjacent ones, a replacement with a newline and one spanning lines
+    QVector<Range> ranges;
+    ranges << Range(0, 0, 0, 3) << Range(0, 8, 0, 11) << Range(1, 0, 1, 3) << Range(1, 3, 1, 6)
+           << Range(2, 2, 2, 5) << Range(2, 8, 3, 1);
+    const QStringList texts = QStringList() << "a" << "" << "bb" << "c" << "d\ne" << "f";
+
+    const QString result = QLatin1String("a bar \n"
+                                         "bbc\n"
+                                         "x d\n"
+                                         "e y foo\n");
+
+    // reference: one replaceText per range, back to front, and the batch, both with cursors everywhere
+    KTextEditor::DocumentPrivate reference(false, false);
+    KTextEditor::DocumentPrivate doc(false, false);
+    reference.setText(text);
+    doc.setText(text);
+
+    QList<MovingCursor *> referenceCursors;
+    QList<MovingCursor *> cursors;
+    for (int line = 0; line < doc.lines(); ++line) {
+        for (int column = 0; column <= doc.lineLength(line); ++column) {
+            referenceCursors << reference.newMovingCursor(Cursor(line, column), MovingCursor::MoveOnInsert)
+                             << reference.newMovingCursor(Cursor(line, column), MovingCursor::StayOnInsert);
+            cursors << doc.newMovingCursor(Cursor(line, column), MovingCursor::MoveOnInsert)
+                    << doc.newMovingCursor(Cursor(line, column), MovingCursor::StayOnInsert);
+        }
+    }
+
+    reference.editStart();
+    for (int i = ranges.size() - 1; i >= 0; --i) {
+        reference.replaceText(ranges.at(i), texts.at(i));
+    }
+    reference.editEnd();
+
+    const QVector<Range> newRanges = doc.replaceTexts(ranges, texts);
+
+    QCOMPARE(reference.text(), result);
+    QCOMPARE(doc.text(), result);
+    for (int i = 0; i < cursors.size(); ++i) {
+        QCOMPARE(cursors.at(i)->toCursor(), referenceCursors.at(i)->toCursor());
+    }
+
+    // the returned ranges cover the new texts
+    QCOMPARE(newRanges.size(), ranges.size());
+    for (int i = 0; i < newRanges.size(); ++i) {
+        QCOMPARE(doc.text(newRanges.at(i)), texts.at(i));
+    }
+
+    // all of it is one undo step
+    doc.undo();
+    QCOMPARE(doc.text(), text);
+    doc.redo();
+    QCOMPARE(doc.text(), result);
+
+    qDeleteAll(referenceCursors);
+    qDeleteAll(cursors);
+}
+
+void KateDocumentTest::testReplaceTextsPerformance()
+{
+    const int lines = benchmarkLines(5000);
+
+    const QString line = QLatin1String("foo bar foo bar foo bar foo bar foo bar foo bar foo bar foo bar foo bar foo bar");
+    const int matchesPerLine = line.count(QLatin1String("foo"));
+
+    QString text;
+    QVector<Range> ranges;
+    QStringList texts;
+    ranges.reserve(lines * matchesPerLine);
+    for (int l = 0; l < lines; ++l) {
+        text.append(line);
+        text.append('\n');
+        for (int c = line.indexOf(QLatin1String("foo")); c >= 0; c = line.indexOf(QLatin1String("foo"), c + 3)) {
+            ranges << Range(l, c, l, c + 3);
+            texts << QStringLiteral("foobar");
+        }
+    }
+
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(text);
+
+    QBENCHMARK_ONCE {
+        doc.replaceTexts(ranges, texts);
+    }
+
+    QCOMPARE(doc.line(0), QString(line).replace(QLatin1String("foo"), QLatin1String("foobar")));
+    QCOMPARE(doc.lines(), lines + 1);
+}
+
 void KateDocumentTest::testForgivingApiUsage()
 {
     KTextEditor::DocumentPrivate doc;
@@ -434,6 +533,141 @@ void KateDocumentTest::testDefStyleNum()
     QCOMPARE(doc.defStyleNum(0, 0), 0);
 }
 
+void KateDocumentTest::testBackgroundHighlighting()
+{
+    QStringList text;
+    for (int i = 0; i < 20000; ++i) {
+        text << QStringLiteral("int f%1() { return %1; } // comment").arg(i);
+    }
+
+    // set the highlighting after the text, setText() would highlight all lines
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(text);
+    doc.setHighlightingMode(QStringLiteral("C++"));
+    KateBuffer &buffer = doc.buffer();
+
+    // lines near the highlighted area are done at once
+    QVERIFY(buffer.requestHighlighting(10));
+    QVERIFY(buffer.lastHighlightedLine() >= 10);
+
+    // far lines are done in the background, in more than one batch
+    QSignalSpy progressSpy(&doc, SIGNAL(highlightingProgress(KTextEditor::DocumentPrivate*,int)));
+    QVERIFY(!buffer.requestHighlighting(15000));
+    QVERIFY(buffer.lastHighlightedLine() < 15000);
+    while (buffer.lastHighlightedLine() < 15000) {
+        QVERIFY(progressSpy.wait(10000));
+    }
+    QCOMPARE(progressSpy.last().at(1).toInt(), buffer.lastHighlightedLine());
+    QVERIFY(buffer.requestHighlighting(15000));
+
+    // same result as highlighting it at once
+    KTextEditor::DocumentPrivate reference;
+    reference.setHighlightingMode(QStringLiteral("C++"));
+    reference.setText(text);
+    const auto attributes = doc.plainKateTextLine(15000)->attributesList();
+    const auto expected = reference.kateTextLine(15000)->attributesList();
+    QVERIFY(!expected.isEmpty());
+    QCOMPARE(attributes.size(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+        QCOMPARE(attributes[i].offset, expected[i].offset);
+        QCOMPARE(attributes[i].length, expected[i].length);
+        QCOMPARE(attributes[i].attributeValue, expected[i].attributeValue);
+    }
+}
+
+void KateDocumentTest::testHighlightingScheduler()
+{
+    QStringList text;
+    for (int i = 0; i < 20000; ++i) {
+        text << QStringLiteral("int f%1() { return %1; } // comment").arg(i);
+    }
+
+    // set the highlighting after the text, setText() would highlight all lines
+    KTextEditor::DocumentPrivate background;
+    background.setText(text);
+    background.setHighlightingMode(QStringLiteral("C++"));
+    KTextEditor::DocumentPrivate focused;
+    focused.setText(text);
+    focused.setHighlightingMode(QStringLiteral("C++"));
+
+    KateHighlightingScheduler *scheduler = KTextEditor::EditorPrivate::self()->highlightingScheduler();
+    scheduler->resetStatistics();
+
+    // one request per buffer, a second one raises the priority
+    QVERIFY(!background.buffer().requestHighlighting(15000, 64, KateHighlightingScheduler::IdlePriority));
+    QVERIFY(!background.buffer().requestHighlighting(15000, 64, KateHighlightingScheduler::LookaheadPriority));
+    QVERIFY(!focused.buffer().requestHighlighting(15000, 64, KateHighlightingScheduler::FocusedViewPriority));
+    QCOMPARE(scheduler->queueDepth(), 2);
+    QCOMPARE(scheduler->queueDepth(KateHighlightingScheduler::FocusedViewPriority), 1);
+    QCOMPARE(scheduler->queueDepth(KateHighlightingScheduler::LookaheadPriority), 1);
+
+    // the focused view goes first, the other buffer gets at most the rest of its last slice
+    QSignalSpy backgroundSpy(&background, SIGNAL(highlightingProgress(KTextEditor::DocumentPrivate*,int)));
+    QSignalSpy focusedSpy(&focused, SIGNAL(highlightingProgress(KTextEditor::DocumentPrivate*,int)));
+    while (focused.buffer().lastHighlightedLine() < 15000) {
+        QVERIFY(focusedSpy.wait(10000));
+    }
+    QVERIFY(focusedSpy.count() > 1);
+    QVERIFY(backgroundSpy.count() <= 1);
+    QVERIFY(scheduler->slices() >= focusedSpy.count());
+    QCOMPARE(scheduler->firstFrames(), qint64(1));
+    QVERIFY(scheduler->maxFirstFrameLatency() >= scheduler->lastFirstFrameLatency());
+    QCOMPARE(scheduler->averageFirstFrameLatency(), scheduler->lastFirstFrameLatency());
+
+    // then lookahead and idle highlighting complete both documents
+    QTRY_COMPARE_WITH_TIMEOUT(scheduler->queueDepth(), 0, 30000);
+    QCOMPARE(background.buffer().lastHighlightedLine(), background.lines() - 1);
+    QCOMPARE(focused.buffer().lastHighlightedLine(), focused.lines() - 1);
+    QCOMPARE(scheduler->highlightedLines(), qint64(background.lines() + focused.lines()));
+}
+
+void KateDocumentTest::testReloadInBackground()
+{
+    // more than the background loading limit of 1 MB
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    for (int i = 0; i < 50000; ++i) {
+        file.write(QByteArray("line ") + QByteArray::number(i) + QByteArray(" of some text in the file\n"));
+    }
+    file.close();
+
+    const int oldLimit = KateGlobalConfig::global()->backgroundLoadingLimit();
+    KateGlobalConfig::global()->setBackgroundLoadingLimit(1);
+
+    KTextEditor::DocumentPrivate doc;
+    auto view = static_cast<KTextEditor::ViewPrivate *>(doc.createView(nullptr));
+    QVERIFY(doc.openUrl(QUrl::fromLocalFile(file.fileName())));
+    QTRY_VERIFY_WITH_TIMEOUT(!doc.buffer().isLoading(), 10000);
+    QCOMPARE(doc.lines(), 50001);
+
+    view->setCursorPosition(KTextEditor::Cursor(40000, 5));
+    doc.setMark(40000, KTextEditor::MarkInterface::markType01);
+
+    // the cursor and the mark come back once the lines are there, reloaded() only then
+    QSignalSpy reloadedSpy(&doc, SIGNAL(reloaded(KTextEditor::Document*)));
+    QVERIFY(doc.documentReload());
+    QVERIFY(doc.buffer().isLoading());
+    QCOMPARE(reloadedSpy.count(), 0);
+    QVERIFY(reloadedSpy.wait(10000));
+    QVERIFY(!doc.buffer().isLoading());
+    QCOMPARE(doc.lines(), 50001);
+    QCOMPARE(view->cursorPosition(), KTextEditor::Cursor(40000, 5));
+    QCOMPARE(doc.mark(40000), uint(KTextEditor::MarkInterface::markType01));
+
+    // a reload closed before its lines are there leaves nothing behind for the next loading
+    QVERIFY(doc.documentReload());
+    QVERIFY(doc.buffer().isLoading());
+    QVERIFY(doc.closeUrl());
+    QVERIFY(doc.openUrl(QUrl::fromLocalFile(file.fileName())));
+    QTRY_VERIFY_WITH_TIMEOUT(!doc.buffer().isLoading(), 10000);
+    QCOMPARE(doc.lines(), 50001);
+    QCOMPARE(reloadedSpy.count(), 1);
+    QCOMPARE(view->cursorPosition(), KTextEditor::Cursor(0, 0));
+    QCOMPARE(doc.mark(40000), uint(0));
+
+    KateGlobalConfig::global()->setBackgroundLoadingLimit(oldLimit);
+}
+
 void KateDocumentTest::testTypeCharsWithSurrogateAndNewLine()
 {
     KTextEditor::DocumentPrivate doc;
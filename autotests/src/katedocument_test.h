@@ -40,6 +40,8 @@ private Q_SLOTS:
 
     void testSetTextPerformance();
     void testRemoveTextPerformance();
+    void testReplaceTexts();
+    void testReplaceTextsPerformance();
 
     void testForgivingApiUsage();
 
@@ -53,6 +55,10 @@ private Q_SLOTS:
 
     void testDefStyleNum();
 
+    void testBackgroundHighlighting();
+    void testHighlightingScheduler();
+    void testReloadInBackground();
+
     void testTypeCharsWithSurrogateAndNewLine();
 
     void testRemoveComposedCharacters();
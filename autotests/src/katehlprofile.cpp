@@ -0,0 +1,92 @@
+/*  This file is part of the Kate project.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include <kateglobal.h>
+#include <katebuffer.h>
+#include <katedocument.h>
+#include <katehighlight.h>
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+#include <cstdio>
+
+/**
+ * Highlights a corpus file with the given highlighting and prints the contexts and
+ * rules that took most time, to spot pathological syntax definitions.
+ *
+ * usage: katehlprofile <highlighting mode> <corpus file> [count] [repeat]
+ */
+int main(int argc, char *argv[])
+{
+    // construct app, the document needs it
+    QApplication app(argc, argv);
+
+    // test mode
+    KTextEditor::EditorPrivate::enableUnitTestMode();
+
+    // get arguments
+    const QStringList args = app.arguments();
+    if (args.size() < 3) {
+        fprintf(stderr, "usage: %s <highlighting mode> <corpus file> [count] [repeat]\n", qPrintable(args.value(0)));
+        return 1;
+    }
+    const QString mode = args.at(1);
+    const QString corpus = args.at(2);
+    const int count = qMax(1, args.value(3, QStringLiteral("20")).toInt());
+    const int repeat = qMax(1, args.value(4, QStringLiteral("1")).toInt());
+
+    // read corpus
+    QFile file(corpus);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "can't read %s\n", qPrintable(corpus));
+        return 1;
+    }
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+    const QString text = stream.readAll();
+
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(text);
+    doc.setHighlightingMode(mode);
+    if (doc.highlightingMode() != mode || doc.highlight()->noHighlighting()) {
+        fprintf(stderr, "unknown highlighting %s\n", qPrintable(mode));
+        return 1;
+    }
+
+    // highlight the whole corpus repeat times, the profile adds up
+    KateHighlighting::setProfilingEnabled(true);
+    doc.highlight()->resetProfile();
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < repeat; ++i) {
+        doc.buffer().invalidateHighlighting();
+        doc.buffer().ensureHighlighted(doc.lines() - 1, 0);
+    }
+    const qint64 elapsed = qMax(qint64(1), timer.elapsed());
+    KateHighlighting::setProfilingEnabled(false);
+
+    const qint64 lines = qint64(doc.lines()) * repeat;
+    printf("%s: %lld lines in %lld ms, %lld lines/s\n", qPrintable(corpus), lines, elapsed, lines * 1000 / elapsed);
+    printf("%s", qPrintable(doc.highlight()->profileReport(count)));
+
+    return 0;
+}
@@ -19,6 +19,7 @@
  */
 
 #include "katesyntaxtest.h"
+#include "benchmarklines.h"
 
 #include <kateglobal.h>
 #include <katebuffer.h>
@@ -26,11 +27,16 @@
 #include <kateview.h>
 #include <kateconfig.h>
 #include <katetextfolding.h>
+#include <katehighlight.h>
+#include <katehighlighthelpers.h>
+#include <katesyntaxdocument.h>
 
 #include <QtTestWidgets>
 #include <QDirIterator>
 #include <QFileInfo>
 #include <QProcess>
+#include <QThread>
+#include <QThreadPool>
 
 QTEST_MAIN(KateSyntaxTest)
 
@@ -132,3 +138,512 @@ void KateSyntaxTest::testSyntaxHighlighting()
     QCOMPARE(QString::fromLocal8Bit(out), QString());
     QCOMPARE(diff.exitCode(), EXIT_SUCCESS);
 }
+
+void KateSyntaxTest::testLineMemoryUsage()
+{
+    /**
+     * highlight the complete corpus of the syntax tests, check the memory of the attribute lists per line
+     */
+    qint64 lines = 0;
+    qint64 attributes = 0;
+    qint64 attributeBytes = 0;
+    const QString testDir(QLatin1String(TEST_DATA_DIR) + QLatin1String("/syntax/"));
+    QDirIterator contents(testDir, QDir::Files, QDirIterator::Subdirectories);
+    while (contents.hasNext()) {
+        const QString hlTestCase = contents.next();
+        if (hlTestCase.contains(QLatin1String("/results/"))) {
+            continue;
+        }
+
+        KTextEditor::DocumentPrivate doc;
+        QUrl url;
+        url.setScheme(QLatin1String("file"));
+        url.setPath(hlTestCase);
+        doc.setEncoding(QStringLiteral("UTF-8"));
+        QVERIFY(doc.openUrl(url));
+
+        doc.buffer().ensureHighlighted(doc.lines() - 1, 0);
+
+        const Kate::TextBuffer::DebugStatistics statistics = doc.buffer().debugStatistics();
+        lines += statistics.lines;
+        attributes += statistics.attributes;
+        attributeBytes += statistics.attributeBytes;
+    }
+
+    QVERIFY(lines > 0);
+    QVERIFY(attributes > 0);
+
+    /**
+     * short lists are stored inline, longer ones in an arena slot with a two pointer header
+     * and less than twice the needed capacity, no vector header or growth reserve
+     */
+    const qint64 maxBytesPerLine = (2 * attributes * qint64(sizeof(Kate::TextLineData::Attribute))) / lines + 2 * qint64(sizeof(void *));
+    QVERIFY(attributeBytes / lines <= maxBytesPerLine);
+}
+
+void KateSyntaxTest::testRehighlightingPerKeystroke()
+{
+    const int lines = benchmarkLines(5000);
+
+    QStringList text;
+    for (int i = 0; i < lines / 5; ++i) {
+        text << QStringLiteral("/**")
+             << QStringLiteral(" * function %1").arg(i)
+             << QStringLiteral(" */")
+             << QStringLiteral("int f%1(int x) { return x * %1; } // \"x\"").arg(i)
+             << QString();
+    }
+
+    KTextEditor::DocumentPrivate doc;
+    doc.setHighlightingMode(QStringLiteral("C++"));
+    doc.setText(text);
+    doc.buffer().ensureHighlighted(doc.lines() - 1, 0);
+
+    // type in the middle, the view shows the 50 lines below the cursor, opening and closing a comment on the way
+    const QString typed = QStringLiteral("int /* value */ y = f1(2);\n");
+    const int startLine = doc.lines() / 2;
+    int keystrokes = 0;
+    qint64 rehighlighted = 0;
+    QBENCHMARK_ONCE {
+        const qint64 before = doc.buffer().highlightedLinesCount();
+        KTextEditor::Cursor cursor(startLine, 0);
+        for (int i = 0; i < typed.size(); ++i) {
+            doc.insertText(cursor, typed.mid(i, 1));
+            cursor = (typed.at(i) == QLatin1Char('\n')) ? KTextEditor::Cursor(cursor.line() + 1, 0) : KTextEditor::Cursor(cursor.line(), cursor.column() + 1);
+            doc.buffer().ensureHighlighted(cursor.line() + 50, 0);
+            ++keystrokes;
+        }
+
+        // finally scroll to the end
+        doc.buffer().ensureHighlighted(doc.lines() - 1, 0);
+        rehighlighted = doc.buffer().highlightedLinesCount() - before;
+    }
+
+    // whatever got skipped must match highlighting everything from scratch
+    KTextEditor::DocumentPrivate reference;
+    reference.setHighlightingMode(QStringLiteral("C++"));
+    reference.setText(doc.text());
+    reference.buffer().ensureHighlighted(reference.lines() - 1, 0);
+    QCOMPARE(reference.lines(), doc.lines());
+    for (int line = 0; line < doc.lines(); ++line) {
+        const auto attributes = doc.buffer().plainLine(line)->attributesList();
+        const auto expected = reference.buffer().plainLine(line)->attributesList();
+        QCOMPARE(attributes.size(), expected.size());
+        for (int i = 0; i < expected.size(); ++i) {
+            QCOMPARE(attributes[i].attributeValue, expected[i].attributeValue);
+        }
+        QCOMPARE(doc.buffer().plainLine(line)->contextStack(), reference.buffer().plainLine(line)->contextStack());
+    }
+
+    // not the whole rest of the document on each keystroke
+    QVERIFY(rehighlighted / keystrokes < lines / 4);
+}
+
+void KateSyntaxTest::testKeywordMatchingPerformance_data()
+{
+    QTest::addColumn<QString>("mode");
+    QTest::addColumn<QString>("line");
+
+    QTest::newRow("C++") << QStringLiteral("C++")
+                         << QStringLiteral("static const unsigned long value%1 = sizeof(int) + reinterpret_cast<long>(ptr); if (x) return nullptr; else break;");
+    QTest::newRow("SQL") << QStringLiteral("SQL")
+                         << QStringLiteral("SELECT name, count(*) FROM table%1 WHERE id BETWEEN 1 AND 10 and Name IS NOT NULL GROUP BY name ORDER BY name desc;");
+    QTest::newRow("PHP") << QStringLiteral("PHP/PHP")
+                         << QStringLiteral("<?php function f%1($x) { foreach ($x as $key => $value) { echo strtolower($value); } return array_merge($x, array()); } ?>");
+}
+
+void KateSyntaxTest::testKeywordMatchingPerformance()
+{
+    QFETCH(QString, mode);
+    QFETCH(QString, line);
+
+    const int lines = benchmarkLines(5000);
+
+    QStringList text;
+    for (int i = 0; i < lines; ++i) {
+        text << line.arg(i);
+    }
+
+    KTextEditor::DocumentPrivate doc;
+    doc.setHighlightingMode(mode);
+    QCOMPARE(doc.highlightingMode(), mode);
+    doc.setText(text);
+
+    // keywords dominate these lines, highlight all of them
+    QBENCHMARK_ONCE {
+        doc.buffer().ensureHighlighted(doc.lines() - 1, 0);
+    }
+
+    QVERIFY(!doc.buffer().plainLine(lines - 1)->attributesList().isEmpty());
+}
+
+void KateSyntaxTest::testRegExprFirstCharacters()
+{
+    quint64 chars[2] = { 0, 0 };
+    const auto hasChar = [&chars](char c) {
+        return (chars[c >> 6] & (Q_UINT64_C(1) << (c & 63))) != 0;
+    };
+
+    // character class behind a word boundary
+    QVERIFY(KateHlRegExpr::firstCharacters(QStringLiteral("\\b[A-Z_]+\\b"), false, chars));
+    QVERIFY(hasChar('A') && hasChar('Z') && hasChar('_'));
+    QVERIFY(!hasChar('a') && !hasChar('0') && !hasChar(' '));
+
+    // literal, case insensitive
+    chars[0] = chars[1] = 0;
+    QVERIFY(KateHlRegExpr::firstCharacters(QStringLiteral("abc"), true, chars));
+    QVERIFY(hasChar('a') && hasChar('A'));
+    QVERIFY(!hasChar('b') && !hasChar('B'));
+
+    // escapes
+    chars[0] = chars[1] = 0;
+    QVERIFY(KateHlRegExpr::firstCharacters(QStringLiteral("^\\d+\\.\\d*"), false, chars));
+    QVERIFY(hasChar('0') && hasChar('9'));
+    QVERIFY(!hasChar('.') && !hasChar('a'));
+
+    chars[0] = chars[1] = 0;
+    QVERIFY(KateHlRegExpr::firstCharacters(QStringLiteral("\\$\\{[^}]*\\}"), false, chars));
+    QVERIFY(hasChar('$') && !hasChar('{'));
+
+    // negated class
+    chars[0] = chars[1] = 0;
+    QVERIFY(KateHlRegExpr::firstCharacters(QStringLiteral("[^a-z\\s]+"), false, chars));
+    QVERIFY(hasChar('A') && hasChar('#'));
+    QVERIFY(!hasChar('a') && !hasChar(' ') && !hasChar('\t'));
+
+    // anything might start these
+    chars[0] = chars[1] = 0;
+    QVERIFY(!KateHlRegExpr::firstCharacters(QStringLiteral("foo|bar"), false, chars));
+    QVERIFY(!KateHlRegExpr::firstCharacters(QStringLiteral("a?b"), false, chars));
+    QVERIFY(!KateHlRegExpr::firstCharacters(QStringLiteral("(foo)"), false, chars));
+    QVERIFY(!KateHlRegExpr::firstCharacters(QStringLiteral(".*"), false, chars));
+    QVERIFY(!KateHlRegExpr::firstCharacters(QStringLiteral("[[:alpha:]]"), false, chars));
+    QVERIFY(!KateHlRegExpr::firstCharacters(QStringLiteral("\\b"), false, chars));
+
+    // alternatives inside a group or class are fine
+    QVERIFY(KateHlRegExpr::firstCharacters(QStringLiteral("#(if|else)"), false, chars));
+    QVERIFY(KateHlRegExpr::firstCharacters(QStringLiteral("[|&]+"), false, chars));
+}
+
+void KateSyntaxTest::testRegExprPerformance()
+{
+    const int lines = benchmarkLines(5000);
+
+    // shell scripts are mostly regular expression rules
+    QStringList text;
+    for (int i = 0; i < lines; ++i) {
+        text << QStringLiteral("if [ -n \"${VALUE_%1}\" ]; then export PATH=$HOME/bin:$PATH; echo $((i + %1)) >> /tmp/log; fi # done").arg(i);
+    }
+
+    KTextEditor::DocumentPrivate doc;
+    doc.setHighlightingMode(QStringLiteral("Bash"));
+    QCOMPARE(doc.highlightingMode(), QStringLiteral("Bash"));
+    doc.setText(text);
+
+    KateHighlighting::setProfilingEnabled(true);
+    doc.highlight()->resetProfile();
+
+    QBENCHMARK_ONCE {
+        doc.buffer().ensureHighlighted(doc.lines() - 1, 0);
+    }
+
+    KateHighlighting::setProfilingEnabled(false);
+    const QString report = doc.highlight()->profileReport(10);
+    qDebug().noquote() << report;
+    QVERIFY(report.contains(QLatin1String("RegExpr")));
+    QVERIFY(report.contains(QLatin1String("Contexts:")));
+
+    QVERIFY(!doc.buffer().plainLine(lines - 1)->attributesList().isEmpty());
+}
+
+namespace {
+QByteArray syntaxDefinition(const QByteArray &keywords)
+{
+    return QByteArray("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                      "<language name=\"CacheTest\" version=\"1\" kateversion=\"5.0\" section=\"Other\" extensions=\"*.cachetest\">\n"
+                      "  <highlighting>\n"
+                      "    <list name=\"keywords\">\n") + keywords +
+           QByteArray("    </list>\n"
+                      "    <contexts>\n"
+                      "      <context name=\"Normal\" attribute=\"Normal Text\" lineEndContext=\"#stay\">\n"
+                      "        <keyword attribute=\"Keyword\" context=\"#stay\" String=\"keywords\"/>\n"
+                      "        <DetectChar attribute=\"String\" context=\"String\" char=\"&quot;\"/>\n"
+                      "      </context>\n"
+                      "      <context name=\"String\" attribute=\"String\" lineEndContext=\"#pop\">\n"
+                      "        <DetectChar attribute=\"String\" context=\"#pop\" char=\"&quot;\"/>\n"
+                      "      </context>\n"
+                      "    </contexts>\n"
+                      "    <itemDatas>\n"
+                      "      <itemData name=\"Normal Text\" defStyleNum=\"dsNormal\"/>\n"
+                      "      <itemData name=\"Keyword\" defStyleNum=\"dsKeyword\"/>\n"
+                      "      <itemData name=\"String\" defStyleNum=\"dsString\"/>\n"
+                      "    </itemDatas>\n"
+                      "  </highlighting>\n"
+                      "</language>\n");
+}
+
+bool writeFile(const QString &path, const QByteArray &data)
+{
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(data) == data.size();
+}
+}
+
+void KateSyntaxTest::testSyntaxDefinitionCache()
+{
+    // definitions compiled into resources get a cache, too
+    QVERIFY(!KateSyntaxDocument::cacheFile(QStringLiteral(":/org.kde.syntax-highlighting/syntax/cpp.xml")).isEmpty());
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString identifier = dir.path() + QLatin1String("/cachetest.xml");
+    QVERIFY(writeFile(identifier, syntaxDefinition("      <item>if</item>\n      <item>else</item>\n")));
+    const QString cache = KateSyntaxDocument::cacheFile(identifier);
+    QVERIFY(!cache.isEmpty());
+
+    // parse the xml, that writes the cache
+    QFile::remove(cache);
+    KateSyntaxDocument parsed;
+    QVERIFY(parsed.setIdentifier(identifier));
+    QVERIFY(QFile::exists(cache));
+
+    // read it back
+    KateSyntaxDocument cached;
+    QVERIFY(cached.setIdentifier(identifier));
+
+    // same keywords
+    const QStringList keywords = parsed.finddata(QStringLiteral("highlighting"), QStringLiteral("keywords"));
+    QCOMPARE(keywords, QStringList() << QStringLiteral("if") << QStringLiteral("else"));
+    QCOMPARE(cached.finddata(QStringLiteral("highlighting"), QStringLiteral("keywords")), keywords);
+
+    // same contexts and rules
+    KateSyntaxContextData *parsedData = parsed.getGroupInfo(QStringLiteral("highlighting"), QStringLiteral("context"));
+    KateSyntaxContextData *cachedData = cached.getGroupInfo(QStringLiteral("highlighting"), QStringLiteral("context"));
+    QVERIFY(parsedData && cachedData);
+    int rules = 0;
+    while (parsed.nextGroup(parsedData)) {
+        QVERIFY(cached.nextGroup(cachedData));
+        QCOMPARE(cached.groupData(cachedData, QStringLiteral("name")), parsed.groupData(parsedData, QStringLiteral("name")));
+        while (parsed.nextItem(parsedData)) {
+            QVERIFY(cached.nextItem(cachedData));
+            QCOMPARE(cached.groupItemData(cachedData, QString()), parsed.groupItemData(parsedData, QString()));
+            QCOMPARE(cached.groupItemData(cachedData, QStringLiteral("attribute")), parsed.groupItemData(parsedData, QStringLiteral("attribute")));
+            QCOMPARE(cached.groupItemData(cachedData, QStringLiteral("char")), parsed.groupItemData(parsedData, QStringLiteral("char")));
+            ++rules;
+        }
+        QVERIFY(!cached.nextItem(cachedData));
+    }
+    QVERIFY(!cached.nextGroup(cachedData));
+    QCOMPARE(rules, 3);
+    parsed.freeGroupInfo(parsedData);
+    cached.freeGroupInfo(cachedData);
+
+    // a changed definition is parsed again
+    QVERIFY(writeFile(identifier, syntaxDefinition("      <item>if</item>\n      <item>else</item>\n      <item>while</item>\n")));
+    KateSyntaxDocument changed;
+    QVERIFY(changed.setIdentifier(identifier));
+    const QStringList changedKeywords = changed.finddata(QStringLiteral("highlighting"), QStringLiteral("keywords"));
+    QCOMPARE(changedKeywords.size(), 3);
+
+    // a cache of another format version is ignored
+    QFile file(cache);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.seek(7));
+    QVERIFY(file.write("x", 1) == 1);
+    file.close();
+    KateSyntaxDocument otherVersion;
+    QVERIFY(otherVersion.setIdentifier(identifier));
+    QCOMPARE(otherVersion.finddata(QStringLiteral("highlighting"), QStringLiteral("keywords")), changedKeywords);
+
+    // so is a truncated one, its counts are larger than the file
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.resize(file.size() / 2));
+    file.close();
+    KateSyntaxDocument truncated;
+    QVERIFY(truncated.setIdentifier(identifier));
+    QCOMPARE(truncated.finddata(QStringLiteral("highlighting"), QStringLiteral("keywords")), changedKeywords);
+}
+
+namespace {
+QStringList hereDocuments(const QString &terminator, int count)
+{
+    QStringList text;
+    for (int i = 0; i < count; ++i) {
+        text << QStringLiteral("cat <<%1%2").arg(terminator).arg(i)
+             << QStringLiteral("here document %1").arg(i)
+             << QStringLiteral("%1%2").arg(terminator).arg(i)
+             << QStringLiteral("echo %1").arg(i);
+    }
+    return text;
+}
+
+void verifyHereDocuments(KTextEditor::DocumentPrivate &doc)
+{
+    // each here document is closed again and got the same highlighting
+    const Kate::TextLine first = doc.buffer().plainLine(1);
+    const Kate::TextLineData::ContextStack closed = doc.buffer().plainLine(3)->contextStack();
+    for (int i = 0; i < doc.lines(); i += 4) {
+        const Kate::TextLine body = doc.buffer().plainLine(i + 1);
+        QCOMPARE(body->attributesList().size(), first->attributesList().size());
+        for (int j = 0; j < body->attributesList().size(); ++j) {
+            QCOMPARE(body->attributesList()[j].attributeValue, first->attributesList()[j].attributeValue);
+        }
+        QCOMPARE(doc.buffer().plainLine(i + 3)->contextStack(), closed);
+    }
+}
+}
+
+void KateSyntaxTest::testDynamicContextEviction()
+{
+    // each here document terminator needs its own dynamic context
+    KTextEditor::DocumentPrivate doc;
+    doc.setHighlightingMode(QStringLiteral("Bash"));
+    doc.setText(hereDocuments(QStringLiteral("END"), 2000));
+    doc.buffer().ensureHighlighted(doc.lines() - 1, 0);
+    QCOMPARE(doc.buffer().lastHighlightedLine(), doc.lines() - 1);
+    verifyHereDocuments(doc);
+
+    // a second document with other terminators evicts the contexts of the first one,
+    // that only drops the highlighting of lines there, no full invalidation
+    KTextEditor::DocumentPrivate other;
+    other.setHighlightingMode(QStringLiteral("Bash"));
+    QCOMPARE(other.highlight(), doc.highlight());
+    other.setText(hereDocuments(QStringLiteral("EOF"), 2000));
+    const qint64 highlightedBefore = doc.buffer().highlightedLinesCount();
+    other.buffer().ensureHighlighted(other.lines() - 1, 0);
+    verifyHereDocuments(other);
+    QCOMPARE(doc.buffer().highlightedLinesCount(), highlightedBefore);
+    QVERIFY(doc.buffer().lastHighlightedLine() < doc.lines() - 1);
+
+    // the slots of the evicted contexts are empty, the not yet highlighted lines still refer to them
+    KateHighlighting *highlighting = doc.highlight();
+    for (int line = doc.buffer().lastHighlightedLine() + 1; line < doc.lines(); ++line) {
+        const Kate::TextLine textLine = doc.buffer().plainLine(line);
+        foreach (short context, textLine->contextStack()) {
+            QVERIFY(highlighting->contextNum(context));
+            QVERIFY(highlighting->attribute(context) >= 0);
+        }
+    }
+    highlighting->resetProfile();
+    QVERIFY(highlighting->profileReport(10).contains(QStringLiteral("Contexts:")));
+
+    // highlighting the first document again gives the same result
+    doc.buffer().ensureHighlighted(doc.lines() - 1, 0);
+    QCOMPARE(doc.buffer().lastHighlightedLine(), doc.lines() - 1);
+    verifyHereDocuments(doc);
+}
+
+namespace {
+QStringList commentedCode(int lines)
+{
+    // block comments of 300 lines start every 2500 lines, chunk borders fall into some of them
+    QStringList text;
+    for (int i = 0; i < lines; ++i) {
+        if (i % 2500 == 2400) {
+            text << QStringLiteral("int g%1; /* comment").arg(i);
+        } else if (i % 2500 == 2699) {
+            text << QStringLiteral("end of comment */ int h%1;").arg(i);
+        } else {
+            text << QStringLiteral("int f%1(int x) { return x * %1; } // \"x\"").arg(i);
+        }
+    }
+    return text;
+}
+
+void compareHighlighting(KTextEditor::DocumentPrivate &doc, KTextEditor::DocumentPrivate &reference)
+{
+    QCOMPARE(doc.lines(), reference.lines());
+    for (int line = 0; line < doc.lines(); ++line) {
+        const Kate::TextLine textLine = doc.buffer().plainLine(line);
+        const Kate::TextLine expected = reference.buffer().plainLine(line);
+        QCOMPARE(textLine->attributesList().size(), expected->attributesList().size());
+        for (int i = 0; i < expected->attributesList().size(); ++i) {
+            QCOMPARE(textLine->attributesList()[i].offset, expected->attributesList()[i].offset);
+            QCOMPARE(textLine->attributesList()[i].length, expected->attributesList()[i].length);
+            QCOMPARE(textLine->attributesList()[i].attributeValue, expected->attributesList()[i].attributeValue);
+        }
+        QCOMPARE(textLine->contextStack(), expected->contextStack());
+        QCOMPARE(textLine->hlLineContinue(), expected->hlLineContinue());
+        QCOMPARE(textLine->markedAsFoldingStart(), expected->markedAsFoldingStart());
+    }
+}
+}
+
+void KateSyntaxTest::testParallelHighlighting_data()
+{
+    QTest::addColumn<QString>("mode");
+    QTest::addColumn<QStringList>("text");
+    QTest::addColumn<bool>("mostlyGuessed");
+
+    QTest::newRow("C++") << QStringLiteral("C++") << commentedCode(20000) << true;
+    QTest::newRow("Bash") << QStringLiteral("Bash") << hereDocuments(QStringLiteral("END"), 5000) << false;
+}
+
+void KateSyntaxTest::testParallelHighlighting()
+{
+    QFETCH(QString, mode);
+    QFETCH(QStringList, text);
+    QFETCH(bool, mostlyGuessed);
+
+    KTextEditor::DocumentPrivate reference;
+    reference.setText(text);
+    reference.setHighlightingMode(mode);
+    reference.buffer().ensureHighlighted(reference.lines() - 1, 0);
+
+    // enough threads for several chunks on any machine
+    KateGlobalConfig::global()->setParallelHighlightingLimit(4096);
+
+    KTextEditor::DocumentPrivate doc;
+    doc.buffer().workerPool()->setMaxThreadCount(4);
+    doc.setText(text);
+    doc.setHighlightingMode(mode);
+    doc.buffer().ensureHighlighted(doc.lines() - 1, 0);
+
+    KateGlobalConfig::global()->setParallelHighlightingLimit(0);
+    QVERIFY(doc.buffer().speculativeChunksCount() > 1);
+
+    // the same as highlighting everything sequentially
+    QCOMPARE(doc.buffer().lastHighlightedLine(), doc.lines() - 1);
+    compareHighlighting(doc, reference);
+
+    // all lines got guessed, only the comments across chunk borders got highlighted again
+    QVERIFY(doc.buffer().highlightedLinesCount() > doc.lines());
+    if (mostlyGuessed) {
+        QVERIFY(doc.buffer().highlightedLinesCount() < doc.lines() + doc.lines() / 10);
+    }
+}
+
+void KateSyntaxTest::testParallelHighlightingPerformance_data()
+{
+    QTest::addColumn<int>("threads");
+
+    QTest::newRow("sequential") << 0;
+    QTest::newRow(qPrintable(QStringLiteral("%1 threads").arg(QThread::idealThreadCount()))) << QThread::idealThreadCount();
+}
+
+void KateSyntaxTest::testParallelHighlightingPerformance()
+{
+    QFETCH(int, threads);
+
+    const int lines = benchmarkLines(5000);
+    const QStringList text = commentedCode(lines);
+
+    // set the highlighting after the text, setText() would highlight all lines
+    KTextEditor::DocumentPrivate reference;
+    reference.setText(text);
+    reference.setHighlightingMode(QStringLiteral("C++"));
+    reference.buffer().ensureHighlighted(reference.lines() - 1, 0);
+
+    KTextEditor::DocumentPrivate doc;
+    doc.buffer().workerPool()->setMaxThreadCount(qMax(1, threads));
+    doc.setText(text);
+    doc.setHighlightingMode(QStringLiteral("C++"));
+    KateGlobalConfig::global()->setParallelHighlightingLimit(threads ? 4096 : 0);
+    QBENCHMARK_ONCE {
+        doc.buffer().ensureHighlighted(doc.lines() - 1, 0);
+    }
+    KateGlobalConfig::global()->setParallelHighlightingLimit(0);
+
+    QCOMPARE(doc.buffer().speculativeChunksCount() > 0, threads > 0);
+    compareHighlighting(doc, reference);
+}
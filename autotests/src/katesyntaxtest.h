@@ -33,6 +33,24 @@ public Q_SLOTS:
 private Q_SLOTS:
     void testSyntaxHighlighting_data();
     void testSyntaxHighlighting();
+
+    void testLineMemoryUsage();
+    void testRehighlightingPerKeystroke();
+
+    void testKeywordMatchingPerformance_data();
+    void testKeywordMatchingPerformance();
+
+    void testRegExprFirstCharacters();
+    void testRegExprPerformance();
+
+    void testSyntaxDefinitionCache();
+
+    void testDynamicContextEviction();
+
+    void testParallelHighlighting_data();
+    void testParallelHighlighting();
+    void testParallelHighlightingPerformance_data();
+    void testParallelHighlightingPerformance();
 };
 
 #endif // KATE_FOLDING_TEST_H
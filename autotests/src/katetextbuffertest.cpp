@@ -21,12 +21,56 @@
 
 #include <kateglobal.h>
 #include "katetextbuffertest.h"
+#include "benchmarklines.h"
 #include "katetextbuffer.h"
 #include "katetextcursor.h"
 #include "katetextfolding.h"
+#include "katetextloader.h"
+
+#include <QThread>
+
+#ifdef Q_OS_UNIX
+#include <signal.h>
+#include <sys/resource.h>
+#endif
 
 QTEST_MAIN(KateTextBufferTest)
 
+/**
+ * Write data as gzip file: qCompress output is a zlib stream, rewrap its deflate data.
+ */
+static bool writeGzipFile(const QString &filePath, const QByteArray &data)
+{
+    // crc32 as needed by the gzip trailer
+    quint32 crc = 0xffffffff;
+    for (int i = 0; i < data.size(); ++i) {
+        crc ^= quint8(data.at(i));
+        for (int k = 0; k < 8; ++k) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    crc = ~crc;
+
+    // skip size prefix + zlib header, drop adler32 trailer
+    const QByteArray zlib = qCompress(data, 1);
+    const QByteArray deflate = zlib.mid(4 + 2, zlib.size() - 4 - 2 - 4);
+
+    QFile f(filePath);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    QByteArray gzip("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03", 10);
+    gzip += deflate;
+    const quint32 trailer[2] = { crc, quint32(data.size()) };
+    for (int i = 0; i < 2; ++i) {
+        for (int b = 0; b < 4; ++b) {
+            gzip.append(char((trailer[i] >> (8 * b)) & 0xff));
+        }
+    }
+    return f.write(gzip) == gzip.size();
+}
+
 KateTextBufferTest::KateTextBufferTest()
     : QObject()
 {
@@ -65,6 +109,7 @@ void KateTextBufferTest::wrapLineTest()
     buffer.finishEditing();
     buffer.debugPrint(QLatin1String("Two empty lines"));
     QVERIFY(buffer.text() == QLatin1String("\n"));
+    QVERIFY(buffer.debugStatistics().blocks > 1);
 
     // unwrap again -> only one empty line
     buffer.startEditing();
@@ -87,6 +132,7 @@ void KateTextBufferTest::insertRemoveTextTest()
     buffer.finishEditing();
     buffer.debugPrint(QLatin1String("Two empty lines"));
     QVERIFY(buffer.text() == QLatin1String("\n"));
+    QVERIFY(buffer.debugStatistics().blocks > 1);
 
     // remember second line
     Kate::TextLine second = buffer.line(1);
@@ -136,10 +182,10 @@ void KateTextBufferTest::cursorTest()
     // last buffer content, for consistence checks
     QString lastBufferContent;
 
-    // test with different block sizes
+    // test with different block sizes, from one line per block on
     for (int i = 1; i <= 4; ++i) {
         // construct an empty text buffer
-        Kate::TextBuffer buffer(nullptr, i);
+        Kate::TextBuffer buffer(nullptr, (i - 1) * 128 + 1);
 
         // wrap first line
         buffer.startEditing();
@@ -226,6 +272,7 @@ void KateTextBufferTest::foldingTest()
     }
     buffer.finishEditing();
     QVERIFY(buffer.lines() == 100);
+    QVERIFY(buffer.debugStatistics().blocks > 1);
 
     // starting with empty folding!
     folding.debugPrint(QLatin1String("Empty Folding"));
@@ -417,6 +464,7 @@ void KateTextBufferTest::nestedFoldingTest()
     buffer.finishEditing();
 
     QVERIFY(buffer.lines() == 5);
+    QVERIFY(buffer.debugStatistics().blocks > 1);
 
     // folding for line 1
     QVERIFY(folding.newFoldingRange(KTextEditor::Range(KTextEditor::Cursor(0, 0), KTextEditor::Cursor(3, 0)), Kate::TextFolding::Folded) == 0);
@@ -466,3 +514,531 @@ void KateTextBufferTest::saveFileInUnwritableFolder()
     QVERIFY(f.remove());
     QVERIFY(dir.remove());
 }
+
+void KateTextBufferTest::saveFailingWrite()
+{
+#ifndef Q_OS_UNIX
+    QSKIP("needs a file size limit to make the writes fail");
+#else
+    // enough lines for several chunks, encoded in parallel
+    QByteArray content;
+    while (content.size() < 8 * 1024 * 1024) {
+        content.append("some line of text with a few words in it\n");
+    }
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString inputPath = dir.path() + QLatin1String("/input.txt");
+    QFile input(inputPath);
+    QVERIFY(input.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QCOMPARE(input.write(content), qint64(content.size()));
+    input.close();
+
+    const QString outputPath = dir.path() + QLatin1String("/output.txt");
+    QFile output(outputPath);
+    QVERIFY(output.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    output.write("old");
+    output.close();
+
+    Kate::TextBuffer buffer(nullptr);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    bool encodingErrors = false;
+    bool tooLongLinesWrapped = false;
+    int longestLineLoaded = 0;
+    QVERIFY(buffer.load(inputPath, encodingErrors, tooLongLinesWrapped, longestLineLoaded, false));
+
+    // writes beyond 1 MB fail, while later chunks are still being encoded
+    struct rlimit oldLimit;
+    QCOMPARE(getrlimit(RLIMIT_FSIZE, &oldLimit), 0);
+    struct rlimit limit = oldLimit;
+    limit.rlim_cur = 1024 * 1024;
+    void (*oldHandler)(int) = signal(SIGXFSZ, SIG_IGN);
+    QCOMPARE(setrlimit(RLIMIT_FSIZE, &limit), 0);
+
+    const bool saved = buffer.save(outputPath);
+
+    setrlimit(RLIMIT_FSIZE, &oldLimit);
+    signal(SIGXFSZ, oldHandler);
+
+    // the save must fail without touching the old file, the buffer stays usable for the next try
+    QVERIFY(!saved);
+    QVERIFY(output.open(QIODevice::ReadOnly));
+    QCOMPARE(output.readAll(), QByteArray("old"));
+    output.close();
+
+    QVERIFY(buffer.save(outputPath));
+    QVERIFY(output.open(QIODevice::ReadOnly));
+    QVERIFY(output.readAll() == content);
+#endif
+}
+
+void KateTextBufferTest::adaptiveBlockSizeTest()
+{
+    // construct an empty text buffer with default block size
+    Kate::TextBuffer buffer(nullptr);
+
+    // many empty lines: blocks hold much more than 64 lines
+    buffer.startEditing();
+    for (int i = 0; i < 9999; ++i) {
+        buffer.wrapLine(KTextEditor::Cursor(i, 0));
+    }
+    buffer.finishEditing();
+
+    Kate::TextBuffer::DebugStatistics statistics = buffer.debugStatistics();
+    QCOMPARE(statistics.lines, 10000);
+    QCOMPARE(statistics.characters, qint64(0));
+    QVERIFY(statistics.blocks > 1);
+    QVERIFY(statistics.blocks < 10000 / 64);
+    QVERIFY(statistics.maxLinesPerBlock > 64);
+
+    // long lines: the blocks get split, they hold less lines
+    buffer.startEditing();
+    const QString longText(1000, QLatin1Char('x'));
+    for (int i = 0; i < 1000; ++i) {
+        buffer.insertText(KTextEditor::Cursor(i, 0), longText);
+    }
+    buffer.finishEditing();
+
+    statistics = buffer.debugStatistics();
+    QCOMPARE(statistics.lines, 10000);
+    QCOMPARE(statistics.characters, qint64(1000 * 1000));
+    QVERIFY(statistics.blocks >= 1000 / 32);
+    QCOMPARE(buffer.line(999)->text(), longText);
+    QCOMPARE(buffer.line(1000)->text(), QString());
+
+    // removing the text again merges the blocks
+    buffer.startEditing();
+    for (int i = 0; i < 1000; ++i) {
+        buffer.removeText(KTextEditor::Range(KTextEditor::Cursor(i, 0), KTextEditor::Cursor(i, 1000)));
+    }
+    buffer.finishEditing();
+
+    statistics = buffer.debugStatistics();
+    QCOMPARE(statistics.characters, qint64(0));
+    QVERIFY(statistics.blocks < 10000 / 64);
+
+    // cursors are reported
+    Kate::TextCursor cursor1(buffer, KTextEditor::Cursor(0, 0), Kate::TextCursor::MoveOnInsert);
+    Kate::TextCursor cursor2(buffer, KTextEditor::Cursor(5000, 0), Kate::TextCursor::MoveOnInsert);
+    QCOMPARE(buffer.debugStatistics().cursors, 2);
+}
+
+void KateTextBufferTest::backgroundLoadingTest()
+{
+    // enough lines for several batches, latin1 umlaut at the end forces a second loading round
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString filePath = dir.path() + QLatin1String("/background.txt");
+    QFile f(filePath);
+    QVERIFY(f.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    for (int i = 0; i < 100000; ++i) {
+        f.write(QByteArray("line ") + QByteArray::number(i) + '\n');
+    }
+    f.write("last line \xe4");
+    f.close();
+
+    // reference: load synchronously
+    Kate::TextBuffer reference(nullptr);
+    reference.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    reference.setFallbackTextCodec(QTextCodec::codecForName("ISO 8859-15"));
+    bool encodingErrors = false;
+    bool tooLongLinesWrapped = false;
+    int longestLineLoaded = 0;
+    QVERIFY(reference.load(filePath, encodingErrors, tooLongLinesWrapped, longestLineLoaded, false));
+    QVERIFY(!encodingErrors);
+    QCOMPARE(reference.lines(), 100001);
+
+    Kate::TextBuffer buffer(nullptr);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("ISO 8859-15"));
+
+    // cancel drops everything
+    buffer.startLoading(filePath, false);
+    QVERIFY(buffer.isLoading());
+    buffer.cancelLoading();
+    QVERIFY(!buffer.isLoading());
+    QCOMPARE(buffer.lines(), 1);
+    QCOMPARE(buffer.line(0)->string(), QString());
+
+    // load in the background, lines arrive in batches
+    QSignalSpy progressSpy(&buffer, SIGNAL(loadingProgress(int)));
+    QSignalSpy finishedSpy(&buffer, SIGNAL(loadingFinished(bool,bool,bool,int)));
+    buffer.startLoading(filePath, false);
+    QVERIFY(buffer.isLoading());
+    QVERIFY(finishedSpy.wait(10000));
+    QVERIFY(!buffer.isLoading());
+    QVERIFY(progressSpy.count() > 0);
+    QCOMPARE(finishedSpy.count(), 1);
+    QCOMPARE(finishedSpy.at(0).at(0).toBool(), true);
+    QCOMPARE(finishedSpy.at(0).at(1).toBool(), false);
+
+    // same content and codec as the synchronous load
+    QCOMPARE(buffer.textCodec(), reference.textCodec());
+    QCOMPARE(buffer.digest(), reference.digest());
+    QCOMPARE(buffer.lines(), reference.lines());
+    for (int i = 0; i < buffer.lines(); ++i) {
+        QCOMPARE(buffer.line(i)->string(), reference.line(i)->string());
+    }
+
+    // the block index grown batch by batch matches the one built at once
+    for (int i = 0; i < buffer.lines(); i += 997) {
+        QCOMPARE(buffer.cursorToOffset(KTextEditor::Cursor(i, 0)), reference.cursorToOffset(KTextEditor::Cursor(i, 0)));
+    }
+}
+
+/**
+ * Reads a snapshot again and again, while the buffer is edited.
+ */
+class SnapshotReader : public QThread
+{
+public:
+    SnapshotReader(const Kate::TextSnapshot &snapshot, const QString &expectedText)
+        : m_snapshot(snapshot)
+        , m_expectedText(expectedText)
+        , m_reads(0)
+        , m_mismatches(0)
+    {
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        while (!m_stop.loadAcquire()) {
+            if (m_snapshot.text() != m_expectedText) {
+                ++m_mismatches;
+            }
+            ++m_reads;
+        }
+    }
+
+    Kate::TextSnapshot m_snapshot;
+    const QString m_expectedText;
+    QAtomicInt m_stop;
+    int m_reads;
+    int m_mismatches;
+};
+
+void KateTextBufferTest::loadTruncatedFileTest()
+{
+    // several chunks of the memory mapped loader
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString filePath = dir.path() + QLatin1String("/truncated.txt");
+    QFile f(filePath);
+    QVERIFY(f.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    for (int i = 0; i < 300000; ++i) {
+        f.write(QByteArray("line ") + QByteArray::number(i) + '\n');
+    }
+    f.close();
+
+    Kate::TextLoader loader(filePath, KEncodingProber::Universal);
+    QVERIFY(loader.open(QTextCodec::codecForName("UTF-8")));
+    int offset = 0;
+    int length = 0;
+    QVERIFY(loader.readLine(offset, length));
+    QCOMPARE(QString(loader.unicode() + offset, length), QStringLiteral("line 0"));
+
+    // another process truncates the file, mapping the pages behind its end would raise SIGBUS
+    QVERIFY(f.resize(1024));
+    int lines = 1;
+    while (!loader.eof()) {
+        loader.readLine(offset, length);
+        ++lines;
+    }
+
+    // the first chunk was decoded before, nothing of the dropped part is read
+    QVERIFY(lines > 1);
+    QVERIFY(lines < 300000);
+}
+
+void KateTextBufferTest::snapshotTest()
+{
+    // small blocks, to have edits across block boundaries
+    Kate::TextBuffer buffer(nullptr, 1);
+    buffer.startEditing();
+    for (int i = 0; i < 200; ++i) {
+        buffer.insertText(KTextEditor::Cursor(i, 0), QStringLiteral("line %1").arg(i));
+        buffer.wrapLine(KTextEditor::Cursor(i, buffer.line(i)->length()));
+    }
+    buffer.finishEditing();
+    QVERIFY(buffer.debugStatistics().blocks > 1);
+
+    const QString expectedText = buffer.text();
+    const Kate::TextSnapshot snapshot = buffer.snapshot();
+    QCOMPARE(snapshot.lines(), buffer.lines());
+    QCOMPARE(snapshot.revision(), buffer.revision());
+    QCOMPARE(snapshot.text(), expectedText);
+    QCOMPARE(snapshot.line(42), QStringLiteral("line 42"));
+
+    // read it in a thread, while we edit all lines
+    SnapshotReader reader(snapshot, expectedText);
+    reader.start();
+    for (int round = 0; round < 10; ++round) {
+        buffer.startEditing();
+        for (int i = 0; i + 1 < buffer.lines(); i += 3) {
+            buffer.insertText(KTextEditor::Cursor(i, 0), QStringLiteral("x"));
+            buffer.wrapLine(KTextEditor::Cursor(i, 2));
+            buffer.unwrapLine(i + 1);
+            QString removed;
+            buffer.removeText(KTextEditor::Range(i, 0, i, 1), removed);
+        }
+        buffer.finishEditing();
+
+        // later snapshots must not disturb the first one
+        QCOMPARE(buffer.snapshot().text(), buffer.text());
+    }
+
+    // remove every second line, merges blocks
+    buffer.startEditing();
+    for (int i = buffer.lines() - 2; i > 0; i -= 2) {
+        QString removed;
+        buffer.removeText(KTextEditor::Range(i, 0, i, buffer.line(i)->length()), removed);
+        buffer.unwrapLine(i);
+    }
+    buffer.finishEditing();
+
+    reader.m_stop.storeRelease(1);
+    reader.wait();
+    QVERIFY(reader.m_reads > 0);
+    QCOMPARE(reader.m_mismatches, 0);
+
+    // snapshot still shows the old text
+    QVERIFY(buffer.text() != expectedText);
+    QCOMPARE(snapshot.lines(), 201);
+    QCOMPARE(snapshot.text(), expectedText);
+}
+
+void KateTextBufferTest::offsetTest()
+{
+    // small blocks, the edits below move lines and text across them
+    Kate::TextBuffer buffer(nullptr, 1);
+
+    // check all positions against offsets computed from the text
+    auto verifyOffsets = [&buffer]() {
+        const QString text = buffer.text();
+        int line = 0;
+        int column = 0;
+        for (int offset = 0; offset <= text.size(); ++offset) {
+            QCOMPARE(buffer.cursorToOffset(KTextEditor::Cursor(line, column)), qint64(offset));
+            QCOMPARE(buffer.offsetToCursor(offset), KTextEditor::Cursor(line, column));
+            if (offset < text.size() && text.at(offset) == QLatin1Char('\n')) {
+                ++line;
+                column = 0;
+            } else {
+                ++column;
+            }
+        }
+        QVERIFY(!buffer.offsetToCursor(text.size() + 1).isValid());
+        QVERIFY(!buffer.offsetToCursor(-1).isValid());
+        QCOMPARE(buffer.cursorToOffset(KTextEditor::Cursor(buffer.lines(), 0)), qint64(-1));
+    };
+
+    verifyOffsets();
+
+    // insert lines of different length, they end up in many blocks
+    buffer.startEditing();
+    for (int i = 0; i < 200; ++i) {
+        buffer.wrapLine(KTextEditor::Cursor(i, 0));
+        buffer.insertText(KTextEditor::Cursor(i, 0), QString(i % 40, QLatin1Char('a' + i % 26)));
+    }
+    buffer.finishEditing();
+    QVERIFY(buffer.debugStatistics().blocks > 1);
+    verifyOffsets();
+
+    // columns behind the line end are clamped
+    QCOMPARE(buffer.cursorToOffset(KTextEditor::Cursor(1, 100)), buffer.cursorToOffset(KTextEditor::Cursor(2, 0)) - 1);
+
+    // remove text, wrap and unwrap lines, also the first lines of blocks
+    buffer.startEditing();
+    for (int i = 0; i < 100; i += 3) {
+        buffer.removeText(KTextEditor::Range(i, 0, i, buffer.line(i)->length() / 2));
+        buffer.wrapLine(KTextEditor::Cursor(i + 1, buffer.line(i + 1)->length() / 2));
+    }
+    for (int i = 1; i < buffer.lines(); i += 4) {
+        buffer.unwrapLine(i);
+    }
+    buffer.insertText(KTextEditor::Cursor(5, 0), QStringLiteral("hello"));
+    buffer.replaceText(5, {{0, 1, QStringLiteral("xyz")}, {3, 2, QString()}});
+    buffer.finishEditing();
+    verifyOffsets();
+
+    // everything away again
+    buffer.startEditing();
+    while (buffer.lines() > 1) {
+        buffer.unwrapLine(buffer.lines() - 1);
+    }
+    buffer.removeText(KTextEditor::Range(0, 0, 0, buffer.line(0)->length()));
+    buffer.finishEditing();
+    verifyOffsets();
+}
+
+void KateTextBufferTest::loadFilePerformance_data()
+{
+    QTest::addColumn<int>("minLineLength");
+    QTest::addColumn<int>("maxLineLength");
+    QTest::addColumn<bool>("withUmlauts");
+
+    QTest::newRow("short lines") << 0 << 16 << false;
+    QTest::newRow("long lines") << 1000 << 4000 << false;
+    QTest::newRow("mixed lines") << 0 << 400 << true;
+}
+
+void KateTextBufferTest::loadFilePerformance()
+{
+    QFETCH(int, minLineLength);
+    QFETCH(int, maxLineLength);
+    QFETCH(bool, withUmlauts);
+
+    const int lines = benchmarkLines(5000);
+
+    // create the synthetic file, deterministic content
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString filePath = dir.path() + QLatin1String("/load.txt");
+    QFile f(filePath);
+    QVERIFY(f.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    qsrand(42);
+    QByteArray chunk;
+    for (int l = 0; l < lines; ++l) {
+        const int length = minLineLength + (qrand() % (maxLineLength - minLineLength + 1));
+        for (int i = 0; i < length; ++i) {
+            if (withUmlauts && (i % 64) == 63) {
+                chunk.append("\xc3\xa4");
+            } else {
+                chunk.append(char('a' + (i % 26)));
+            }
+        }
+        chunk.append('\n');
+
+        if (chunk.size() > 1024 * 1024) {
+            QCOMPARE(f.write(chunk), qint64(chunk.size()));
+            chunk.clear();
+        }
+    }
+    QCOMPARE(f.write(chunk), qint64(chunk.size()));
+    f.close();
+
+    Kate::TextBuffer buffer(nullptr);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("ISO 8859-15"));
+
+    QBENCHMARK_ONCE {
+        bool encodingErrors = false;
+        bool tooLongLinesWrapped = false;
+        int longestLineLoaded = 0;
+        QVERIFY(buffer.load(filePath, encodingErrors, tooLongLinesWrapped, longestLineLoaded, false));
+        QVERIFY(!encodingErrors);
+    }
+
+    // the file ends with a newline, that starts one more empty line
+    QCOMPARE(buffer.lines(), lines + 1);
+}
+
+void KateTextBufferTest::savePerformance_data()
+{
+    QTest::addColumn<bool>("gzip");
+
+    QTest::newRow("plain") << false;
+    QTest::newRow("gzip") << true;
+}
+
+void KateTextBufferTest::savePerformance()
+{
+    QFETCH(bool, gzip);
+
+    const int lines = benchmarkLines(5000);
+
+    // synthetic content, lines of varying length with some umlauts, long enough for several chunks
+    qsrand(42);
+    QByteArray content;
+    for (int l = 0; l < lines; ++l) {
+        const int length = qrand() % 1600;
+        for (int i = 0; i < length; ++i) {
+            if ((i % 64) == 63) {
+                content.append("\xc3\xa4");
+            } else {
+                content.append(char('a' + (i % 26)));
+            }
+        }
+        content.append('\n');
+    }
+
+    // load it, this decides about the compression used for saving
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString inputPath = dir.path() + (gzip ? QLatin1String("/input.txt.gz") : QLatin1String("/input.txt"));
+    if (gzip) {
+        QVERIFY(writeGzipFile(inputPath, content));
+    } else {
+        QFile f(inputPath);
+        QVERIFY(f.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        QCOMPARE(f.write(content), qint64(content.size()));
+        f.close();
+    }
+
+    Kate::TextBuffer buffer(nullptr);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("ISO 8859-15"));
+    bool encodingErrors = false;
+    bool tooLongLinesWrapped = false;
+    int longestLineLoaded = 0;
+    QVERIFY(buffer.load(inputPath, encodingErrors, tooLongLinesWrapped, longestLineLoaded, false));
+    QVERIFY(!encodingErrors);
+
+    const QString outputPath = dir.path() + (gzip ? QLatin1String("/output.txt.gz") : QLatin1String("/output.txt"));
+    QBENCHMARK_ONCE {
+        QVERIFY(buffer.save(outputPath));
+    }
+
+    // the chunks must end up in the right order
+    if (gzip) {
+        Kate::TextBuffer reloaded(nullptr);
+        reloaded.setTextCodec(QTextCodec::codecForName("UTF-8"));
+        reloaded.setFallbackTextCodec(QTextCodec::codecForName("ISO 8859-15"));
+        QVERIFY(reloaded.load(outputPath, encodingErrors, tooLongLinesWrapped, longestLineLoaded, false));
+        QCOMPARE(reloaded.digest(), buffer.digest());
+    } else {
+        QFile f(outputPath);
+        QVERIFY(f.open(QIODevice::ReadOnly));
+        QVERIFY(f.readAll() == content);
+    }
+}
+
+void KateTextBufferTest::wrapLinePerformance()
+{
+    const int lines = benchmarkLines(5000);
+
+    // create a file with the wanted number of empty lines
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString filePath = dir.path() + QLatin1String("/lines.txt");
+    QFile f(filePath);
+    QVERIFY(f.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    const QByteArray newlines(lines - 1, '\n');
+    QCOMPARE(f.write(newlines), qint64(newlines.size()));
+    f.close();
+
+    Kate::TextBuffer buffer(nullptr);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    bool encodingErrors = false;
+    bool tooLongLinesWrapped = false;
+    int longestLineLoaded = 0;
+    QVERIFY(buffer.load(filePath, encodingErrors, tooLongLinesWrapped, longestLineLoaded, true));
+    QCOMPARE(buffer.lines(), lines);
+
+    // insert newlines at random positions, a cursor at the end must follow
+    qsrand(42);
+    Kate::TextCursor cursor(buffer, KTextEditor::Cursor(buffer.lines() - 1, 0), Kate::TextCursor::MoveOnInsert);
+    const int wraps = 10000;
+    QBENCHMARK_ONCE {
+        buffer.startEditing();
+        for (int i = 0; i < wraps; ++i) {
+            buffer.wrapLine(KTextEditor::Cursor(qrand() % buffer.lines(), 0));
+        }
+        buffer.finishEditing();
+    }
+
+    QCOMPARE(buffer.lines(), lines + wraps);
+    QCOMPARE(cursor.line(), buffer.lines() - 1);
+}
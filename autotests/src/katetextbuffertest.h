@@ -40,6 +40,18 @@ private Q_SLOTS:
     void foldingTest();
     void nestedFoldingTest();
     void saveFileInUnwritableFolder();
+    void saveFailingWrite();
+    void adaptiveBlockSizeTest();
+    void backgroundLoadingTest();
+    void loadTruncatedFileTest();
+    void snapshotTest();
+    void offsetTest();
+
+    void loadFilePerformance_data();
+    void loadFilePerformance();
+    void wrapLinePerformance();
+    void savePerformance_data();
+    void savePerformance();
 };
 
 #endif // KATEBUFFERTEST_H
@@ -18,6 +18,7 @@
 */
 
 #include "kateview_test.h"
+#include "benchmarklines.h"
 #include "moc_kateview_test.cpp"
 
 #include <kateglobal.h>
@@ -27,9 +28,14 @@
 #include <kateconfig.h>
 #include <katebuffer.h>
 #include <ktexteditor/message.h>
+#include <kateshapingcache.h>
+#include <katerenderer.h>
+#include <kateviewhelpers.h>
+#include <ktexteditor/movingrange.h>
 
 #include <QtTestWidgets>
 #include <QTemporaryFile>
+#include <QFontDatabase>
 
 using namespace KTextEditor;
 
@@ -384,4 +390,302 @@ void KateViewTest::testDragAndDrop()
     QCOMPARE(view->selectionRange(), Range(2, 0, 3, 0));
 }
 
+void KateViewTest::testShapingCache()
+{
+    KateShapingCache *cache = KTextEditor::EditorPrivate::self()->shapingCache();
+    cache->clear();
+
+    // equal lines share one layout
+    QString text;
+    for (int i = 0; i < 20; ++i) {
+        text += QStringLiteral("int a = 0;\n");
+    }
+    text += QStringLiteral("int b = 1;");
+
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(text);
+    doc.setHighlightingMode(QStringLiteral("C++"));
+
+    KTextEditor::ViewPrivate *view = new KTextEditor::ViewPrivate(&doc, nullptr);
+    view->resize(400, 600);
+    view->show();
+
+    QTRY_VERIFY(cache->hits() >= 19);
+    QVERIFY(cache->size() >= 2);
+    QVERIFY(cache->statistics().contains(QStringLiteral("hit rate")));
+
+    // the key compares text, formats and layout parameters
+    KateShapingCache::Key key;
+    key.text = QStringLiteral("int a = 0;");
+    key.font = QFont();
+    key.tabStop = 80;
+    key.maxWidth = -1;
+    key.rightToLeft = false;
+    key.alignIndent = 0;
+    key.lineHeight = 16;
+
+    QTextLayout::FormatRange range;
+    range.start = 0;
+    range.length = 3;
+    range.format.setFontWeight(QFont::Bold);
+    key.formats << range;
+
+    cache->clear();
+    QSharedPointer<QTextLayout> layout(new QTextLayout(key.text, key.font));
+    cache->insert(key, layout, -1);
+
+    int shiftX = 0;
+    QCOMPARE(cache->find(key, shiftX), layout);
+    QCOMPARE(shiftX, -1);
+
+    KateShapingCache::Key other = key;
+    other.formats[0].format.setFontItalic(true);
+    QVERIFY(!cache->find(other, shiftX));
+
+    other = key;
+    other.maxWidth = 200;
+    QVERIFY(!cache->find(other, shiftX));
+
+    QCOMPARE(cache->hits(), qint64(1));
+    QCOMPARE(cache->misses(), qint64(2));
+    QCOMPARE(cache->hitRate(), 33);
+}
+
+void KateViewTest::testDecorationsForLine()
+{
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(QStringLiteral("int foo = bar;"));
+
+    KTextEditor::ViewPrivate *view = new KTextEditor::ViewPrivate(&doc, nullptr);
+    KateRenderer *renderer = view->renderer();
+
+    KTextEditor::Attribute::Ptr red(new KTextEditor::Attribute());
+    red->setForeground(Qt::red);
+    KTextEditor::Attribute::Ptr yellow(new KTextEditor::Attribute());
+    yellow->setBackground(Qt::yellow);
+
+    // the inner range wins where they overlap
+    QScopedPointer<KTextEditor::MovingRange> outer(doc.newMovingRange(Range(0, 0, 0, 10)));
+    outer->setAttribute(red);
+    QScopedPointer<KTextEditor::MovingRange> inner(doc.newMovingRange(Range(0, 4, 0, 7)));
+    inner->setAttribute(yellow);
+    renderer->clearMergedAttributes();
+
+    QList<QTextLayout::FormatRange> decorations = renderer->decorationsForLine(doc.kateTextLine(0), 0);
+    QCOMPARE(decorations.size(), 3);
+    QCOMPARE(decorations[0].start, 0);
+    QCOMPARE(decorations[0].length, 4);
+    QCOMPARE(decorations[0].format.foreground().color(), QColor(Qt::red));
+    QVERIFY(!decorations[0].format.hasProperty(QTextFormat::BackgroundBrush));
+    QCOMPARE(decorations[1].start, 4);
+    QCOMPARE(decorations[1].length, 3);
+    QCOMPARE(decorations[1].format.foreground().color(), QColor(Qt::red));
+    QCOMPARE(decorations[1].format.background().color(), QColor(Qt::yellow));
+    QCOMPARE(decorations[2].start, 7);
+    QCOMPARE(decorations[2].length, 3);
+    QCOMPARE(decorations[2].format.foreground().color(), QColor(Qt::red));
+
+    // the merged attribute is reused
+    QCOMPARE(renderer->mergedAttributeCount(), 1);
+    QCOMPARE(renderer->decorationsForLine(doc.kateTextLine(0), 0).size(), 3);
+    QCOMPARE(renderer->mergedAttributeCount(), 1);
+
+    // an attribute changed in place is merged anew, the cache compares the formats
+    yellow->setBackground(Qt::cyan);
+    decorations = renderer->decorationsForLine(doc.kateTextLine(0), 0);
+    QCOMPARE(decorations.size(), 3);
+    QCOMPARE(decorations[1].format.background().color(), QColor(Qt::cyan));
+    QCOMPARE(renderer->mergedAttributeCount(), 2);
+
+    // until the attributes of the ranges change
+    yellow->setBackground(Qt::green);
+    inner->setAttribute(yellow);
+    QCOMPARE(renderer->mergedAttributeCount(), 0);
+    decorations = renderer->decorationsForLine(doc.kateTextLine(0), 0);
+    QCOMPARE(decorations.size(), 3);
+    QCOMPARE(decorations[1].format.background().color(), QColor(Qt::green));
+
+    // a higher z-depth loses where both set the same property
+    yellow->setForeground(Qt::blue);
+    inner->setAttribute(yellow);
+    QCOMPARE(renderer->decorationsForLine(doc.kateTextLine(0), 0)[1].format.foreground().color(), QColor(Qt::blue));
+    inner->setZDepth(1.0);
+    QCOMPARE(renderer->decorationsForLine(doc.kateTextLine(0), 0)[1].format.foreground().color(), QColor(Qt::red));
+}
+
+void KateViewTest::testMiniMapTypingPerformance()
+{
+    const int lines = benchmarkLines(5000);
+    const int keystrokes = 50;
+
+    const QString line = QStringLiteral("    for (int i = 0; i < count; ++i) { sum += values[i]; } // accumulate\n");
+    QString text;
+    text.reserve(line.size() * lines);
+    for (int l = 0; l < lines; ++l) {
+        text.append(line);
+    }
+
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(text);
+    doc.setHighlightingMode(QStringLiteral("C++"));
+    doc.buffer().ensureHighlighted(doc.lines() - 1, 0);
+
+    KTextEditor::ViewPrivate *view = new KTextEditor::ViewPrivate(&doc, nullptr);
+    view->config()->setScrollBarMiniMap(true);
+    view->resize(800, 600);
+    view->show();
+
+    KateScrollBar *scrollBar = view->findChild<KateScrollBar *>();
+    QVERIFY(scrollBar);
+    QVERIFY(scrollBar->showMiniMap());
+
+    // paint the whole minimap first
+    scrollBar->updatePixmap();
+    QTRY_VERIFY_WITH_TIMEOUT(!scrollBar->miniMapBusy(), 60000);
+    QVERIFY(scrollBar->miniMapTilesRendered() > 0);
+
+    view->setCursorPosition(Cursor(lines / 2, 4));
+    const qint64 tilesBefore = scrollBar->miniMapTilesRendered();
+
+    QBENCHMARK_ONCE {
+        for (int i = 0; i < keystrokes; ++i) {
+            doc.typeChars(view, QStringLiteral("x"));
+
+            // don't wait for the update timer, update at once
+            scrollBar->updatePixmap();
+            while (scrollBar->miniMapBusy()) {
+                QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+            }
+        }
+    }
+
+    // only the tiles of the edited line got painted again
+    QVERIFY(scrollBar->miniMapTilesRendered() - tilesBefore <= 2 * keystrokes);
+    QCOMPARE(doc.line(lines / 2).left(4 + keystrokes), QString(4, QLatin1Char(' ')) + QString(keystrokes, QLatin1Char('x')));
+}
+
+void KateViewTest::testMiniMapBracketMatching()
+{
+    const QString line = QStringLiteral("    for (int i = 0; i < count; ++i) { sum += values[i]; } // accumulate\n");
+    QString text;
+    for (int l = 0; l < 5000; ++l) {
+        text.append(line);
+    }
+
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(text);
+
+    KTextEditor::ViewPrivate *view = new KTextEditor::ViewPrivate(&doc, nullptr);
+    view->config()->setScrollBarMiniMap(true);
+    view->resize(800, 600);
+    view->show();
+
+    KateScrollBar *scrollBar = view->findChild<KateScrollBar *>();
+    QVERIFY(scrollBar);
+    scrollBar->updatePixmap();
+    QTRY_VERIFY(!scrollBar->miniMapBusy());
+    const qint64 allTiles = scrollBar->miniMapTilesRendered();
+    QVERIFY(allTiles > 4);
+
+    // next to a bracket and then next to the one of the following line, the bracket marks move along
+    const int column = line.indexOf(QLatin1Char('('));
+    for (int l = 2500; l < 2502; ++l) {
+        const qint64 tilesBefore = scrollBar->miniMapTilesRendered();
+        view->setCursorPosition(Cursor(l, column));
+        QCoreApplication::processEvents();
+        scrollBar->updatePixmap();
+        QTRY_VERIFY(!scrollBar->miniMapBusy());
+
+        // only the tiles of the lines with the old and new marks got painted again
+        QVERIFY(scrollBar->miniMapTilesRendered() - tilesBefore <= 4);
+    }
+
+    delete view;
+}
+
+void KateViewTest::testPaintOnlyChangedLines()
+{
+    KTextEditor::DocumentPrivate doc;
+    QStringList lines;
+    for (int l = 0; l < 100; ++l) {
+        lines << QStringLiteral("line %1 with_some_text").arg(l);
+    }
+    doc.setText(lines);
+
+    KTextEditor::ViewPrivate *view = new KTextEditor::ViewPrivate(&doc, nullptr);
+    view->resize(400, 600);
+    view->show();
+    QTest::qWaitForWindowExposed(view);
+    QTRY_VERIFY(view->paintedLineCount() > 0);
+    QCoreApplication::processEvents();
+
+    // a repaint without changes reuses all lines
+    qint64 painted = view->paintedLineCount();
+    qint64 reused = view->reusedLineCount();
+    view->repaintText();
+    QTRY_VERIFY(view->reusedLineCount() > reused);
+    QCOMPARE(view->paintedLineCount(), painted);
+
+    // moving the cursor far paints just the old and the new cursor line
+    painted = view->paintedLineCount();
+    view->setCursorPosition(Cursor(15, 0));
+    QTRY_COMPARE(view->paintedLineCount() - painted, qint64(2));
+    QCoreApplication::processEvents();
+    QCOMPARE(view->paintedLineCount() - painted, qint64(2));
+
+    // editing paints the edited line again, the next one only if the line's layout reaches into it
+    painted = view->paintedLineCount();
+    doc.insertText(Cursor(15, 0), QStringLiteral("_"));
+    QTRY_VERIFY(view->paintedLineCount() > painted);
+    QCoreApplication::processEvents();
+    QVERIFY(view->paintedLineCount() - painted <= 2);
+
+    // the render-stats report contains the counters
+    QVERIFY(view->paintStatistics().contains(QString::number(view->paintedLineCount())));
+
+    delete view;
+}
+
+void KateViewTest::testLongLineLayout()
+{
+    // long enough to get laid out in the background
+    const QString text = QStringLiteral("lorem ipsum ").repeated(20000);
+
+    KateShapingCache::Key key;
+    key.text = text;
+    key.font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+    key.tabStop = 80;
+    key.maxWidth = 400;
+    key.rightToLeft = false;
+    key.alignIndent = 0;
+    key.lineHeight = 16;
+
+    QTextOption option;
+    option.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+
+    // the placeholder lays out the start of the line and estimates the rest
+    int shiftX = -1;
+    const QSharedPointer<QTextLayout> layout = KateRenderer::createLayout(key, option, 0, true, shiftX);
+    const QSharedPointer<QTextLayout> placeholder = KateRenderer::createPlaceholderLayout(key, option, 0, 1000, shiftX);
+    QVERIFY(placeholder->text().startsWith(text.left(1000)));
+    QCOMPARE(placeholder->lineAt(0).textLength(), layout->lineAt(0).textLength());
+    QVERIFY(placeholder->lineCount() > layout->lineCount() / 2);
+    QVERIFY(placeholder->lineCount() < layout->lineCount() * 2);
+
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(QStringLiteral("first line\n") + text + QStringLiteral("\nlast line"));
+
+    KTextEditor::ViewPrivate *view = new KTextEditor::ViewPrivate(&doc, nullptr);
+    view->config()->setDynWordWrap(true);
+    view->resize(400, 300);
+    view->show();
+    QTest::qWaitForWindowExposed(view);
+
+    // the real layout replaces the placeholder once done
+    QTRY_COMPARE_WITH_TIMEOUT(view->textLayout(1)->text(), text, 30000);
+    QVERIFY(view->textLayout(1)->lineCount() > 1);
+
+    delete view;
+}
+
 // kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -45,6 +45,16 @@ private Q_SLOTS:
     void testFoldFirstLine();
 
     void testDragAndDrop();
+
+    void testShapingCache();
+    void testDecorationsForLine();
+
+    void testMiniMapTypingPerformance();
+    void testMiniMapBracketMatching();
+
+    void testPaintOnlyChangedLines();
+
+    void testLongLineLayout();
 };
 
 #endif // KATE_VIEW_TEST_H
@@ -20,16 +20,21 @@
 
 #include "katetextblock.h"
 #include "katetextbuffer.h"
+#include "katetextlinearena.h"
+
+#include <algorithm>
 
 namespace Kate
 {
 
-TextBlock::TextBlock(TextBuffer *buffer, int startLine)
+TextBlock::TextBlock(TextBuffer *buffer, int blockIndex)
     : m_buffer(buffer)
-    , m_startLine(startLine)
+    , m_arena(new TextLineArena())
+    , m_characters(0)
+    , m_blockIndex(blockIndex)
+    , m_startLine(0)
+    , m_startLineGeneration(0)
 {
-    // reserve the block size
-    m_lines.reserve(m_buffer->m_blockSize);
 }
 
 TextBlock::~TextBlock()
@@ -39,15 +44,20 @@ TextBlock::~TextBlock()
     Q_ASSERT(m_cursors.empty());
 
     // it only is a hint for ranges for this block, not the storage of them
+
+    // lines still alive elsewhere keep the arena alive
+    m_arena->deref();
 }
 
-void TextBlock::setStartLine(int startLine)
+int TextBlock::startLine() const
 {
-    // allow only valid lines
-    Q_ASSERT(startLine >= 0);
-    Q_ASSERT(startLine < m_buffer->lines());
+    // recompute the start line via the block index, if it changed since the last time
+    if (m_startLineGeneration != m_buffer->m_blockIndexGeneration) {
+        m_startLine = m_buffer->blockStartLine(m_blockIndex);
+        m_startLineGeneration = m_buffer->m_blockIndexGeneration;
+    }
 
-    m_startLine = startLine;
+    return m_startLine;
 }
 
 TextLine TextBlock::line(int line) const
@@ -68,11 +78,27 @@ TextLine TextBlock::line(int line) const
 void TextBlock::appendLine(const QString &textOfLine)
 {
     m_lines.append(TextLine::create(textOfLine));
+    m_lines.last()->m_snapshotGeneration = m_buffer->m_snapshotGeneration;
+    m_characters += textOfLine.size();
+}
+
+const TextLine &TextBlock::detachLine(int line)
+{
+    // line created or copied after the last snapshot => only we know it
+    const quint32 generation = m_buffer->m_snapshotGeneration;
+    if (m_lines.at(line)->m_snapshotGeneration != generation) {
+        TextLine copy = TextLine::create(*m_lines.at(line));
+        copy->m_snapshotGeneration = generation;
+        m_lines[line] = copy;
+    }
+
+    return m_lines.at(line);
 }
 
 void TextBlock::clearLines()
 {
     m_lines.clear();
+    m_characters = 0;
 }
 
 void TextBlock::text(QString &text) const
@@ -94,14 +120,16 @@ void TextBlock::wrapLine(const KTextEditor::Cursor &position, int fixStartLinesS
     int line = position.line() - startLine();
 
     // get text
-    QString &text = m_lines.at(line)->textReadWrite();
+    QString &text = detachLine(line)->textReadWrite();
 
     // check if valid column
     Q_ASSERT(position.column() >= 0);
     Q_ASSERT(position.column() <= text.size());
 
     // create new line and insert it
-    m_lines.insert(m_lines.begin() + line + 1, TextLine(new TextLineData()));
+    TextLine newLine = TextLine::create();
+    newLine->m_snapshotGeneration = m_buffer->m_snapshotGeneration;
+    m_lines.insert(m_lines.begin() + line + 1, newLine);
 
     // cases for modification:
     // 1. line is wrapped in the middle
@@ -207,22 +235,21 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
         // move last line of previous block to this one, might result in empty block
         TextLine oldFirst = m_lines.at(0);
         int lastLineOfPreviousBlock = previousBlock->lines() - 1;
-        TextLine newFirst = previousBlock->m_lines.last();
-        m_lines[0] = newFirst;
+        m_lines[0] = previousBlock->m_lines.last();
         previousBlock->m_lines.erase(previousBlock->m_lines.begin() + (previousBlock->lines() - 1));
 
-        const int oldSizeOfPreviousLine = newFirst->text().size();
+        const int oldSizeOfPreviousLine = m_lines.at(0)->text().size();
+        m_characters += oldSizeOfPreviousLine;
+        previousBlock->m_characters -= oldSizeOfPreviousLine;
         if (oldFirst->length() > 0) {
             // append text
+            const TextLine &newFirst = detachLine(0);
             newFirst->textReadWrite().append(oldFirst->text());
 
             // mark line as modified, since text was appended
             newFirst->markAsModified(true);
         }
 
-        // patch startLine of this block
-        --m_startLine;
-
         /**
          * fix all start lines
          * we need to do this NOW, else the range update will FAIL!
@@ -298,7 +325,7 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
     const int oldSizeOfPreviousLine = m_lines.at(line - 1)->length();
     const int sizeOfCurrentLine = m_lines.at(line)->length();
     if (sizeOfCurrentLine > 0) {
-        m_lines.at(line - 1)->textReadWrite().append(m_lines.at(line)->text());
+        detachLine(line - 1)->textReadWrite().append(m_lines.at(line)->text());
     }
 
     const bool lineChanged = (oldSizeOfPreviousLine > 0 && m_lines.at(line - 1)->markedAsModified())
@@ -367,7 +394,7 @@ void TextBlock::insertText(const KTextEditor::Cursor &position, const QString &t
     int line = position.line() - startLine();
 
     // get text
-    QString &textOfLine = m_lines.at(line)->textReadWrite();
+    QString &textOfLine = detachLine(line)->textReadWrite();
     int oldLength = textOfLine.size();
     m_lines.at(line)->markAsModified(true);
 
@@ -377,6 +404,7 @@ void TextBlock::insertText(const KTextEditor::Cursor &position, const QString &t
 
     // insert text
     textOfLine.insert(position.column(), text);
+    m_characters += text.size();
 
     /**
      * notify the text history
@@ -436,7 +464,7 @@ void TextBlock::removeText(const KTextEditor::Range &range, QString &removedText
     int line = range.start().line() - startLine();
 
     // get text
-    QString &textOfLine = m_lines.at(line)->textReadWrite();
+    QString &textOfLine = detachLine(line)->textReadWrite();
     int oldLength = textOfLine.size();
 
     // check if valid column
@@ -450,6 +478,7 @@ void TextBlock::removeText(const KTextEditor::Range &range, QString &removedText
 
     // remove text
     textOfLine.remove(range.start().column(), range.end().column() - range.start().column());
+    m_characters -= removedText.size();
     m_lines.at(line)->markAsModified(true);
 
     /**
@@ -499,6 +528,119 @@ void TextBlock::removeText(const KTextEditor::Range &range, QString &removedText
     }
 }
 
+void TextBlock::replaceText(int bufferLine, const QVector<TextReplacement> &replacements, QStringList &removedTexts)
+{
+    // calc internal line
+    const int line = bufferLine - startLine();
+
+    // get text
+    QString &textOfLine = detachLine(line)->textReadWrite();
+    const int oldLength = textOfLine.size();
+    m_lines.at(line)->markAsModified(true);
+
+    /**
+     * build the new text in one pass, remember the replaced parts
+     * shifts[i] is the length difference caused by all replacements before i
+     */
+    QVector<int> shifts;
+    shifts.reserve(replacements.size() + 1);
+    shifts.append(0);
+
+    int newLength = oldLength;
+    foreach (const TextReplacement &replacement, replacements) {
+        newLength += replacement.text.size() - replacement.length;
+        shifts.append(newLength - oldLength);
+    }
+
+    QString newText;
+    newText.reserve(newLength);
+    int lastEnd = 0;
+    foreach (const TextReplacement &replacement, replacements) {
+        // check if valid and sorted columns
+        Q_ASSERT(replacement.column >= lastEnd);
+        Q_ASSERT(replacement.column + replacement.length <= oldLength);
+
+        newText.append(textOfLine.midRef(lastEnd, replacement.column - lastEnd));
+        removedTexts.append(textOfLine.mid(replacement.column, replacement.length));
+        newText.append(replacement.text);
+        lastEnd = replacement.column + replacement.length;
+    }
+    newText.append(textOfLine.midRef(lastEnd));
+    textOfLine = newText;
+    m_characters += newLength - oldLength;
+
+    /**
+     * cursor and range handling below
+     */
+
+    // no cursors in this block, no work to do..
+    if (m_cursors.empty()) {
+        return;
+    }
+
+    // move all cursors on the changed line
+    // the result is the same as applying the replacements as removeText + insertText from front to back
+    // remember all ranges modified
+    QSet<TextRange *> changedRanges;
+    foreach (TextCursor *cursor, m_cursors) {
+        // skip cursors not on this line!
+        if (cursor->lineInBlock() != line) {
+            continue;
+        }
+
+        const int column = cursor->column();
+        int newColumn = column;
+
+        // special handling if cursor behind the real line, e.g. non-wrapping cursor in block selection mode
+        if (column > oldLength) {
+            int length = oldLength;
+            foreach (const TextReplacement &replacement, replacements) {
+                length += replacement.text.size() - replacement.length;
+                newColumn = qMax(newColumn - replacement.length, length);
+            }
+        } else {
+            // first replacement not completely in front of the cursor
+            int i = std::lower_bound(replacements.begin(), replacements.end(), column, [](const TextReplacement &replacement, int cursorColumn) {
+                return replacement.column + replacement.length < cursorColumn;
+            }) - replacements.begin();
+
+            // replacements in front of the cursor just shift it, the ones touching it might move it
+            newColumn += shifts.at(i);
+            for (; i < replacements.size() && replacements.at(i).column <= column; ++i) {
+                const TextReplacement &replacement = replacements.at(i);
+                const int start = replacement.column + shifts.at(i);
+
+                // removal
+                if (newColumn > start) {
+                    newColumn = qMax(start, newColumn - replacement.length);
+                }
+
+                // insertion
+                if (newColumn > start || (newColumn == start && cursor->m_moveOnInsert)) {
+                    newColumn += replacement.text.size();
+                }
+            }
+        }
+
+        if (newColumn == column) {
+            continue;
+        }
+
+        // patch column of cursor
+        cursor->m_column = newColumn;
+
+        // remember range, if any
+        if (cursor->kateRange()) {
+            changedRanges.insert(cursor->kateRange());
+        }
+    }
+
+    // check validity of all ranges, might invalidate them...
+    foreach (TextRange *range, changedRanges) {
+        range->checkValidity();
+    }
+}
+
 void TextBlock::debugPrint(int blockIndex) const
 {
     // print all blocks
@@ -512,15 +654,20 @@ TextBlock *TextBlock::splitBlock(int fromLine)
     // half the block
     int linesOfNewBlock = lines() - fromLine;
 
-    // create and insert new block
-    TextBlock *newBlock = new TextBlock(m_buffer, startLine() + fromLine);
+    // create new block, the buffer will insert it behind this one
+    // its start line is known already, the range fixup below needs it before the block index is updated
+    TextBlock *newBlock = new TextBlock(m_buffer, m_blockIndex + 1);
+    newBlock->m_startLine = startLine() + fromLine;
+    newBlock->m_startLineGeneration = m_buffer->m_blockIndexGeneration;
 
     // move lines
     newBlock->m_lines.reserve(linesOfNewBlock);
     for (int i = fromLine; i < m_lines.size(); ++i) {
         newBlock->m_lines.append(m_lines.at(i));
+        newBlock->m_characters += m_lines.at(i)->length();
     }
     m_lines.resize(fromLine);
+    m_characters -= newBlock->m_characters;
 
     // move cursors
     QSet<TextCursor *> oldBlockSet;
@@ -563,6 +710,8 @@ void TextBlock::mergeBlock(TextBlock *targetBlock)
         targetBlock->m_lines.append(m_lines.at(i));
     }
     m_lines.clear();
+    targetBlock->m_characters += m_characters;
+    m_characters = 0;
 
     // fix ALL ranges!
     const QList<TextRange *> allRanges = m_uncachedRanges.toList() + m_cachedLineForRanges.keys();
@@ -583,7 +732,7 @@ void TextBlock::deleteBlockContent()
         }
 
     // kill lines
-    m_lines.clear();
+    clearLines();
 }
 
 void TextBlock::clearBlockContent(TextBlock *targetBlock)
@@ -601,7 +750,7 @@ void TextBlock::clearBlockContent(TextBlock *targetBlock)
     }
 
     // kill lines
-    m_lines.clear();
+    clearLines();
 }
 
 void TextBlock::markModifiedLinesAsSaved()
@@ -627,7 +776,8 @@ void TextBlock::updateRange(TextRange *range)
     /**
      * perhaps remove range and be done
      */
-    if ((endLine < m_startLine) || (startLine >= (m_startLine + lines()))) {
+    const int blockStartLine = this->startLine();
+    if ((endLine < blockStartLine) || (startLine >= (blockStartLine + lines()))) {
         removeRange(range);
         return;
     }
@@ -635,7 +785,7 @@ void TextBlock::updateRange(TextRange *range)
     /**
      * The range is still a single-line range, and is still cached to the correct line.
      */
-    if (isSingleLine && m_cachedLineForRanges.contains(range) && (m_cachedLineForRanges.value(range) == startLine - m_startLine)) {
+    if (isSingleLine && m_cachedLineForRanges.contains(range) && (m_cachedLineForRanges.value(range) == startLine - blockStartLine)) {
         return;
     }
 
@@ -665,7 +815,7 @@ void TextBlock::updateRange(TextRange *range)
     /**
      * The range is contained by a single line, put it into the line-cache
      */
-    const int lineOffset = startLine - m_startLine;
+    const int lineOffset = startLine - blockStartLine;
 
     /**
      * enlarge cache if needed
@@ -23,6 +23,7 @@
 
 #include <QVector>
 #include <QSet>
+#include <QStringList>
 
 #include <ktexteditor_export.h>
 #include <ktexteditor/cursor.h>
@@ -33,8 +34,33 @@ namespace Kate
 
 class TextBuffer;
 class TextCursor;
+class TextLineArena;
 class TextRange;
 
+/**
+ * One replacement of a column range inside a line, see TextBuffer::replaceText().
+ * The columns always refer to the line as it was before the batch of
+ * replacements it belongs to was applied.
+ */
+class TextReplacement
+{
+public:
+    /**
+     * start column of the replaced text
+     */
+    int column;
+
+    /**
+     * length of the replaced text
+     */
+    int length;
+
+    /**
+     * new text, must not contain line breaks
+     */
+    QString text;
+};
+
 /**
  * Class representing a text block.
  * This is used to build up a Kate::TextBuffer.
@@ -46,9 +72,9 @@ public:
     /**
      * Construct an empty text block.
      * @param buffer parent text buffer
-     * @param startLine start line of this block
+     * @param blockIndex index of this block in the buffer
      */
-    TextBlock(TextBuffer *buffer, int startLine);
+    TextBlock(TextBuffer *buffer, int blockIndex);
 
     /**
      * Destruct the text block
@@ -57,18 +83,28 @@ public:
 
     /**
      * Start line of this block.
+     * Is computed with the block index of the buffer in O(log n) and cached until the next line count change.
      * @return start line of this block
      */
-    int startLine() const
+    int startLine() const;
+
+    /**
+     * Index of this block in the buffer.
+     * @return block index
+     */
+    int blockIndex() const
     {
-        return m_startLine;
+        return m_blockIndex;
     }
 
     /**
-     * Set start line of this block.
-     * @param startLine new start line of this block
+     * Set index of this block in the buffer.
+     * @param blockIndex new index of this block
      */
-    void setStartLine(int startLine);
+    void setBlockIndex(int blockIndex)
+    {
+        m_blockIndex = blockIndex;
+    }
 
     /**
      * Retrieve a text line.
@@ -97,12 +133,50 @@ public:
         return m_lines.size();
     }
 
+    /**
+     * Number of characters in this block, line ends not counted.
+     * @return number of characters
+     */
+    int characters() const
+    {
+        return m_characters;
+    }
+
     /**
      * Retrieve text of block.
      * @param text for this block, lines separated by '\n'
      */
     void text(QString &text) const;
 
+    /**
+     * Append all lines of this block to the given list.
+     * The lines are shared, not copied.
+     * @param lines list to append the lines to
+     */
+    void appendLinesTo(QVector<Kate::TextLine> &lines) const
+    {
+        lines += m_lines;
+    }
+
+    /**
+     * All lines of this block, used for snapshots.
+     * Copying the list is cheap, it is implicitly shared until the block changes.
+     * @return lines of this block
+     */
+    const QVector<Kate::TextLine> &lineList() const
+    {
+        return m_lines;
+    }
+
+    /**
+     * Arena for the attribute lists of the lines of this block.
+     * @return arena of this block
+     */
+    TextLineArena *arena() const
+    {
+        return m_arena;
+    }
+
     /**
      * Wrap line at given cursor position.
      * @param position line/column as cursor where to wrap
@@ -132,6 +206,16 @@ public:
      */
     void removeText(const KTextEditor::Range &range, QString &removedText);
 
+    /**
+     * Replace several column ranges of one line in one pass.
+     * The line text is rebuilt once and cursors are moved once, as if the
+     * replacements had been applied one after the other from front to back.
+     * @param bufferLine line in the buffer to modify
+     * @param replacements sorted, non-overlapping replacements
+     * @param removedTexts will be filled with the replaced texts, one per replacement
+     */
+    void replaceText(int bufferLine, const QVector<TextReplacement> &replacements, QStringList &removedTexts);
+
     /**
      * Debug output, print whole block content with line numbers and line length
      * @param blockIndex index of this block in buffer
@@ -191,6 +275,22 @@ public:
      */
     void markModifiedLinesAsSaved();
 
+    /**
+     * Add the cursor and range bookkeeping of this block to the given counters.
+     * Used by TextBuffer::debugStatistics.
+     * @param cursors number of cursors in this block
+     * @param cachedRanges number of single-line ranges in the line cache
+     * @param uncachedRanges number of multi-line ranges
+     * @param rangeCacheLines number of entries in the per-line range cache
+     */
+    void addStatistics(int &cursors, int &cachedRanges, int &uncachedRanges, int &rangeCacheLines) const
+    {
+        cursors += m_cursors.size();
+        cachedRanges += m_cachedLineForRanges.size();
+        uncachedRanges += m_uncachedRanges.size();
+        rangeCacheLines += m_cachedRangesForLine.size();
+    }
+
     /**
      * Insert cursor into this block.
      * @param cursor cursor to insert
@@ -230,7 +330,7 @@ public:
      */
     QSet<TextRange *> cachedRangesForLine(int line) const
     {
-        line -= m_startLine;
+        line -= startLine();
         if (line >= 0 && line < m_cachedRangesForLine.size()) {
             return m_cachedRangesForLine[line];
         } else {
@@ -238,6 +338,15 @@ public:
         }
     }
 
+private:
+    /**
+     * Prepare a line for modification of its text.
+     * If the line might be part of a snapshot, it is replaced by a copy first.
+     * @param line line in this block, not the line number in the buffer
+     * @return text line that may be modified
+     */
+    const TextLine &detachLine(int line);
+
 private:
     /**
      * parent text buffer
@@ -250,9 +359,29 @@ private:
     QVector<Kate::TextLine> m_lines;
 
     /**
-     * Startline of this block
+     * Arena for the attribute lists of the lines, one reference is ours
+     */
+    TextLineArena *m_arena;
+
+    /**
+     * Number of characters in all lines of this block
+     */
+    int m_characters;
+
+    /**
+     * Index of this block in the buffer
+     */
+    int m_blockIndex;
+
+    /**
+     * Cached start line of this block
      */
-    int m_startLine;
+    mutable int m_startLine;
+
+    /**
+     * Generation of the block index of the buffer, for which m_startLine was computed
+     */
+    mutable quint64 m_startLineGeneration;
 
     /**
      * Set of cursors for this block.
@@ -278,4 +407,7 @@ private:
 
 }
 
+Q_DECLARE_TYPEINFO(Kate::TextReplacement, Q_MOVABLE_TYPE);
+Q_DECLARE_METATYPE(Kate::TextReplacement)
+
 #endif
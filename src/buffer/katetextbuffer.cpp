@@ -36,7 +36,14 @@
 #include <sys/stat.h>
 #endif
 
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QSaveFile>
+#include <QScopedPointer>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
 
 #if 0
 #define BUFFER_DEBUG qCDebug(LOG_KTE)
@@ -47,12 +54,386 @@
 namespace Kate
 {
 
+/**
+ * approximated memory needed per line beside the text: TextLineData, shared pointer and QString header
+ */
+static const qint64 KATE_BLOCK_LINE_OVERHEAD = 64;
+
+/**
+ * lines and characters the loader thread collects before it hands them over to the buffer
+ */
+static const int KATE_LOADER_BATCH_LINES = 16 * 1024;
+static const int KATE_LOADER_BATCH_CHARACTERS = 1024 * 1024;
+
+/**
+ * Read all lines of the given file, shared by TextBuffer::load and the loader thread.
+ * The sink gets reset() at the start of each loading round and append() for each line,
+ * too long lines are already wrapped. Loading stops if the sink reports canceled().
+ * @return false, if the file could not be opened or the loading got canceled
+ */
+template <typename Sink>
+static bool readLines(TextLoader &file, Sink &sink, QTextCodec *textCodec, QTextCodec *fallbackTextCodec, bool enforceTextCodec, int lineLengthLimit,
+                      bool &encodingErrors, bool &tooLongLinesWrapped, int &longestLineLoaded)
+{
+    /**
+     * triple play, maximal three loading rounds
+     * 0) use the given encoding, be done, if no encoding errors happen
+     * 1) use BOM to decided if Unicode or if that fails, use encoding prober, if no encoding errors happen, be done
+     * 2) use fallback encoding, be done, if no encoding errors happen
+     * 3) use again given encoding, be done in any case
+     */
+    for (int i = 0; i < (enforceTextCodec ? 1 : 4);  ++i) {
+        /**
+         * drop the lines of the last round
+         */
+        sink.reset();
+
+        /**
+         * try to open file, with given encoding
+         * in round 0 + 3 use the given encoding from user
+         * in round 1 use 0, to trigger detection
+         * in round 2 use fallback
+         */
+        QTextCodec *codec = textCodec;
+        if (i == 1) {
+            codec = nullptr;
+        } else if (i == 2) {
+            codec = fallbackTextCodec;
+        }
+
+        if (!file.open(codec)) {
+            return false;
+        }
+
+        // read in all lines...
+        encodingErrors = false;
+        while (!file.eof()) {
+            // stop if nobody wants the lines anymore
+            if (sink.canceled()) {
+                return false;
+            }
+
+            // read line
+            int offset = 0, length = 0;
+            bool currentError = !file.readLine(offset, length);
+            encodingErrors = encodingErrors || currentError;
+
+            // bail out on encoding error, if not last round!
+            if (encodingErrors && i < (enforceTextCodec ? 0 : 3)) {
+                BUFFER_DEBUG << "Failed try to load file with codec" << (file.textCodec() ? file.textCodec()->name() : "(null)");
+                break;
+            }
+
+            // get Unicode data for this line
+            const QChar *unicodeData = file.unicode() + offset;
+
+
+            if (longestLineLoaded < length) longestLineLoaded=length;
+
+            /**
+             * split lines, if too large
+             */
+            do {
+                /**
+                 * calculate line length
+                 */
+                int lineLength = length;
+                if ((lineLengthLimit > 0) && (lineLength > lineLengthLimit)) {
+                    /**
+                     * search for place to wrap
+                     */
+                    int spacePosition = lineLengthLimit - 1;
+                    for (int testPosition = lineLengthLimit - 1; (testPosition >= 0) && (testPosition >= (lineLengthLimit - (lineLengthLimit / 10))); --testPosition) {
+                        /**
+                         * wrap place found?
+                         */
+                        if (unicodeData[testPosition].isSpace() || unicodeData[testPosition].isPunct()) {
+                            spacePosition = testPosition;
+                            break;
+                        }
+                    }
+
+                    /**
+                     * wrap the line
+                     */
+                    lineLength = spacePosition + 1;
+                    length -= lineLength;
+                    tooLongLinesWrapped = true;
+                } else {
+                    /**
+                     * be done after this round
+                     */
+                    length = 0;
+                }
+
+                /**
+                 * hand out new text line with content from file
+                 * move data pointer
+                 */
+                sink.append(QString(unicodeData, lineLength));
+                unicodeData += lineLength;
+            } while (length > 0);
+        }
+
+        // if no encoding error, break out of reading loop
+        if (!encodingErrors) {
+            break;
+        }
+    }
+
+    // file loading worked, modulo encoding problems
+    return true;
+}
+
+/**
+ * Thread for TextBuffer::startLoading, reads the file with readLines()
+ * and hands the lines over to the buffer in batches.
+ */
+class TextLoaderThread : public QThread
+{
+public:
+    TextLoaderThread(TextBuffer *buffer, const QString &filename, KEncodingProber::ProberType proberType, QTextCodec *textCodec,
+                     QTextCodec *fallbackTextCodec, bool enforceTextCodec, int lineLengthLimit)
+        : m_buffer(buffer)
+        , m_filename(filename)
+        , m_proberType(proberType)
+        , m_textCodec(textCodec)
+        , m_fallbackTextCodec(fallbackTextCodec)
+        , m_enforceTextCodec(enforceTextCodec)
+        , m_lineLengthLimit(lineLengthLimit)
+        , m_success(false)
+        , m_encodingErrors(false)
+        , m_tooLongLinesWrapped(false)
+        , m_longestLineLoaded(0)
+        , m_batchCharacters(0)
+        , m_restarted(false)
+        , m_importScheduled(false)
+        , m_done(false)
+    {
+    }
+
+    /**
+     * Stop reading as soon as possible, call wait() afterwards.
+     */
+    void cancel()
+    {
+        m_canceled.storeRelease(1);
+    }
+
+    /**
+     * Take the lines read since the last call, called by the buffer.
+     * @param restarted is set if a new loading round started, the buffer must drop its lines
+     * @param done is set if the thread has finished reading
+     * @return new lines
+     */
+    QVector<QString> takeLines(bool &restarted, bool &done)
+    {
+        QMutexLocker locker(&m_mutex);
+        restarted = m_restarted;
+        done = m_done;
+        m_restarted = false;
+        m_importScheduled = false;
+
+        QVector<QString> lines;
+        lines.swap(m_pendingLines);
+        return lines;
+    }
+
+    // sink interface of readLines
+
+    void reset()
+    {
+        m_batch.clear();
+        m_batchCharacters = 0;
+
+        QMutexLocker locker(&m_mutex);
+        m_pendingLines.clear();
+        m_restarted = true;
+    }
+
+    void append(const QString &textLine)
+    {
+        m_batch.append(textLine);
+        m_batchCharacters += textLine.size();
+        if (m_batch.size() >= KATE_LOADER_BATCH_LINES || m_batchCharacters >= KATE_LOADER_BATCH_CHARACTERS) {
+            publish(false);
+        }
+    }
+
+    bool canceled() const
+    {
+        return m_canceled.loadAcquire();
+    }
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        // even the mime-type detection of the loader reads from the file, do it here
+        m_file.reset(new TextLoader(m_filename, m_proberType));
+        m_success = readLines(*m_file, *this, m_textCodec, m_fallbackTextCodec, m_enforceTextCodec, m_lineLengthLimit,
+                              m_encodingErrors, m_tooLongLinesWrapped, m_longestLineLoaded);
+        publish(true);
+    }
+
+private:
+    /**
+     * Move the current batch to the pending lines, trigger an import in the buffer thread if none is scheduled.
+     * @param done reading finished?
+     */
+    void publish(bool done)
+    {
+        bool schedule = false;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_pendingLines.isEmpty()) {
+                m_pendingLines.swap(m_batch);
+            } else {
+                m_pendingLines += m_batch;
+            }
+            m_done = done;
+            schedule = !m_importScheduled || done;
+            m_importScheduled = true;
+        }
+
+        m_batch.clear();
+        m_batchCharacters = 0;
+
+        if (schedule) {
+            QMetaObject::invokeMethod(m_buffer, "importLoadedLines", Qt::QueuedConnection);
+        }
+    }
+
+public:
+    TextBuffer *const m_buffer;
+    const QString m_filename;
+    const KEncodingProber::ProberType m_proberType;
+    QScopedPointer<TextLoader> m_file;
+    QTextCodec *const m_textCodec;
+    QTextCodec *const m_fallbackTextCodec;
+    const bool m_enforceTextCodec;
+    const int m_lineLengthLimit;
+
+    /**
+     * results of readLines, valid after the thread is done
+     */
+    bool m_success;
+    bool m_encodingErrors;
+    bool m_tooLongLinesWrapped;
+    int m_longestLineLoaded;
+
+private:
+    QAtomicInt m_canceled;
+
+    /**
+     * lines not yet published, only touched by the thread itself
+     */
+    QVector<QString> m_batch;
+    int m_batchCharacters;
+
+    /**
+     * shared with the buffer thread, guarded by m_mutex
+     */
+    QMutex m_mutex;
+    QVector<QString> m_pendingLines;
+    bool m_restarted;
+    bool m_importScheduled;
+    bool m_done;
+};
+
+/**
+ * characters TextBuffer::save encodes in one go, chunks are encoded in parallel and written with one write each
+ */
+static const int KATE_SAVE_CHUNK_CHARACTERS = 1024 * 1024;
+
+/**
+ * Can the text be split at line boundaries and the parts be encoded independently with this codec?
+ * True for the Unicode encodings and the usual single byte ones, stateful codecs like ISO-2022-JP
+ * need the output of the previous part.
+ * @param codec codec to check
+ * @return codec without shift states?
+ */
+static bool encodesLinesIndependently(QTextCodec *codec)
+{
+    const int mib = codec->mibEnum();
+    return (mib == 106)                     // UTF-8
+           || (mib >= 1013 && mib <= 1019)  // UTF-16 and UTF-32 variants
+           || (mib >= 3 && mib <= 12)       // ASCII, ISO-8859-1 to ISO-8859-9
+           || (mib >= 109 && mib <= 112)    // ISO-8859-13 to ISO-8859-16
+           || (mib >= 2250 && mib <= 2258); // windows-1250 to windows-1258
+}
+
+/**
+ * Encodes a snapshot of consecutive lines for TextBuffer::save.
+ * Runs in the worker pool of the buffer if the codec allows it, is reused for further chunks.
+ */
+class TextSaveChunk : public QRunnable
+{
+public:
+    TextSaveChunk()
+        : m_codec(nullptr)
+        , m_state(nullptr)
+        , m_appendEol(false)
+    {
+        setAutoDelete(false);
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        encode();
+        m_done.release();
+    }
+
+    /**
+     * Encode the lines into m_data, with m_eol between them and after the last one, if wanted.
+     */
+    void encode()
+    {
+        // the text buffer keeps its reserved capacity for the next chunks
+        int length = m_lines.size() * m_eol.size();
+        for (int i = 0; i < m_lines.size(); ++i) {
+            length += m_lines.at(i)->length();
+        }
+        m_text.reserve(length);
+        m_text.resize(0);
+
+        for (int i = 0; i < m_lines.size(); ++i) {
+            m_text += m_lines.at(i)->text();
+            if (m_appendEol || (i + 1) < m_lines.size()) {
+                m_text += m_eol;
+            }
+        }
+        m_lines.clear();
+
+        // like QTextStream, nothing to write => no byte order mark
+        if (m_text.isEmpty()) {
+            m_data.clear();
+        } else {
+            m_data = m_codec->fromUnicode(m_text.constData(), m_text.size(), m_state);
+        }
+    }
+
+    QVector<TextLine> m_lines;
+    QTextCodec *m_codec;
+    QTextCodec::ConverterState *m_state;
+    QString m_eol;
+    bool m_appendEol;
+    QString m_text;
+    QByteArray m_data;
+
+    /**
+     * released once the pool has encoded the chunk
+     */
+    QSemaphore m_done;
+};
+
 TextBuffer::TextBuffer(KTextEditor::DocumentPrivate *parent, int blockSize)
     : QObject(parent)
     , m_document(parent)
     , m_history(*this)
-    , m_blockSize(blockSize)
+    , m_targetBlockWeight(blockSize)
+    , m_blockIndexGeneration(1)
     , m_lines(0)
+    , m_snapshotGeneration(0)
     , m_lastUsedBlock(0)
     , m_revision(0)
     , m_editingTransactions(0)
@@ -67,9 +448,11 @@ TextBuffer::TextBuffer(KTextEditor::DocumentPrivate *parent, int blockSize)
     , m_endOfLineMode(eolUnix)
     , m_newLineAtEof(false)
     , m_lineLengthLimit(4096)
+    , m_loaderThread(nullptr)
+    , m_loadingPlaceholder(false)
 {
     // minimal block size must be > 0
-    Q_ASSERT(m_blockSize > 0);
+    Q_ASSERT(m_targetBlockWeight > 0);
 
     // create initial state
     clear();
@@ -77,6 +460,9 @@ TextBuffer::TextBuffer(KTextEditor::DocumentPrivate *parent, int blockSize)
 
 TextBuffer::~TextBuffer()
 {
+    // the loader thread must not outlive us
+    stopLoading();
+
     // remove document pointer, this will avoid any notifyAboutRangeChange to have a effect
     m_document = nullptr;
 
@@ -104,6 +490,27 @@ TextBuffer::~TextBuffer()
     Q_ASSERT(m_invalidCursors.empty());
 }
 
+TextSnapshot TextBuffer::snapshot()
+{
+    // from now on, all existing lines are shared with the snapshot
+    ++m_snapshotGeneration;
+
+    TextSnapshot snapshot;
+    snapshot.m_blocks.reserve(m_blocks.size());
+    snapshot.m_blockStartLines.reserve(m_blocks.size());
+
+    int startLine = 0;
+    foreach (TextBlock *block, m_blocks) {
+        snapshot.m_blocks.append(block->lineList());
+        snapshot.m_blockStartLines.append(startLine);
+        startLine += block->lines();
+    }
+
+    snapshot.m_lines = m_lines;
+    snapshot.m_revision = m_revision;
+    return snapshot;
+}
+
 void TextBuffer::invalidateRanges()
 {
     // invalidate all ranges, work on copy, they might delete themself...
@@ -135,6 +542,7 @@ void TextBuffer::clear()
 
     // insert one block with one empty line
     m_blocks.append(newBlock);
+    rebuildBlockIndex();
 
     // reset lines and last used block
     m_lines = 1;
@@ -165,6 +573,75 @@ TextLine TextBuffer::line(int line) const
     return m_blocks.at(blockIndex)->line(line);
 }
 
+TextLineArena *TextBuffer::lineArena(int line) const
+{
+    return m_blocks.at(blockForLine(line))->arena();
+}
+
+qint64 TextBuffer::cursorToOffset(const KTextEditor::Cursor &position) const
+{
+    // only allow valid lines
+    if (position.line() < 0 || position.line() >= lines() || position.column() < 0) {
+        return -1;
+    }
+
+    // start of the block, then walk over the lines in front of the position
+    const int blockIndex = blockForLine(position.line());
+    const TextBlock *block = m_blocks.at(blockIndex);
+    qint64 offset = blockStartOffset(blockIndex);
+    for (int line = block->startLine(); line < position.line(); ++line) {
+        offset += block->line(line)->length() + 1;
+    }
+
+    return offset + qMin(position.column(), block->line(position.line())->length());
+}
+
+KTextEditor::Cursor TextBuffer::offsetToCursor(qint64 offset) const
+{
+    if (offset < 0) {
+        return KTextEditor::Cursor::invalid();
+    }
+
+    /**
+     * descend the block index: find the first block whose characters sum up to more than offset
+     * the index counts a line break for the last line, too, so the end of the text is found in the last block
+     */
+    const int blockCount = m_blocks.size();
+    int step = 1;
+    while (2 * step <= blockCount) {
+        step *= 2;
+    }
+
+    int index = 0;
+    qint64 remaining = offset;
+    for (; step > 0; step /= 2) {
+        if ((index + step) <= blockCount && m_blockCharactersTree.at(index + step) <= remaining) {
+            index += step;
+            remaining -= m_blockCharactersTree.at(index);
+        }
+    }
+
+    // behind the end of the text
+    if (index >= blockCount) {
+        return KTextEditor::Cursor::invalid();
+    }
+
+    // walk over the lines of the found block
+    const TextBlock *block = m_blocks.at(index);
+    const int endLine = block->startLine() + block->lines();
+    for (int line = block->startLine(); line < endLine; ++line) {
+        const int length = block->line(line)->length();
+        if (remaining <= length) {
+            return KTextEditor::Cursor(line, int(remaining));
+        }
+        remaining -= length + 1;
+    }
+
+    // not reached, the block index contains the characters of this block
+    Q_ASSERT(false);
+    return KTextEditor::Cursor::invalid();
+}
+
 QString TextBuffer::text() const
 {
     QString text;
@@ -250,6 +727,7 @@ void TextBuffer::wrapLine(const KTextEditor::Cursor &position)
      */
     ++m_lines; // first alter the line counter, as functions called will need the valid one
     m_blocks.at(blockIndex)->wrapLine(position, blockIndex);
+    fixStartOffsets(blockIndex);
 
     // remember changes
     ++m_revision;
@@ -299,6 +777,10 @@ void TextBuffer::unwrapLine(int line)
      */
     m_blocks.at(blockIndex)->unwrapLine(line, (blockIndex > 0) ? m_blocks.at(blockIndex - 1) : nullptr, firstLineInBlock ? (blockIndex - 1) : blockIndex);
     --m_lines;
+    fixStartOffsets(blockIndex);
+    if (firstLineInBlock) {
+        fixStartOffsets(blockIndex - 1);
+    }
 
     // decrement index for later fixup, if we modified the block in front of the found one
     if (firstLineInBlock) {
@@ -346,6 +828,7 @@ void TextBuffer::insertText(const KTextEditor::Cursor &position, const QString &
 
     // let the block handle the insertText
     m_blocks.at(blockIndex)->insertText(position, text);
+    fixStartOffsets(blockIndex);
 
     // remember changes
     ++m_revision;
@@ -359,6 +842,9 @@ void TextBuffer::insertText(const KTextEditor::Cursor &position, const QString &
         m_editingMaximalLineChanged = position.line();
     }
 
+    // balance the changed block if needed, the blocks are sized by text, too
+    balanceBlock(blockIndex);
+
     // emit signal about done change
     emit textInserted(position, text);
     if (m_document)
@@ -391,6 +877,7 @@ void TextBuffer::removeText(const KTextEditor::Range &range)
     // let the block handle the removeText, retrieve removed text
     QString text;
     m_blocks.at(blockIndex)->removeText(range, text);
+    fixStartOffsets(blockIndex);
 
     // remember changes
     ++m_revision;
@@ -404,12 +891,86 @@ void TextBuffer::removeText(const KTextEditor::Range &range)
         m_editingMaximalLineChanged = range.start().line();
     }
 
+    // balance the changed block if needed, the blocks are sized by text, too
+    balanceBlock(blockIndex);
+
     // emit signal about done change
     emit textRemoved(range, text);
     if (m_document)
         emit m_document->KTextEditor::Document::textRemoved(m_document, range, text);
 }
 
+void TextBuffer::replaceText(int line, const QVector<Kate::TextReplacement> &replacements)
+{
+    // debug output for REAL low-level debugging
+    BUFFER_DEBUG << "replaceText" << line << replacements.size();
+
+    // only allowed if editing transaction running
+    Q_ASSERT(m_editingTransactions > 0);
+
+    // skip work, if nothing to replace
+    if (replacements.isEmpty()) {
+        return;
+    }
+
+    // get block, this will assert on invalid line
+    int blockIndex = blockForLine(line);
+
+    /**
+     * notify the text history, one remove and one insert per replacement, like separate edits would do
+     * each entry is its own revision
+     */
+    const QString oldText = m_blocks.at(blockIndex)->line(line)->string();
+    int lineLength = oldText.size();
+    int shift = 0;
+    foreach (const TextReplacement &replacement, replacements) {
+        const int column = replacement.column + shift;
+        if (replacement.length > 0) {
+            m_history.removeText(KTextEditor::Range(line, column, line, column + replacement.length), lineLength);
+            lineLength -= replacement.length;
+            ++m_revision;
+        }
+        if (!replacement.text.isEmpty()) {
+            m_history.insertText(KTextEditor::Cursor(line, column), replacement.text.size(), lineLength);
+            lineLength += replacement.text.size();
+            ++m_revision;
+        }
+        shift += replacement.text.size() - replacement.length;
+    }
+
+    // let the block handle the text and the cursors
+    QStringList removedTexts;
+    m_blocks.at(blockIndex)->replaceText(line, replacements, removedTexts);
+    fixStartOffsets(blockIndex);
+
+    // update changed line interval
+    if (line < m_editingMinimalLineChanged || m_editingMinimalLineChanged == -1) {
+        m_editingMinimalLineChanged = line;
+    }
+
+    if (line > m_editingMaximalLineChanged) {
+        m_editingMaximalLineChanged = line;
+    }
+
+    // balance the changed block if needed, the blocks are sized by text, too
+    balanceBlock(blockIndex);
+
+    // emit signal about done change
+    emit textReplaced(line, replacements, removedTexts);
+
+    /**
+     * for the public interface, describe the change as one removal and one insertion
+     * of the span between the start of the first and the end of the last replacement
+     */
+    if (m_document) {
+        const int spanStart = replacements.first().column;
+        const int spanEnd = replacements.last().column + replacements.last().length;
+        const QString newSpan = TextBuffer::line(line)->string().mid(spanStart, spanEnd - spanStart + shift);
+        emit m_document->KTextEditor::Document::textRemoved(m_document, KTextEditor::Range(line, spanStart, line, spanEnd), oldText.mid(spanStart, spanEnd - spanStart));
+        emit m_document->KTextEditor::Document::textInserted(m_document, KTextEditor::Cursor(line, spanStart), newSpan);
+    }
+}
+
 int TextBuffer::blockForLine(int line) const
 {
     // only allow valid lines
@@ -439,39 +1000,33 @@ int TextBuffer::blockForLine(int line) const
 
     /**
      * search for right block
-     * use binary search
-     * if we leave this loop not by returning the found element we have an error
-     */
-    int blockStart = 0;
-    int blockEnd = m_blocks.size() - 1;
-    while (blockEnd >= blockStart) {
-        // get middle and ensure it is OK
-        int middle = blockStart + ((blockEnd - blockStart) / 2);
-        Q_ASSERT(middle >= 0);
-        Q_ASSERT(middle < m_blocks.size());
-
-        // facts bout this block
-        TextBlock *block = m_blocks[middle];
-        const int start = block->startLine();
-        const int lines = block->lines();
-
-        // right block found, remember it and return it
-        if (start <= line && line < (start + lines)) {
-            m_lastUsedBlock = middle;
-            return middle;
-        }
+     * descend the block index: find the first block whose lines sum up to more than line
+     * empty blocks are skipped automatically
+     */
+    const int blockCount = m_blocks.size();
+    int step = 1;
+    while (2 * step <= blockCount) {
+        step *= 2;
+    }
 
-        // half our stuff ;)
-        if (line < start) {
-            blockEnd = middle - 1;
-        } else {
-            blockStart = middle + 1;
+    int index = 0;
+    int remainingLines = line;
+    for (; step > 0; step /= 2) {
+        if ((index + step) <= blockCount && m_blockLinesTree.at(index + step) <= remainingLines) {
+            index += step;
+            remainingLines -= m_blockLinesTree.at(index);
         }
     }
 
     // we should always find a block
-    qFatal("line requested in text buffer (%d out of [0, %d[), no block found", line, lines());
-    return -1;
+    if (index >= blockCount) {
+        qFatal("line requested in text buffer (%d out of [0, %d[), no block found", line, lines());
+        return -1;
+    }
+
+    // right block found, remember it and return it
+    m_lastUsedBlock = index;
+    return index;
 }
 
 void TextBuffer::fixStartLines(int startBlock)
@@ -480,19 +1035,130 @@ void TextBuffer::fixStartLines(int startBlock)
     Q_ASSERT(startBlock >= 0);
     Q_ASSERT(startBlock < m_blocks.size());
 
-    // new start line for next block
-    TextBlock *block = m_blocks.at(startBlock);
-    int newStartLine = block->startLine() + block->lines();
+    // line count change of this block, nothing to do if it didn't change
+    const int delta = m_blocks.at(startBlock)->lines() - m_blockLines.at(startBlock);
+    if (delta == 0) {
+        return;
+    }
+
+    // update the block index, this implicitly fixes the start lines of all following blocks
+    m_blockLines[startBlock] += delta;
+    for (int i = startBlock + 1; i < m_blockLinesTree.size(); i += (i & -i)) {
+        m_blockLinesTree[i] += delta;
+    }
+
+    // invalidate the cached start lines
+    ++m_blockIndexGeneration;
+}
+
+int TextBuffer::blockStartLine(int index) const
+{
+    // only allow valid block
+    Q_ASSERT(index >= 0);
+    Q_ASSERT(index < m_blocks.size());
+
+    // sum up the lines of all blocks in front of this one
+    int startLine = 0;
+    for (int i = index; i > 0; i -= (i & -i)) {
+        startLine += m_blockLinesTree.at(i);
+    }
+    return startLine;
+}
+
+void TextBuffer::fixStartOffsets(int index)
+{
+    // only allow valid block
+    Q_ASSERT(index >= 0);
+    Q_ASSERT(index < m_blocks.size());
+
+    // character count change of this block, nothing to do if it didn't change
+    const qint64 delta = m_blocks.at(index)->characters() + m_blocks.at(index)->lines() - m_blockCharacters.at(index);
+    if (delta == 0) {
+        return;
+    }
+
+    // update the block index, this implicitly fixes the start offsets of all following blocks
+    m_blockCharacters[index] += delta;
+    for (int i = index + 1; i < m_blockCharactersTree.size(); i += (i & -i)) {
+        m_blockCharactersTree[i] += delta;
+    }
+}
+
+qint64 TextBuffer::blockStartOffset(int index) const
+{
+    // only allow valid block
+    Q_ASSERT(index >= 0);
+    Q_ASSERT(index < m_blocks.size());
+
+    // sum up the characters of all blocks in front of this one
+    qint64 startOffset = 0;
+    for (int i = index; i > 0; i -= (i & -i)) {
+        startOffset += m_blockCharactersTree.at(i);
+    }
+    return startOffset;
+}
 
-    // fixup block
-    for (int index = startBlock + 1; index < m_blocks.size(); ++index) {
-        // set new start line
-        block = m_blocks.at(index);
-        block->setStartLine(newStartLine);
+void TextBuffer::rebuildBlockIndex(int startBlock)
+{
+    // renumber the blocks
+    for (int index = startBlock; index < m_blocks.size(); ++index) {
+        m_blocks.at(index)->setBlockIndex(index);
+    }
 
-        // calculate next start line
-        newStartLine += block->lines();
+    // rebuild the Fenwick tree in linear time
+    const int blockCount = m_blocks.size();
+    m_blockLines.resize(blockCount);
+    m_blockLinesTree.fill(0, blockCount + 1);
+    m_blockCharacters.resize(blockCount);
+    m_blockCharactersTree.fill(0, blockCount + 1);
+    for (int index = 0; index < blockCount; ++index) {
+        m_blockLines[index] = m_blocks.at(index)->lines();
+        m_blockLinesTree[index + 1] += m_blockLines.at(index);
+        m_blockCharacters[index] = m_blocks.at(index)->characters() + m_blocks.at(index)->lines();
+        m_blockCharactersTree[index + 1] += m_blockCharacters.at(index);
+
+        const int parent = (index + 1) + ((index + 1) & -(index + 1));
+        if (parent <= blockCount) {
+            m_blockLinesTree[parent] += m_blockLinesTree.at(index + 1);
+            m_blockCharactersTree[parent] += m_blockCharactersTree.at(index + 1);
+        }
     }
+
+    // invalidate the cached start lines
+    ++m_blockIndexGeneration;
+}
+
+void TextBuffer::appendToBlockIndex(int lastIndexedBlock)
+{
+    // the last indexed block got lines, too
+    fixStartLines(lastIndexedBlock);
+    fixStartOffsets(lastIndexedBlock);
+
+    // append the new blocks, a tree node sums up its own block and the nodes it covers, O(log n) per block
+    const int blockCount = m_blocks.size();
+    for (int index = m_blockLines.size(); index < blockCount; ++index) {
+        m_blocks.at(index)->setBlockIndex(index);
+        m_blockLines.append(m_blocks.at(index)->lines());
+        m_blockCharacters.append(m_blocks.at(index)->characters() + m_blocks.at(index)->lines());
+
+        const int node = index + 1;
+        int nodeLines = m_blockLines.at(index);
+        qint64 nodeCharacters = m_blockCharacters.at(index);
+        for (int i = node - 1; i > node - (node & -node); i -= (i & -i)) {
+            nodeLines += m_blockLinesTree.at(i);
+            nodeCharacters += m_blockCharactersTree.at(i);
+        }
+        m_blockLinesTree.append(nodeLines);
+        m_blockCharactersTree.append(nodeCharacters);
+    }
+
+    // invalidate the cached start lines
+    ++m_blockIndexGeneration;
+}
+
+qint64 TextBuffer::blockWeight(int lines, int characters)
+{
+    return lines * KATE_BLOCK_LINE_OVERHEAD + characters * qint64(sizeof(QChar));
 }
 
 void TextBuffer::balanceBlock(int index)
@@ -501,16 +1167,25 @@ void TextBuffer::balanceBlock(int index)
      * two cases, too big or too small block
      */
     TextBlock *blockToBalance = m_blocks.at(index);
+    const qint64 targetWeight = m_targetBlockWeight;
+    const qint64 weight = blockWeight(blockToBalance->lines(), blockToBalance->characters());
 
     // first case, too big one, split it
-    if (blockToBalance->lines() >= 2 * m_blockSize) {
-        // half the block
-        int halfSize = blockToBalance->lines() / 2;
+    if (blockToBalance->lines() >= 2 && weight >= 2 * targetWeight) {
+        // half the block by weight, blocks with lines of different length are split where half of the text is
+        int halfSize = 0;
+        qint64 halfWeight = 0;
+        while (halfSize < (blockToBalance->lines() - 1) && 2 * halfWeight < weight) {
+            halfWeight += blockWeight(1, blockToBalance->line(blockToBalance->startLine() + halfSize)->length());
+            ++halfSize;
+        }
+        halfSize = qMax(1, halfSize);
 
         // create and insert new block behind current one, already set right start line
         TextBlock *newBlock = blockToBalance->splitBlock(halfSize);
         Q_ASSERT(newBlock);
         m_blocks.insert(m_blocks.begin() + index + 1, newBlock);
+        rebuildBlockIndex(index + 1);
 
         // split is done
         return;
@@ -525,7 +1200,7 @@ void TextBuffer::balanceBlock(int index)
     }
 
     // block still large enough, do nothing
-    if (2 * blockToBalance->lines() > m_blockSize) {
+    if (2 * weight > targetWeight) {
         return;
     }
 
@@ -538,12 +1213,13 @@ void TextBuffer::balanceBlock(int index)
     // delete old block
     delete blockToBalance;
     m_blocks.erase(m_blocks.begin() + index);
+    rebuildBlockIndex(index);
 }
 
 void TextBuffer::debugPrint(const QString &title) const
 {
     // print header with title
-    printf("%s (lines: %d bs: %d)\n", qPrintable(title), m_lines, m_blockSize);
+    printf("%s (lines: %d bs: %lld)\n", qPrintable(title), m_lines, static_cast<long long>(m_targetBlockWeight));
 
     // print all blocks
     for (int i = 0; i < m_blocks.size(); ++i) {
@@ -551,6 +1227,51 @@ void TextBuffer::debugPrint(const QString &title) const
     }
 }
 
+TextBuffer::DebugStatistics TextBuffer::debugStatistics() const
+{
+    DebugStatistics statistics;
+    statistics.blocks = m_blocks.size();
+    statistics.lines = m_lines;
+    statistics.minLinesPerBlock = m_lines;
+
+    // heap allocations have a header with ref-count, size and alloc
+    const qint64 arrayHeader = sizeof(QArrayData);
+    QSet<const void *> contextStacks;
+    foreach (TextBlock *block, m_blocks) {
+        statistics.characters += block->characters();
+        statistics.minLinesPerBlock = qMin(statistics.minLinesPerBlock, block->lines());
+        statistics.maxLinesPerBlock = qMax(statistics.maxLinesPerBlock, block->lines());
+        block->addStatistics(statistics.cursors, statistics.cachedRanges, statistics.uncachedRanges, statistics.rangeCacheLines);
+
+        for (int line = block->startLine(); line < block->startLine() + block->lines(); ++line) {
+            const TextLine textLine = block->line(line);
+
+            // line data + shared pointer control block
+            statistics.lineBytes += sizeof(TextLineData) + 2 * sizeof(void *);
+
+            if (textLine->text().capacity() > 0) {
+                statistics.lineBytes += arrayHeader + textLine->text().capacity() * sizeof(QChar);
+            }
+
+            // short attribute lists are part of the line data
+            statistics.attributes += textLine->attributesList().size();
+            statistics.attributeBytes += textLine->attributesList().allocatedBytes();
+            statistics.lineBytes += textLine->attributesList().allocatedBytes();
+
+            const TextLineData::ContextStack &stack = textLine->contextStack();
+            if (stack.capacity() > 0 && !contextStacks.contains(stack.constData())) {
+                contextStacks.insert(stack.constData());
+                statistics.lineBytes += arrayHeader + stack.capacity() * sizeof(short);
+            }
+        }
+    }
+
+    // invalid cursors are not part of any block
+    statistics.cursors += m_invalidCursors.size();
+
+    return statistics;
+}
+
 bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLongLinesWrapped, int &longestLineLoaded, bool enforceTextCodec)
 {
     // fallback codec must exist
@@ -562,6 +1283,7 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
     /**
      * first: clear buffer in any case!
      */
+    stopLoading();
     clear();
 
     /**
@@ -570,133 +1292,195 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
     Kate::TextLoader file(filename, m_encodingProberType);
 
     /**
-     * triple play, maximal three loading rounds
-     * 0) use the given encoding, be done, if no encoding errors happen
-     * 1) use BOM to decided if Unicode or if that fails, use encoding prober, if no encoding errors happen, be done
-     * 2) use fallback encoding, be done, if no encoding errors happen
-     * 3) use again given encoding, be done in any case
+     * read the lines directly into our blocks
      */
-    for (int i = 0; i < (enforceTextCodec ? 1 : 4);  ++i) {
-        /**
-         * kill all blocks beside first one
-         */
-        for (int b = 1; b < m_blocks.size(); ++b) {
-            TextBlock *block = m_blocks.at(b);
-            block->clearLines();
-            delete block;
+    struct BlockSink {
+        TextBuffer *buffer;
+        void reset()
+        {
+            buffer->clearForLoading();
         }
-        m_blocks.resize(1);
-
-        /**
-         * remove lines in first block
-         */
-        m_blocks.last()->clearLines();
-        m_lines = 0;
-
-        /**
-         * try to open file, with given encoding
-         * in round 0 + 3 use the given encoding from user
-         * in round 1 use 0, to trigger detection
-         * in round 2 use fallback
-         */
-        QTextCodec *codec = m_textCodec;
-        if (i == 1) {
-            codec = nullptr;
-        } else if (i == 2) {
-            codec = m_fallbackTextCodec;
+        void append(const QString &textLine)
+        {
+            buffer->appendLoadedLine(textLine);
         }
-
-        if (!file.open(codec)) {
-            // create one dummy textline, in any case
-            m_blocks.last()->appendLine(QString());
-            m_lines++;
+        bool canceled() const
+        {
             return false;
         }
+    } sink = { this };
 
-        // read in all lines...
-        encodingErrors = false;
-        while (!file.eof()) {
-            // read line
-            int offset = 0, length = 0;
-            bool currentError = !file.readLine(offset, length);
-            encodingErrors = encodingErrors || currentError;
+    if (!readLines(file, sink, m_textCodec, m_fallbackTextCodec, enforceTextCodec, m_lineLengthLimit, encodingErrors, tooLongLinesWrapped, longestLineLoaded)) {
+        // create one dummy textline, in any case
+        appendLoadedLine(QString());
+        rebuildBlockIndex();
+        return false;
+    }
 
-            // bail out on encoding error, if not last round!
-            if (encodingErrors && i < (enforceTextCodec ? 0 : 3)) {
-                BUFFER_DEBUG << "Failed try to load file" << filename << "with codec" << (file.textCodec() ? file.textCodec()->name() : "(null)");
-                break;
-            }
+    // all blocks are there, index them
+    rebuildBlockIndex();
 
-            // get Unicode data for this line
-            const QChar *unicodeData = file.unicode() + offset;
+    // remember codec, bom, eol, ...
+    finishLoad(file, filename, encodingErrors);
 
+    // file loading worked, modulo encoding problems
+    return true;
+}
 
-            if (longestLineLoaded < length) longestLineLoaded=length;
+void TextBuffer::startLoading(const QString &filename, bool enforceTextCodec)
+{
+    // fallback codec must exist
+    Q_ASSERT(m_fallbackTextCodec);
 
-            /**
-             * split lines, if too large
-             */
-            do {
-                /**
-                 * calculate line length
-                 */
-                int lineLength = length;
-                if ((m_lineLengthLimit > 0) && (lineLength > m_lineLengthLimit)) {
-                    /**
-                     * search for place to wrap
-                     */
-                    int spacePosition = m_lineLengthLimit - 1;
-                    for (int testPosition = m_lineLengthLimit - 1; (testPosition >= 0) && (testPosition >= (m_lineLengthLimit - (m_lineLengthLimit / 10))); --testPosition) {
-                        /**
-                         * wrap place found?
-                         */
-                        if (unicodeData[testPosition].isSpace() || unicodeData[testPosition].isPunct()) {
-                            spacePosition = testPosition;
-                            break;
-                        }
-                    }
+    // codec must be set!
+    Q_ASSERT(m_textCodec);
 
-                    /**
-                     * wrap the line
-                     */
-                    lineLength = spacePosition + 1;
-                    length -= lineLength;
-                    tooLongLinesWrapped = true;
-                } else {
-                    /**
-                     * be done after this round
-                     */
-                    length = 0;
-                }
+    /**
+     * first: clear buffer in any case!
+     * the empty line stays until the first lines arrive, views need at least one line
+     */
+    stopLoading();
+    clear();
+    m_loadingPlaceholder = true;
 
-                /**
-                 * construct new text line with content from file
-                 * move data pointer
-                 */
-                QString textLine(unicodeData, lineLength);
-                unicodeData += lineLength;
+    /**
+     * let the thread do the decoding, it will call importLoadedLines for each batch
+     */
+    m_loaderThread = new TextLoaderThread(this, filename, m_encodingProberType, m_textCodec, m_fallbackTextCodec, enforceTextCodec, m_lineLengthLimit);
+    m_loaderThread->start();
+}
 
-                /**
-                 * ensure blocks aren't too large
-                 */
-                if (m_blocks.last()->lines() >= m_blockSize) {
-                    m_blocks.append(new TextBlock(this, m_blocks.last()->startLine() + m_blocks.last()->lines()));
-                }
+void TextBuffer::cancelLoading()
+{
+    if (!m_loaderThread) {
+        return;
+    }
 
-                /**
-                 * append line to last block
-                 */
-                m_blocks.last()->appendLine(textLine);
-                ++m_lines;
-            } while (length > 0);
+    stopLoading();
+
+    // drop what we got so far
+    clear();
+}
+
+void TextBuffer::stopLoading()
+{
+    if (!m_loaderThread) {
+        return;
+    }
+
+    // pending imports will find no thread and do nothing
+    m_loaderThread->cancel();
+    m_loaderThread->wait();
+    delete m_loaderThread;
+    m_loaderThread = nullptr;
+    m_loadingPlaceholder = false;
+}
+
+void TextBuffer::importLoadedLines()
+{
+    // canceled meanwhile or stale call for already imported lines
+    if (!m_loaderThread) {
+        return;
+    }
+
+    bool restarted = false;
+    bool done = false;
+    const QVector<QString> lines = m_loaderThread->takeLines(restarted, done);
+
+    /**
+     * new loading round => the lines we have are garbage
+     */
+    if (restarted && !m_loadingPlaceholder) {
+        clear();
+        m_loadingPlaceholder = true;
+    }
+
+    if (!lines.isEmpty()) {
+        if (m_loadingPlaceholder) {
+            clearForLoading();
+            m_loadingPlaceholder = false;
         }
 
-        // if no encoding error, break out of reading loop
-        if (!encodingErrors) {
-            // remember used codec, might change bom setting
-            setTextCodec(file.textCodec());
-            break;
+        // only the last block and the new ones changed
+        const int firstChangedBlock = m_blocks.size() - 1;
+        foreach (const QString &textLine, lines) {
+            appendLoadedLine(textLine);
         }
+        appendToBlockIndex(firstChangedBlock);
+
+        emit loadingProgress(m_lines);
+    }
+
+    if (!done) {
+        return;
+    }
+
+    /**
+     * thread is done, take over results and get rid of it
+     */
+    TextLoaderThread *loader = m_loaderThread;
+    loader->wait();
+    m_loaderThread = nullptr;
+    m_loadingPlaceholder = false;
+
+    if (loader->m_success) {
+        finishLoad(*loader->m_file, loader->m_filename, loader->m_encodingErrors);
+    }
+
+    const bool success = loader->m_success;
+    const bool encodingErrors = loader->m_encodingErrors;
+    const bool tooLongLinesWrapped = loader->m_tooLongLinesWrapped;
+    const int longestLineLoaded = loader->m_longestLineLoaded;
+    delete loader;
+
+    emit loadingFinished(success, encodingErrors, tooLongLinesWrapped, longestLineLoaded);
+}
+
+void TextBuffer::clearForLoading()
+{
+    /**
+     * kill all blocks beside first one
+     */
+    for (int b = 1; b < m_blocks.size(); ++b) {
+        TextBlock *block = m_blocks.at(b);
+        block->clearLines();
+        delete block;
+    }
+    m_blocks.resize(1);
+
+    /**
+     * remove lines in first block
+     */
+    m_blocks.last()->clearLines();
+    m_lines = 0;
+
+    /**
+     * the loaded lines get appended to this index, see appendToBlockIndex()
+     */
+    rebuildBlockIndex();
+}
+
+void TextBuffer::appendLoadedLine(const QString &textLine)
+{
+    /**
+     * ensure blocks aren't too large
+     */
+    if (blockWeight(m_blocks.last()->lines(), m_blocks.last()->characters()) >= m_targetBlockWeight) {
+        m_blocks.append(new TextBlock(this, m_blocks.size()));
+    }
+
+    /**
+     * append line to last block
+     */
+    m_blocks.last()->appendLine(textLine);
+    ++m_lines;
+}
+
+void TextBuffer::finishLoad(TextLoader &file, const QString &filename, bool encodingErrors)
+{
+    // remember used codec, might change bom setting
+    if (!encodingErrors) {
+        setTextCodec(file.textCodec());
     }
 
     // save checksum of file on disk
@@ -729,9 +1513,6 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
 
     // emit success
     emit loaded(filename, encodingErrors);
-
-    // file loading worked, modulo encoding problems
-    return true;
 }
 
 const QByteArray &TextBuffer::digest() const
@@ -787,18 +1568,6 @@ bool TextBuffer::save(const QString &filename)
         return false;
     }
 
-    /**
-     * construct stream + disable Unicode headers
-     */
-    QTextStream stream(&file);
-    stream.setCodec(QTextCodec::codecForName("UTF-16"));
-
-    // set the correct codec
-    stream.setCodec(m_textCodec);
-
-    // generate byte order mark?
-    stream.setGenerateByteOrderMark(generateByteOrderMark());
-
     // our loved eol string ;)
     QString eol = QStringLiteral("\n"); //m_doc->config()->eolString ();
     if (endOfLineMode() == eolDos) {
@@ -807,30 +1576,103 @@ bool TextBuffer::save(const QString &filename)
         eol = QStringLiteral("\r");
     }
 
-    // just dump the lines out ;)
-    for (int i = 0; i < m_lines; ++i) {
-        // get line to save
-        Kate::TextLine textline = line(i);
+    // newline at the end of the file wanted?
+    bool eolAtEof = false;
+    if (m_newLineAtEof) {
+        Q_ASSERT(m_lines > 0); // see .h file
+        const Kate::TextLine lastLine = line(m_lines - 1);
+        const int firstChar = lastLine->firstChar();
+        eolAtEof = (firstChar > -1 || lastLine->length() > 0);
+    }
 
-        stream << textline->text();
+    /**
+     * split the buffer into chunks of whole blocks, each chunk start is the index of its first block
+     */
+    QVector<int> chunkStarts;
+    int chunkCharacters = KATE_SAVE_CHUNK_CHARACTERS;
+    for (int b = 0; b < m_blocks.size(); ++b) {
+        if (chunkCharacters >= KATE_SAVE_CHUNK_CHARACTERS) {
+            chunkStarts.append(b);
+            chunkCharacters = 0;
+        }
+        chunkCharacters += m_blocks.at(b)->characters() + m_blocks.at(b)->lines() * eol.size();
+    }
+    chunkStarts.append(m_blocks.size());
+    const int chunkCount = chunkStarts.size() - 1;
 
-        // append correct end of line string
-        if ((i + 1) < m_lines) {
-            stream << eol;
+    /**
+     * stateless codecs: encode the chunks in the thread pool, while we write the finished ones in order
+     * else: encode one after the other here, with one converter state for all of them
+     * generate byte order mark only at the start, like QTextStream does
+     */
+    const bool parallel = (chunkCount > 1) && encodesLinesIndependently(m_textCodec);
+    const int window = parallel ? qMax(2, 2 * workerPool()->maxThreadCount()) : 1;
+    QVector<TextSaveChunk *> jobs;
+    QVector<QTextCodec::ConverterState *> states;
+    for (int i = 0; i < qMin(window, chunkCount); ++i) {
+        jobs.append(new TextSaveChunk());
+        jobs.last()->m_codec = m_textCodec;
+        jobs.last()->m_eol = eol;
+        if (i == 0 || parallel) {
+            states.append(new QTextCodec::ConverterState(QTextCodec::IgnoreHeader));
         }
+        jobs.last()->m_state = states.last();
+    }
+    if (generateByteOrderMark()) {
+        states.first()->flags = QTextCodec::DefaultConversion;
     }
 
-    if (m_newLineAtEof) {
-        Q_ASSERT(m_lines > 0); // see .h file
-        const Kate::TextLine lastLine = line(m_lines - 1);
-        const int firstChar = lastLine->firstChar();
-        if (firstChar > -1 || lastLine->length() > 0) {
-            stream << eol;
+    /**
+     * snapshot the lines of the given chunk into a free job and start it
+     */
+    int startedChunks = 0;
+    auto startChunk = [&](int chunk) {
+        TextSaveChunk *job = jobs.at(chunk % window);
+        for (int b = chunkStarts.at(chunk); b < chunkStarts.at(chunk + 1); ++b) {
+            m_blocks.at(b)->appendLinesTo(job->m_lines);
+        }
+        job->m_appendEol = ((chunk + 1) < chunkCount) || eolAtEof;
+
+        if (parallel) {
+            workerPool()->start(job);
+        }
+        startedChunks = chunk + 1;
+    };
+
+    for (int chunk = 0; chunk < jobs.size(); ++chunk) {
+        startChunk(chunk);
+    }
+
+    // write the chunks in order, keep the pipeline filled
+    bool writeOk = true;
+    int writtenChunks = 0;
+    for (; writtenChunks < chunkCount; ++writtenChunks) {
+        TextSaveChunk *job = jobs.at(writtenChunks % window);
+        if (parallel) {
+            job->m_done.acquire();
+        } else {
+            job->encode();
+        }
+
+        if (!job->m_data.isEmpty() && file.write(job->m_data) != job->m_data.size()) {
+            writeOk = false;
+            break;
+        }
+
+        if ((writtenChunks + window) < chunkCount) {
+            startChunk(writtenChunks + window);
+        }
+    }
+
+    // on errors, wait for the chunks still running, the failed one is already done
+    if (parallel && !writeOk) {
+        for (int chunk = writtenChunks + 1; chunk < startedChunks; ++chunk) {
+            jobs.at(chunk % window)->m_done.acquire();
         }
     }
 
-    // flush stream
-    stream.flush();
+    qDeleteAll(jobs);
+    qDeleteAll(states);
 
     // close and delete file
     file.close();
@@ -850,8 +1692,8 @@ bool TextBuffer::save(const QString &filename)
 #endif
 
     // did save work?
-    // only finalize if stream status == OK
-    bool ok = (stream.status() == QTextStream::Ok) && saveFile.commit();
+    // only finalize if all writes worked
+    bool ok = writeOk && saveFile.commit();
 
     // remember this revision as last saved if we had success!
     if (ok) {
@@ -26,6 +26,7 @@
 #include <QVector>
 #include <QSet>
 #include <QTextCodec>
+#include <QThreadPool>
 
 #include <ktexteditor/document.h>
 
@@ -35,6 +36,7 @@
 #include "katetextcursor.h"
 #include "katetextrange.h"
 #include "katetexthistory.h"
+#include "katetextsnapshot.h"
 
 // encoding prober
 #include <KEncodingProber>
@@ -42,6 +44,9 @@
 namespace Kate
 {
 
+class TextLoader;
+class TextLoaderThread;
+
 /**
  * Class representing a text buffer.
  * The interface is line based, internally the text will be stored in blocks of text lines.
@@ -68,10 +73,13 @@ public:
     /**
      * Construct an empty text buffer.
      * Empty means one empty line in one block.
+     * Blocks are sized by their memory footprint, not by the number of lines: the buffer tries to
+     * hold blockSize bytes of lines + text per block. Blocks of short lines will hold more lines,
+     * blocks of long lines less.
      * @param parent parent qobject
-     * @param blockSize block size in lines the buffer should try to hold, default 64 lines
+     * @param blockSize bytes per block the buffer should try to hold, default 16 kb, tests pass 1 to get blocks of one line each
      */
-    TextBuffer(KTextEditor::DocumentPrivate *parent, int blockSize = 64);
+    TextBuffer(KTextEditor::DocumentPrivate *parent, int blockSize = 16 * 1024);
 
     /**
      * Destruct the text buffer
@@ -210,6 +218,33 @@ public:
      */
     virtual bool load(const QString &filename, bool &encodingErrors, bool &tooLongLinesWrapped, int &longestLineLoaded, bool enforceTextCodec);
 
+    /**
+     * Load the given file in the background. This will first clear the buffer and then start
+     * a thread that decodes the file, exactly like load() would do.
+     * The lines are appended to the buffer in batches while the thread is running,
+     * loadingProgress() is emitted after each batch, loadingFinished() at the end.
+     * Until then, the buffer must not be edited.
+     * Before calling this, setTextCodec must have been used to set codec!
+     * @param filename file to open
+     * @param enforceTextCodec enforce to use only the set text codec
+     */
+    void startLoading(const QString &filename, bool enforceTextCodec);
+
+    /**
+     * Abort a running background loading, the buffer will be cleared.
+     * Does nothing if no loading is running.
+     */
+    void cancelLoading();
+
+    /**
+     * Is a background loading started with startLoading() still running?
+     * @return loading running?
+     */
+    bool isLoading() const
+    {
+        return m_loaderThread;
+    }
+
     /**
      * Save the current buffer content to the given file.
      * Before calling this, setTextCodec and setFallbackTextCodec must have been used to set codec!
@@ -246,6 +281,28 @@ public:
      */
     TextLine line(int line) const;
 
+    /**
+     * Arena for the attribute lists of a text line, the one of its block.
+     * @param line wanted line number
+     * @return arena to pass to TextLineData::setAttributes()
+     */
+    TextLineArena *lineArena(int line) const;
+
+    /**
+     * Character offset of the given position in the whole text, each line break counts as one character.
+     * Uses the block index, O(log n) plus a walk over the lines of one block.
+     * @param position position, the column is clamped to the line length
+     * @return offset or -1 for a position outside of the buffer
+     */
+    qint64 cursorToOffset(const KTextEditor::Cursor &position) const;
+
+    /**
+     * Position of the given character offset, the inverse of cursorToOffset().
+     * @param offset character offset, each line break counts as one character
+     * @return position or an invalid cursor for an offset outside of the buffer
+     */
+    KTextEditor::Cursor offsetToCursor(qint64 offset) const;
+
     /**
      * Retrieve text of complete buffer.
      * @return text for this buffer, lines separated by '\n'
@@ -362,6 +419,15 @@ public:
      */
     virtual void removeText(const KTextEditor::Range &range);
 
+    /**
+     * Replace several column ranges of one line at once.
+     * This is equal to removing and inserting the texts of all replacements from front to back,
+     * but the line is only rebuilt once, cursors are moved once and only one textReplaced signal is emitted.
+     * @param line line to modify
+     * @param replacements replacements sorted by column, they must not overlap and their texts must not contain line breaks
+     */
+    void replaceText(int line, const QVector<Kate::TextReplacement> &replacements);
+
     /**
      * TextHistory of this buffer
      * @return text history for this buffer
@@ -371,6 +437,13 @@ public:
         return m_history;
     }
 
+    /**
+     * Take a snapshot of the current text, cost is O(blocks).
+     * The snapshot stays unchanged while the buffer is edited and may be read in other threads.
+     * @return snapshot of the buffer at the current revision
+     */
+    TextSnapshot snapshot();
+
 Q_SIGNALS:
     /**
      * Buffer got cleared. This is emitted when constructor or load have called clear() internally,
@@ -385,6 +458,22 @@ Q_SIGNALS:
      */
     void loaded(const QString &filename, bool encodingErrors);
 
+    /**
+     * Background loading appended lines to the buffer.
+     * @param lines number of lines loaded so far
+     */
+    void loadingProgress(int lines);
+
+    /**
+     * Background loading is done, emitted after loaded(), if the file could be read.
+     * Not emitted if the loading got canceled.
+     * @param success the file got loaded, perhaps with encoding errors
+     * @param encodingErrors were there problems occurred while decoding the file?
+     * @param tooLongLinesWrapped were too long lines found and wrapped?
+     * @param longestLineLoaded the longest line in the file (before wrapping)
+     */
+    void loadingFinished(bool success, bool encodingErrors, bool tooLongLinesWrapped, int longestLineLoaded);
+
     /**
      * Buffer saved successfully a file
      * @param filename file which was saved
@@ -427,6 +516,61 @@ Q_SIGNALS:
      */
     void textRemoved(const KTextEditor::Range &range, const QString &text);
 
+    /**
+     * Several parts of one line got replaced, see replaceText().
+     * @param line line the replacements happened in
+     * @param replacements the replacements, columns refer to the line before the change
+     * @param removedTexts replaced texts, one per replacement
+     */
+    void textReplaced(int line, const QVector<Kate::TextReplacement> &replacements, const QStringList &removedTexts);
+
+private Q_SLOTS:
+    /**
+     * Append the lines the loader thread has read meanwhile to the buffer.
+     * Finishes the loading, if the thread is done.
+     */
+    void importLoadedLines();
+
+private:
+    /**
+     * Remove all lines for a new loading round, leaves one empty block.
+     * Only to be used during loading, cursors must all be in the first block.
+     */
+    void clearForLoading();
+
+    /**
+     * Append a line read from the file, starts a new block if the last one is full.
+     * The block index is not updated, call rebuildBlockIndex() or appendToBlockIndex() afterwards.
+     * @param textLine line to append
+     */
+    void appendLoadedLine(const QString &textLine);
+
+    /**
+     * Take over the properties of a loaded file: codec, checksum, byte order mark,
+     * end of line mode and mime-type, and emit loaded().
+     * @param file loader the lines were read with
+     * @param filename file that was loaded
+     * @param encodingErrors were there problems occurred while decoding the file?
+     */
+    void finishLoad(TextLoader &file, const QString &filename, bool encodingErrors);
+
+protected:
+    /**
+     * Stop the background loading, if any, without touching the buffer content.
+     * Derived classes must call this in their destructor.
+     */
+    void stopLoading();
+
+    /**
+     * Thread pool for work the buffer waits for, like encoding on save.
+     * Separate from the global pool, there it would queue behind long running jobs of the views.
+     * @return worker pool of this buffer
+     */
+    QThreadPool *workerPool()
+    {
+        return &m_workerPool;
+    }
+
 private:
     /**
      * Find block containing given line.
@@ -436,17 +580,61 @@ private:
     int blockForLine(int line) const;
 
     /**
-     * Fix start lines of all blocks after the given one
+     * Fix start lines of all blocks after the given one.
+     * Updates the line count of the given block in the block index, O(log n).
      * @param startBlock index of block from which we start to fix
      */
     void fixStartLines(int startBlock);
 
+    /**
+     * Start line of the given block, computed with the block index, O(log n).
+     * @param index block index
+     * @return start line of the block
+     */
+    int blockStartLine(int index) const;
+
+    /**
+     * Fix the character count of the given block in the block index, O(log n).
+     * Must be called after text of the block changed, line breaks count as characters, too.
+     * @param index index of the changed block
+     */
+    void fixStartOffsets(int index);
+
+    /**
+     * Start offset of the given block, computed with the block index, O(log n).
+     * @param index block index
+     * @return character offset of the first line of the block
+     */
+    qint64 blockStartOffset(int index) const;
+
+    /**
+     * Renumber the blocks starting at the given one and rebuild the block index.
+     * Must be called after blocks got inserted or removed, O(n).
+     * @param startBlock index of first block that needs to be renumbered
+     */
+    void rebuildBlockIndex(int startBlock = 0);
+
+    /**
+     * Add the blocks appended behind the indexed ones to the block index, O(log n) per block.
+     * Used while loading, where only the last indexed block and new blocks behind it change.
+     * @param lastIndexedBlock index of the last block already in the block index
+     */
+    void appendToBlockIndex(int lastIndexedBlock);
+
     /**
      * Balance the given block. Look if it is too small or too large.
      * @param index block to balance
      */
     void balanceBlock(int index);
 
+    /**
+     * Approximated memory footprint of lines and text of the given block, used to balance the blocks.
+     * @param lines number of lines
+     * @param characters number of characters
+     * @return weight in bytes
+     */
+    static qint64 blockWeight(int lines, int characters);
+
     /**
      * Block for given index in block list.
      * @param index block index
@@ -487,6 +675,33 @@ public:
      */
     void debugPrint(const QString &title) const;
 
+    /**
+     * Statistics about the blocks of this buffer and their bookkeeping.
+     */
+    struct DebugStatistics {
+        int blocks = 0;
+        int lines = 0;
+        qint64 characters = 0;
+        int minLinesPerBlock = 0;
+        int maxLinesPerBlock = 0;
+        int cursors = 0;
+        int cachedRanges = 0;
+        int uncachedRanges = 0;
+        int rangeCacheLines = 0;
+        qint64 lineBytes = 0;
+        qint64 attributes = 0;
+        qint64 attributeBytes = 0;
+    };
+
+    /**
+     * Collect statistics about the blocks of this buffer, e.g. to measure the effect of the block size.
+     * lineBytes is the approximated heap memory used by the lines: line data, text, attributes and
+     * context stacks, stacks shared between lines are only counted once. attributeBytes is the part
+     * of it used by the arena slots of the attribute lists too long to be stored inline.
+     * @return block statistics
+     */
+    DebugStatistics debugStatistics() const;
+
     /**
      * Return the ranges which affect the given line.
      * @param line line to look at
@@ -532,6 +747,11 @@ private:
     QByteArray m_digest;
 
 private:
+    /**
+     * worker pool, see workerPool()
+     */
+    QThreadPool m_workerPool;
+
     /**
      * parent document
      */
@@ -543,20 +763,53 @@ private:
     TextHistory m_history;
 
     /**
-     * block size in lines the buffer will try to hold
+     * weight in bytes the buffer will try to hold per block, see blockWeight()
      */
-    const int m_blockSize;
+    const qint64 m_targetBlockWeight;
 
     /**
      * List of blocks which contain the lines of this buffer
      */
     QVector<TextBlock *> m_blocks;
 
+    /**
+     * Number of lines of each block, as known by the block index.
+     */
+    QVector<int> m_blockLines;
+
+    /**
+     * Block index: Fenwick tree over m_blockLines, 1-based.
+     * Allows to compute start lines of blocks and to find the block for a line in O(log n).
+     */
+    QVector<int> m_blockLinesTree;
+
+    /**
+     * Number of characters of each block including one line break per line, as known by the block index.
+     */
+    QVector<qint64> m_blockCharacters;
+
+    /**
+     * Fenwick tree over m_blockCharacters, 1-based, for the character offset of blocks in O(log n).
+     */
+    QVector<qint64> m_blockCharactersTree;
+
+    /**
+     * Generation of the block index, incremented on each change of it.
+     * Blocks use this to validate their cached start line.
+     */
+    quint64 m_blockIndexGeneration;
+
     /**
      * Number of lines in buffer
      */
     int m_lines;
 
+    /**
+     * Incremented for each snapshot, lines of older generations might be part of a snapshot
+     * and must be copied before their text is changed, see TextBlock::detachLine
+     */
+    quint32 m_snapshotGeneration;
+
     /**
      * Last used block in the buffer. Is used for speeding up blockForLine.
      * May contain invalid index, must be checked before using.
@@ -644,6 +897,16 @@ private:
      * Limit for line length, longer lines will be wrapped on load
      */
     int m_lineLengthLimit;
+
+    /**
+     * Thread doing a background loading started by startLoading(), if any
+     */
+    TextLoaderThread *m_loaderThread;
+
+    /**
+     * Buffer only contains the empty line of clear(), to be replaced by the first loaded lines
+     */
+    bool m_loadingPlaceholder;
 };
 
 }
@@ -19,18 +19,23 @@
  */
 
 #include "katetextline.h"
+#include "katetextlinearena.h"
+
+#include <algorithm>
 
 namespace Kate
 {
 
 TextLineData::TextLineData()
     : m_flags(0)
+    , m_snapshotGeneration(0)
 {
 }
 
 TextLineData::TextLineData(const QString &text)
     : m_text(text)
     , m_flags(0)
+    , m_snapshotGeneration(0)
 {
 }
 
@@ -192,17 +197,63 @@ int TextLineData::virtualLength(int tabWidth) const
     return x;
 }
 
-void TextLineData::addAttribute(const Attribute &attribute)
+TextLineData::Attributes::Attributes(const Attributes &other)
+    : m_size(0)
+{
+    assign(other.constData(), other.m_size, (other.m_size > InlineSize) ? TextLineArena::arena(other.m_slot) : nullptr);
+}
+
+TextLineData::Attributes::~Attributes()
+{
+    clear();
+}
+
+TextLineData::Attributes &TextLineData::Attributes::operator=(const Attributes &other)
+{
+    if (this != &other) {
+        assign(other.constData(), other.m_size, (other.m_size > InlineSize) ? TextLineArena::arena(other.m_slot) : nullptr);
+    }
+
+    return *this;
+}
+
+void TextLineData::Attributes::assign(const Attribute *attributes, int size, TextLineArena *arena)
 {
-    // try to append to previous range, if no folding info + same attribute value
-    if ((attribute.foldingValue == 0) && !m_attributesList.isEmpty() && (m_attributesList.back().foldingValue == 0)
-            && (m_attributesList.back().attributeValue == attribute.attributeValue)
-            && ((m_attributesList.back().offset + m_attributesList.back().length) == attribute.offset)) {
-        m_attributesList.back().length += attribute.length;
+    // short lists need no slot
+    if (size <= InlineSize) {
+        clear();
+        std::copy(attributes, attributes + size, m_inline);
+        m_size = size;
         return;
     }
 
-    m_attributesList.append(attribute);
+    // keep the slot if it fits and wastes at most half of it, like a new one would
+    if (m_size > InlineSize && TextLineArena::arena(m_slot) == arena
+            && TextLineArena::capacity(m_slot) >= size && TextLineArena::capacity(m_slot) < 2 * size) {
+        std::copy(attributes, attributes + size, m_slot);
+        m_size = size;
+        return;
+    }
+
+    Attribute *slot = TextLineArena::allocate(arena, size);
+    std::copy(attributes, attributes + size, slot);
+    clear();
+    m_slot = slot;
+    m_size = size;
+}
+
+void TextLineData::Attributes::clear()
+{
+    if (m_size > InlineSize) {
+        TextLineArena::release(m_slot);
+    }
+
+    m_size = 0;
+}
+
+int TextLineData::Attributes::allocatedBytes() const
+{
+    return (m_size > InlineSize) ? TextLineArena::slotBytes(m_slot) : 0;
 }
 
 }
@@ -30,6 +30,8 @@
 namespace Kate
 {
 
+class TextLineArena;
+
 /**
  * Class representing a single text line.
  * For efficience reasons, not only pure text is stored here, but also additional data.
@@ -90,6 +92,127 @@ public:
         short foldingValue;
     };
 
+    /**
+     * Attribute list of a line, see attributesList().
+     * Short lists are stored inline, longer ones in a slot of the TextLineArena of the block of the line.
+     * Copies are deep, they take a slot of the same arena.
+     */
+    class KTEXTEDITOR_EXPORT Attributes
+    {
+    public:
+        typedef const Attribute *const_iterator;
+
+        /**
+         * number of attributes stored without a slot
+         */
+        enum { InlineSize = 2 };
+
+        /**
+         * Construct an empty list.
+         */
+        Attributes()
+            : m_size(0)
+        {
+        }
+
+        /**
+         * Copy the attributes of another list.
+         * @param other list to copy
+         */
+        Attributes(const Attributes &other);
+
+        /**
+         * Destruct the list, gives back its slot.
+         */
+        ~Attributes();
+
+        /**
+         * Copy the attributes of another list.
+         * @param other list to copy
+         * @return this list
+         */
+        Attributes &operator=(const Attributes &other);
+
+        /**
+         * Replace the attributes.
+         * A slot is only taken if the list is too long to be stored inline, the slot of the current list is reused if it fits.
+         * @param attributes new attributes
+         * @param size number of new attributes
+         * @param arena arena for the slot, nullptr to allocate it on the heap
+         */
+        void assign(const Attribute *attributes, int size, TextLineArena *arena);
+
+        /**
+         * Remove all attributes, gives back the slot.
+         */
+        void clear();
+
+        /**
+         * Heap memory used by the list.
+         * @return bytes of the slot, 0 for lists stored inline
+         */
+        int allocatedBytes() const;
+
+        int size() const
+        {
+            return m_size;
+        }
+
+        int count() const
+        {
+            return m_size;
+        }
+
+        bool isEmpty() const
+        {
+            return m_size == 0;
+        }
+
+        const Attribute *constData() const
+        {
+            return (m_size > InlineSize) ? m_slot : m_inline;
+        }
+
+        const Attribute &at(int i) const
+        {
+            Q_ASSERT(i >= 0 && i < m_size);
+            return constData()[i];
+        }
+
+        const Attribute &operator[](int i) const
+        {
+            return at(i);
+        }
+
+        const_iterator begin() const
+        {
+            return constData();
+        }
+
+        const_iterator end() const
+        {
+            return constData() + m_size;
+        }
+
+    private:
+        union {
+            /**
+             * attributes of lists up to InlineSize
+             */
+            Attribute m_inline[InlineSize];
+
+            /**
+             * attributes of longer lists, in a slot taken by TextLineArena::allocate()
+             */
+            Attribute *m_slot;
+        };
+
+        /**
+         * number of attributes
+         */
+        int m_size;
+    };
+
     /**
      * Flags of TextLineData
      */
@@ -99,7 +222,8 @@ public:
         flagFoldingStartAttribute = 4,
         flagFoldingStartIndentation = 8,
         flagLineModified = 16,
-        flagLineSavedOnDisk = 32
+        flagLineSavedOnDisk = 32,
+        flagHlChained = 64
     };
 
     /**
@@ -285,6 +409,16 @@ public:
         return m_flags & flagHlContinue;
     }
 
+    /**
+     * Returns \e true, if the line got highlighted starting from the context stack
+     * the previous line has now and was not changed since.
+     * @return hl-chained flag is set
+     */
+    bool hlChained() const
+    {
+        return m_flags & flagHlChained;
+    }
+
     /**
      * Returns \e true, if the line was automagically wrapped, otherwise returns
      * \e false.
@@ -383,10 +517,14 @@ public:
     }
 
     /**
-     * Add attribute to this line.
-     * @param attribute new attribute to append
+     * Set the attributes of this line.
+     * @param attributes new attributes
+     * @param arena arena of the block of this line for long lists, nullptr to use the heap
      */
-    void addAttribute(const Attribute &attribute);
+    void setAttributes(const QVector<Attribute> &attributes, TextLineArena *arena)
+    {
+        m_attributesList.assign(attributes.constData(), attributes.size(), arena);
+    }
 
     /**
      * Clear attributes of this line
@@ -400,7 +538,7 @@ public:
      * Accessor to attributes
      * @return attributes of this line
      */
-    const QVector<Attribute> &attributesList() const
+    const Attributes &attributesList() const
     {
         return m_attributesList;
     }
@@ -440,6 +578,19 @@ public:
         }
     }
 
+    /**
+     * set hl chained flag
+     * @param chained line highlighted from the current state of the previous line?
+     */
+    void setHlChained(bool chained)
+    {
+        if (chained) {
+            m_flags = m_flags | flagHlChained;
+        } else {
+            m_flags = m_flags & ~ flagHlChained;
+        }
+    }
+
     /**
      * set auto-wrapped property
      * @param wrapped line was wrapped?
@@ -473,7 +624,7 @@ private:
     /**
      * attributes of this line
      */
-    QVector<Attribute> m_attributesList;
+    Attributes m_attributesList;
 
     /**
      * context stack of this line
@@ -484,6 +635,12 @@ private:
      * flags of this line
      */
     unsigned int m_flags;
+
+    /**
+     * snapshot generation of the buffer when this line was created, see TextBlock::detachLine
+     * fits into the padding after m_flags
+     */
+    quint32 m_snapshotGeneration;
 };
 
 /**
@@ -0,0 +1,128 @@
+/*  This file is part of the Kate project.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "katetextlinearena.h"
+
+#include <QMutexLocker>
+
+namespace Kate
+{
+
+TextLineArena::TextLineArena()
+    : m_ref(1)
+    , m_chunkRest(nullptr)
+    , m_chunkRestBytes(0)
+{
+    for (int i = 0; i < SizeClasses; ++i) {
+        m_freeSlots[i] = nullptr;
+    }
+}
+
+TextLineArena::~TextLineArena()
+{
+    // no slot is used anymore, they all held a reference
+    foreach (char *chunk, m_chunks) {
+        delete[] chunk;
+    }
+}
+
+int TextLineArena::sizeClass(int size, int &capacity)
+{
+    capacity = MinimalCapacity;
+    for (int i = 0; i < SizeClasses; ++i) {
+        if (size <= capacity) {
+            return i;
+        }
+        capacity *= 2;
+    }
+
+    capacity = size;
+    return -1;
+}
+
+TextLineArena::Slot *TextLineArena::takeFromChunk(int bytes)
+{
+    // the rest of the old chunk is lost, it is smaller than the largest slot
+    if (m_chunkRestBytes < bytes) {
+        m_chunkRest = new char[ChunkBytes];
+        m_chunkRestBytes = ChunkBytes;
+        m_chunks.append(m_chunkRest);
+    }
+
+    Slot *slot = reinterpret_cast<Slot *>(m_chunkRest);
+    m_chunkRest += bytes;
+    m_chunkRestBytes -= bytes;
+    return slot;
+}
+
+TextLineData::Attribute *TextLineArena::allocate(TextLineArena *arena, int size)
+{
+    Q_ASSERT(size > TextLineData::Attributes::InlineSize);
+
+    int capacity = 0;
+    const int index = sizeClass(size, capacity);
+    const int bytes = sizeof(Slot) + capacity * sizeof(TextLineData::Attribute);
+
+    // long lists and lines of no block, e.g. temporary ones, get an own allocation
+    if (!arena || index < 0) {
+        Slot *slot = reinterpret_cast<Slot *>(new char[sizeof(Slot) + size * sizeof(TextLineData::Attribute)]);
+        slot->arena = nullptr;
+        slot->capacity = size;
+        return reinterpret_cast<TextLineData::Attribute *>(slot + 1);
+    }
+
+    Slot *slot = nullptr;
+    {
+        QMutexLocker lock(&arena->m_mutex);
+        slot = arena->m_freeSlots[index];
+        if (slot) {
+            arena->m_freeSlots[index] = slot->nextFree;
+        } else {
+            slot = arena->takeFromChunk(bytes);
+        }
+    }
+
+    slot->arena = arena;
+    slot->capacity = capacity;
+    arena->ref();
+    return reinterpret_cast<TextLineData::Attribute *>(slot + 1);
+}
+
+void TextLineArena::release(TextLineData::Attribute *attributes)
+{
+    Slot *slot = TextLineArena::slot(attributes);
+    TextLineArena *arena = slot->arena;
+    if (!arena) {
+        delete[] reinterpret_cast<char *>(slot);
+        return;
+    }
+
+    int capacity = 0;
+    const int index = sizeClass(slot->capacity, capacity);
+    Q_ASSERT(index >= 0 && capacity == slot->capacity);
+    {
+        QMutexLocker lock(&arena->m_mutex);
+        slot->nextFree = arena->m_freeSlots[index];
+        arena->m_freeSlots[index] = slot;
+    }
+
+    // might be the last reference, if the block is gone
+    arena->deref();
+}
+
+}
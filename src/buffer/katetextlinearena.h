@@ -0,0 +1,217 @@
+/*  This file is part of the Kate project.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KATE_TEXTLINEARENA_H
+#define KATE_TEXTLINEARENA_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QVector>
+
+#include <ktexteditor_export.h>
+#include "katetextline.h"
+
+namespace Kate
+{
+
+/**
+ * Storage for the attribute lists of the lines of one TextBlock, the lists too long
+ * to be stored inline in the line, see TextLineData::Attributes.
+ *
+ * Lists are kept in slots of a few size classes, cut out of larger chunks, without
+ * an own heap allocation each. Freed slots are reused for the next list of their size class.
+ *
+ * Lines can live longer than their block, e.g. in a snapshot, or be moved to another block.
+ * Therefore the arena is reference counted: the block and each used slot hold one reference.
+ * Slots are taken and freed by the highlighting threads too, this is guarded by a mutex.
+ */
+class KTEXTEDITOR_EXPORT TextLineArena
+{
+public:
+    /**
+     * Construct an empty arena, the reference of the creator is already held.
+     */
+    TextLineArena();
+
+    /**
+     * Take one reference.
+     */
+    void ref()
+    {
+        m_ref.ref();
+    }
+
+    /**
+     * Release one reference, the arena is deleted with the last one.
+     */
+    void deref()
+    {
+        if (!m_ref.deref()) {
+            delete this;
+        }
+    }
+
+    /**
+     * Take a slot for the given number of attributes.
+     * Lists longer than the largest size class and lists without arena are allocated on the heap.
+     * @param arena arena to take the slot from, may be nullptr
+     * @param size number of attributes, must be larger than TextLineData::Attributes::InlineSize
+     * @return uninitialized attributes of the slot
+     */
+    static TextLineData::Attribute *allocate(TextLineArena *arena, int size);
+
+    /**
+     * Give back a slot taken by allocate().
+     * @param attributes attributes of the slot
+     */
+    static void release(TextLineData::Attribute *attributes);
+
+    /**
+     * Number of attributes the slot can hold.
+     * @param attributes attributes of a slot taken by allocate()
+     * @return capacity of the slot
+     */
+    static int capacity(const TextLineData::Attribute *attributes)
+    {
+        return slot(attributes)->capacity;
+    }
+
+    /**
+     * Arena of a slot.
+     * @param attributes attributes of a slot taken by allocate()
+     * @return arena of the slot, nullptr for slots on the heap
+     */
+    static TextLineArena *arena(const TextLineData::Attribute *attributes)
+    {
+        return slot(attributes)->arena;
+    }
+
+    /**
+     * Bytes used by a slot, including its header.
+     * @param attributes attributes of a slot taken by allocate()
+     * @return bytes of the slot
+     */
+    static int slotBytes(const TextLineData::Attribute *attributes)
+    {
+        return sizeof(Slot) + capacity(attributes) * sizeof(TextLineData::Attribute);
+    }
+
+private:
+    /**
+     * Only deref() deletes the arena.
+     */
+    ~TextLineArena();
+
+    /**
+     * Header in front of the attributes of each slot.
+     */
+    struct Slot {
+        union {
+            /**
+             * arena of the used slot, nullptr for a slot on the heap
+             */
+            TextLineArena *arena;
+
+            /**
+             * next free slot of the same size class
+             */
+            Slot *nextFree;
+        };
+
+        /**
+         * number of attributes the slot can hold
+         */
+        int capacity;
+    };
+
+    /**
+     * Header of the slot of the given attributes.
+     */
+    static Slot *slot(const TextLineData::Attribute *attributes)
+    {
+        return reinterpret_cast<Slot *>(const_cast<TextLineData::Attribute *>(attributes)) - 1;
+    }
+
+    /**
+     * Size class for the given number of attributes.
+     * @param size number of attributes
+     * @param capacity capacity of the size class, is set
+     * @return size class or -1 if the list is too long for the arena
+     */
+    static int sizeClass(int size, int &capacity);
+
+    /**
+     * Cut a new slot out of the current chunk, start a new chunk if it has no room left.
+     * The mutex must be locked.
+     * @param bytes bytes of the slot, including its header
+     * @return new slot
+     */
+    Slot *takeFromChunk(int bytes);
+
+private:
+    Q_DISABLE_COPY(TextLineArena)
+
+    /**
+     * smallest slot capacity, shorter lists are stored inline in the line
+     */
+    static const int MinimalCapacity = 4;
+
+    /**
+     * number of size classes, the capacity doubles from one to the next
+     */
+    static const int SizeClasses = 5;
+
+    /**
+     * bytes of one chunk, enough for slots of all size classes
+     */
+    static const int ChunkBytes = 4096;
+
+    /**
+     * references of the block and of the used slots
+     */
+    QAtomicInt m_ref;
+
+    /**
+     * guards the chunks and free slots
+     */
+    QMutex m_mutex;
+
+    /**
+     * all chunks, freed with the arena
+     */
+    QVector<char *> m_chunks;
+
+    /**
+     * unused rest of the last chunk
+     */
+    char *m_chunkRest;
+
+    /**
+     * bytes of the unused rest of the last chunk
+     */
+    int m_chunkRestBytes;
+
+    /**
+     * free slots per size class
+     */
+    Slot *m_freeSlots[SizeClasses];
+};
+
+}
+
+#endif
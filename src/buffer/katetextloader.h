@@ -22,13 +22,26 @@
 #define KATE_TEXTLOADER_H
 
 #include <QString>
+#include <QDateTime>
 #include <QFile>
+#include <QFileInfo>
 #include <QCryptographicHash>
 #include <QMimeDatabase>
+#include <QtAlgorithms>
 
 // on the fly compression
 #include <KFilterDev>
 
+// vectorized scanning
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define KATE_TEXTLOADER_SSE2 1
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define KATE_TEXTLOADER_AVX2 1
+#endif
+#endif
+
 namespace Kate
 {
 
@@ -39,6 +52,226 @@ namespace Kate
  */
 static const qint64 KATE_FILE_LOADER_BS  = 256 * 1024;
 
+/**
+ * loader block size for memory mapped files, map and decode 1 mb at once per default
+ * no read buffer is needed for them, therefore we can use larger chunks
+ * only the chunk being decoded is mapped, the file is never mapped as a whole
+ */
+static const qint64 KATE_FILE_LOADER_MAPPED_BS  = 1024 * 1024;
+
+/**
+ * Scanning kernels used by the TextLoader.
+ * Each kernel has a scalar version and SSE2/AVX2 versions, the best one is picked at runtime.
+ */
+namespace TextLoaderKernels
+{
+
+/**
+ * Is the given character one of the line breaks the loader handles?
+ * @param c character to check
+ * @return c is '\n', '\r' or a Unicode line separator
+ */
+inline bool isLineBreak(ushort c)
+{
+    return (c == '\n') || (c == '\r') || (c == QChar::LineSeparator);
+}
+
+/**
+ * Search the first line break in the given range, scalar version.
+ * @param text text to search in
+ * @param from first position to check
+ * @param to end of the range to check
+ * @return position of the first line break or to, if none found
+ */
+inline int findLineBreakScalar(const ushort *text, int from, int to)
+{
+    for (; from < to; ++from) {
+        if (isLineBreak(text[from])) {
+            return from;
+        }
+    }
+
+    return to;
+}
+
+/**
+ * Check if the given data is plain ASCII without any null byte, scalar version.
+ * @param data data to check
+ * @param length length of data in bytes
+ * @return all bytes are inside [1, 127]
+ */
+inline bool isPlainAsciiScalar(const char *data, int length)
+{
+    for (int i = 0; i < length; ++i) {
+        const uchar c = data[i];
+        if (c == 0 || c >= 0x80) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Check if the given text contains a null character, scalar version.
+ * @param text text to check
+ * @param length length of text
+ * @return null character found?
+ */
+inline bool containsNullScalar(const ushort *text, int length)
+{
+    for (int i = 0; i < length; ++i) {
+        if (text[i] == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#ifdef KATE_TEXTLOADER_SSE2
+inline int findLineBreakSse2(const ushort *text, int from, int to)
+{
+    const __m128i lf = _mm_set1_epi16('\n');
+    const __m128i cr = _mm_set1_epi16('\r');
+    const __m128i ls = _mm_set1_epi16(short(QChar::LineSeparator));
+    for (; from + 8 <= to; from += 8) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + from));
+        const __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(chunk, lf), _mm_cmpeq_epi16(chunk, cr)), _mm_cmpeq_epi16(chunk, ls));
+        if (const uint mask = _mm_movemask_epi8(hits)) {
+            return from + int(qCountTrailingZeroBits(mask) / 2);
+        }
+    }
+
+    return findLineBreakScalar(text, from, to);
+}
+
+inline bool isPlainAsciiSse2(const char *data, int length)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        if (_mm_movemask_epi8(_mm_or_si128(chunk, _mm_cmpeq_epi8(chunk, zero)))) {
+            return false;
+        }
+    }
+
+    return isPlainAsciiScalar(data + i, length - i);
+}
+
+inline bool containsNullSse2(const ushort *text, int length)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(chunk, zero))) {
+            return true;
+        }
+    }
+
+    return containsNullScalar(text + i, length - i);
+}
+#endif
+
+#ifdef KATE_TEXTLOADER_AVX2
+__attribute__((target("avx2"))) inline int findLineBreakAvx2(const ushort *text, int from, int to)
+{
+    const __m256i lf = _mm256_set1_epi16('\n');
+    const __m256i cr = _mm256_set1_epi16('\r');
+    const __m256i ls = _mm256_set1_epi16(short(QChar::LineSeparator));
+    for (; from + 16 <= to; from += 16) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + from));
+        const __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(chunk, lf), _mm256_cmpeq_epi16(chunk, cr)), _mm256_cmpeq_epi16(chunk, ls));
+        if (const uint mask = _mm256_movemask_epi8(hits)) {
+            return from + int(qCountTrailingZeroBits(mask) / 2);
+        }
+    }
+
+    return findLineBreakSse2(text, from, to);
+}
+
+__attribute__((target("avx2"))) inline bool isPlainAsciiAvx2(const char *data, int length)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= length; i += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        if (_mm256_movemask_epi8(_mm256_or_si256(chunk, _mm256_cmpeq_epi8(chunk, zero)))) {
+            return false;
+        }
+    }
+
+    return isPlainAsciiSse2(data + i, length - i);
+}
+
+/**
+ * Does the CPU we run on support AVX2?
+ * @return AVX2 support available
+ */
+inline bool hasAvx2()
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+#endif
+
+/**
+ * Search the first line break in the given range.
+ * @param text text to search in
+ * @param from first position to check
+ * @param to end of the range to check
+ * @return position of the first line break or to, if none found
+ */
+inline int findLineBreak(const QChar *text, int from, int to)
+{
+    const ushort *data = reinterpret_cast<const ushort *>(text);
+#if defined(KATE_TEXTLOADER_AVX2)
+    return hasAvx2() ? findLineBreakAvx2(data, from, to) : findLineBreakSse2(data, from, to);
+#elif defined(KATE_TEXTLOADER_SSE2)
+    return findLineBreakSse2(data, from, to);
+#else
+    return findLineBreakScalar(data, from, to);
+#endif
+}
+
+/**
+ * Check if the given data is plain ASCII without any null byte.
+ * Such data decodes the same for UTF-8 and Latin-1 and can't contain encoding errors.
+ * @param data data to check
+ * @param length length of data in bytes
+ * @return all bytes are inside [1, 127]
+ */
+inline bool isPlainAscii(const char *data, int length)
+{
+#if defined(KATE_TEXTLOADER_AVX2)
+    return hasAvx2() ? isPlainAsciiAvx2(data, length) : isPlainAsciiSse2(data, length);
+#elif defined(KATE_TEXTLOADER_SSE2)
+    return isPlainAsciiSse2(data, length);
+#else
+    return isPlainAsciiScalar(data, length);
+#endif
+}
+
+/**
+ * Check if the given text contains a null character.
+ * The codecs are used with QTextCodec::ConvertInvalidToNull, that is how we detect encoding errors.
+ * @param text text to check
+ * @return null character found?
+ */
+inline bool containsNull(const QString &text)
+{
+    const ushort *data = reinterpret_cast<const ushort *>(text.unicode());
+#ifdef KATE_TEXTLOADER_SSE2
+    return containsNullSse2(data, text.size());
+#else
+    return containsNullScalar(data, text.size());
+#endif
+}
+
+}
+
 /**
  * File Loader, will handle reading of files + detecting encoding
  */
@@ -65,6 +298,10 @@ public:
         , m_firstRead(true)
         , m_proberType(proberType)
         , m_fileSize(0)
+        , m_mapping(false)
+        , m_mappedData(nullptr)
+        , m_mappedSize(0)
+        , m_mappedPosition(0)
     {
         // try to get mimetype for on the fly decompression, don't rely on filename!
         QFile testMime(filename);
@@ -72,8 +309,15 @@ public:
         m_fileSize = testMime.size();
 
         // construct filter device
+        // uncompressed files are read directly, that allows us to memory map them
         KCompressionDevice::CompressionType compressionType = KFilterDev::compressionTypeForMimeType(m_mimeType);
-        m_file = new KCompressionDevice(filename, compressionType);
+        if (compressionType == KCompressionDevice::None) {
+            m_mappableFile = new QFile(filename);
+            m_file = m_mappableFile;
+        } else {
+            m_mappableFile = nullptr;
+            m_file = new KCompressionDevice(filename, compressionType);
+        }
     }
 
     /**
@@ -81,6 +325,7 @@ public:
      */
     ~TextLoader()
     {
+        unmap();
         delete m_file;
         delete m_converterState;
     }
@@ -111,11 +356,26 @@ public:
         m_digest.addData(header.toLatin1() + '\0');
         
         // if already opened, close the file...
+        unmap();
         if (m_file->isOpen()) {
             m_file->close();
         }
 
-        return m_file->open(QIODevice::ReadOnly);
+        if (!m_file->open(QIODevice::ReadOnly)) {
+            return false;
+        }
+
+        /**
+         * try to memory map uncompressed files chunk by chunk, this avoids copying all data through the read buffer
+         * if mapping fails, e.g. for special files, we just read them like compressed ones, see mapNextChunk()
+         */
+        if (m_mappableFile && m_mappableFile->size() > 0) {
+            m_mapping = true;
+            m_mappedSize = m_mappableFile->size();
+            m_mappedLastModified = QFileInfo(m_mappableFile->fileName()).lastModified();
+        }
+
+        return true;
     }
 
     /**
@@ -205,19 +465,24 @@ public:
                     // kill the old lines...
                     m_text.remove(0, m_lastLineStart);
                     
-                    // try to read new data
-                    const int c = m_file->read(m_buffer.data(), m_buffer.size());
+                    // try to read new data, either directly from the mapped file or via the read buffer
+                    const char *data = nullptr;
+                    int c = m_mapping ? mapNextChunk(data) : 0;
+                    if (!m_mapping) {
+                        c = m_file->read(m_buffer.data(), m_buffer.size());
+                        data = m_buffer.constData();
+                    }
 
                     // if any text is there, append it....
                     if (c > 0) {
                         // update hash sum
-                        m_digest.addData(m_buffer.data(), c);
+                        m_digest.addData(data, c);
                     
                         // detect byte order marks & codec for byte order marks on first read
                         int bomBytes = 0;
                         if (m_firstRead) {
                             // use first 16 bytes max to allow BOM detection of codec
-                            QByteArray bom(m_buffer.data(), qMin(16, c));
+                            QByteArray bom(data, qMin(16, c));
                             QTextCodec *codecForByteOrderMark = QTextCodec::codecForUtfText(bom, nullptr);
 
                             // if codec != null, we found a BOM!
@@ -254,7 +519,7 @@ public:
                                     /**
                                      * first: try to get HTML header encoding
                                      */
-                                    if (QTextCodec *codecForHtml = QTextCodec::codecForHtml (m_buffer, nullptr)) {
+                                    if (QTextCodec *codecForHtml = QTextCodec::codecForHtml (QByteArray::fromRawData(data, c), nullptr)) {
                                         m_codec = codecForHtml;
                                     }
                                     
@@ -263,7 +528,7 @@ public:
                                      */
                                     else {
                                         KEncodingProber prober(m_proberType);
-                                        prober.feed(m_buffer.constData(), c);
+                                        prober.feed(data, c);
 
                                         // we found codec with some confidence?
                                         if (prober.confidence() > 0.5) {
@@ -282,17 +547,30 @@ public:
                         }
 
                         Q_ASSERT(m_codec);
-                        QString unicode = m_codec->toUnicode(m_buffer.constData() + bomBytes, c - bomBytes, m_converterState);
-
-                        // detect broken encoding
-                        for (int i = 0; i < unicode.size(); ++i) {
-                            if (unicode[i] == 0) {
+                        const char *toConvert = data + bomBytes;
+                        const int toConvertLength = c - bomBytes;
+
+                        /**
+                         * fast path: plain ASCII decodes the same for UTF-8 and Latin-1, skip the codec
+                         * only allowed if the codec has no incomplete multi-byte sequence left from the last chunk
+                         */
+                        const int mib = m_codec->mibEnum();
+                        if ((mib == 106 || mib == 4) && m_converterState->remainingChars == 0
+                                && TextLoaderKernels::isPlainAscii(toConvert, toConvertLength)) {
+                            m_text.append(QString::fromLatin1(toConvert, toConvertLength));
+
+                            // a BOM is only allowed at the start, like the codec would do after the first chunk
+                            m_converterState->flags |= QTextCodec::IgnoreHeader;
+                        } else {
+                            const QString unicode = m_codec->toUnicode(toConvert, toConvertLength, m_converterState);
+
+                            // detect broken encoding
+                            if (TextLoaderKernels::containsNull(unicode)) {
                                 encodingError = true;
-                                break;
                             }
-                        }
 
-                        m_text.append(unicode);
+                            m_text.append(unicode);
+                        }
                     }
 
                     // is file completely read ?
@@ -376,6 +654,10 @@ public:
             } else {
                 m_lastWasEndOfLine = false;
                 m_lastWasR = false;
+
+                // skip all following characters that can't end the line in one go
+                m_position = TextLoaderKernels::findLineBreak(m_text.unicode(), m_position + 1, m_text.length());
+                continue;
             }
 
             m_position++;
@@ -389,6 +671,67 @@ public:
         return m_digest.result();
     }
 
+private:
+    /**
+     * Map the next chunk of the file, the previous chunk is unmapped.
+     * Its pages were decoded already, this way the mapping never holds more than one chunk next to the decoded text.
+     *
+     * Reading mapped pages of a file another process truncated meanwhile raises SIGBUS. Before each chunk
+     * we therefore check that size and modification time of the file are still the ones it had when we
+     * opened it, else the rest is read through the read buffer from where we are. A truncation in the
+     * short time between this check and the decoding of the chunk is not caught.
+     *
+     * @param data set to the mapped chunk
+     * @return length of the chunk, 0 at the end of the file; m_mapping is reset if the rest must be read
+     */
+    int mapNextChunk(const char *&data)
+    {
+        unmapChunk();
+
+        const int c = int(qMin<qint64>(KATE_FILE_LOADER_MAPPED_BS, m_mappedSize - m_mappedPosition));
+        if (c <= 0) {
+            return 0;
+        }
+
+        const QFileInfo info(m_mappableFile->fileName());
+        if (info.size() == m_mappedSize && info.lastModified() == m_mappedLastModified) {
+            m_mappedData = m_mappableFile->map(m_mappedPosition, c);
+        }
+
+        if (!m_mappedData) {
+            m_mapping = false;
+            m_mappableFile->seek(m_mappedPosition);
+            return 0;
+        }
+
+        data = reinterpret_cast<const char *>(m_mappedData);
+        m_mappedPosition += c;
+        return c;
+    }
+
+    /**
+     * unmap the current chunk, if any
+     */
+    void unmapChunk()
+    {
+        if (m_mappedData) {
+            m_mappableFile->unmap(m_mappedData);
+        }
+
+        m_mappedData = nullptr;
+    }
+
+    /**
+     * stop reading the file memory mapped
+     */
+    void unmap()
+    {
+        unmapChunk();
+        m_mapping = false;
+        m_mappedSize = 0;
+        m_mappedPosition = 0;
+    }
+
 private:
     QTextCodec *m_codec;
     bool m_eof;
@@ -399,6 +742,7 @@ private:
     TextBuffer::EndOfLineMode m_eol;
     QString m_mimeType;
     QIODevice *m_file;
+    QFile *m_mappableFile;
     QByteArray m_buffer;
     QCryptographicHash m_digest;
     QString m_text;
@@ -407,6 +751,15 @@ private:
     bool m_firstRead;
     KEncodingProber::ProberType m_proberType;
     quint64 m_fileSize;
+
+    /**
+     * reading the file memory mapped, one chunk at a time, see mapNextChunk()
+     */
+    bool m_mapping;
+    uchar *m_mappedData;
+    qint64 m_mappedSize;
+    qint64 m_mappedPosition;
+    QDateTime m_mappedLastModified;
 };
 
 }
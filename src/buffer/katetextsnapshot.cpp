@@ -0,0 +1,58 @@
+/*  This file is part of the Kate project.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "katetextsnapshot.h"
+
+#include <algorithm>
+
+namespace Kate
+{
+
+TextSnapshot::TextSnapshot()
+    : m_lines(0)
+    , m_revision(-1)
+{
+}
+
+QString TextSnapshot::line(int line) const
+{
+    // right input
+    Q_ASSERT(line >= 0 && line < m_lines);
+
+    // last block starting at or before the line
+    const int block = int(std::upper_bound(m_blockStartLines.constBegin(), m_blockStartLines.constEnd(), line) - m_blockStartLines.constBegin()) - 1;
+    return m_blocks.at(block).at(line - m_blockStartLines.at(block))->text();
+}
+
+QString TextSnapshot::text() const
+{
+    QString text;
+    bool firstLine = true;
+    foreach (const QVector<TextLine> &lines, m_blocks) {
+        foreach (const TextLine &line, lines) {
+            if (!firstLine) {
+                text.append(QLatin1Char('\n'));
+            }
+            text.append(line->text());
+            firstLine = false;
+        }
+    }
+    return text;
+}
+
+}
@@ -0,0 +1,107 @@
+/*  This file is part of the Kate project.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KATE_TEXTSNAPSHOT_H
+#define KATE_TEXTSNAPSHOT_H
+
+#include <QString>
+#include <QVector>
+
+#include <ktexteditor_export.h>
+#include "katetextline.h"
+
+namespace Kate
+{
+
+class TextBuffer;
+
+/**
+ * Immutable copy of the text of a TextBuffer, created by TextBuffer::snapshot().
+ *
+ * The snapshot shares the lines with the buffer, taking it costs O(blocks).
+ * The buffer copies a line before it changes its text, if the line might be part of a snapshot.
+ * Therefore a snapshot can be passed to other threads and read there while the buffer is edited.
+ * Only the text of the lines is accessible, highlighting information is still changed in place.
+ */
+class KTEXTEDITOR_EXPORT TextSnapshot
+{
+    friend class TextBuffer;
+
+public:
+    /**
+     * Construct an empty snapshot without any line.
+     */
+    TextSnapshot();
+
+    /**
+     * Lines in this snapshot.
+     * @return number of lines, 0 for an empty snapshot
+     */
+    int lines() const
+    {
+        return m_lines;
+    }
+
+    /**
+     * Revision of the buffer the snapshot was taken at.
+     * Use TextHistory to transform positions of the snapshot to later revisions.
+     * @return buffer revision
+     */
+    qint64 revision() const
+    {
+        return m_revision;
+    }
+
+    /**
+     * Retrieve the text of a line, O(log blocks).
+     * @param line line number, must be valid
+     * @return text of the line
+     */
+    QString line(int line) const;
+
+    /**
+     * Retrieve the whole text, lines separated by '\n'.
+     * @return text of the snapshot
+     */
+    QString text() const;
+
+private:
+    /**
+     * lines of each block, shared with the blocks of the buffer until they change
+     */
+    QVector<QVector<TextLine> > m_blocks;
+
+    /**
+     * start line of each block
+     */
+    QVector<int> m_blockStartLines;
+
+    /**
+     * number of lines
+     */
+    int m_lines;
+
+    /**
+     * buffer revision
+     */
+    qint64 m_revision;
+};
+
+}
+
+#endif
@@ -163,6 +163,7 @@ KateCompletionWidget::KateCompletionWidget(KTextEditor::ViewPrivate *parent)
     connect(&view()->doc()->buffer(), SIGNAL(lineUnwrapped(int)), this, SLOT(unwrapLine(int)));
     connect(&view()->doc()->buffer(), SIGNAL(textInserted(KTextEditor::Cursor,QString)), this, SLOT(insertText(KTextEditor::Cursor,QString)));
     connect(&view()->doc()->buffer(), SIGNAL(textRemoved(KTextEditor::Range,QString)), this, SLOT(removeText(KTextEditor::Range)));
+    connect(&view()->doc()->buffer(), SIGNAL(textReplaced(int,QVector<Kate::TextReplacement>,QStringList)), this, SLOT(replaceText(int)));
 
     // This is a non-focus widget, it is passed keyboard input from the view
 
@@ -1398,6 +1399,15 @@ void KateCompletionWidget::removeText(const KTextEditor::Range &)
     m_automaticInvocationTimer->stop();
 }
 
+void KateCompletionWidget::replaceText(int)
+{
+    m_lastInsertionByUser = !m_completionEditRunning;
+
+    // replacement, like removal, invalidates the pending invocation
+    m_automaticInvocationLine.clear();
+    m_automaticInvocationTimer->stop();
+}
+
 void KateCompletionWidget::automaticInvocation()
 {
     //qCDebug(LOG_KTE)<<"m_automaticInvocationAt:"<<m_automaticInvocationAt;
@@ -182,6 +182,7 @@ private Q_SLOTS:
     void unwrapLine(int line);
     void insertText(const KTextEditor::Cursor &position, const QString &text);
     void removeText(const KTextEditor::Range &range);
+    void replaceText(int line);
 
 private:
     void updateAndShow();
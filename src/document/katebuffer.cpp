@@ -32,16 +32,102 @@
 #include <KFilterDev>
 
 #include <QDate>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileInfo>
+#include <QRunnable>
+#include <QSemaphore>
 #include <QTextCodec>
 #include <QTextStream>
-#include <QTimer>
+#include <QThreadPool>
 
 /**
- * Initial value for m_maxDynamicContexts
+ * Requested lines at most that far behind the highlighted area
+ * are highlighted at once, farther ones in the background
  */
-static const int KATE_MAX_DYNAMIC_CONTEXTS = 512;
+static const int KATE_HL_SYNCHRONOUS_LINES = 1024;
+
+/**
+ * Lines highlighted per doHighlight call in the background
+ */
+static const int KATE_HL_BATCH_LINES = 256;
+
+/**
+ * Lines each thread at least gets for speculative highlighting
+ */
+static const int KATE_HL_PARALLEL_CHUNK_LINES = 1024;
+
+/**
+ * Highlights consecutive lines for KateBuffer::highlightSpeculatively() in the worker pool of the buffer.
+ * Uses an own instance of the highlighting, its rules keep state while matching.
+ * The first line is highlighted from the state of m_start, a line ending in the
+ * default context if that is not the real previous line. The line numbers of
+ * dynamic contexts are those of our instance, we stop at the first line ending
+ * in one, the following lines are left for the sequential highlighting.
+ */
+class KateHighlightChunk : public QRunnable
+{
+public:
+    KateHighlightChunk(KateHighlighting *highlighting)
+        : m_highlighting(highlighting)
+        , m_tabWidth(0)
+        , m_completed(false)
+    {
+        setAutoDelete(false);
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        highlight();
+        m_done.release();
+    }
+
+    void highlight()
+    {
+        const int staticContexts = m_highlighting->staticContextCount();
+        const Kate::TextLineData *prevLine = m_start.data();
+        m_completed = false;
+        for (int i = 0; i < m_lines.size(); ++i) {
+            Kate::TextLineData *textLine = m_lines.at(i).data();
+            const Kate::TextLineData *nextLine = ((i + 1) < m_lines.size()) ? m_lines.at(i + 1).data() : m_next.data();
+            bool ctxChanged = false;
+            m_highlighting->doHighlight(prevLine, textLine, nextLine, ctxChanged, m_tabWidth, nullptr, m_arenas.at(i));
+
+            // the buffer's highlighting can't continue from our dynamic contexts
+            foreach (short context, textLine->contextStack()) {
+                if (context >= staticContexts) {
+                    textLine->setContextStack(Kate::TextLineData::ContextStack());
+                    for (int j = i; j < m_lines.size(); ++j) {
+                        m_lines.at(j)->setHlChained(false);
+                    }
+                    return;
+                }
+            }
+
+            // the first line depends on the assumed start state
+            textLine->setHlChained(i > 0);
+            prevLine = textLine;
+        }
+        m_completed = true;
+    }
+
+    KateHighlighting *const m_highlighting;
+    Kate::TextLine m_start;
+    QVector<Kate::TextLine> m_lines;
+    QVector<Kate::TextLineArena *> m_arenas;
+    Kate::TextLine m_next;
+    int m_tabWidth;
+
+    /**
+     * all lines got highlighted
+     */
+    bool m_completed;
+
+    /**
+     * released once the pool has highlighted the chunk
+     */
+    QSemaphore m_done;
+};
 
 /**
  * Create an empty buffer. (with one block with one empty line)
@@ -55,8 +141,11 @@ KateBuffer::KateBuffer(KTextEditor::DocumentPrivate *doc)
       m_highlight(nullptr),
       m_tabWidth(8),
       m_lineHighlighted(0),
-      m_maxDynamicContexts(KATE_MAX_DYNAMIC_CONTEXTS)
+      m_lineHighlightedMax(0),
+      m_highlightedLinesCount(0),
+      m_speculativeChunksCount(0)
 {
+    connect(this, SIGNAL(loadingFinished(bool,bool,bool,int)), this, SLOT(finishBackgroundLoading(bool,bool,bool,int)));
 }
 
 /**
@@ -64,6 +153,8 @@ KateBuffer::KateBuffer(KTextEditor::DocumentPrivate *doc)
  */
 KateBuffer::~KateBuffer()
 {
+    // no background loading may call us back during destruction
+    stopLoading();
 }
 
 void KateBuffer::editStart()
@@ -103,6 +194,13 @@ void KateBuffer::editEnd()
         return;
     }
 
+    /**
+     * changed lines must not be skipped when resuming the highlighting behind them
+     */
+    for (int line = editingMinimalLineChanged(); line <= qMin(editingMaximalLineChanged(), m_lineHighlightedMax - 1); ++line) {
+        plainLine(line)->setHlChained(false);
+    }
+
     /**
      * if we don't touch the highlighted area => fine
      */
@@ -143,8 +241,10 @@ void KateBuffer::clear()
     m_tooLongLinesWrapped = false;
     m_longestLineLoaded = 0;
 
-    // back to line 0 with hl
+    // back to line 0 with hl, nothing to do in the background
     m_lineHighlighted = 0;
+    m_lineHighlightedMax = 0;
+    KTextEditor::EditorPrivate::self()->highlightingScheduler()->cancel(this);
 }
 
 bool KateBuffer::openFile(const QString &m_file, bool enforceTextCodec)
@@ -197,6 +297,16 @@ bool KateBuffer::openFile(const QString &m_file, bool enforceTextCodec)
         return false;
     }
 
+    /**
+     * large files are decoded in the background, the views show the lines read so far
+     * the rest is done in finishBackgroundLoading
+     */
+    const qint64 backgroundLoadingLimit = qint64(KateGlobalConfig::global()->backgroundLoadingLimit()) * 1024 * 1024;
+    if ((backgroundLoadingLimit > 0) && (QFileInfo(m_file).size() >= backgroundLoadingLimit)) {
+        startLoading(m_file, enforceTextCodec);
+        return true;
+    }
+
     /**
      * try to load
      */
@@ -204,6 +314,27 @@ bool KateBuffer::openFile(const QString &m_file, bool enforceTextCodec)
         return false;
     }
 
+    updateConfigFromLoadedFile();
+
+    // okay, loading did work
+    return true;
+}
+
+void KateBuffer::finishBackgroundLoading(bool success, bool encodingErrors, bool tooLongLinesWrapped, int longestLineLoaded)
+{
+    m_brokenEncoding = encodingErrors;
+    m_tooLongLinesWrapped = tooLongLinesWrapped;
+    m_longestLineLoaded = longestLineLoaded;
+
+    if (success) {
+        updateConfigFromLoadedFile();
+    }
+
+    emit fileOpened(success);
+}
+
+void KateBuffer::updateConfigFromLoadedFile()
+{
     // save back encoding
     m_doc->config()->setEncoding(QString::fromLatin1(textCodec()->name()));
 
@@ -216,9 +347,6 @@ bool KateBuffer::openFile(const QString &m_file, bool enforceTextCodec)
     if (generateByteOrderMark()) {
         m_doc->config()->setBom(true);
     }
-
-    // okay, loading did work
-    return true;
 }
 
 bool KateBuffer::canEncode()
@@ -292,6 +420,53 @@ void KateBuffer::ensureHighlighted(int line, int lookAhead)
     doHighlight(m_lineHighlighted, end, false);
 }
 
+bool KateBuffer::requestHighlighting(int line, int lookAhead, KateHighlightingScheduler::Priority priority)
+{
+    // valid line at all?
+    if (line < 0 || line >= lines()) {
+        return false;
+    }
+
+    // already hl up-to-date for this line or no hl at all?
+    if (line < m_lineHighlighted || !m_highlight || m_highlight->noHighlighting()) {
+        return true;
+    }
+
+    // near enough, cheaper to just do it now
+    if (line - m_lineHighlighted < KATE_HL_SYNCHRONOUS_LINES) {
+        ensureHighlighted(line, lookAhead);
+        return true;
+    }
+
+    // continue in the background, the caller shows the outdated attributes meanwhile
+    KTextEditor::EditorPrivate::self()->highlightingScheduler()->schedule(this, qMin(line + lookAhead, lines() - 1), priority);
+    return false;
+}
+
+bool KateBuffer::highlightUntil(int line, const QElapsedTimer &timer, qint64 timeSlice)
+{
+    // target may have vanished by editing or got reached by ensureHighlighted
+    const int target = qMin(line, lines() - 1);
+    if (!m_highlight || m_highlight->noHighlighting() || target < m_lineHighlighted) {
+        return true;
+    }
+
+    // highlight in batches until the time slice is used up, with parallel highlighting big enough ones to use it
+    const int batchLines = qMax(KATE_HL_BATCH_LINES, KateGlobalConfig::global()->parallelHighlightingLimit());
+    const int startLine = m_lineHighlighted;
+    do {
+        doHighlight(m_lineHighlighted, qMin(m_lineHighlighted + batchLines - 1, target), false);
+    } while (m_lineHighlighted <= target && timer.elapsed() < timeSlice);
+
+    // views did show these lines with the old attributes, tag them
+    if (m_lineHighlighted > startLine) {
+        emit tagLines(startLine, m_lineHighlighted - 1);
+    }
+    emit highlightingProgress(m_lineHighlighted - 1);
+
+    return m_lineHighlighted > target;
+}
+
 void KateBuffer::wrapLine(const KTextEditor::Cursor &position)
 {
     // call original
@@ -300,6 +475,10 @@ void KateBuffer::wrapLine(const KTextEditor::Cursor &position)
     if (m_lineHighlighted > position.line() + 1) {
         m_lineHighlighted++;
     }
+
+    if (m_lineHighlightedMax > position.line() + 1) {
+        m_lineHighlightedMax++;
+    }
 }
 
 void KateBuffer::unwrapLine(int line)
@@ -310,6 +489,10 @@ void KateBuffer::unwrapLine(int line)
     if (m_lineHighlighted > line) {
         --m_lineHighlighted;
     }
+
+    if (m_lineHighlightedMax > line) {
+        --m_lineHighlightedMax;
+    }
 }
 
 void KateBuffer::setTabWidth(int w)
@@ -357,6 +540,110 @@ void KateBuffer::setHighlight(int hlMode)
 void KateBuffer::invalidateHighlighting()
 {
     m_lineHighlighted = 0;
+    m_lineHighlightedMax = 0;
+}
+
+void KateBuffer::countDynamicContextReferences(int firstDynamicContext, QVector<int> &references) const
+{
+    for (int i = 0; i < lines(); ++i) {
+        const Kate::TextLine textLine = line(i);
+        const Kate::TextLineData::ContextStack &stack = textLine->contextStack();
+        for (int j = 0; j < stack.size(); ++j) {
+            const int slot = stack[j] - firstDynamicContext;
+            if (slot >= 0 && slot < references.size()) {
+                ++references[slot];
+            }
+        }
+    }
+}
+
+void KateBuffer::dropDynamicContextReferences(int firstDynamicContext, const QVector<bool> &evicted)
+{
+    int firstDropped = -1;
+    for (int i = 0; i < lines(); ++i) {
+        Kate::TextLine textLine = plainLine(i);
+        const Kate::TextLineData::ContextStack &stack = textLine->contextStack();
+        for (int j = 0; j < stack.size(); ++j) {
+            const int slot = stack[j] - firstDynamicContext;
+            if (slot >= 0 && slot < evicted.size() && evicted[slot]) {
+                // the context number will be reused, forget it
+                textLine->setContextStack(Kate::TextLineData::ContextStack());
+                textLine->setHlChained(false);
+                if (firstDropped < 0) {
+                    firstDropped = i;
+                }
+                break;
+            }
+        }
+    }
+
+    // highlight again from there, lines behind still chained to it stay valid
+    if (firstDropped >= 0 && firstDropped < m_lineHighlighted) {
+        m_lineHighlighted = firstDropped;
+    }
+}
+
+void KateBuffer::highlightSpeculatively(int startLine, int endLine)
+{
+    const int chunkCount = qMin(workerPool()->maxThreadCount() + 1, (endLine - startLine + 1) / KATE_HL_PARALLEL_CHUNK_LINES);
+    if (chunkCount < 2) {
+        return;
+    }
+
+    // the real previous line is a valid start for the first chunk, unless it ends in a dynamic context
+    Kate::TextLine start = (startLine > 0) ? plainLine(startLine - 1) : Kate::TextLine();
+    if (start) {
+        foreach (short context, start->contextStack()) {
+            if (context >= m_highlight->staticContextCount()) {
+                start = Kate::TextLine(new Kate::TextLineData());
+                break;
+            }
+        }
+    }
+
+    // the other chunks assume a start in the default context
+    QVector<KateHighlightChunk *> jobs;
+    const int chunkLines = (endLine - startLine + 1) / chunkCount;
+    for (int i = 0; i < chunkCount; ++i) {
+        const int first = startLine + i * chunkLines;
+        const int last = ((i + 1) < chunkCount) ? (first + chunkLines - 1) : endLine;
+
+        KateHighlightChunk *job = new KateHighlightChunk(m_highlight->takeIndependentCopy());
+        job->m_start = (i == 0) ? start : Kate::TextLine(new Kate::TextLineData());
+        job->m_lines.reserve(last - first + 1);
+        job->m_arenas.reserve(last - first + 1);
+        for (int line = first; line <= last; ++line) {
+            job->m_lines.append(plainLine(line));
+            job->m_arenas.append(lineArena(line));
+        }
+        job->m_next = ((last + 1) < lines()) ? plainLine(last + 1) : Kate::TextLine(new Kate::TextLineData());
+        job->m_tabWidth = tabWidth();
+        jobs.append(job);
+    }
+
+    // the last chunk is ours, we would wait anyway
+    for (int i = 0; i + 1 < chunkCount; ++i) {
+        workerPool()->start(jobs.at(i));
+    }
+    jobs.last()->highlight();
+    for (int i = 0; i + 1 < chunkCount; ++i) {
+        jobs.at(i)->m_done.acquire();
+    }
+
+    // a chunk continues the previous one if that ends in the default context, as assumed
+    for (int i = 1; i < chunkCount; ++i) {
+        const Kate::TextLine &last = jobs.at(i - 1)->m_lines.last();
+        jobs.at(i)->m_lines.first()->setHlChained(jobs.at(i - 1)->m_completed && last->contextStack().isEmpty() && !last->hlLineContinue());
+    }
+    m_highlightedLinesCount += endLine - startLine + 1;
+    m_speculativeChunksCount += chunkCount;
+    foreach (KateHighlightChunk *job, jobs) {
+        m_highlight->releaseIndependentCopy(job->m_highlighting);
+    }
+    qDeleteAll(jobs);
+
+    // the chained lines are valid once the sequential highlighting confirms the state of the line before them
+    m_lineHighlightedMax = qMax(m_lineHighlightedMax, endLine + 1);
 }
 
 void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
@@ -366,45 +653,20 @@ void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
         return;
     }
 
+    // enough never highlighted lines, guess their highlighting in parallel first, see highlightSpeculatively()
+    const int parallelLimit = KateGlobalConfig::global()->parallelHighlightingLimit();
+    if ((parallelLimit > 0) && (startLine == m_lineHighlighted) && (startLine >= m_lineHighlightedMax)
+            && (qMin(endLine, lines() - 1) - startLine + 1 >= parallelLimit)) {
+        highlightSpeculatively(startLine, qMin(endLine, lines() - 1));
+    }
+
 #ifdef BUFFER_DEBUGGING
     QTime t;
     t.start();
     qCDebug(LOG_KTE) << "HIGHLIGHTED START --- NEED HL, LINESTART: " << startLine << " LINEEND: " << endLine;
     qCDebug(LOG_KTE) << "HL UNTIL LINE: " << m_lineHighlighted;
-    qCDebug(LOG_KTE) << "HL DYN COUNT: " << KateHlManager::self()->countDynamicCtxs() << " MAX: " << m_maxDynamicContexts;
-#endif
-
-    // see if there are too many dynamic contexts; if yes, invalidate HL of all documents
-    if (KateHlManager::self()->countDynamicCtxs() >= m_maxDynamicContexts) {
-        {
-            if (KateHlManager::self()->resetDynamicCtxs()) {
-#ifdef BUFFER_DEBUGGING
-                qCDebug(LOG_KTE) << "HL invalidated - too many dynamic contexts ( >= " << m_maxDynamicContexts << ")";
-#endif
-
-                // avoid recursive invalidation
-                KateHlManager::self()->setForceNoDCReset(true);
-
-                foreach (KTextEditor::DocumentPrivate *doc, KTextEditor::EditorPrivate::self()->kateDocuments()) {
-                    doc->makeAttribs();
-                }
-
-                // doHighlight *shall* do his work. After invalidation, some highlight has
-                // been recalculated, but *maybe not* until endLine ! So we shall force it manually...
-                doHighlight(m_lineHighlighted, endLine, false);
-                m_lineHighlighted = endLine;
-
-                KateHlManager::self()->setForceNoDCReset(false);
-                return;
-            } else {
-                m_maxDynamicContexts *= 2;
-
-#ifdef BUFFER_DEBUGGING
-                qCDebug(LOG_KTE) << "New dynamic contexts limit: " << m_maxDynamicContexts;
+    qCDebug(LOG_KTE) << "HL DYN COUNT: " << m_highlight->dynamicContextCount();
 #endif
-            }
-        }
-    }
 
     // if possible get previous line, otherwise create 0 line.
     Kate::TextLine prevLine = (startLine >= 1) ? plainLine(startLine - 1) : Kate::TextLine();
@@ -414,6 +676,8 @@ void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
     int start_spellchecking = -1;
     int last_line_spellchecking = -1;
     bool ctxChanged = false;
+    bool lineContinueChanged = false;
+    const int oldHighlighted = m_lineHighlighted;
     Kate::TextLine textLine = plainLine(current_line);
     Kate::TextLine nextLine;
     // loop over the lines of the block, from startline to endline or end of block
@@ -426,8 +690,18 @@ void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
             nextLine = Kate::TextLine(new Kate::TextLineData());
         }
 
+        // keep the dynamic contexts bounded, the ones our lines use are kept
+        // other documents lose the highlighting of their lines using evicted ones
+        if (m_highlight->dynamicContextsFull()) {
+            m_highlight->evictDynamicContexts(m_doc);
+        }
+
         ctxChanged = false;
-        m_highlight->doHighlight(prevLine.data(), textLine.data(), nextLine.data(), ctxChanged, tabWidth());
+        const bool lineContinue = textLine->hlLineContinue();
+        m_highlight->doHighlight(prevLine.data(), textLine.data(), nextLine.data(), ctxChanged, tabWidth(), nullptr, lineArena(current_line));
+        lineContinueChanged = (lineContinue != textLine->hlLineContinue());
+        textLine->setHlChained(true);
+        ++m_highlightedLinesCount;
 
 #ifdef BUFFER_DEBUGGING
         // debug stuff
@@ -449,6 +723,22 @@ void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
             last_line_spellchecking = current_line;
         }
 
+        // behind the highlighted area, the next lines may have been highlighted from exactly this state before
+        if (!ctxChanged && !lineContinueChanged && current_line >= oldHighlighted && nextLine->hlChained()) {
+            int chainEnd = current_line + 1;
+            while (chainEnd < m_lineHighlightedMax && plainLine(chainEnd)->hlChained()) {
+                ++chainEnd;
+            }
+
+            // resume behind them
+            if (chainEnd > current_line + 1) {
+                current_line = chainEnd - 1;
+                prevLine = plainLine(current_line);
+                textLine = (chainEnd < lines()) ? plainLine(chainEnd) : Kate::TextLine();
+                continue;
+            }
+        }
+
         // move around the lines
         prevLine = textLine;
         textLine = nextLine;
@@ -457,10 +747,17 @@ void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
     /**
      * perhaps we need to adjust the maximal highlighed line
      */
-    int oldHighlighted = m_lineHighlighted;
     if (ctxChanged || current_line > m_lineHighlighted) {
         m_lineHighlighted = current_line;
     }
+    m_lineHighlightedMax = qMax(m_lineHighlightedMax, current_line);
+
+    /**
+     * the next line got highlighted from another state
+     */
+    if ((ctxChanged || lineContinueChanged) && current_line < lines()) {
+        plainLine(current_line)->setHlChained(false);
+    }
 
     // tag the changed lines !
     if (invalidate) {
@@ -479,7 +776,7 @@ void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
 #ifdef BUFFER_DEBUGGING
     qCDebug(LOG_KTE) << "HIGHLIGHTED END --- NEED HL, LINESTART: " << startLine << " LINEEND: " << endLine;
     qCDebug(LOG_KTE) << "HL UNTIL LINE: " << m_lineHighlighted;
-    qCDebug(LOG_KTE) << "HL DYN COUNT: " << KateHlManager::self()->countDynamicCtxs() << " MAX: " << m_maxDynamicContexts;
+    qCDebug(LOG_KTE) << "HL DYN COUNT: " << m_highlight->dynamicContextCount();
     qCDebug(LOG_KTE) << "TIME TAKEN: " << t.elapsed();
 #endif
 }
@@ -598,7 +895,7 @@ KTextEditor::Range KateBuffer::computeFoldingRangeForStartLine(int startLine)
         /**
          * walk over all attributes of the line and compute the matchings
          */
-        const QVector<Kate::TextLineData::Attribute> &startLineAttributes = startTextLine->attributesList();
+        const Kate::TextLineData::Attributes &startLineAttributes = startTextLine->attributesList();
         for (int i = 0; i < startLineAttributes.size(); ++i) {
             /**
              * folding close?
@@ -667,7 +964,7 @@ KTextEditor::Range KateBuffer::computeFoldingRangeForStartLine(int startLine)
         /**
          * search for matching end marker
          */
-        const QVector<Kate::TextLineData::Attribute> &lineAttributes = textLine->attributesList();
+        const Kate::TextLineData::Attributes &lineAttributes = textLine->attributesList();
         for (int i = 0; i < lineAttributes.size(); ++i) {
             /**
              * matching folding close?
@@ -22,6 +22,7 @@
 #define __KATE_BUFFER_H__
 
 #include "katetextbuffer.h"
+#include "katehighlightingscheduler.h"
 
 #include <ktexteditor_export.h>
 
@@ -109,9 +110,11 @@ public:
 
     /**
      * Open a file, use the given filename
+     * Files larger than the configured background loading limit are loaded in the background,
+     * then isLoading() is true after this returns and fileOpened() is emitted once all lines are there.
      * @param m_file filename to open
      * @param enforceTextCodec enforce to use only the set text codec
-     * @return success
+     * @return success, for background loading: the loading got started
      */
     bool openFile(const QString &m_file, bool enforceTextCodec);
 
@@ -177,6 +180,58 @@ public:
      */
     void ensureHighlighted(int line, int lookAhead = 64);
 
+    /**
+     * Request highlighting of given line @p line for display.
+     * Lines near the already highlighted area are highlighted at once,
+     * like @ref ensureHighlighted does. For lines far behind it, the
+     * highlighting is queued at the editor's KateHighlightingScheduler
+     * and the line keeps its outdated attributes until
+     * highlightingProgress() reports it as done.
+     * @param line line to highlight
+     * @param lookAhead also highlight these following lines
+     * @param priority priority of the background highlighting, see KateHighlightingScheduler::priorityForView()
+     * @return true if the highlighting of @p line is up to date now
+     */
+    bool requestHighlighting(int line, int lookAhead = 64, KateHighlightingScheduler::Priority priority = KateHighlightingScheduler::VisibleViewPriority);
+
+    /**
+     * Highlight towards line @p line in batches until @p timer says
+     * @p timeSlice ms are over. Used by the KateHighlightingScheduler
+     * for the requests of requestHighlighting().
+     * @param line line the highlighting should reach
+     * @param timer timer started at the begin of the time slice
+     * @param timeSlice length of the time slice in ms
+     * @return true if nothing is left to highlight up to @p line
+     */
+    bool highlightUntil(int line, const QElapsedTimer &timer, qint64 timeSlice);
+
+    /**
+     * Last line with valid highlighting.
+     * @return line up to which the highlighting is up to date, -1 if none
+     */
+    int lastHighlightedLine() const
+    {
+        return m_lineHighlighted - 1;
+    }
+
+    /**
+     * Number of lines run through the highlighting so far, for statistics.
+     * @return count of highlighted lines, including all re-highlighting
+     */
+    qint64 highlightedLinesCount() const
+    {
+        return m_highlightedLinesCount;
+    }
+
+    /**
+     * Number of chunks highlighted speculatively in parallel so far, for statistics.
+     * @return count of chunks, see highlightSpeculatively()
+     */
+    qint64 speculativeChunksCount() const
+    {
+        return m_speculativeChunksCount;
+    }
+
     /**
      * Return the total number of lines in the buffer.
      */
@@ -224,6 +279,21 @@ public:
      */
     void invalidateHighlighting();
 
+    /**
+     * Count the lines whose context stack refers to each dynamic context.
+     * @param firstDynamicContext number of the first dynamic context of the highlighting
+     * @param references line count per dynamic context, by context number - firstDynamicContext, to add to
+     */
+    void countDynamicContextReferences(int firstDynamicContext, QVector<int> &references) const;
+
+    /**
+     * Drop the highlighting of the lines whose context stack refers to an evicted
+     * dynamic context, they are highlighted again on next request.
+     * @param firstDynamicContext number of the first dynamic context of the highlighting
+     * @param evicted evicted flag per dynamic context, by context number - firstDynamicContext
+     */
+    void dropDynamicContextReferences(int firstDynamicContext, const QVector<bool> &evicted);
+
     /**
      * For a given line, compute the folding range that starts there
      * to be used to fold e.g. from the icon border
@@ -242,7 +312,38 @@ private:
      */
     void doHighlight(int from, int to, bool invalidate);
 
+    /**
+     * Speculative parallel highlighting of never highlighted lines, done by doHighlight()
+     * before highlighting them sequentially. The lines are split into chunks that are
+     * highlighted in the worker pool of the buffer, the last one in this thread, each one
+     * assuming the previous line ends in the default context. Each chunk is chained to
+     * the previous one only if that holds.
+     * The sequential highlighting then skips the chained lines once the state of the
+     * line before them is confirmed, only the lines behind a wrong guess get highlighted
+     * again, until their state matches the guessed one.
+     * @param from first line in range, the first line not highlighted so far
+     * @param to last line in range
+     */
+    void highlightSpeculatively(int from, int to);
+
+    /**
+     * Write the encoding, eol mode and bom found while loading back to the document config.
+     */
+    void updateConfigFromLoadedFile();
+
+private Q_SLOTS:
+    /**
+     * Background loading of openFile() is done.
+     */
+    void finishBackgroundLoading(bool success, bool encodingErrors, bool tooLongLinesWrapped, int longestLineLoaded);
+
 Q_SIGNALS:
+    /**
+     * A file opened in the background by openFile() is completely loaded.
+     * @param success the file got loaded, perhaps with encoding errors
+     */
+    void fileOpened(bool success);
+
     /**
      * Emitted when the highlighting of a certain range has
      * changed.
@@ -250,6 +351,12 @@ Q_SIGNALS:
     void tagLines(int start, int end);
     void respellCheckBlock(int start, int end);
 
+    /**
+     * Emitted after each batch of background highlighting.
+     * @param line highlighting is up to date until this line
+     */
+    void highlightingProgress(int line);
+
 private:
     /**
      * document we belong to
@@ -285,9 +392,20 @@ private:
     int m_lineHighlighted;
 
     /**
-     * number of dynamic contexts causing a full invalidation
+     * lines from this one on were not highlighted since the last invalidation,
+     * below it lines with the hl-chained flag are valid once their previous line is
+     */
+    int m_lineHighlightedMax;
+
+    /**
+     * lines run through the highlighting so far
+     */
+    qint64 m_highlightedLinesCount;
+
+    /**
+     * chunks highlighted speculatively so far
      */
-    int m_maxDynamicContexts;
+    qint64 m_speculativeChunksCount;
 };
 
 #endif
@@ -80,6 +80,7 @@
 #include <QMimeDatabase>
 #include <QTemporaryFile>
 
+#include <algorithm>
 #include <cmath>
 
 #ifdef LIBGIT2_FOUND
@@ -202,6 +203,8 @@ KTextEditor::DocumentPrivate::DocumentPrivate(bool bSingleViewMode,
       m_fileType(QStringLiteral("Normal")),
       m_fileTypeSetByUser(false),
       m_reloading(false),
+      m_reloadPending(false),
+      m_reloadModeSetByUser(false),
       m_config(new KateDocumentConfig(this)),
       m_fileChangedDialogsActivated(false),
       m_onTheFlyChecker(nullptr),
@@ -240,6 +243,9 @@ KTextEditor::DocumentPrivate::DocumentPrivate(bool bSingleViewMode,
 
     // some nice signals from the buffer
     connect(m_buffer, SIGNAL(tagLines(int,int)), this, SLOT(tagLines(int,int)));
+    connect(m_buffer, SIGNAL(loadingProgress(int)), this, SLOT(slotBackgroundLoadingProgress(int)));
+    connect(m_buffer, SIGNAL(highlightingProgress(int)), this, SLOT(slotBackgroundHighlightingProgress(int)));
+    connect(m_buffer, SIGNAL(fileOpened(bool)), this, SLOT(slotBackgroundLoadingFinished(bool)));
 
     // if the user changes the highlight with the dialog, notify the doc
     connect(KateHlManager::self(), SIGNAL(changed()), SLOT(internalHlChanged()));
@@ -904,17 +910,8 @@ bool KTextEditor::DocumentPrivate::removeLine(int line)
 
 int KTextEditor::DocumentPrivate::totalCharacters() const
 {
-    int l = 0;
-
-    for (int i = 0; i < m_buffer->count(); ++i) {
-        Kate::TextLine line = m_buffer->plainLine(i);
-
-        if (line) {
-            l += line->length();
-        }
-    }
-
-    return l;
+    // offset of the end minus the line breaks
+    return int(m_buffer->cursorToOffset(documentEnd()) - lastLine());
 }
 
 int KTextEditor::DocumentPrivate::lines() const
@@ -937,6 +934,16 @@ int KTextEditor::DocumentPrivate::lineLength(int line) const
     return l->length();
 }
 
+qint64 KTextEditor::DocumentPrivate::cursorToOffset(const KTextEditor::Cursor &cursor) const
+{
+    return m_buffer->cursorToOffset(cursor);
+}
+
+KTextEditor::Cursor KTextEditor::DocumentPrivate::offsetToCursor(qint64 offset) const
+{
+    return m_buffer->offsetToCursor(offset);
+}
+
 bool KTextEditor::DocumentPrivate::isLineModified(int line) const
 {
     if (line < 0 || line >= lines()) {
@@ -1284,6 +1291,64 @@ bool KTextEditor::DocumentPrivate::editRemoveText(int line, int col, int len)
     return true;
 }
 
+bool KTextEditor::DocumentPrivate::editReplaceText(int line, const QVector<Kate::TextReplacement> &replacements)
+{
+    // verbose debug
+    EDIT_DEBUG << "editReplaceText" << line << replacements.size();
+
+    if (line < 0) {
+        return false;
+    }
+
+    if (!isReadWrite()) {
+        return false;
+    }
+
+    Kate::TextLine l = kateTextLine(line);
+
+    if (!l) {
+        return false;
+    }
+
+    // nothing to do, do nothing!
+    if (replacements.isEmpty()) {
+        return true;
+    }
+
+    // sorted, not overlapping and inside the line
+    const QString oldText = l->string();
+    QStringList removedTexts;
+    removedTexts.reserve(replacements.size());
+    int lastEnd = 0;
+    foreach (const Kate::TextReplacement &replacement, replacements) {
+        if (replacement.column < lastEnd || replacement.length < 0 || replacement.column + replacement.length > oldText.size()) {
+            return false;
+        }
+        Q_ASSERT(!replacement.text.contains(QLatin1Char('\n')));
+
+        removedTexts.append(oldText.mid(replacement.column, replacement.length));
+        lastEnd = replacement.column + replacement.length;
+    }
+
+    editStart();
+
+    m_undoManager->slotTextReplaced(line, replacements, removedTexts);
+
+    // replace text in line
+    m_buffer->replaceText(line, replacements);
+
+    // like the buffer, announce the span from the first to the last replacement as one change
+    const int spanStart = replacements.first().column;
+    const KTextEditor::Range oldSpan(line, spanStart, line, lastEnd);
+    const int newSpanLength = plainKateTextLine(line)->length() - (oldText.size() - lastEnd) - spanStart;
+    emit textRemoved(this, oldSpan, oldText.mid(spanStart, lastEnd - spanStart));
+    emit textInserted(this, KTextEditor::Range(line, spanStart, line, spanStart + newSpanLength));
+
+    editEnd();
+
+    return true;
+}
+
 bool KTextEditor::DocumentPrivate::editMarkLineAutoWrapped(int line, bool autowrapped)
 {
     // verbose debug
@@ -2187,7 +2252,10 @@ void KTextEditor::DocumentPrivate::openWithLineLengthLimitOverride()
     m_buffer->clear();
     openFile();
     if (!m_openingError) {
-        setReadWrite(true);
+        // background loading restores the read-write mode once done
+        if (!m_buffer->isLoading()) {
+            setReadWrite(true);
+        }
         m_readWriteStateBeforeLoading = true;
     }
 }
@@ -2238,6 +2306,39 @@ bool KTextEditor::DocumentPrivate::openFile()
 
     bool success = m_buffer->openFile(localFilePath(), (m_reloading && m_userSetEncodingForNextReload));
 
+    //
+    // large file loaded in the background
+    // stay read-only until all lines are there, the views show what we have got so far
+    // the rest is done in slotBackgroundLoadingFinished
+    //
+    if (success && m_buffer->isLoading()) {
+        if (m_documentState == DocumentIdle) {
+            m_documentState = DocumentLoading;
+            m_readWriteStateBeforeLoading = isReadWrite();
+        }
+        setReadWrite(false);
+
+        foreach (KTextEditor::ViewPrivate *view, m_views) {
+            view->setCursorPosition(KTextEditor::Cursor());
+            view->updateView(true);
+        }
+
+        // allow to abort the loading, if it takes long
+        QTimer::singleShot(1000, this, SLOT(slotTriggerLoadingMessage()));
+        return true;
+    }
+
+    // This is needed here because inserting the text moves the view's start position (it is a MovingCursor)
+    foreach (KTextEditor::ViewPrivate *view, m_views) {
+        view->setCursorPosition(KTextEditor::Cursor());
+    }
+
+    finishOpenFile(success);
+    return success;
+}
+
+void KTextEditor::DocumentPrivate::finishOpenFile(bool success)
+{
     //
     // yeah, success
     // read variables
@@ -2250,8 +2351,6 @@ bool KTextEditor::DocumentPrivate::openFile()
     // update views
     //
     foreach (KTextEditor::ViewPrivate *view, m_views) {
-        // This is needed here because inserting the text moves the view's start position (it is a MovingCursor)
-        view->setCursorPosition(KTextEditor::Cursor());
         view->updateView(true);
     }
 
@@ -2321,11 +2420,46 @@ bool KTextEditor::DocumentPrivate::openFile()
                                      "The longest of those lines was %3 characters long<br/>"
                                      "Those lines were wrapped and the document is set to read-only mode, as saving will modify its content.", this->url().toDisplayString(QUrl::PreferLocalFile), config()->lineLengthLimit(),m_buffer->longestLineLoaded());
     }
+}
 
-    //
-    // return the success
-    //
-    return success;
+void KTextEditor::DocumentPrivate::slotBackgroundLoadingProgress(int lines)
+{
+    // show the new lines
+    foreach (KTextEditor::ViewPrivate *view, m_views) {
+        view->updateView(true);
+    }
+
+    emit loadingProgress(this, lines);
+}
+
+void KTextEditor::DocumentPrivate::slotBackgroundHighlightingProgress(int line)
+{
+    // the new highlighted lines got tagged already, repaint them
+    foreach (KTextEditor::ViewPrivate *view, m_views) {
+        view->updateView(true);
+    }
+
+    emit highlightingProgress(this, line);
+}
+
+void KTextEditor::DocumentPrivate::slotBackgroundLoadingFinished(bool success)
+{
+    finishOpenFile(success);
+
+    /**
+     * loading is done now, back to old read-write mode before loading
+     * finishOpenFile might have reset it because of errors
+     */
+    if (m_documentState == DocumentLoading) {
+        setReadWrite(m_readWriteStateBeforeLoading);
+        delete m_loadingMessage;
+    }
+
+    m_documentState = DocumentIdle;
+    m_reloading = false;
+
+    // a reload waits for the lines to restore the cursors and marks
+    finishReload();
 }
 
 bool KTextEditor::DocumentPrivate::saveFile()
@@ -2663,6 +2797,19 @@ bool KTextEditor::DocumentPrivate::closeUrl()
         return false;
     }
 
+    //
+    // stop loading in the background, if still running
+    //
+    if (m_buffer->isLoading()) {
+        m_buffer->cancelLoading();
+        discardReload();
+
+        if (m_documentState == DocumentLoading) {
+            setReadWrite(m_readWriteStateBeforeLoading);
+            m_documentState = DocumentIdle;
+        }
+    }
+
     // Tell the world that we're about to go ahead with the close
     if (!m_reloading) {
         emit aboutToClose(this);
@@ -4167,13 +4314,6 @@ void KTextEditor::DocumentPrivate::setModifiedOnDisk(ModifiedOnDiskReason reason
     emit modifiedOnDisk(this, (reason != OnDiskUnmodified), reason);
 }
 
-class KateDocumentTmpMark
-{
-public:
-    QString line;
-    KTextEditor::Mark mark;
-};
-
 void KTextEditor::DocumentPrivate::setModifiedOnDiskWarning(bool on)
 {
     m_fileChangedDialogsActivated = on;
@@ -4214,62 +4354,88 @@ bool KTextEditor::DocumentPrivate::documentReload()
 
     emit aboutToReload(this);
 
-    QList<KateDocumentTmpMark> tmp;
-
+    QList<KateDocumentTmpMark> reloadMarks;
     for (QHash<int, KTextEditor::Mark *>::const_iterator i = m_marks.constBegin(); i != m_marks.constEnd(); ++i) {
         KateDocumentTmpMark m;
 
         m.line = line(i.value()->line);
         m.mark = *i.value();
 
-        tmp.append(m);
+        reloadMarks.append(m);
     }
 
-    const QString oldMode = mode();
-    const bool byUser = m_fileTypeSetByUser;
-    const QString hl_mode = highlightingMode();
+    m_reloadMode = mode();
+    m_reloadModeSetByUser = m_fileTypeSetByUser;
+    m_reloadHighlightingMode = highlightingMode();
 
     m_storedVariables.clear();
 
     // save cursor positions for all views
-    QHash<KTextEditor::ViewPrivate *, KTextEditor::Cursor> cursorPositions;
+    QHash<KTextEditor::ViewPrivate *, KTextEditor::Cursor> reloadCursorPositions;
     for (auto it = m_views.constBegin(); it != m_views.constEnd(); ++it) {
         auto v = it.value();
-        cursorPositions.insert(v, v->cursorPosition());
+        reloadCursorPositions.insert(v, v->cursorPosition());
     }
 
     m_reloading = true;
     KTextEditor::DocumentPrivate::openUrl(url());
 
+    // remembered only now, closing the url above cancels what is pending
+    m_reloadMarks = reloadMarks;
+    m_reloadCursorPositions = reloadCursorPositions;
+    m_reloadPending = true;
+
     // reset some flags only valid for one reload!
     m_userSetEncodingForNextReload = false;
 
+    // with background loading, the lines are not there yet, slotBackgroundLoadingFinished() finishes the reload
+    if (!m_buffer->isLoading()) {
+        finishReload();
+    }
+
+    return true;
+}
+
+void KTextEditor::DocumentPrivate::finishReload()
+{
+    if (!m_reloadPending) {
+        return;
+    }
+    m_reloadPending = false;
+
     // restore cursor positions for all views
     for (auto it = m_views.constBegin(); it != m_views.constEnd(); ++it) {
         auto v = it.value();
         setActiveView(v);
-        v->setCursorPosition(cursorPositions.value(v));
+        v->setCursorPosition(m_reloadCursorPositions.value(v));
         if (v->isVisible()) {
             v->repaintText(false);
         }
     }
+    m_reloadCursorPositions.clear();
 
-    for (int z = 0; z < tmp.size(); z++) {
+    for (int z = 0; z < m_reloadMarks.size(); z++) {
         if (z < (int)lines()) {
-            if (line(tmp.at(z).mark.line) == tmp.at(z).line) {
-                setMark(tmp.at(z).mark.line, tmp.at(z).mark.type);
+            if (line(m_reloadMarks.at(z).mark.line) == m_reloadMarks.at(z).line) {
+                setMark(m_reloadMarks.at(z).mark.line, m_reloadMarks.at(z).mark.type);
             }
         }
     }
+    m_reloadMarks.clear();
 
-    if (byUser) {
-        setMode(oldMode);
+    if (m_reloadModeSetByUser) {
+        setMode(m_reloadMode);
     }
-    setHighlightingMode(hl_mode);
+    setHighlightingMode(m_reloadHighlightingMode);
 
     emit reloaded(this);
+}
 
-    return true;
+void KTextEditor::DocumentPrivate::discardReload()
+{
+    m_reloadPending = false;
+    m_reloadCursorPositions.clear();
+    m_reloadMarks.clear();
 }
 
 bool KTextEditor::DocumentPrivate::documentSave()
@@ -5121,6 +5287,71 @@ bool KTextEditor::DocumentPrivate::replaceText(const KTextEditor::Range &range,
     return changed;
 }
 
+QVector<KTextEditor::Range> KTextEditor::DocumentPrivate::replaceTexts(const QVector<KTextEditor::Range> &ranges, const QStringList &texts)
+{
+    Q_ASSERT(ranges.size() == texts.size());
+
+    editStart();
+
+    /**
+     * apply from back to front, this way the positions of the replacements still to do stay valid
+     * all single line replacements on one line are collected and done in one go
+     */
+    QVector<Kate::TextReplacement> lineReplacements;
+    int replacementsLine = -1;
+    for (int i = ranges.size() - 1; i >= 0; --i) {
+        const KTextEditor::Range &range = ranges.at(i);
+        const bool singleLine = range.onSingleLine() && !texts.at(i).contains(QLatin1Char('\n'));
+
+        if (!lineReplacements.isEmpty() && (!singleLine || range.start().line() != replacementsLine)) {
+            std::reverse(lineReplacements.begin(), lineReplacements.end());
+            editReplaceText(replacementsLine, lineReplacements);
+            lineReplacements.clear();
+        }
+
+        if (singleLine) {
+            replacementsLine = range.start().line();
+            lineReplacements.append({range.start().column(), range.columnWidth(), texts.at(i)});
+        } else {
+            replaceText(range, texts.at(i));
+        }
+    }
+
+    if (!lineReplacements.isEmpty()) {
+        std::reverse(lineReplacements.begin(), lineReplacements.end());
+        editReplaceText(replacementsLine, lineReplacements);
+    }
+
+    editEnd();
+
+    /**
+     * compute where the new texts ended up
+     * line and column shift of the positions behind the end of the last replacement
+     */
+    QVector<KTextEditor::Range> newRanges;
+    newRanges.reserve(ranges.size());
+    int lineShift = 0;
+    int columnShiftLine = -1;
+    int columnShift = 0;
+    for (int i = 0; i < ranges.size(); ++i) {
+        const KTextEditor::Range &range = ranges.at(i);
+        const QString &text = texts.at(i);
+
+        const KTextEditor::Cursor start(range.start().line() + lineShift,
+                                        range.start().column() + (range.start().line() == columnShiftLine ? columnShift : 0));
+        const int newLines = text.count(QLatin1Char('\n'));
+        const KTextEditor::Cursor end = newLines ? KTextEditor::Cursor(start.line() + newLines, text.size() - text.lastIndexOf(QLatin1Char('\n')) - 1)
+                                        : KTextEditor::Cursor(start.line(), start.column() + text.size());
+        newRanges.append(KTextEditor::Range(start, end));
+
+        lineShift += newLines - (range.end().line() - range.start().line());
+        columnShift = end.column() - range.end().column();
+        columnShiftLine = range.end().line();
+    }
+
+    return newRanges;
+}
+
 KateHighlighting *KTextEditor::DocumentPrivate::highlight() const
 {
     return m_buffer->highlight();
@@ -5304,6 +5535,13 @@ void KTextEditor::DocumentPrivate::slotStarted(KIO::Job *job)
 
 void KTextEditor::DocumentPrivate::slotCompleted()
 {
+    /**
+     * file still loading in the background, slotBackgroundLoadingFinished will finish it
+     */
+    if (m_documentState == DocumentLoading && m_buffer->isLoading()) {
+        return;
+    }
+
     /**
      * if were loading, reset back to old read-write mode before loading
      * and kill the possible loading message
@@ -5368,9 +5606,9 @@ void KTextEditor::DocumentPrivate::slotTriggerLoadingMessage()
     m_loadingMessage->setPosition(KTextEditor::Message::TopInView);
 
     /**
-     * if around job: add cancel action
+     * if around job or background loading: add cancel action
      */
-    if (m_loadingJob) {
+    if (m_loadingJob || m_buffer->isLoading()) {
         QAction *cancel = new QAction(i18n("&Abort Loading"), nullptr);
         connect(cancel, SIGNAL(triggered()), this, SLOT(slotAbortLoading()));
         m_loadingMessage->addAction(cancel);
@@ -5384,6 +5622,23 @@ void KTextEditor::DocumentPrivate::slotTriggerLoadingMessage()
 
 void KTextEditor::DocumentPrivate::slotAbortLoading()
 {
+    /**
+     * background loading: stop it, the partially loaded content is dropped
+     * signal results like a killed job would do
+     */
+    if (m_buffer->isLoading()) {
+        m_buffer->cancelLoading();
+        discardReload();
+
+        foreach (KTextEditor::ViewPrivate *view, m_views) {
+            view->setCursorPosition(KTextEditor::Cursor());
+            view->updateView(true);
+        }
+
+        emit canceled(i18n("Loading of the file was aborted."));
+        return;
+    }
+
     /**
      * no job, no work
      */
@@ -5869,8 +6124,7 @@ int KTextEditor::DocumentPrivate::defStyleNum(int line, int column)
     if (column < tl->length()) {
         attribute = tl->attribute(column);
     } else if (column == tl->length()) {
-        KateHlContext *context = tl->contextStack().isEmpty() ? highlight()->contextNum(0) : highlight()->contextNum(tl->contextStack().back());
-        attribute = context->attr;
+        attribute = highlight()->attribute(tl->contextStack().isEmpty() ? 0 : tl->contextStack().back());
     } else {
         return -1;
     }
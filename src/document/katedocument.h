@@ -56,6 +56,7 @@ class TransferJob;
 namespace Kate
 {
 class SwapFile;
+class TextReplacement;
 }
 
 class KateBuffer;
@@ -69,6 +70,16 @@ class KateDocumentTest;
 class KateAutoIndent;
 class KateModOnHdPrompt;
 
+/**
+ * Mark remembered across a reload, together with the text of its line.
+ */
+class KateDocumentTmpMark
+{
+public:
+    QString line;
+    KTextEditor::Mark mark;
+};
+
 /**
  * @brief Backend of KTextEditor::Document related public KTextEditor interfaces.
  *
@@ -171,6 +182,16 @@ public Q_SLOTS:
 
     bool replaceText(const KTextEditor::Range &range, const QString &s, bool block = false) Q_DECL_OVERRIDE;
 
+    /**
+     * Replace many ranges in one editing transaction, e.g. for replace all.
+     * All single line replacements on the same line are applied at once with editReplaceText(),
+     * other ones fall back to replaceText().
+     * @param ranges ranges to replace, sorted and not overlapping
+     * @param texts new text for each range
+     * @return ranges of the inserted texts, in the same order
+     */
+    QVector<KTextEditor::Range> replaceTexts(const QVector<KTextEditor::Range> &ranges, const QStringList &texts);
+
     // unhide method...
     bool replaceText(const KTextEditor::Range &r, const QStringList &l, bool b) Q_DECL_OVERRIDE
     {
@@ -195,6 +216,21 @@ public:
     int totalCharacters() const Q_DECL_OVERRIDE;
     int lineLength(int line) const Q_DECL_OVERRIDE;
 
+    /**
+     * Character offset of @p cursor in the text of the document, each line break counts as one character.
+     * This uses the block index of the buffer and is O(log n) in the number of lines.
+     * @param cursor position, the column is clamped to the line length
+     * @return offset or -1 for a position outside of the document
+     */
+    qint64 cursorToOffset(const KTextEditor::Cursor &cursor) const;
+
+    /**
+     * Position of the character @p offset, the inverse of cursorToOffset().
+     * @param offset character offset, each line break counts as one character
+     * @return position or an invalid cursor for an offset outside of the document
+     */
+    KTextEditor::Cursor offsetToCursor(qint64 offset) const;
+
 Q_SIGNALS:
     void charactersSemiInteractivelyInserted(const KTextEditor::Cursor &position, const QString &text);
 
@@ -275,6 +311,17 @@ public:
      */
     bool editRemoveText(int line, int col, int len);
 
+    /**
+     * Replace several parts of the given line in one go.
+     * This is much cheaper than one editRemoveText() and editInsertText() per part,
+     * the line is rebuilt once and the whole change is one undo item.
+     * @param line line number
+     * @param replacements replacements sorted by column, not overlapping and without line breaks,
+     *        the columns refer to the line before any replacement is done
+     * @return true on success
+     */
+    bool editReplaceText(int line, const QVector<Kate::TextReplacement> &replacements);
+
     /**
      * Mark @p line as @p autowrapped. This is necessary if static word warp is
      * enabled, because we have to know whether to insert a new line or add the
@@ -732,6 +779,34 @@ public:
      */
     bool openFile() Q_DECL_OVERRIDE;
 
+private:
+    /**
+     * second half of openFile, after the buffer has loaded all lines
+     * read variables, update views, report errors
+     * @param success did the loading of the buffer work?
+     */
+    void finishOpenFile(bool success);
+
+private Q_SLOTS:
+    /**
+     * the buffer loading in the background got new lines
+     * @param lines number of lines loaded so far
+     */
+    void slotBackgroundLoadingProgress(int lines);
+
+    /**
+     * the buffer highlighted some more lines in the background
+     * @param line highlighting is up to date until this line
+     */
+    void slotBackgroundHighlightingProgress(int line);
+
+    /**
+     * the buffer loading in the background is done
+     * @param success did the loading work?
+     */
+    void slotBackgroundLoadingFinished(bool success);
+
+public:
     /**
      * save the file obtained by the kparts framework
      * the framework abstracts the uploading of remote files
@@ -1096,6 +1171,26 @@ private:
      */
     bool m_reloading;
 
+    /**
+     * documentReload() waits for the background loading to restore the state below, see finishReload()
+     */
+    bool m_reloadPending;
+    QList<KateDocumentTmpMark> m_reloadMarks;
+    QHash<KTextEditor::ViewPrivate *, KTextEditor::Cursor> m_reloadCursorPositions;
+    QString m_reloadMode;
+    QString m_reloadHighlightingMode;
+    bool m_reloadModeSetByUser;
+
+    /**
+     * Restore the cursors, marks and modes remembered by documentReload() and emit reloaded().
+     */
+    void finishReload();
+
+    /**
+     * Forget what documentReload() remembered, the loading got cancelled.
+     */
+    void discardReload();
+
 public Q_SLOTS:
     void slotQueryClose_save(bool *handled, bool *abortClosing);
 
@@ -1400,6 +1495,20 @@ public:
 Q_SIGNALS:
     void loaded(KTextEditor::DocumentPrivate *document);
 
+    /**
+     * emitted while a large file is loaded in the background, loaded() follows at the end
+     * @param document this document
+     * @param lines number of lines loaded so far
+     */
+    void loadingProgress(KTextEditor::DocumentPrivate *document, int lines);
+
+    /**
+     * emitted while far lines requested for display are highlighted in the background
+     * @param document this document
+     * @param line highlighting is up to date until this line
+     */
+    void highlightingProgress(KTextEditor::DocumentPrivate *document, int line);
+
 private Q_SLOTS:
     /**
      * trigger a close of this document in the application
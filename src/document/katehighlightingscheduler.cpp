@@ -0,0 +1,220 @@
+/*  This file is part of the KDE libraries and the Kate part.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "katehighlightingscheduler.h"
+#include "katebuffer.h"
+#include "kateview.h"
+
+/**
+ * Time in ms one background highlighting slice may block the event loop
+ */
+static const int KATE_HL_TIME_SLICE = 10;
+
+/**
+ * Lines highlighted beyond the visible ones before the idle highlighting takes over
+ */
+static const int KATE_HL_LOOKAHEAD_LINES = 4096;
+
+KateHighlightingScheduler::KateHighlightingScheduler()
+    : m_slices(0)
+    , m_highlightedLines(0)
+    , m_firstFrames(0)
+    , m_lastFirstFrameLatency(0)
+    , m_maxFirstFrameLatency(0)
+    , m_totalFirstFrameLatency(0)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setInterval(0);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(runSlice()));
+}
+
+KateHighlightingScheduler::~KateHighlightingScheduler()
+{
+}
+
+KateHighlightingScheduler::Priority KateHighlightingScheduler::priorityForView(const KTextEditor::ViewPrivate *view)
+{
+    // lines of hidden views are needed only once they get shown
+    if (!view || !view->isVisible()) {
+        return LookaheadPriority;
+    }
+
+    return view->hasFocus() ? FocusedViewPriority : VisibleViewPriority;
+}
+
+void KateHighlightingScheduler::schedule(KateBuffer *buffer, int line, Priority priority)
+{
+    Q_ASSERT(buffer);
+
+    const int index = indexOf(buffer);
+    if (index < 0) {
+        Request request;
+        request.buffer = buffer;
+        request.line = line;
+        request.priority = priority;
+        request.queued.start();
+        m_requests.append(request);
+    } else {
+        Request &request = m_requests[index];
+        if (priority < request.priority) {
+            // the lookahead or idle line is derived again once these lines are done
+            request.line = line;
+            request.priority = priority;
+            request.queued.start();
+        } else if (priority == request.priority) {
+            request.line = qMax(request.line, line);
+        }
+    }
+
+    if (!m_timer.isActive()) {
+        m_timer.start();
+    }
+}
+
+void KateHighlightingScheduler::cancel(KateBuffer *buffer)
+{
+    const int index = indexOf(buffer);
+    if (index >= 0) {
+        m_requests.remove(index);
+    }
+}
+
+int KateHighlightingScheduler::queueDepth() const
+{
+    int depth = 0;
+    foreach (const Request &request, m_requests) {
+        if (request.buffer) {
+            ++depth;
+        }
+    }
+    return depth;
+}
+
+int KateHighlightingScheduler::queueDepth(Priority priority) const
+{
+    int depth = 0;
+    foreach (const Request &request, m_requests) {
+        if (request.buffer && request.priority == priority) {
+            ++depth;
+        }
+    }
+    return depth;
+}
+
+void KateHighlightingScheduler::resetStatistics()
+{
+    m_slices = 0;
+    m_highlightedLines = 0;
+    m_firstFrames = 0;
+    m_lastFirstFrameLatency = 0;
+    m_maxFirstFrameLatency = 0;
+    m_totalFirstFrameLatency = 0;
+}
+
+void KateHighlightingScheduler::runSlice()
+{
+    ++m_slices;
+
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < KATE_HL_TIME_SLICE) {
+        int index = nextRequest();
+        if (index < 0) {
+            break;
+        }
+
+        QPointer<KateBuffer> buffer = m_requests[index].buffer;
+        const int line = m_requests[index].line;
+        const Priority priority = m_requests[index].priority;
+        const int startLine = buffer->lastHighlightedLine();
+        const bool done = buffer->highlightUntil(line, timer, KATE_HL_TIME_SLICE);
+
+        // the progress signals repaint the views, that may have changed the request meanwhile
+        if (!buffer) {
+            continue;
+        }
+        m_highlightedLines += qMax(0, buffer->lastHighlightedLine() - startLine);
+        index = indexOf(buffer);
+        if (done && index >= 0 && m_requests[index].line == line && m_requests[index].priority == priority) {
+            advance(index);
+        }
+    }
+
+    // more to do? give the event loop a chance first
+    if (nextRequest() >= 0) {
+        m_timer.start();
+    }
+}
+
+int KateHighlightingScheduler::indexOf(KateBuffer *buffer) const
+{
+    for (int i = 0; i < m_requests.size(); ++i) {
+        if (m_requests[i].buffer == buffer) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int KateHighlightingScheduler::nextRequest()
+{
+    int best = -1;
+    for (int i = 0; i < m_requests.size(); ++i) {
+        if (!m_requests[i].buffer) {
+            m_requests.remove(i--);
+            continue;
+        }
+
+        if (best < 0 || m_requests[i].priority < m_requests[best].priority) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+void KateHighlightingScheduler::advance(int index)
+{
+    Request request = m_requests.takeAt(index);
+
+    switch (request.priority) {
+    case FocusedViewPriority:
+    case VisibleViewPriority: {
+        // the views show the right attributes now
+        const qint64 latency = request.queued.elapsed();
+        ++m_firstFrames;
+        m_lastFirstFrameLatency = latency;
+        m_maxFirstFrameLatency = qMax(m_maxFirstFrameLatency, latency);
+        m_totalFirstFrameLatency += latency;
+
+        request.line += KATE_HL_LOOKAHEAD_LINES;
+        request.priority = LookaheadPriority;
+        break;
+    }
+
+    case LookaheadPriority:
+        request.line = request.buffer->lines() - 1;
+        request.priority = IdlePriority;
+        break;
+
+    case IdlePriority:
+        return;
+    }
+
+    // behind the other requests of the same priority
+    m_requests.append(request);
+}
@@ -0,0 +1,207 @@
+/*  This file is part of the KDE libraries and the Kate part.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KATE_HIGHLIGHTING_SCHEDULER_H
+#define KATE_HIGHLIGHTING_SCHEDULER_H
+
+#include <ktexteditor_export.h>
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+#include <QVector>
+
+class KateBuffer;
+namespace KTextEditor { class ViewPrivate; }
+
+/**
+ * Background highlighting of all documents, shared by the whole editor.
+ *
+ * Buffers queue the lines they can't highlight at once here, see
+ * KateBuffer::requestHighlighting(). Each time slice the scheduler works
+ * on the request with the best priority: the visible lines of the focused
+ * view first, then the ones of other visible views. Once the visible lines
+ * of a buffer are done, it continues with some lookahead and at last with
+ * the rest of the document while nothing else is to do.
+ */
+class KTEXTEDITOR_EXPORT KateHighlightingScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Priority of a highlighting request, lower values are done first.
+     */
+    enum Priority {
+        FocusedViewPriority = 0,
+        VisibleViewPriority,
+        LookaheadPriority,
+        IdlePriority
+    };
+
+    KateHighlightingScheduler();
+    ~KateHighlightingScheduler();
+
+    /**
+     * Priority for lines shown in the given view.
+     * @param view view showing the lines, may be 0
+     * @return focused or visible view priority, lookahead for hidden views
+     */
+    static Priority priorityForView(const KTextEditor::ViewPrivate *view);
+
+    /**
+     * Queue highlighting of @p buffer up to @p line.
+     * A buffer has at most one request, a new one raises its priority
+     * or extends its target line.
+     * @param buffer buffer to highlight
+     * @param line line the highlighting should reach
+     * @param priority priority of the request
+     */
+    void schedule(KateBuffer *buffer, int line, Priority priority);
+
+    /**
+     * Drop the request of @p buffer, e.g. after it got cleared.
+     * @param buffer buffer not to highlight any longer
+     */
+    void cancel(KateBuffer *buffer);
+
+    /**
+     * Number of buffers waiting for background highlighting.
+     * @return queue depth
+     */
+    int queueDepth() const;
+
+    /**
+     * Number of buffers waiting with the given priority.
+     * @param priority priority to count
+     * @return queue depth for @p priority
+     */
+    int queueDepth(Priority priority) const;
+
+    /**
+     * Time slices run so far.
+     */
+    qint64 slices() const
+    {
+        return m_slices;
+    }
+
+    /**
+     * Lines highlighted in the background so far.
+     */
+    qint64 highlightedLines() const
+    {
+        return m_highlightedLines;
+    }
+
+    /**
+     * Number of visible requests done so far, the latency statistics are about these.
+     */
+    qint64 firstFrames() const
+    {
+        return m_firstFrames;
+    }
+
+    /**
+     * Time in ms from queueing the lines of a view until they got highlighted,
+     * for the last visible request done.
+     */
+    qint64 lastFirstFrameLatency() const
+    {
+        return m_lastFirstFrameLatency;
+    }
+
+    /**
+     * Maximal latency to the first highlighted frame, in ms.
+     */
+    qint64 maxFirstFrameLatency() const
+    {
+        return m_maxFirstFrameLatency;
+    }
+
+    /**
+     * Average latency to the first highlighted frame, in ms.
+     */
+    qint64 averageFirstFrameLatency() const
+    {
+        return m_firstFrames ? m_totalFirstFrameLatency / m_firstFrames : 0;
+    }
+
+    /**
+     * Reset the slice, line and latency statistics.
+     */
+    void resetStatistics();
+
+private Q_SLOTS:
+    /**
+     * Highlight the queued requests in order of their priority
+     * until the time slice is used up.
+     */
+    void runSlice();
+
+private:
+    /**
+     * One queued request, per buffer.
+     */
+    struct Request {
+        QPointer<KateBuffer> buffer;
+        int line;
+        Priority priority;
+        QElapsedTimer queued;
+    };
+
+    /**
+     * Index of the buffer's request, -1 if none.
+     */
+    int indexOf(KateBuffer *buffer) const;
+
+    /**
+     * Index of the request to work on next, drops the ones of deleted buffers.
+     * @return request index, -1 if the queue is empty
+     */
+    int nextRequest();
+
+    /**
+     * The request at @p index reached its line, continue with the next priority or drop it.
+     */
+    void advance(int index);
+
+private:
+    /**
+     * queued requests, in order of arrival for equal priority
+     */
+    QVector<Request> m_requests;
+
+    /**
+     * triggers the next time slice
+     */
+    QTimer m_timer;
+
+    /**
+     * statistics
+     */
+    qint64 m_slices;
+    qint64 m_highlightedLines;
+    qint64 m_firstFrames;
+    qint64 m_lastFirstFrameLatency;
+    qint64 m_maxFirstFrameLatency;
+    qint64 m_totalFirstFrameLatency;
+};
+
+#endif
@@ -22,6 +22,13 @@
 #include "katelayoutcache.h"
 
 #include <QtAlgorithms>
+#include <QAtomicInt>
+#include <QMetaObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
 
 #include "katerenderer.h"
 #include "kateview.h"
@@ -29,6 +36,16 @@
 #include "katebuffer.h"
 #include "katepartdebug.h"
 
+/**
+ * Wrapped lines from this length on are laid out in the background.
+ */
+static const int KATE_ASYNC_LAYOUT_CHARACTERS = 100000;
+
+/**
+ * Characters of such lines laid out for their placeholders per view update.
+ */
+static const int KATE_LAYOUT_BUDGET_CHARACTERS = 20000;
+
 namespace {
 
 bool enableLayoutCache = false;
@@ -41,6 +58,103 @@ bool lessThan(const KateLineLayoutMap::LineLayoutPair &lhs,
 
 }
 
+/**
+ * Lays out a very long line in the global thread pool.
+ * The receiver doesn't wait for the job when it goes away, it abandons it instead,
+ * the job then deletes itself once it is done.
+ */
+class KateLayoutJob : public QRunnable
+{
+public:
+    KateLayoutJob(QObject *receiver, int line, const KateShapingCache::Key &key, const QTextOption &option, int firstNonSpace)
+        : line(line)
+        , key(key)
+        , option(option)
+        , firstNonSpace(firstNonSpace)
+        , shiftX(-1)
+        , m_receiver(receiver)
+    {
+        setAutoDelete(false);
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        // nobody wants the layout of a job abandoned before it started
+        if (!isAbandoned()) {
+            layout = KateRenderer::createLayout(key, option, firstNonSpace, true, shiftX);
+        }
+
+        bool abandoned = false;
+        {
+            QMutexLocker locker(&m_mutex);
+            m_finished.storeRelease(1);
+            abandoned = !m_receiver;
+            if (!abandoned) {
+                QMetaObject::invokeMethod(m_receiver, "layoutJobsDone", Qt::QueuedConnection);
+            }
+        }
+
+        if (abandoned) {
+            delete this;
+            return;
+        }
+        m_done.release();
+    }
+
+    bool isFinished() const
+    {
+        return m_finished.loadAcquire();
+    }
+
+    /**
+     * Block until run() is done, only to be called once isFinished().
+     */
+    void wait()
+    {
+        m_done.acquire();
+        m_done.release();
+    }
+
+    /**
+     * Forget the receiver, it must not touch the job anymore afterwards.
+     * Deletes the job right away if it is done, else run() does that.
+     */
+    void abandon()
+    {
+        bool finished = false;
+        {
+            QMutexLocker locker(&m_mutex);
+            m_receiver = nullptr;
+            finished = isFinished();
+        }
+
+        if (finished) {
+            wait();
+            delete this;
+        }
+    }
+
+    const int line;
+    const KateShapingCache::Key key;
+    const QTextOption option;
+    const int firstNonSpace;
+
+    QSharedPointer<QTextLayout> layout;
+    int shiftX;
+
+private:
+    bool isAbandoned()
+    {
+        QMutexLocker locker(&m_mutex);
+        return !m_receiver;
+    }
+
+    QMutex m_mutex;
+    QObject *m_receiver;
+    QAtomicInt m_finished;
+    QSemaphore m_done;
+};
+
 //BEGIN KateLineLayoutMap
 KateLineLayoutMap::KateLineLayoutMap()
 {
@@ -149,6 +263,7 @@ KateLayoutCache::KateLayoutCache(KateRenderer *renderer, QObject *parent)
     , m_viewWidth(0)
     , m_wrap(false)
     , m_acceptDirtyLayouts(false)
+    , m_layoutBudget(KATE_LAYOUT_BUDGET_CHARACTERS)
 {
     Q_ASSERT(m_renderer);
 
@@ -159,6 +274,15 @@ KateLayoutCache::KateLayoutCache(KateRenderer *renderer, QObject *parent)
     connect(&m_renderer->doc()->buffer(), SIGNAL(lineUnwrapped(int)), this, SLOT(unwrapLine(int)));
     connect(&m_renderer->doc()->buffer(), SIGNAL(textInserted(KTextEditor::Cursor,QString)), this, SLOT(insertText(KTextEditor::Cursor,QString)));
     connect(&m_renderer->doc()->buffer(), SIGNAL(textRemoved(KTextEditor::Range,QString)), this, SLOT(removeText(KTextEditor::Range)));
+    connect(&m_renderer->doc()->buffer(), SIGNAL(textReplaced(int,QVector<Kate::TextReplacement>,QStringList)), this, SLOT(replaceText(int)));
+}
+
+KateLayoutCache::~KateLayoutCache()
+{
+    // don't block the closing of the view on a long layout
+    foreach (KateLayoutJob *job, m_layoutJobs) {
+        job->abandon();
+    }
 }
 
 void KateLayoutCache::updateViewCache(const KTextEditor::Cursor &startPos, int newViewLineCount, int viewLinesScrolled)
@@ -171,6 +295,7 @@ void KateLayoutCache::updateViewCache(const KTextEditor::Cursor &startPos, int n
     }
 
     enableLayoutCache = true;
+    m_layoutBudget = KATE_LAYOUT_BUDGET_CHARACTERS;
 
     int realLine;
     if (newViewLineCount == -1) {
@@ -305,12 +430,12 @@ KateLineLayoutPtr KateLayoutCache::line(int realLine, int virtualLine)
         if (!l->isValid()) {
             l->setUsePlainTextLine(acceptDirtyLayouts());
             l->textLine(!acceptDirtyLayouts());
-            m_renderer->layoutLine(l, wrap() ? m_viewWidth : -1, enableLayoutCache);
+            layoutLine(l);
         } else if (l->isLayoutDirty() && !acceptDirtyLayouts()) {
             // reset textline
             l->setUsePlainTextLine(false);
             l->textLine(true);
-            m_renderer->layoutLine(l, wrap() ? m_viewWidth : -1, enableLayoutCache);
+            layoutLine(l);
         }
 
         Q_ASSERT(l->isValid() && (!l->isLayoutDirty() || acceptDirtyLayouts()));
@@ -331,7 +456,7 @@ KateLineLayoutPtr KateLayoutCache::line(int realLine, int virtualLine)
         l->setUsePlainTextLine(true);
     }
 
-    m_renderer->layoutLine(l, wrap() ? m_viewWidth : -1, enableLayoutCache);
+    layoutLine(l);
     Q_ASSERT(l->isValid());
 
     if (acceptDirtyLayouts()) {
@@ -342,6 +467,90 @@ KateLineLayoutPtr KateLayoutCache::line(int realLine, int virtualLine)
     return l;
 }
 
+void KateLayoutCache::layoutLine(KateLineLayoutPtr lineLayout)
+{
+    const int maxWidth = wrap() ? m_viewWidth : -1;
+
+    // without wrapping, a placeholder had to shape all of the line, too
+    if (maxWidth <= 0 || lineLayout->length() < KATE_ASYNC_LAYOUT_CHARACTERS) {
+        m_renderer->layoutLine(lineLayout, maxWidth, enableLayoutCache);
+        return;
+    }
+
+    QTextOption option;
+    int firstNonSpace = 0;
+    const KateShapingCache::Key key = m_renderer->layoutKey(lineLayout, maxWidth, option, firstNonSpace);
+
+    // one job per line, the last one finished decides whether to start another
+    KateLayoutJob *job = nullptr;
+    foreach (KateLayoutJob *candidate, m_layoutJobs) {
+        if (candidate->line == lineLayout->line()) {
+            job = candidate;
+            break;
+        }
+    }
+
+    if (job && job->isFinished()) {
+        job->wait();
+        m_layoutJobs.removeOne(job);
+
+        if (job->key == key) {
+            if (job->shiftX >= 0) {
+                lineLayout->setShiftX(job->shiftX);
+            }
+            lineLayout->setLayout(job->layout);
+            delete job;
+            return;
+        }
+
+        // the line changed meanwhile
+        delete job;
+        job = nullptr;
+    }
+
+    if (!job) {
+        job = new KateLayoutJob(this, lineLayout->line(), key, option, firstNonSpace);
+        m_layoutJobs.append(job);
+        QThreadPool::globalInstance()->start(job);
+    }
+
+    // until then, lay out what this view update can afford and estimate the rest
+    const int characters = qMin(m_layoutBudget, key.text.size());
+    m_layoutBudget -= characters;
+
+    int shiftX = -1;
+    const QSharedPointer<QTextLayout> placeholder = KateRenderer::createPlaceholderLayout(key, option, firstNonSpace, characters, shiftX);
+    if (shiftX >= 0) {
+        lineLayout->setShiftX(shiftX);
+    }
+    lineLayout->setLayout(placeholder);
+}
+
+void KateLayoutCache::layoutJobsDone()
+{
+    QList<int> lines;
+    foreach (KateLayoutJob *job, m_layoutJobs) {
+        if (job->isFinished() && !lines.contains(job->line)) {
+            lines.append(job->line);
+        }
+    }
+
+    // the views lay the lines out again and take the finished layouts
+    foreach (int line, lines) {
+        emit lineLaidOut(line);
+    }
+
+    // the others belong to lines not shown anymore
+    for (int i = m_layoutJobs.size() - 1; i >= 0; --i) {
+        KateLayoutJob *job = m_layoutJobs.at(i);
+        if (job->isFinished()) {
+            job->wait();
+            m_layoutJobs.removeAt(i);
+            delete job;
+        }
+    }
+}
+
 KateLineLayoutPtr KateLayoutCache::line(const KTextEditor::Cursor &realCursor)
 {
     return line(realCursor.line());
@@ -538,6 +747,11 @@ void KateLayoutCache::removeText(const KTextEditor::Range &range)
     m_lineLayouts.slotEditDone(range.start().line(), range.start().line(), 0);
 }
 
+void KateLayoutCache::replaceText(int line)
+{
+    m_lineLayouts.slotEditDone(line, line, 0);
+}
+
 void KateLayoutCache::clear()
 {
     m_textLayouts.clear();
@@ -22,6 +22,7 @@
 #ifndef KATELAYOUTCACHE_H
 #define KATELAYOUTCACHE_H
 
+#include <QList>
 #include <QPair>
 
 #include <ktexteditor/range.h>
@@ -29,6 +30,7 @@
 #include "katetextlayout.h"
 
 class KateRenderer;
+class KateLayoutJob;
 
 class KateLineLayoutMap
 {
@@ -78,6 +80,7 @@ class KateLayoutCache : public QObject
 
 public:
     explicit KateLayoutCache(KateRenderer *renderer, QObject *parent);
+    ~KateLayoutCache();
 
     void clear();
 
@@ -139,13 +142,29 @@ public:
     void viewCacheDebugOutput() const;
     // END
 
+Q_SIGNALS:
+    /**
+     * The layout of a very long line got computed in the background,
+     * the line has to be laid out again to replace its placeholder.
+     */
+    void lineLaidOut(int realLine);
+
 private Q_SLOTS:
+    void layoutJobsDone();
+
     void wrapLine(const KTextEditor::Cursor &position);
     void unwrapLine(int line);
     void insertText(const KTextEditor::Cursor &position, const QString &text);
     void removeText(const KTextEditor::Range &range);
+    void replaceText(int line);
 
 private:
+    /**
+     * Lay out a line with the renderer. Very long wrapped lines are laid out
+     * in the background, a placeholder stands in until that is done.
+     */
+    void layoutLine(KateLineLayoutPtr lineLayout);
+
     KateRenderer *m_renderer;
 
     /**
@@ -163,6 +182,17 @@ private:
     int m_viewWidth;
     bool m_wrap;
     bool m_acceptDirtyLayouts;
+
+    /**
+     * layouts of very long lines, computed in the global thread pool
+     */
+    QList<KateLayoutJob *> m_layoutJobs;
+
+    /**
+     * characters of very long lines still to lay out for placeholders
+     * in this view update, the rest of the lines is estimated
+     */
+    int m_layoutBudget;
 };
 
 #endif
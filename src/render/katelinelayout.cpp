@@ -35,7 +35,6 @@ KateLineLayout::KateLineLayout(KateRenderer &renderer)
     , m_line(-1)
     , m_virtualLine(-1)
     , m_shiftX(0)
-    , m_layout(nullptr)
     , m_layoutDirty(true)
     , m_usePlainTextLine(false)
 {
@@ -43,7 +42,6 @@ KateLineLayout::KateLineLayout(KateRenderer &renderer)
 
 KateLineLayout::~KateLineLayout()
 {
-    delete m_layout;
 }
 
 void KateLineLayout::clear()
@@ -53,8 +51,7 @@ void KateLineLayout::clear()
     m_virtualLine = -1;
     m_shiftX = 0;
     // not touching dirty
-    delete m_layout;
-    m_layout = nullptr;
+    m_layout.clear();
     // not touching layout dirty
 }
 
@@ -66,7 +63,15 @@ bool KateLineLayout::includesCursor(const KTextEditor::Cursor &realCursor) const
 const Kate::TextLine &KateLineLayout::textLine(bool reloadForce) const
 {
     if (reloadForce || !m_textLine) {
-        m_textLine = usePlainTextLine() ? m_renderer.doc()->plainKateTextLine(line()) : m_renderer.doc()->kateTextLine(line());
+        if (usePlainTextLine()) {
+            m_textLine = m_renderer.doc()->plainKateTextLine(line());
+        } else if (!m_renderer.isPrinterFriendly()) {
+            // on screen, far lines show outdated attributes until their highlighting is done in the background
+            m_renderer.doc()->buffer().requestHighlighting(line(), 64, KateHighlightingScheduler::priorityForView(m_renderer.view()));
+            m_textLine = m_renderer.doc()->plainKateTextLine(line());
+        } else {
+            m_textLine = m_renderer.doc()->kateTextLine(line());
+        }
     }
 
     Q_ASSERT(m_textLine);
@@ -126,16 +131,18 @@ bool KateLineLayout::isValid() const
 }
 
 QTextLayout *KateLineLayout::layout() const
+{
+    return m_layout.data();
+}
+
+QSharedPointer<QTextLayout> KateLineLayout::sharedLayout() const
 {
     return m_layout;
 }
 
-void KateLineLayout::setLayout(QTextLayout *layout)
+void KateLineLayout::setLayout(const QSharedPointer<QTextLayout> &layout)
 {
-    if (m_layout != layout) {
-        delete m_layout;
-        m_layout = layout;
-    }
+    m_layout = layout;
 
     m_layoutDirty = !m_layout;
     m_dirtyList.clear();
@@ -147,7 +154,7 @@ void KateLineLayout::setLayout(QTextLayout *layout)
 
 void KateLineLayout::invalidateLayout()
 {
-    setLayout(nullptr);
+    setLayout(QSharedPointer<QTextLayout>());
 }
 
 bool KateLineLayout::isDirty(int viewLine) const
@@ -23,6 +23,7 @@
 
 #include <QSharedData>
 #include <QExplicitlySharedDataPointer>
+#include <QSharedPointer>
 
 #include "katetextline.h"
 
@@ -91,7 +92,15 @@ public:
     void setShiftX(int shiftX);
 
     QTextLayout *layout() const;
-    void setLayout(QTextLayout *layout);
+    /**
+     * Same as layout(), keeps the layout alive while the line gets laid out anew.
+     */
+    QSharedPointer<QTextLayout> sharedLayout() const;
+    /**
+     * The layout may be shared with other lines, see KateShapingCache,
+     * it must not be changed after it got set.
+     */
+    void setLayout(const QSharedPointer<QTextLayout> &layout);
     void invalidateLayout();
 
     bool isLayoutDirty() const;
@@ -104,15 +113,13 @@ private:
     // Disable copy
     KateLineLayout(const KateLineLayout &copy);
 
-    QTextLayout *takeLayout() const;
-
     KateRenderer &m_renderer;
     mutable Kate::TextLine m_textLine;
     int m_line;
     int m_virtualLine;
     int m_shiftX;
 
-    QTextLayout *m_layout;
+    QSharedPointer<QTextLayout> m_layout;
     QList<bool> m_dirtyList;
 
     bool m_layoutDirty;
@@ -30,6 +30,8 @@
 #include "katerenderrange.h"
 #include "katetextlayout.h"
 #include "katebuffer.h"
+#include "kateglobal.h"
+#include "kateshapingcache.h"
 
 #include "katepartdebug.h"
 
@@ -40,10 +42,17 @@
 #include <QRegularExpression>
 #include <QtMath> // qCeil
 
+#include <algorithm>
+
 static const QChar tabChar(QLatin1Char('\t'));
 static const QChar spaceChar(QLatin1Char(' '));
 static const QChar nbSpaceChar(0xa0); // non-breaking space
 
+/**
+ * Merged attributes of overlapping decorations kept per renderer
+ */
+static const int KATE_MAX_MERGED_ATTRIBUTES = 1024;
+
 KateRenderer::KateRenderer(KTextEditor::DocumentPrivate *doc, Kate::TextFolding &folding, KTextEditor::ViewPrivate *view)
     : m_doc(doc)
     , m_folding(folding)
@@ -57,6 +66,7 @@ KateRenderer::KateRenderer(KTextEditor::DocumentPrivate *doc, Kate::TextFolding
     , m_showSpaces(true)
     , m_showNonPrintableSpaces(false)
     , m_printerFriendly(false)
+    , m_paintSerial(0)
     , m_config(new KateRendererConfig(this))
 {
     updateAttributes();
@@ -73,6 +83,8 @@ KateRenderer::~KateRenderer()
 void KateRenderer::updateAttributes()
 {
     m_attributes = m_doc->highlight()->attributes(config()->schema());
+    m_mergedAttributes.clear();
+    ++m_paintSerial;
 }
 
 KTextEditor::Attribute::Ptr KateRenderer::attribute(uint pos) const
@@ -105,22 +117,34 @@ void KateRenderer::setCaretStyle(KateRenderer::caretStyles style)
 
 void KateRenderer::setShowTabs(bool showTabs)
 {
-    m_showTabs = showTabs;
+    if (m_showTabs != showTabs) {
+        m_showTabs = showTabs;
+        ++m_paintSerial;
+    }
 }
 
 void KateRenderer::setShowTrailingSpaces(bool showSpaces)
 {
-    m_showSpaces = showSpaces;
+    if (m_showSpaces != showSpaces) {
+        m_showSpaces = showSpaces;
+        ++m_paintSerial;
+    }
 }
 
 void KateRenderer::setShowNonPrintableSpaces(const bool on)
 {
-    m_showNonPrintableSpaces = on;
+    if (m_showNonPrintableSpaces != on) {
+        m_showNonPrintableSpaces = on;
+        ++m_paintSerial;
+    }
 }
 
 void KateRenderer::setTabWidth(int tabWidth)
 {
-    m_tabWidth = tabWidth;
+    if (m_tabWidth != tabWidth) {
+        m_tabWidth = tabWidth;
+        ++m_paintSerial;
+    }
 }
 
 bool KateRenderer::showIndentLines() const
@@ -135,12 +159,18 @@ void KateRenderer::setShowIndentLines(bool showIndentLines)
 
 void KateRenderer::setIndentWidth(int indentWidth)
 {
-    m_indentWidth = indentWidth;
+    if (m_indentWidth != indentWidth) {
+        m_indentWidth = indentWidth;
+        ++m_paintSerial;
+    }
 }
 
 void KateRenderer::setShowSelections(bool showSelections)
 {
-    m_showSelections = showSelections;
+    if (m_showSelections != showSelections) {
+        m_showSelections = showSelections;
+        ++m_paintSerial;
+    }
 }
 
 void KateRenderer::increaseFontSizes()
@@ -170,6 +200,7 @@ bool KateRenderer::isPrinterFriendly() const
 void KateRenderer::setPrinterFriendly(bool printerFriendly)
 {
     m_printerFriendly = printerFriendly;
+    ++m_paintSerial;
     setShowTabs(false);
     setShowTrailingSpaces(false);
     setShowSelections(false);
@@ -378,16 +409,18 @@ QList<QTextLayout::FormatRange> KateRenderer::decorationsForLine(const Kate::Tex
     // Don't compute the highlighting if there isn't going to be any highlighting
     QList<Kate::TextRange *> rangesWithAttributes = m_doc->buffer().rangesForLine(line, m_printerFriendly ? nullptr : m_view, true);
     if (selectionsOnly || !textLine->attributesList().isEmpty() || !rangesWithAttributes.isEmpty()) {
-        RenderRangeList renderRanges;
+        // Collect the attribute runs of all layers, where overlapping, later layers win:
+        // the inbuilt highlighting, the ranges by z-depth, at last completion or selection.
+        m_decorationSpans.resize(0);
+        int layer = 0;
 
-        // Add the inbuilt highlighting to the list
-        NormalRenderRange *inbuiltHighlight = new NormalRenderRange();
-        const QVector<Kate::TextLineData::Attribute> &al = textLine->attributesList();
+        // Add the inbuilt highlighting
+        const Kate::TextLineData::Attributes &al = textLine->attributesList();
         for (int i = 0; i < al.count(); ++i)
             if (al[i].length > 0 && al[i].attributeValue > 0) {
-                inbuiltHighlight->addRange(new KTextEditor::Range(KTextEditor::Cursor(line, al[i].offset), al[i].length), specificAttribute(al[i].attributeValue));
+                addDecorationSpan(KTextEditor::Cursor(line, al[i].offset), KTextEditor::Cursor(line, al[i].offset + al[i].length), layer, specificAttribute(al[i].attributeValue));
             }
-        renderRanges.append(inbuiltHighlight);
+        ++layer;
 
         if (!completionHighlight) {
             // check for dynamic hl stuff
@@ -421,39 +454,49 @@ QList<QTextLayout::FormatRange> KateRenderer::decorationsForLine(const Kate::Tex
                     }
                 }
 
-                // span range
-                NormalRenderRange *additionaHl = new NormalRenderRange();
-                additionaHl->addRange(new KTextEditor::Range(*kateRange), attribute);
-                renderRanges.append(additionaHl);
+                // span range, each one is a layer on its own
+                addDecorationSpan(kateRange->start().toCursor(), kateRange->end().toCursor(), layer++, attribute);
             }
         } else {
-            // Add the code completion arbitrary highlight to the list
-            renderRanges.append(completionHighlight);
+            // Add the code completion arbitrary highlight, it only tells its runs step by step
+            const KTextEditor::Cursor lineEnd(line + 1, 0);
+            for (KTextEditor::Cursor pos(line, 0); pos < lineEnd;) {
+                completionHighlight->advanceTo(pos);
+                const KTextEditor::Cursor next = completionHighlight->nextBoundary();
+                if (next <= pos) {
+                    break;
+                }
+                if (KTextEditor::Attribute::Ptr attribute = completionHighlight->currentAttribute()) {
+                    addDecorationSpan(pos, next, layer, attribute);
+                }
+                pos = next;
+            }
+            ++layer;
         }
 
         // Add selection highlighting if we're creating the selection decorations
         if ((m_view && selectionsOnly && showSelections() && m_view->selection()) || (completionHighlight && completionSelected) || (m_view && m_view->blockSelection())) {
-            NormalRenderRange *selectionHighlight = new NormalRenderRange();
-
             // Set up the selection background attribute TODO: move this elsewhere, eg. into the config?
-            static KTextEditor::Attribute::Ptr backgroundAttribute;
-            if (!backgroundAttribute) {
-                backgroundAttribute = KTextEditor::Attribute::Ptr(new KTextEditor::Attribute());
+            // a new attribute each time the colors change, the merged attributes depend on it
+            const QColor selectionForeground = attribute(KTextEditor::dsNormal)->selectedForeground().color();
+            if (!m_selectionAttribute || m_selectionAttribute->background().color() != config()->selectionColor()
+                    || m_selectionAttribute->foreground().color() != selectionForeground) {
+                m_selectionAttribute = KTextEditor::Attribute::Ptr(new KTextEditor::Attribute());
+                m_selectionAttribute->setBackground(config()->selectionColor());
+                m_selectionAttribute->setForeground(selectionForeground);
             }
 
-            backgroundAttribute->setBackground(config()->selectionColor());
-            backgroundAttribute->setForeground(attribute(KTextEditor::dsNormal)->selectedForeground().color());
-
             // Create a range for the current selection
+            KTextEditor::Range selection;
             if (completionHighlight && completionSelected) {
-                selectionHighlight->addRange(new KTextEditor::Range(line, 0, line + 1, 0), backgroundAttribute);
+                selection = KTextEditor::Range(line, 0, line + 1, 0);
             } else if (m_view->blockSelection() && m_view->selectionRange().overlapsLine(line)) {
-                selectionHighlight->addRange(new KTextEditor::Range(m_doc->rangeOnLine(m_view->selectionRange(), line)), backgroundAttribute);
+                selection = m_doc->rangeOnLine(m_view->selectionRange(), line);
             } else {
-                selectionHighlight->addRange(new KTextEditor::Range(m_view->selectionRange()), backgroundAttribute);
+                selection = m_view->selectionRange();
             }
 
-            renderRanges.append(selectionHighlight);
+            addDecorationSpan(selection.start(), selection.end(), layer++, m_selectionAttribute);
             // highlighting for the vi visual modes
         }
 
@@ -476,57 +519,145 @@ QList<QTextLayout::FormatRange> KateRenderer::decorationsForLine(const Kate::Tex
             endPosition = KTextEditor::Cursor(line + 1, 0);
         }
 
-        // Main iterative loop.  This walks through each set of highlighting ranges, and stops each
-        // time the highlighting changes.  It then creates the corresponding QTextLayout::FormatRanges.
-        while (currentPosition < endPosition) {
-            renderRanges.advanceTo(currentPosition);
+        // The highlighting only changes at the boundaries of the spans, sort them once
+        m_decorationBoundaries.resize(0);
+        m_decorationBoundaries.append(currentPosition);
+        for (int i = 0; i < m_decorationSpans.size(); ++i) {
+            m_decorationBoundaries.append(m_decorationSpans[i].start);
+            m_decorationBoundaries.append(m_decorationSpans[i].end);
+        }
+        std::sort(m_decorationBoundaries.begin(), m_decorationBoundaries.end());
+        m_decorationBoundaries.erase(std::unique(m_decorationBoundaries.begin(), m_decorationBoundaries.end()), m_decorationBoundaries.end());
+
+        std::sort(m_decorationSpans.begin(), m_decorationSpans.end(), [](const DecorationSpan &a, const DecorationSpan &b) {
+            return a.start < b.start;
+        });
+
+        // Main sweep.  Walks the boundaries and keeps the spans covering the current position, ordered
+        // by layer.  Between two boundaries it creates the corresponding QTextLayout::FormatRange.
+        m_activeDecorations.resize(0);
+        int nextSpan = 0;
+        for (int b = 0; b < m_decorationBoundaries.size() && m_decorationBoundaries[b] < endPosition; ++b) {
+            const KTextEditor::Cursor currentBoundary = m_decorationBoundaries[b];
+
+            // drop the spans ended here, add the ones started
+            for (int i = m_activeDecorations.size() - 1; i >= 0; --i) {
+                if (m_decorationSpans[m_activeDecorations[i]].end <= currentBoundary) {
+                    m_activeDecorations.remove(i);
+                }
+            }
+            for (; nextSpan < m_decorationSpans.size() && m_decorationSpans[nextSpan].start <= currentBoundary; ++nextSpan) {
+                const DecorationSpan &span = m_decorationSpans[nextSpan];
+                if (span.end <= currentBoundary) {
+                    continue;
+                }
+
+                int insertAt = m_activeDecorations.size();
+                while (insertAt > 0 && m_decorationSpans[m_activeDecorations[insertAt - 1]].layer > span.layer) {
+                    --insertAt;
+                }
+                m_activeDecorations.insert(insertAt, nextSpan);
+            }
 
-            if (!renderRanges.hasAttribute()) {
+            if (currentBoundary < currentPosition || m_activeDecorations.isEmpty()) {
                 // No attribute, don't need to create a FormatRange for this text range
-                currentPosition = renderRanges.nextBoundary();
                 continue;
             }
 
-            KTextEditor::Cursor nextPosition = renderRanges.nextBoundary();
+            // the active spans end at some later boundary
+            Q_ASSERT(b + 1 < m_decorationBoundaries.size());
+            const KTextEditor::Cursor nextPosition = m_decorationBoundaries[b + 1];
 
             // Create the format range and populate with the correct start, length and format info
             QTextLayout::FormatRange fr;
-            fr.start = currentPosition.column();
+            fr.start = currentBoundary.column();
 
             if (nextPosition < endPosition || endPosition.line() <= line) {
-                fr.length = nextPosition.column() - currentPosition.column();
+                fr.length = nextPosition.column() - currentBoundary.column();
 
             } else {
                 // +1 to force background drawing at the end of the line when it's warranted
-                fr.length = textLine->length() - currentPosition.column() + 1;
+                fr.length = textLine->length() - currentBoundary.column() + 1;
             }
 
-            KTextEditor::Attribute::Ptr a = renderRanges.generateAttribute();
-            if (a) {
-                fr.format = *a;
+            KTextEditor::Attribute::Ptr a = mergedDecorationAttribute();
+            fr.format = *a;
 
-                if (selectionsOnly) {
-                    assignSelectionBrushesFromAttribute(fr, *a);
-                }
+            if (selectionsOnly) {
+                assignSelectionBrushesFromAttribute(fr, *a);
             }
 
             newHighlight.append(fr);
-
-            currentPosition = nextPosition;
-        }
-
-        if (completionHighlight)
-            // Don't delete external completion render range
-        {
-            renderRanges.removeAll(completionHighlight);
         }
 
-        qDeleteAll(renderRanges);
+        // don't keep the attributes alive beyond the line
+        m_decorationSpans.resize(0);
+        m_combination.formats.resize(0);
     }
 
     return newHighlight;
 }
 
+void KateRenderer::addDecorationSpan(const KTextEditor::Cursor &start, const KTextEditor::Cursor &end, int layer, const KTextEditor::Attribute::Ptr &attribute) const
+{
+    DecorationSpan span;
+    span.start = start;
+    span.end = end;
+    span.layer = layer;
+    span.attribute = attribute;
+    m_decorationSpans.append(span);
+}
+
+uint qHash(const KateRenderer::AttributeCombination &combination, uint seed)
+{
+    // the properties that usually differ, operator== compares all of them
+    uint hash = seed;
+    foreach (const QTextCharFormat &format, combination.formats) {
+        hash = hash * 31 + uint(format.propertyCount());
+        hash = hash * 31 + format.foreground().color().rgba();
+        hash = hash * 31 + format.background().color().rgba();
+        hash = hash * 31 + uint(format.fontWeight());
+    }
+    return hash;
+}
+
+KTextEditor::Attribute::Ptr KateRenderer::mergedDecorationAttribute() const
+{
+    // a single decoration needs no merging
+    if (m_activeDecorations.size() == 1) {
+        return m_decorationSpans[m_activeDecorations[0]].attribute;
+    }
+
+    // the formats are implicitly shared, the copies are cheap
+    m_combination.formats.resize(0);
+    for (int i = 0; i < m_activeDecorations.size(); ++i) {
+        m_combination.formats.append(*m_decorationSpans[m_activeDecorations[i]].attribute);
+    }
+
+    QHash<AttributeCombination, KTextEditor::Attribute::Ptr>::const_iterator it = m_mergedAttributes.constFind(m_combination);
+    if (it != m_mergedAttributes.constEnd()) {
+        return it.value();
+    }
+
+    // Make an own copy of the first attribute and merge the others in
+    KTextEditor::Attribute::Ptr merged(new KTextEditor::Attribute(*m_decorationSpans[m_activeDecorations[0]].attribute));
+    for (int i = 1; i < m_activeDecorations.size(); ++i) {
+        mergeAttributes(merged, m_decorationSpans[m_activeDecorations[i]].attribute);
+    }
+
+    // the combinations seen while painting are few, anything else is some transient state
+    if (m_mergedAttributes.size() >= KATE_MAX_MERGED_ATTRIBUTES) {
+        m_mergedAttributes.clear();
+    }
+    m_mergedAttributes.insert(m_combination, merged);
+    return merged;
+}
+
+void KateRenderer::clearMergedAttributes()
+{
+    m_mergedAttributes.clear();
+}
+
 void KateRenderer::assignSelectionBrushesFromAttribute(QTextLayout::FormatRange &target, const KTextEditor::Attribute &attribute) const
 {
     if (attribute.hasProperty(SelectedForeground)) {
@@ -542,7 +673,7 @@ The ultimate line painting function.
 Currently missing features:
 - draw indent lines
 */
-void KateRenderer::paintTextLine(QPainter &paint, KateLineLayoutPtr range, int xStart, int xEnd, const KTextEditor::Cursor *cursor, PaintTextLineFlags flags)
+void KateRenderer::paintTextLine(QPainter &paint, KateLineLayoutPtr range, int xStart, int xEnd, const KTextEditor::Cursor *cursor, PaintTextLineFlags flags, const QRect &clipRect)
 {
     Q_ASSERT(range->isValid());
 
@@ -558,6 +689,14 @@ void KateRenderer::paintTextLine(QPainter &paint, KateLineLayoutPtr range, int x
 
     paintTextLineBackground(paint, range, currentViewLine, xStart, xEnd);
 
+    // view lines touching the clip rect, the others are skipped, a long wrapped line has many
+    int firstViewLine = 0;
+    int lastViewLine = range->viewLineCount() - 1;
+    if (!clipRect.isNull()) {
+        firstViewLine = qMax(0, clipRect.top() / lineHeight());
+        lastViewLine = qMin(lastViewLine, clipRect.bottom() / lineHeight());
+    }
+
     if (range->layout()) {
         bool drawSelection = m_view && m_view->selection() && showSelections() && m_view->selectionRange().overlapsLine(range->line());
         // Draw selection in block selecton mode. We need 2 kinds of selections that QTextLayout::draw can't render:
@@ -592,10 +731,10 @@ void KateRenderer::paintTextLine(QPainter &paint, KateLineLayoutPtr range, int x
             if (drawSelection) {
                 // FIXME toVector() may be a performance issue
                 additionalFormats = decorationsForLine(range->textLine(), range->line(), true).toVector();
-                range->layout()->draw(&paint, QPoint(-xStart, 0), additionalFormats);
+                range->layout()->draw(&paint, QPoint(-xStart, 0), additionalFormats, clipRect);
 
             } else {
-                range->layout()->draw(&paint, QPoint(-xStart, 0));
+                range->layout()->draw(&paint, QPoint(-xStart, 0), QVector<QTextLayout::FormatRange>(), clipRect);
             }
         }
 
@@ -648,6 +787,11 @@ void KateRenderer::paintTextLine(QPainter &paint, KateLineLayoutPtr range, int x
                 it.next();
             }
 
+            // the format iterators must pass all view lines, only the clipped ones get painted
+            if (i < firstViewLine || i > lastViewLine) {
+                continue;
+            }
+
             // Draw selection or background color outside of areas where text is rendered
             if (!m_printerFriendly) {
                 bool draw = false;
@@ -760,79 +904,8 @@ void KateRenderer::paintTextLine(QPainter &paint, KateLineLayoutPtr range, int x
         }
 
         // Draw caret
-        if (drawCaret() && cursor && range->includesCursor(*cursor)) {
-            int caretWidth, lineWidth = 2;
-            QColor color;
-            QTextLine line = range->layout()->lineForTextPosition(qMin(cursor->column(), range->length()));
-
-            // Determine the caret's style
-            caretStyles style = caretStyle();
-
-            // Make the caret the desired width
-            if (style == Line) {
-                caretWidth = lineWidth;
-            } else if (line.isValid() && cursor->column() < range->length()) {
-                caretWidth = int(line.cursorToX(cursor->column() + 1) - line.cursorToX(cursor->column()));
-                if (caretWidth < 0) {
-                    caretWidth = -caretWidth;
-                }
-            } else {
-                caretWidth = spaceWidth();
-            }
-
-            // Determine the color
-            if (m_caretOverrideColor.isValid()) {
-                // Could actually use the real highlighting system for this...
-                // would be slower, but more accurate for corner cases
-                color = m_caretOverrideColor;
-            } else {
-                // search for the FormatRange that includes the cursor
-                foreach (const QTextLayout::FormatRange &r, range->layout()->additionalFormats()) {
-                    if ((r.start <= cursor->column()) && ((r.start + r.length)  > cursor->column())) {
-                        // check for Qt::NoBrush, as the returned color is black() and no invalid QColor
-                        QBrush foregroundBrush = r.format.foreground();
-                        if (foregroundBrush != Qt::NoBrush) {
-                            color = r.format.foreground().color();
-                        }
-                        break;
-                    }
-                }
-                // still no color found, fall back to default style
-                if (!color.isValid()) {
-                    color = attribute(KTextEditor::dsNormal)->foreground().color();
-                }
-            }
-
-            paint.save();
-            switch (style) {
-            case Line :
-                paint.setPen(QPen(color, caretWidth));
-                break;
-            case Block :
-                // use a gray caret so it's possible to see the character
-                color.setAlpha(128);
-                paint.setPen(QPen(color, caretWidth));
-                break;
-            case Underline :
-                break;
-            case Half :
-                color.setAlpha(128);
-                paint.setPen(QPen(color, caretWidth));
-                break;
-            }
-
-            if (cursor->column() <= range->length()) {
-                range->layout()->drawCursor(&paint, QPoint(-xStart, 0), cursor->column(), caretWidth);
-            } else {
-                // Off the end of the line... must be block mode. Draw the caret ourselves.
-                const KateTextLayout &lastLine = range->viewLine(range->viewLineCount() - 1);
-                int x = cursorToX(lastLine, KTextEditor::Cursor(range->line(), cursor->column()), true);
-                if ((x >= xStart) && (x <= xEnd)) {
-                    paint.fillRect(x - xStart, (int)lastLine.lineLayout().y(), caretWidth, lineHeight(), color);
-                }
-            }
-
-            paint.restore();
+        if (cursor && !(flags & SkipDrawCaret)) {
+            paintCaret(paint, range, xStart, xEnd, *cursor);
         }
     }
 
@@ -860,6 +933,86 @@ void KateRenderer::paintTextLine(QPainter &paint, KateLineLayoutPtr range, int x
     }
 }
 
+void KateRenderer::paintCaret(QPainter &paint, KateLineLayoutPtr range, int xStart, int xEnd, const KTextEditor::Cursor &cursor)
+{
+    if (!drawCaret() || !range->layout() || !range->includesCursor(cursor)) {
+        return;
+    }
+
+    int caretWidth, lineWidth = 2;
+    QColor color;
+    QTextLine line = range->layout()->lineForTextPosition(qMin(cursor.column(), range->length()));
+
+    // Determine the caret's style
+    caretStyles style = caretStyle();
+
+    // Make the caret the desired width
+    if (style == Line) {
+        caretWidth = lineWidth;
+    } else if (line.isValid() && cursor.column() < range->length()) {
+        caretWidth = int(line.cursorToX(cursor.column() + 1) - line.cursorToX(cursor.column()));
+        if (caretWidth < 0) {
+            caretWidth = -caretWidth;
+        }
+    } else {
+        caretWidth = spaceWidth();
+    }
+
+    // Determine the color
+    if (m_caretOverrideColor.isValid()) {
+        // Could actually use the real highlighting system for this...
+        // would be slower, but more accurate for corner cases
+        color = m_caretOverrideColor;
+    } else {
+        // search for the FormatRange that includes the cursor
+        foreach (const QTextLayout::FormatRange &r, range->layout()->additionalFormats()) {
+            if ((r.start <= cursor.column()) && ((r.start + r.length)  > cursor.column())) {
+                // check for Qt::NoBrush, as the returned color is black() and no invalid QColor
+                QBrush foregroundBrush = r.format.foreground();
+                if (foregroundBrush != Qt::NoBrush) {
+                    color = r.format.foreground().color();
+                }
+                break;
+            }
+        }
+        // still no color found, fall back to default style
+        if (!color.isValid()) {
+            color = attribute(KTextEditor::dsNormal)->foreground().color();
+        }
+    }
+
+    paint.save();
+    switch (style) {
+    case Line :
+        paint.setPen(QPen(color, caretWidth));
+        break;
+    case Block :
+        // use a gray caret so it's possible to see the character
+        color.setAlpha(128);
+        paint.setPen(QPen(color, caretWidth));
+        break;
+    case Underline :
+        break;
+    case Half :
+        color.setAlpha(128);
+        paint.setPen(QPen(color, caretWidth));
+        break;
+    }
+
+    if (cursor.column() <= range->length()) {
+        range->layout()->drawCursor(&paint, QPoint(-xStart, 0), cursor.column(), caretWidth);
+    } else {
+        // Off the end of the line... must be block mode. Draw the caret ourselves.
+        const KateTextLayout &lastLine = range->viewLine(range->viewLineCount() - 1);
+        int x = cursorToX(lastLine, KTextEditor::Cursor(range->line(), cursor.column()), true);
+        if ((x >= xStart) && (x <= xEnd)) {
+            paint.fillRect(x - xStart, (int)lastLine.lineLayout().y(), caretWidth, lineHeight(), color);
+        }
+    }
+
+    paint.restore();
+}
+
 const QFont &KateRenderer::currentFont() const
 {
     return config()->font();
@@ -942,6 +1095,7 @@ void KateRenderer::updateFontHeight()
     // we round down to avoid artifacts: line height too large vs. qt background rendering of text attributes
     const qreal height = config()->fontMetrics().height();
     m_fontHeight = qMax(1, qFloor(height));
+    ++m_paintSerial;
 }
 
 qreal KateRenderer::spaceWidth() const
@@ -952,24 +1106,45 @@ qreal KateRenderer::spaceWidth() const
 void KateRenderer::layoutLine(KateLineLayoutPtr lineLayout, int maxwidth, bool cacheLayout) const
 {
     // if maxwidth == -1 we have no wrap
+    QTextOption opt;
+    int firstNonSpace = 0;
+    const KateShapingCache::Key key = layoutKey(lineLayout, maxwidth, opt, firstNonSpace);
+
+    // Lines equal in text, attributes and wrapping share their layout,
+    // shaping is the most expensive part of the layouting.
+    KateShapingCache *shapingCache = KTextEditor::EditorPrivate::self()->shapingCache();
+    int shiftX = -1;
+    const QSharedPointer<QTextLayout> cached = shapingCache->find(key, shiftX);
+    if (cached) {
+        if (shiftX >= 0) {
+            lineLayout->setShiftX(shiftX);
+        }
+        lineLayout->setLayout(cached);
+        return;
+    }
 
-    Kate::TextLine textLine = lineLayout->textLine();
-    Q_ASSERT(textLine);
+    // a layout still in use by other lines must not be touched, always start over
+    const QSharedPointer<QTextLayout> l = createLayout(key, opt, firstNonSpace, cacheLayout, shiftX);
+    if (shiftX >= 0) {
+        lineLayout->setShiftX(shiftX);
+    }
 
-    QTextLayout *l = lineLayout->layout();
-    if (!l) {
-        l = new QTextLayout(textLine->string(), config()->font());
-    } else {
-        l->setText(textLine->string());
-        l->setFont(config()->font());
+    // only layouts keeping their glyphs are worth sharing
+    if (cacheLayout) {
+        shapingCache->insert(key, l, shiftX);
     }
 
-    l->setCacheEnabled(cacheLayout);
+    lineLayout->setLayout(l);
+}
+
+KateShapingCache::Key KateRenderer::layoutKey(KateLineLayoutPtr lineLayout, int maxwidth, QTextOption &opt, int &firstNonSpace) const
+{
+    Kate::TextLine textLine = lineLayout->textLine();
+    Q_ASSERT(textLine);
 
     // Initial setup of the QTextLayout.
 
     // Tab width
-    QTextOption opt;
     opt.setFlags(QTextOption::IncludeTrailingSpaces);
     opt.setTabStop(m_tabWidth * config()->fontMetrics().width(spaceChar));
     opt.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
@@ -981,7 +1156,8 @@ void KateRenderer::layoutLine(KateLineLayoutPtr lineLayout, int maxwidth, bool c
     // Qt's text renderer ("scribe") version 4.2 assumes a "higher-level protocol"
     // (such as KatePart) will specify the paragraph level, so it does not apply P2 & P3
     // by itself. If this ever change in Qt, the next code block could be removed.
-    if (isLineRightToLeft(lineLayout)) {
+    const bool rightToLeft = isLineRightToLeft(lineLayout);
+    if (rightToLeft) {
         opt.setAlignment(Qt::AlignRight);
         opt.setTextDirection(Qt::RightToLeft);
     } else {
@@ -989,19 +1165,40 @@ void KateRenderer::layoutLine(KateLineLayoutPtr lineLayout, int maxwidth, bool c
         opt.setTextDirection(Qt::LeftToRight);
     }
 
+    const bool needShiftX = (maxwidth != -1)
+                            && m_view && (m_view->config()->dynWordWrapAlignIndent() > 0);
+
+    KateShapingCache::Key key;
+    key.text = textLine->string();
+    key.formats = decorationsForLine(textLine, lineLayout->line());
+    key.font = config()->font();
+    key.tabStop = opt.tabStop();
+    key.maxWidth = maxwidth;
+    key.rightToLeft = rightToLeft;
+    key.alignIndent = needShiftX ? m_view->config()->dynWordWrapAlignIndent() : 0;
+    key.lineHeight = lineHeight();
+
+    firstNonSpace = needShiftX ? textLine->nextNonSpaceChar(0) : 0;
+    return key;
+}
+
+QSharedPointer<QTextLayout> KateRenderer::createLayout(const KateShapingCache::Key &key, const QTextOption &opt, int firstNonSpace, bool cacheLayout, int &shiftX)
+{
+    QSharedPointer<QTextLayout> l(new QTextLayout(key.text, key.font));
+    l->setCacheEnabled(cacheLayout);
     l->setTextOption(opt);
 
     // Syntax highlighting, inbuilt and arbitrary
-    l->setAdditionalFormats(decorationsForLine(textLine, lineLayout->line()));
+    l->setAdditionalFormats(key.formats);
 
     // Begin layouting
     l->beginLayout();
 
+    int maxwidth = key.maxWidth;
+    bool needShiftX = (maxwidth != -1) && (key.alignIndent > 0);
     int height = 0;
-    int shiftX = 0;
-
-    bool needShiftX = (maxwidth != -1)
-                      && m_view && (m_view->config()->dynWordWrapAlignIndent() > 0);
+    int lineShiftX = 0;
+    shiftX = -1;
 
     forever {
     QTextLine line = l->createLine();
@@ -1015,35 +1212,56 @@ void KateRenderer::layoutLine(KateLineLayoutPtr lineLayout, int maxwidth, bool c
             line.setLineWidth(maxwidth);
         }
 
-        line.setPosition(QPoint(line.lineNumber() ? shiftX : 0, height));
+        line.setPosition(QPoint(line.lineNumber() ? lineShiftX : 0, height));
 
         if (needShiftX && line.width() > 0)
         {
             needShiftX = false;
             // Determine x offset for subsequent-lines-of-paragraph indenting
-            int pos = textLine->nextNonSpaceChar(0);
-
-            if (pos > 0) {
-                shiftX = (int)line.cursorToX(pos);
+            if (firstNonSpace > 0) {
+                lineShiftX = (int)line.cursorToX(firstNonSpace);
             }
 
             // check for too deep shift value and limit if necessary
-            if (shiftX > ((double)maxwidth / 100 * m_view->config()->dynWordWrapAlignIndent())) {
-                shiftX = 0;
+            if (lineShiftX > ((double)maxwidth / 100 * key.alignIndent)) {
+                lineShiftX = 0;
             }
 
             // if shiftX > 0, the maxwidth has to adapted
-            maxwidth -= shiftX;
+            maxwidth -= lineShiftX;
 
-            lineLayout->setShiftX(shiftX);
+            shiftX = lineShiftX;
         }
 
-        height += lineHeight();
+        height += key.lineHeight;
     }
 
     l->endLayout();
+    return l;
+}
 
-    lineLayout->setLayout(l);
+QSharedPointer<QTextLayout> KateRenderer::createPlaceholderLayout(const KateShapingCache::Key &key, const QTextOption &opt, int firstNonSpace, int characters, int &shiftX)
+{
+    Q_ASSERT(key.maxWidth > 0);
+    characters = qBound(0, characters, key.text.size());
+
+    // estimate the wrapped lines of the rest by the average character width
+    const qreal charWidth = qMax(qreal(1), QFontMetricsF(key.font).averageCharWidth());
+    const int charsPerLine = qMax(1, int(key.maxWidth / charWidth));
+    const int estimatedLines = (key.text.size() - characters + charsPerLine - 1) / charsPerLine;
+
+    // line separators make empty lines without any shaping
+    KateShapingCache::Key placeholder = key;
+    placeholder.text = key.text.left(characters) + QString(estimatedLines, QChar(QChar::LineSeparator));
+    placeholder.formats.clear();
+    foreach (QTextLayout::FormatRange range, key.formats) {
+        if (range.start < characters) {
+            range.length = qMin(range.length, characters - range.start);
+            placeholder.formats.append(range);
+        }
+    }
+
+    return createLayout(placeholder, opt, qMin(firstNonSpace, characters), true, shiftX);
 }
 
 // 1) QString::isRightToLeft() sux
@@ -24,12 +24,16 @@
 #define __KATE_RENDERER_H__
 
 #include <ktexteditor/attribute.h>
+#include <ktexteditor_export.h>
 #include "katetextline.h"
 #include "katelinelayout.h"
+#include "kateshapingcache.h"
 
 #include <QFont>
 #include <QFontMetricsF>
+#include <QHash>
 #include <QList>
+#include <QVector>
 #include <QTextLine>
 #include <QFlags>
 
@@ -47,7 +51,7 @@ class TextFolding;
  * (used for the views and printing)
  *
  **/
-class KateRenderer
+class KTEXTEDITOR_EXPORT KateRenderer
 {
 public:
     /**
@@ -152,6 +156,16 @@ public:
      */
     void setCaretOverrideColor(const QColor &color);
 
+    /**
+     * Changes whenever a setting changes that affects how text lines are
+     * painted, like the attributes, the font or the shown whitespace.
+     * Views use it to know whether painted lines can be reused.
+     */
+    uint paintSerial() const
+    {
+        return m_paintSerial;
+    }
+
     /**
      * @returns whether tabs should be shown (ie. a small mark
      * drawn to identify a tab)
@@ -260,6 +274,33 @@ public:
      */
     void layoutLine(KateLineLayoutPtr line, int maxwidth = -1, bool cacheLayout = false) const;
 
+    /**
+     * Everything layoutLine() lays a line out from.
+     *
+     * @param lineLayout      line to lay out
+     * @param maxwidth        width to wrap at, -1 for no wrap
+     * @param option          set to the text options of the layout
+     * @param firstNonSpace   set to the first non-space column, wrapped lines may be indented up to it
+     */
+    KateShapingCache::Key layoutKey(KateLineLayoutPtr lineLayout, int maxwidth, QTextOption &option, int &firstNonSpace) const;
+
+    /**
+     * Lay out the text of @p key. Uses nothing but its arguments,
+     * so it may run in another thread than the renderer's.
+     *
+     * @param shiftX          set to the indent of the wrapped lines, -1 if not computed
+     */
+    static QSharedPointer<QTextLayout> createLayout(const KateShapingCache::Key &key, const QTextOption &option, int firstNonSpace, bool cacheLayout, int &shiftX);
+
+    /**
+     * Stand-in for the layout of a very long line while the real one is computed.
+     * Only the first @p characters get laid out, followed by empty lines, about as
+     * many as the rest of the text takes when wrapped.
+     *
+     * @param shiftX          set to the indent of the wrapped lines, -1 if not computed
+     */
+    static QSharedPointer<QTextLayout> createPlaceholderLayout(const KateShapingCache::Key &key, const QTextOption &option, int firstNonSpace, int characters, int &shiftX);
+
     /**
      * This is a smaller QString::isRightToLeft(). It's also marked as internal to kate
      * instead of internal to Qt, so we can modify. This method searches for the first
@@ -279,6 +320,20 @@ public:
      */
     QList<QTextLayout::FormatRange> decorationsForLine(const Kate::TextLine &textLine, int line, bool selectionsOnly = false, KateRenderRange *completionHighlight = nullptr, bool completionSelected = false) const;
 
+    /**
+     * Forget the attributes merged for overlapping decorations.
+     * Needed once attributes of ranges got changed in place.
+     */
+    void clearMergedAttributes();
+
+    /**
+     * Number of merged attributes of overlapping decorations kept for reuse.
+     */
+    int mergedAttributeCount() const
+    {
+        return m_mergedAttributes.size();
+    }
+
     // Width calculators
     qreal spaceWidth() const;
 
@@ -316,6 +371,11 @@ public:
          * Skip drawing the dashed underline at the start of a folded block of text?
          */
         SkipDrawFirstInvisibleLineUnderlined = 0x1,
+
+        /**
+         * Skip drawing the caret, paintCaret() draws it on its own
+         */
+        SkipDrawCaret = 0x2,
     };
     Q_DECLARE_FLAGS(PaintTextLineFlags, PaintTextLineFlag)
 
@@ -331,8 +391,10 @@ public:
      * @param xEnd            ending width in pixels.
      * @param cursor          position of the caret, if placed on the current line.
      * @param flags           flags for customizing the drawing of the line
+     * @param clipRect        area that needs painting, relative to the line; only the view lines
+     *                        touching it are drawn. Null paints all of them.
      */
-    void paintTextLine(QPainter &paint, KateLineLayoutPtr range, int xStart, int xEnd, const KTextEditor::Cursor *cursor = nullptr, PaintTextLineFlags flags = PaintTextLineFlags());
+    void paintTextLine(QPainter &paint, KateLineLayoutPtr range, int xStart, int xEnd, const KTextEditor::Cursor *cursor = nullptr, PaintTextLineFlags flags = PaintTextLineFlags(), const QRect &clipRect = QRect());
 
     /**
      * Paint the background of a line
@@ -350,6 +412,19 @@ public:
      */
     void paintTextLineBackground(QPainter &paint, KateLineLayoutPtr layout, int currentViewLine, int xStart, int xEnd);
 
+    /**
+     * Paint the caret, if it is placed on the line and shall be drawn.
+     *
+     * paintTextLine() calls it, unless SkipDrawCaret is given.
+     *
+     * @param paint           painter to use, set up as for paintTextLine()
+     * @param range           layout to use in painting this line
+     * @param xStart          starting width in pixels.
+     * @param xEnd            ending width in pixels.
+     * @param cursor          position of the caret
+     */
+    void paintCaret(QPainter &paint, KateLineLayoutPtr range, int xStart, int xEnd, const KTextEditor::Cursor &cursor);
+
     /**
      * This takes an in index, and returns all the attributes for it.
      * For example, if you have a ktextline, and want the KTextEditor::Attribute
@@ -385,6 +460,16 @@ private:
 
     void assignSelectionBrushesFromAttribute(QTextLayout::FormatRange &target, const KTextEditor::Attribute &attribute) const;
 
+    /**
+     * Add an attribute run of a decoration layer for decorationsForLine().
+     */
+    void addDecorationSpan(const KTextEditor::Cursor &start, const KTextEditor::Cursor &end, int layer, const KTextEditor::Attribute::Ptr &attribute) const;
+
+    /**
+     * Attribute of the active decorations merged in layer order, reused per combination.
+     */
+    KTextEditor::Attribute::Ptr mergedDecorationAttribute() const;
+
     // update font height
     void updateFontHeight();
 
@@ -405,10 +490,49 @@ private:
     bool m_showSpaces;
     bool m_showNonPrintableSpaces;
     bool m_printerFriendly;
+    uint m_paintSerial;
     QColor m_caretOverrideColor;
 
     QList<KTextEditor::Attribute::Ptr> m_attributes;
 
+    /**
+     * One attribute run of a decoration layer: the inbuilt highlighting,
+     * a range with attribute, the completion highlight or the selection.
+     */
+    struct DecorationSpan {
+        KTextEditor::Cursor start;
+        KTextEditor::Cursor end;
+        int layer;
+        KTextEditor::Attribute::Ptr attribute;
+    };
+
+    /**
+     * Formats of overlapping decorations, in layer order.
+     * Keyed by content, not by the attribute pointers: attributes may be changed after they
+     * got merged, their formats then differ from the copies stored in the key.
+     */
+    struct AttributeCombination {
+        QVector<QTextCharFormat> formats;
+
+        bool operator==(const AttributeCombination &other) const
+        {
+            return formats == other.formats;
+        }
+    };
+    friend uint qHash(const AttributeCombination &combination, uint seed);
+
+    // scratch buffers of decorationsForLine(), reused to avoid allocations per line
+    mutable QVector<DecorationSpan> m_decorationSpans;
+    mutable QVector<KTextEditor::Cursor> m_decorationBoundaries;
+    mutable QVector<int> m_activeDecorations;
+    mutable AttributeCombination m_combination;
+
+    // merged attributes per combination of overlapping decorations
+    mutable QHash<AttributeCombination, KTextEditor::Attribute::Ptr> m_mergedAttributes;
+
+    // background of the selection, recreated if the colors change
+    mutable KTextEditor::Attribute::Ptr m_selectionAttribute;
+
     /**
      * Configuration
      */
@@ -140,76 +140,3 @@ KTextEditor::Attribute::Ptr NormalRenderRange::currentAttribute() const
 {
     return m_currentAttribute;
 }
-
-KTextEditor::Cursor RenderRangeList::nextBoundary() const
-{
-    KTextEditor::Cursor ret = m_currentPos;
-    bool first = true;
-    foreach (KateRenderRange *r, *this) {
-        if (first) {
-            ret = r->nextBoundary();
-            first = false;
-
-        } else {
-            KTextEditor::Cursor nb = r->nextBoundary();
-            if (ret > nb) {
-                ret = nb;
-            }
-        }
-    }
-    return ret;
-}
-
-RenderRangeList::~RenderRangeList()
-{
-}
-
-void RenderRangeList::advanceTo(const KTextEditor::Cursor &pos)
-{
-    foreach (KateRenderRange *r, *this) {
-        r->advanceTo(pos);
-    }
-
-    //Delete lists that are ready, else the list may get too large due to temporaries
-    for (int a = size() - 1; a >= 0; --a) {
-        KateRenderRange *r = at(a);
-        if (r->isReady()) {
-            delete r;
-            removeAt(a);
-        }
-    }
-}
-
-bool RenderRangeList::hasAttribute() const
-{
-    foreach (KateRenderRange *r, *this)
-        if (r->currentAttribute()) {
-            return true;
-        }
-
-    return false;
-}
-
-KTextEditor::Attribute::Ptr RenderRangeList::generateAttribute() const
-{
-    KTextEditor::Attribute::Ptr a;
-    bool ownsAttribute = false;
-
-    foreach (KateRenderRange *r, *this) {
-        if (KTextEditor::Attribute::Ptr a2 = r->currentAttribute()) {
-            if (!a) {
-                a = a2;
-            } else {
-                if (!ownsAttribute) {
-                    //Make an own copy of the attribute..
-                    ownsAttribute = true;
-                    a = new KTextEditor::Attribute(*a);
-                }
-                mergeAttributes(a, a2);
-            }
-        }
-    }
-
-    return a;
-}
-
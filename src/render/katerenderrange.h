@@ -59,17 +59,9 @@ private:
     int m_currentRange;
 };
 
-class RenderRangeList : public QList<KateRenderRange *>
-{
-public:
-    ~RenderRangeList();
-    KTextEditor::Cursor nextBoundary() const;
-    void advanceTo(const KTextEditor::Cursor &pos);
-    bool hasAttribute() const;
-    KTextEditor::Attribute::Ptr generateAttribute() const;
-
-private:
-    KTextEditor::Cursor m_currentPos;
-};
+/**
+ * Merge @p add into @p base, blending translucent foreground and background brushes.
+ */
+void mergeAttributes(KTextEditor::Attribute::Ptr base, KTextEditor::Attribute::Ptr add);
 
 #endif
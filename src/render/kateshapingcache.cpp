@@ -0,0 +1,94 @@
+/*  This file is part of the KDE libraries and the Kate part.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "kateshapingcache.h"
+
+#include <QHash>
+
+bool KateShapingCache::Key::operator==(const Key &other) const
+{
+    if (text != other.text || tabStop != other.tabStop || maxWidth != other.maxWidth || rightToLeft != other.rightToLeft
+            || alignIndent != other.alignIndent || lineHeight != other.lineHeight || font != other.font
+            || formats.size() != other.formats.size()) {
+        return false;
+    }
+
+    for (int i = 0; i < formats.size(); ++i) {
+        const QTextLayout::FormatRange &range = formats.at(i);
+        const QTextLayout::FormatRange &otherRange = other.formats.at(i);
+        if (range.start != otherRange.start || range.length != otherRange.length || range.format != otherRange.format) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint qHash(const KateShapingCache::Key &key, uint seed)
+{
+    // the formats are compared in full on lookup, their runs are enough for the hash
+    uint hash = qHash(key.text, seed) ^ qHash(key.font, seed) ^ qHash(key.maxWidth, seed) ^ (key.rightToLeft ? 1u : 0u);
+    foreach (const QTextLayout::FormatRange &range, key.formats) {
+        hash = hash * 31 + uint(range.start);
+        hash = hash * 31 + uint(range.length);
+        hash = hash * 31 + uint(range.format.propertyCount());
+    }
+    return hash;
+}
+
+KateShapingCache::KateShapingCache(int maxCharacters)
+    : m_layouts(maxCharacters)
+    , m_hits(0)
+    , m_misses(0)
+{
+}
+
+QSharedPointer<QTextLayout> KateShapingCache::find(const Key &key, int &shiftX)
+{
+    Entry *entry = m_layouts.object(key);
+    if (!entry) {
+        ++m_misses;
+        return QSharedPointer<QTextLayout>();
+    }
+
+    ++m_hits;
+    shiftX = entry->shiftX;
+    return entry->layout;
+}
+
+void KateShapingCache::insert(const Key &key, const QSharedPointer<QTextLayout> &layout, int shiftX)
+{
+    Entry *entry = new Entry;
+    entry->layout = layout;
+    entry->shiftX = shiftX;
+
+    // lines longer than the whole cache are just not cached
+    m_layouts.insert(key, entry, key.text.size() + 1);
+}
+
+void KateShapingCache::clear()
+{
+    m_layouts.clear();
+    m_hits = 0;
+    m_misses = 0;
+}
+
+QString KateShapingCache::statistics() const
+{
+    return QStringLiteral("Shaping cache: %1 layouts, %2 characters, %3 hits, %4 misses, %5% hit rate")
+           .arg(size()).arg(characters()).arg(m_hits).arg(m_misses).arg(hitRate());
+}
@@ -0,0 +1,147 @@
+/*  This file is part of the KDE libraries and the Kate part.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KATE_SHAPING_CACHE_H
+#define KATE_SHAPING_CACHE_H
+
+#include <ktexteditor_export.h>
+
+#include <QCache>
+#include <QFont>
+#include <QList>
+#include <QSharedPointer>
+#include <QString>
+#include <QTextLayout>
+
+/**
+ * Laid out QTextLayouts shared by all views, for lines with equal text,
+ * formats, font and wrapping. Files with many repeated lines (logs, tables,
+ * generated code) then shape each distinct line only once.
+ *
+ * The shared layouts must not be changed by their users. The cache is
+ * bounded by the characters of the cached lines, least recently used
+ * layouts are dropped first.
+ */
+class KTEXTEDITOR_EXPORT KateShapingCache
+{
+public:
+    /**
+     * Everything the shaping and line breaking of a line depends on.
+     */
+    struct Key {
+        QString text;
+        QList<QTextLayout::FormatRange> formats;
+        QFont font;
+        qreal tabStop;
+        int maxWidth;
+        bool rightToLeft;
+        int alignIndent;
+        int lineHeight;
+
+        bool operator==(const Key &other) const;
+    };
+
+    /**
+     * Create an empty cache.
+     * @param maxCharacters bound for the characters of all cached lines
+     */
+    explicit KateShapingCache(int maxCharacters = 256 * 1024);
+
+    /**
+     * Look up the layout of a line.
+     * @param key text, formats and layout parameters of the line
+     * @param shiftX set to the shift of the wrapped lines, -1 if the line was not shifted
+     * @return shared layout, null if not cached
+     */
+    QSharedPointer<QTextLayout> find(const Key &key, int &shiftX);
+
+    /**
+     * Remember the layout of a line.
+     * @param key text, formats and layout parameters of the line
+     * @param layout finished layout, not changed afterwards
+     * @param shiftX shift of the wrapped lines, -1 if the line was not shifted
+     */
+    void insert(const Key &key, const QSharedPointer<QTextLayout> &layout, int shiftX);
+
+    /**
+     * Drop all layouts and reset the statistics.
+     */
+    void clear();
+
+    /**
+     * Number of cached layouts.
+     */
+    int size() const
+    {
+        return m_layouts.size();
+    }
+
+    /**
+     * Characters of all cached lines.
+     */
+    int characters() const
+    {
+        return m_layouts.totalCost();
+    }
+
+    /**
+     * Lookups that found a layout.
+     */
+    qint64 hits() const
+    {
+        return m_hits;
+    }
+
+    /**
+     * Lookups that found none.
+     */
+    qint64 misses() const
+    {
+        return m_misses;
+    }
+
+    /**
+     * Percentage of lookups that found a layout.
+     */
+    int hitRate() const
+    {
+        return (m_hits + m_misses) ? int(m_hits * 100 / (m_hits + m_misses)) : 0;
+    }
+
+    /**
+     * Human readable summary of the statistics, one line.
+     */
+    QString statistics() const;
+
+private:
+    /**
+     * One cached layout.
+     */
+    struct Entry {
+        QSharedPointer<QTextLayout> layout;
+        int shiftX;
+    };
+
+    QCache<Key, Entry> m_layouts;
+    qint64 m_hits;
+    qint64 m_misses;
+};
+
+uint qHash(const KateShapingCache::Key &key, uint seed = 0);
+
+#endif
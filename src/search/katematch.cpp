@@ -40,12 +40,7 @@ KTextEditor::Range KateMatch::searchText(const KTextEditor::Range &range, const
 
 KTextEditor::Range KateMatch::replace(const QString &replacement, bool blockMode, int replacementCounter)
 {
-    // Placeholders depending on search mode
-    const bool usePlaceholders = m_options.testFlag(KTextEditor::Regex) ||
-                                 m_options.testFlag(KTextEditor::EscapeSequences);
-
-    const QString finalReplacement = usePlaceholders ? buildReplacement(replacement, blockMode, replacementCounter)
-                                     : replacement;
+    const QString finalReplacement = replacementText(replacement, blockMode, replacementCounter);
 
     // Track replacement operation
     KTextEditor::MovingRange *const afterReplace = m_document->newMovingRange(range(), KTextEditor::MovingRange::ExpandLeft | KTextEditor::MovingRange::ExpandRight);
@@ -59,6 +54,16 @@ KTextEditor::Range KateMatch::replace(const QString &replacement, bool blockMode
     return result;
 }
 
+QString KateMatch::replacementText(const QString &replacement, bool blockMode, int replacementCounter) const
+{
+    // Placeholders depending on search mode
+    const bool usePlaceholders = m_options.testFlag(KTextEditor::Regex) ||
+                                 m_options.testFlag(KTextEditor::EscapeSequences);
+
+    return usePlaceholders ? buildReplacement(replacement, blockMode, replacementCounter)
+           : replacement;
+}
+
 KTextEditor::Range KateMatch::range() const
 {
     if (m_resultRanges.size() > 0) {
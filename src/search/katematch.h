@@ -32,6 +32,11 @@ public:
     KateMatch(KTextEditor::DocumentPrivate *document, KTextEditor::SearchOptions options);
     KTextEditor::Range searchText(const KTextEditor::Range &range, const QString &pattern);
     KTextEditor::Range replace(const QString &replacement, bool blockMode, int replacementCounter = 1);
+
+    /**
+     * The text replace() would insert for this match, without changing the document.
+     */
+    QString replacementText(const QString &replacement, bool blockMode, int replacementCounter = 1) const;
     bool isValid() const;
     bool isEmpty() const;
     KTextEditor::Range range() const;
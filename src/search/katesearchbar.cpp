@@ -808,6 +808,8 @@ int KateSearchBar::findAll(Range inputRange, const QString *replacement)
 
     KTextEditor::MovingRange *workingRange = m_view->doc()->newMovingRange(inputRange);
     QList<Range> highlightRanges;
+    QVector<Range> replaceRanges;
+    QStringList replaceTexts;
     int matchCounter = 0;
 
     bool block = m_view->selection() && m_view->blockSelection();
@@ -827,23 +829,18 @@ int KateSearchBar::findAll(Range inputRange, const QString *replacement)
 
             // Work with the match
             if (replacement != nullptr) {
-                if (matchCounter == 0) {
-                    static_cast<KTextEditor::DocumentPrivate *>(m_view->document())->startEditing();
-                }
-
-                // Replace
-                const Range afterReplace = match.replace(*replacement, false, ++matchCounter);
-
-                // Highlight and continue after adjusted match
-                //highlightReplacement(*afterReplace);
-                highlightRanges << afterReplace;
+                // Only remember the replacement, all of them are done in one go below.
+                // The document stays untouched while searching, all ranges refer to the original text
+                replaceRanges << match.range();
+                replaceTexts << match.replacementText(*replacement, false, ++matchCounter);
             } else {
-                // Highlight and continue after original match
-                //highlightMatch(match);
-                highlightRanges << match.range();
                 matchCounter++;
             }
 
+            // Highlight and continue after original match
+            //highlightMatch(match);
+            highlightRanges << match.range();
+
             // Continue after match
             if (highlightRanges.last().end() >= workingRange->end()) {
                 break;
@@ -868,11 +865,11 @@ int KateSearchBar::findAll(Range inputRange, const QString *replacement)
 
     } while (block && ++line <= inputRange.end().line());
 
-    // After last match
-    if (matchCounter > 0) {
-        if (replacement != nullptr) {
-            static_cast<KTextEditor::DocumentPrivate *>(m_view->document())->finishEditing();
-        }
+    // After last match: replace all at once, highlight the replacements
+    if (!replaceRanges.isEmpty()) {
+        static_cast<KTextEditor::DocumentPrivate *>(m_view->document())->startEditing();
+        highlightRanges = m_view->doc()->replaceTexts(replaceRanges, replaceTexts).toList();
+        static_cast<KTextEditor::DocumentPrivate *>(m_view->document())->finishEditing();
     }
 
     if (replacement == nullptr)
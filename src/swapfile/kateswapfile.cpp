@@ -41,8 +41,9 @@
 #include <unistd.h>
 #endif
 
-// swap file version header
-const static char swapFileVersionString[] = "Kate Swap File 2.0";
+// swap file version header, 2.1 added EA_ReplaceText, 2.0 files are still read
+const static char swapFileVersionString[] = "Kate Swap File 2.1";
+const static char swapFileVersionString20[] = "Kate Swap File 2.0";
 
 // tokens for swap files
 const static qint8 EA_StartEditing  = 'S';
@@ -51,6 +52,7 @@ const static qint8 EA_WrapLine      = 'W';
 const static qint8 EA_UnwrapLine    = 'U';
 const static qint8 EA_InsertText    = 'I';
 const static qint8 EA_RemoveText    = 'R';
+const static qint8 EA_ReplaceText   = 'X';
 
 namespace Kate
 {
@@ -63,6 +65,7 @@ SwapFile::SwapFile(KTextEditor::DocumentPrivate *document)
     , m_trackingEnabled(false)
     , m_recovered(false)
     , m_needSync(false)
+    , m_replacedLines(0)
 {
     // fixed version of serialisation
     m_stream.setVersion(QDataStream::Qt_4_6);
@@ -110,6 +113,7 @@ void SwapFile::setTrackingEnabled(bool enable)
         connect(&buffer, SIGNAL(lineUnwrapped(int)), this, SLOT(unwrapLine(int)));
         connect(&buffer, SIGNAL(textInserted(KTextEditor::Cursor,QString)), this, SLOT(insertText(KTextEditor::Cursor,QString)));
         connect(&buffer, SIGNAL(textRemoved(KTextEditor::Range,QString)), this, SLOT(removeText(KTextEditor::Range)));
+        connect(&buffer, SIGNAL(textReplaced(int,QVector<Kate::TextReplacement>,QStringList)), this, SLOT(replaceText(int,QVector<Kate::TextReplacement>)));
     } else {
         disconnect(&buffer, SIGNAL(editingStarted()), this, SLOT(startEditing()));
         disconnect(&buffer, SIGNAL(editingFinished()), this, SLOT(finishEditing()));
@@ -119,6 +123,7 @@ void SwapFile::setTrackingEnabled(bool enable)
         disconnect(&buffer, SIGNAL(lineUnwrapped(int)), this, SLOT(unwrapLine(int)));
         disconnect(&buffer, SIGNAL(textInserted(KTextEditor::Cursor,QString)), this, SLOT(insertText(KTextEditor::Cursor,QString)));
         disconnect(&buffer, SIGNAL(textRemoved(KTextEditor::Range,QString)), this, SLOT(removeText(KTextEditor::Range)));
+        disconnect(&buffer, SIGNAL(textReplaced(int,QVector<Kate::TextReplacement>,QStringList)), this, SLOT(replaceText(int,QVector<Kate::TextReplacement>)));
     }
 }
 
@@ -146,7 +151,7 @@ bool SwapFile::isValidSwapFile(QDataStream &stream, bool checkDigest) const
     QByteArray header;
     stream >> header;
 
-    if (header != swapFileVersionString) {
+    if (header != swapFileVersionString && header != swapFileVersionString20) {
         qCWarning(LOG_KTE) << "Can't open swap file, wrong version";
         return false;
     }
@@ -384,6 +389,46 @@ bool SwapFile::recover(QDataStream &stream, bool checkDigest)
 
             break;
         }
+        case EA_ReplaceText: {
+            if (!editRunning) {
+                brokenSwapFile = true;
+                break;
+            }
+
+            int lines;
+            stream >> lines;
+            for (int l = 0; l < lines && !brokenSwapFile; ++l) {
+                int line, count;
+                stream >> line >> count;
+                QVector<Kate::TextReplacement> replacements;
+                replacements.reserve(count);
+                int shift = 0;
+                for (int i = 0; i < count && !stream.atEnd(); ++i) {
+                    int column, length;
+                    QByteArray text;
+                    stream >> column >> length >> text;
+                    replacements.append({column, length, QString::fromUtf8(text.data(), text.size())});
+                    shift += replacements.last().text.size() - length;
+                }
+                if (stream.status() != QDataStream::Ok || replacements.size() != count) {
+                    brokenSwapFile = true;
+                    break;
+                }
+                m_document->editReplaceText(line, replacements);
+
+                // track undo/redo cursor
+                if (count > 0) {
+                    const Kate::TextReplacement &last = replacements.last();
+                    if (firstEditInGroup) {
+                        firstEditInGroup = false;
+                        undoCursor = KTextEditor::Cursor(line, last.column + last.length);
+                    }
+                    redoCursor = KTextEditor::Cursor(line, last.column + last.length + shift);
+                }
+            }
+
+            break;
+        }
         default: {
             qCWarning(LOG_KTE) << "Unknown type:" << type;
         }
@@ -475,6 +520,9 @@ void SwapFile::finishEditing()
         syncTimer()->start(m_document->config()->swapSyncInterval() * 1000);
     }
 
+    // replacements of this edit first
+    writeReplacements();
+
     // format: qint8
     m_stream << EA_FinishEditing;
     m_swapfile.flush();
@@ -487,6 +535,8 @@ void SwapFile::wrapLine(const KTextEditor::Cursor &position)
         return;
     }
 
+    writeReplacements();
+
     // format: qint8, int, int
     m_stream << EA_WrapLine << position.line() << position.column();
 
@@ -500,6 +550,8 @@ void SwapFile::unwrapLine(int line)
         return;
     }
 
+    writeReplacements();
+
     // format: qint8, int
     m_stream << EA_UnwrapLine << line;
 
@@ -513,6 +565,8 @@ void SwapFile::insertText(const KTextEditor::Cursor &position, const QString &te
         return;
     }
 
+    writeReplacements();
+
     // format: qint8, int, int, bytearray
     m_stream << EA_InsertText << position.line() << position.column() << text.toUtf8();
 
@@ -526,6 +580,8 @@ void SwapFile::removeText(const KTextEditor::Range &range)
         return;
     }
 
+    writeReplacements();
+
     // format: qint8, int, int, int
     Q_ASSERT(range.start().line() == range.end().line());
     m_stream << EA_RemoveText
@@ -535,6 +591,40 @@ void SwapFile::removeText(const KTextEditor::Range &range)
     m_needSync = true;
 }
 
+void SwapFile::replaceText(int line, const QVector<Kate::TextReplacement> &replacements)
+{
+    // skip if not open
+    if (!m_swapfile.isOpen()) {
+        return;
+    }
+
+    // a replace all changes many lines in one edit, collect them for one record
+    // format per line: int, int, (int, int, bytearray)*
+    QDataStream stream(&m_replacements, QIODevice::WriteOnly | QIODevice::Append);
+    stream.setVersion(m_stream.version());
+    stream << line << replacements.size();
+    foreach (const Kate::TextReplacement &replacement, replacements) {
+        stream << replacement.column << replacement.length << replacement.text.toUtf8();
+    }
+    ++m_replacedLines;
+
+    m_needSync = true;
+}
+
+void SwapFile::writeReplacements()
+{
+    if (m_replacedLines == 0) {
+        return;
+    }
+
+    // format: qint8, int, lines collected by replaceText()
+    m_stream << EA_ReplaceText << m_replacedLines;
+    m_stream.writeRawData(m_replacements.constData(), m_replacements.size());
+
+    m_replacements.clear();
+    m_replacedLines = 0;
+}
+
 bool SwapFile::shouldRecover() const
 {
     // should not recover if the file has already recovered in another view
@@ -563,6 +653,8 @@ void SwapFile::removeSwapFile()
         m_stream.setDevice(nullptr);
         m_swapfile.close();
         m_swapfile.remove();
+        m_replacements.clear();
+        m_replacedLines = 0;
     }
 }
 
@@ -63,6 +63,7 @@ private:
     void removeSwapFile();
     bool updateFileName();
     bool isValidSwapFile(QDataStream &stream, bool checkDigest) const;
+    void writeReplacements();
 
 private:
     KTextEditor::DocumentPrivate *m_document;
@@ -80,6 +81,7 @@ protected Q_SLOTS:
     void unwrapLine(int line);
     void insertText(const KTextEditor::Cursor &position, const QString &text);
     void removeText(const KTextEditor::Range &range);
+    void replaceText(int line, const QVector<Kate::TextReplacement> &replacements);
 
 public Q_SLOTS:
     void discard();
@@ -94,6 +96,12 @@ private:
     bool m_needSync;
     static QTimer *s_timer;
 
+    /**
+     * replacements of the running edit, written as one record by writeReplacements()
+     */
+    QByteArray m_replacements;
+    int m_replacedLines;
+
 protected Q_SLOTS:
     void writeFileToDisk();
 
@@ -28,6 +28,7 @@
 #include "katehighlighthelpers.h"
 #include "katetextline.h"
 #include "katedocument.h"
+#include "katebuffer.h"
 #include "katesyntaxdocument.h"
 #include "katerenderer.h"
 #include "kateglobal.h"
@@ -45,12 +46,21 @@
 #include <QStringList>
 #include <QTextStream>
 #include <QVarLengthArray>
+#include <QElapsedTimer>
 #include <QAction>
 #include <QApplication>
+
+#include <algorithm>
 //END
 
 //BEGIN STATICS
 namespace {
+// interned context stacks per highlighting, before they get dropped
+const int KATE_MAX_INTERNED_CONTEXT_STACKS = 4096;
+
+// dynamic contexts per highlighting, before the least recently used get evicted
+const int KATE_MAX_DYNAMIC_CONTEXTS = 512;
+
 inline const QString stdDeliminator()
 {
     return QStringLiteral(" \t.():!+,-<=>%&*/;?[]^{|}~\\");
@@ -65,8 +75,13 @@ bool isTrue(const QString& x)
 //END
 
 //BEGIN KateHighlighting
+bool KateHighlighting::s_profilingEnabled = false;
+
 KateHighlighting::KateHighlighting(const KSyntaxHighlighting::Definition &def)
-    : refCount(0)
+    : m_dynamicContextClock(0)
+    , m_dynamicContextLimit(KATE_MAX_DYNAMIC_CONTEXTS)
+    , m_evictedContext(nullptr)
+    , refCount(0)
     , startctx(0)
     , base_startctx(0)
 {
@@ -106,15 +121,28 @@ KateHighlighting::~KateHighlighting()
 
 void KateHighlighting::cleanup()
 {
+    qDeleteAll(m_independentCopies);
+    m_independentCopies.clear();
+
     qDeleteAll(m_contexts);
     m_contexts.clear();
 
+    delete m_evictedContext;
+    m_evictedContext = nullptr;
+
     qDeleteAll(m_hlItemCleanupList);
     m_hlItemCleanupList.clear();
 
     m_attributeArrays.clear();
 
     internalIDList.clear();
+
+    dynamicCtxs.clear();
+    m_dynamicContextKeys.clear();
+    m_dynamicContextLastUse.clear();
+    m_freeDynamicContexts.clear();
+
+    m_internedContextStacks.clear();
 }
 
 KateHlContext *KateHighlighting::generateContextStack(Kate::TextLineData::ContextStack &contextStack,
@@ -194,11 +222,13 @@ KateHlContext *KateHighlighting::generateContextStack(Kate::TextLineData::Contex
  */
 int KateHighlighting::makeDynamicContext(KateHlContext *model, const QStringList *args)
 {
-    QPair<KateHlContext *, QString> key(model, args->front());
+    // all captures count, the template may use any of them
+    QPair<KateHlContext *, QString> key(model, args->join(QChar(0)));
     short value;
 
-    if (dynamicCtxs.contains(key)) {
-        value = dynamicCtxs[key];
+    QMap< QPair<KateHlContext *, QString>, short>::const_iterator it = dynamicCtxs.constFind(key);
+    if (it != dynamicCtxs.constEnd()) {
+        value = it.value();
     } else {
 #ifdef HIGHLIGHTING_DEBUG
         qCDebug(LOG_KTE) << "new stuff: " << startctx;
@@ -206,13 +236,24 @@ int KateHighlighting::makeDynamicContext(KateHlContext *model, const QStringList
 
         KateHlContext *newctx = model->clone(args);
 
-        m_contexts.push_back(newctx);
+        // reuse the number of an evicted context, if any
+        if (!m_freeDynamicContexts.isEmpty()) {
+            value = m_freeDynamicContexts.takeLast();
+            Q_ASSERT(!m_contexts[value]);
+            m_contexts[value] = newctx;
+        } else {
+            m_contexts.push_back(newctx);
+            value = startctx++;
+            m_dynamicContextKeys.append(QPair<KateHlContext *, QString>());
+            m_dynamicContextLastUse.append(0);
+        }
 
-        value = startctx++;
         dynamicCtxs[key] = value;
-        KateHlManager::self()->incDynamicCtxs();
+        m_dynamicContextKeys[value - base_startctx] = key;
     }
 
+    m_dynamicContextLastUse[value - base_startctx] = ++m_dynamicContextClock;
+
     // qCDebug(LOG_KTE) << "Dynamic context: using context #" << value << " (for model " << model << " with args " << *args << ")";
 
     return value;
@@ -236,7 +277,139 @@ void KateHighlighting::dropDynamicContexts()
     m_contexts.resize(base_startctx);
 
     dynamicCtxs.clear();
+    m_dynamicContextKeys.clear();
+    m_dynamicContextLastUse.clear();
+    m_freeDynamicContexts.clear();
+    m_dynamicContextLimit = KATE_MAX_DYNAMIC_CONTEXTS;
     startctx = base_startctx;
+
+    // stacks referencing dropped contexts are useless now
+    m_internedContextStacks.clear();
+}
+
+bool KateHighlighting::dynamicContextsFull() const
+{
+    return dynamicCtxs.size() >= m_dynamicContextLimit;
+}
+
+bool KateHighlighting::evictDynamicContexts(KTextEditor::DocumentPrivate *document)
+{
+    if (!dynamicContextsFull()) {
+        return false;
+    }
+
+    // count the lines referring to each dynamic context
+    QList<KTextEditor::DocumentPrivate *> documents;
+    foreach (KTextEditor::DocumentPrivate *doc, KTextEditor::EditorPrivate::self()->kateDocuments()) {
+        if (doc->highlight() == this) {
+            documents.append(doc);
+        }
+    }
+    QVector<int> references(m_dynamicContextKeys.size(), 0);
+    foreach (KTextEditor::DocumentPrivate *doc, documents) {
+        if (doc != document) {
+            doc->buffer().countDynamicContextReferences(base_startctx, references);
+        }
+    }
+    QVector<int> ownReferences(m_dynamicContextKeys.size(), 0);
+    document->buffer().countDynamicContextReferences(base_startctx, ownReferences);
+
+    // least recently used first, unreferenced ones before all others
+    QVector<int> candidates;
+    for (int i = 0; i < m_dynamicContextKeys.size(); ++i) {
+        if (m_dynamicContextKeys[i].first && ownReferences[i] == 0) {
+            candidates.append(i);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [this, &references](int a, int b) {
+        if ((references[a] > 0) != (references[b] > 0)) {
+            return references[b] > 0;
+        }
+        return m_dynamicContextLastUse[a] < m_dynamicContextLastUse[b];
+    });
+
+    // evict a quarter, that way this happens not for each new context
+    // the contexts of the document being highlighted stay, else it would evict its own ones again and again
+    const int count = dynamicCtxs.size() - m_dynamicContextLimit * 3 / 4;
+    if (candidates.size() < count) {
+        m_dynamicContextLimit *= 2;
+    }
+    QVector<bool> evicted(m_dynamicContextKeys.size(), false);
+    bool referencedEvicted = false;
+
+    // stands in for the evicted contexts, until no line refers to them anymore
+    if (!m_evictedContext) {
+        m_evictedContext = new KateHlContext(identifier, 0, KateHlContextModification(), false, KateHlContextModification(),
+                                             false, false, false, KateHlContextModification());
+        m_evictedContext->lineEndContext = KateHlContextModification(-1, 1);
+    }
+    for (int i = 0; i < qMin(count, candidates.size()); ++i) {
+        const int slot = candidates[i];
+        const short context = base_startctx + slot;
+        dynamicCtxs.remove(m_dynamicContextKeys[slot]);
+        m_dynamicContextKeys[slot] = QPair<KateHlContext *, QString>();
+        delete m_contexts[context];
+        m_contexts[context] = nullptr;
+        m_freeDynamicContexts.append(context);
+        evicted[slot] = true;
+        referencedEvicted = referencedEvicted || (references[slot] > 0);
+    }
+
+    // stacks referencing evicted contexts are useless now
+    m_internedContextStacks.clear();
+
+    if (!referencedEvicted) {
+        return false;
+    }
+
+    foreach (KTextEditor::DocumentPrivate *doc, documents) {
+        if (doc != document) {
+            doc->buffer().dropDynamicContextReferences(base_startctx, evicted);
+        }
+    }
+    return true;
+}
+
+Kate::TextLineData::ContextStack KateHighlighting::internContextStack(const Kate::TextLineData::ContextStack &contextStack)
+{
+    // all empty stacks share the null vector
+    if (contextStack.isEmpty()) {
+        return Kate::TextLineData::ContextStack();
+    }
+
+    uint hash = contextStack.size();
+    for (int i = 0; i < contextStack.size(); ++i) {
+        hash = hash * 31 + uint(contextStack[i]);
+    }
+
+    for (auto it = m_internedContextStacks.constFind(hash); it != m_internedContextStacks.constEnd() && it.key() == hash; ++it) {
+        if (it.value() == contextStack) {
+            return it.value();
+        }
+    }
+
+    // bound the memory, lines still holding old stacks just look changed once
+    if (m_internedContextStacks.size() >= KATE_MAX_INTERNED_CONTEXT_STACKS) {
+        m_internedContextStacks.clear();
+    }
+
+    Kate::TextLineData::ContextStack interned(contextStack);
+    interned.squeeze();
+    m_internedContextStacks.insert(hash, interned);
+    return interned;
+}
+
+void KateHighlighting::appendAttribute(const Kate::TextLineData::Attribute &attribute)
+{
+    // try to append to previous range, if no folding info + same attribute value
+    if ((attribute.foldingValue == 0) && !m_lineAttributes.isEmpty() && (m_lineAttributes.last().foldingValue == 0)
+            && (m_lineAttributes.last().attributeValue == attribute.attributeValue)
+            && ((m_lineAttributes.last().offset + m_lineAttributes.last().length) == attribute.offset)) {
+        m_lineAttributes.last().length += attribute.length;
+        return;
+    }
+
+    m_lineAttributes.append(attribute);
 }
 
 void KateHighlighting::doHighlight(const Kate::TextLineData *_prevLine,
@@ -244,20 +417,23 @@ void KateHighlighting::doHighlight(const Kate::TextLineData *_prevLine,
                                    const Kate::TextLineData *nextLine,
                                    bool &ctxChanged,
                                    int tabWidth,
-                                   QVector<ContextChange>* contextChanges)
+                                   QVector<ContextChange>* contextChanges,
+                                   Kate::TextLineArena *arena)
 {
     if (!textLine) {
         return;
     }
 
-    // in all cases, remove old hl, or we will grow to infinite ;)
-    textLine->clearAttributes();
+    // the new attributes are collected first, they replace the old ones at once, that way
+    // the line can keep the memory of its old ones if the new ones fit
+    m_lineAttributes.resize(0);
 
     // reset folding start
     textLine->clearMarkedAsFoldingStart();
 
-    // no hl set, nothing to do more than the above cleaning ;)
+    // no hl set, nothing to do more than cleaning ;)
     if (noHl) {
+        textLine->clearAttributes();
         return;
     }
 
@@ -318,9 +494,6 @@ void KateHighlighting::doHighlight(const Kate::TextLineData *_prevLine,
     KateHighlighting::HighlightPropertyBag *additionalData = m_additionalData[context->hlId];
     KateHlContext *oldContext = context;
 
-    // optimization: list of highlighting items that need their cache reset
-    static QVarLengthArray<KateHlItem *> cachingItems;
-
     // catch empty lines
     if (len == 0) {
         // regenerate context stack if needed
@@ -377,7 +550,17 @@ void KateHighlighting::doHighlight(const Kate::TextLineData *_prevLine,
             bool anItemMatched = false;
             bool customStartEnableDetermined = false;
 
-            foreach (item, context->items) {
+            // only try the rules that may start with the current character, in their order
+            const ushort currentChar = text[offset].unicode();
+            const quint64 candidates = (currentChar < 128) ? context->firstCharItems()[currentChar] : ~Q_UINT64_C(0);
+            const int itemCount = context->items.size();
+            for (int itemIndex = 0; itemIndex < itemCount; ++itemIndex) {
+                if (itemIndex < 64 && !(candidates & (Q_UINT64_C(1) << itemIndex))) {
+                    continue;
+                }
+
+                item = context->items[itemIndex];
+
                 // does we only match if we are firstNonSpace?
                 if (item->firstNonSpace && (offset > startNonSpace)) {
                     continue;
@@ -409,9 +592,25 @@ void KateHighlighting::doHighlight(const Kate::TextLineData *_prevLine,
                     }
                 }
 
-                int offset2 = item->checkHgl(text, offset, len - offset);
+                int offset2;
+                if (Q_UNLIKELY(s_profilingEnabled)) {
+                    QElapsedTimer ruleTimer;
+                    ruleTimer.start();
+                    offset2 = item->checkHgl(text, offset, len - offset);
+                    const qint64 nanoseconds = ruleTimer.nsecsElapsed();
+                    item->profileNanoseconds += nanoseconds;
+                    context->profileNanoseconds += nanoseconds;
+                    ++item->profileInvocations;
+                    ++context->profileInvocations;
+                    if (offset2 > offset) {
+                        ++item->profileHits;
+                        ++context->profileHits;
+                    }
+                } else {
+                    offset2 = item->checkHgl(text, offset, len - offset);
+                }
                 if (item->haveCache && !item->cachingHandled) {
-                    cachingItems.append(item);
+                    m_cachingItems.append(item);
                     item->cachingHandled = true;
                 }
 
@@ -486,12 +685,12 @@ void KateHighlighting::doHighlight(const Kate::TextLineData *_prevLine,
                 // even set attributes or end of region! ;)
                 int attribute = item->onlyConsume ? context->attr : item->attr;
                 if ((attribute > 0 && !item->lookAhead) || item->region2) {
-                    textLine->addAttribute(Kate::TextLineData::Attribute(offset, offset2 - offset, attribute, item->region2));
+                    appendAttribute(Kate::TextLineData::Attribute(offset, offset2 - offset, attribute, item->region2));
                 }
 
                 // create 0 length attribute for begin of region, if any!
                 if (item->region) {
-                    textLine->addAttribute(Kate::TextLineData::Attribute(offset2, 0, attribute, item->region));
+                    appendAttribute(Kate::TextLineData::Attribute(offset2, 0, attribute, item->region));
                 }
 
                 // only process, if lookAhead is false
@@ -529,7 +728,7 @@ void KateHighlighting::doHighlight(const Kate::TextLineData *_prevLine,
             } else {
                 // set attribute if any
                 if (context->attr > 0) {
-                    textLine->addAttribute(Kate::TextLineData::Attribute(offset, 1, context->attr, 0));
+                    appendAttribute(Kate::TextLineData::Attribute(offset, 1, context->attr, 0));
                 }
 
                 lastChar = text[offset];
@@ -557,31 +756,18 @@ void KateHighlighting::doHighlight(const Kate::TextLineData *_prevLine,
         }
     }
 
+    textLine->setAttributes(m_lineAttributes, arena);
+
     /**
      * has the context stack changed?
+     * stored stacks are interned, equal ones share their data, only stacks
+     * from before the last drop of the interned ones need a real compare
      */
-    if ((ctxChanged = (ctx != textLine->contextStack()))) {
-        /**
-         * try to share the simple stack that contains only 0
-         */
-        static const Kate::TextLineData::ContextStack onlyDefaulContext(1, 0);
-        if (ctx == onlyDefaulContext) {
-            textLine->setContextStack(onlyDefaulContext);
-        }
-
-        /**
-         * next try: try to share data with last line
-         */
-        else if (ctx == prevLine->contextStack()) {
-            textLine->setContextStack(prevLine->contextStack());
-        }
-
-        /**
-         * ok, really use newly constructed stack!
-         */
-        else {
-            textLine->setContextStack(ctx);
-        }
+    const Kate::TextLineData::ContextStack internedCtx = internContextStack(ctx);
+    ctxChanged = false;
+    if (internedCtx.constData() != textLine->contextStack().constData()) {
+        ctxChanged = (internedCtx != textLine->contextStack());
+        textLine->setContextStack(internedCtx);
     }
 
     // write hl continue flag
@@ -607,11 +793,11 @@ void KateHighlighting::doHighlight(const Kate::TextLineData *_prevLine,
     }
 
     // invalidate caches
-    for (int i = 0; i < cachingItems.size(); ++i) {
-        cachingItems[i]->cachingHandled = false;
-        cachingItems[i]->haveCache = false;
+    for (int i = 0; i < m_cachingItems.size(); ++i) {
+        m_cachingItems[i]->cachingHandled = false;
+        m_cachingItems[i]->haveCache = false;
     }
-    cachingItems.clear();
+    m_cachingItems.clear();
 }
 
 void KateHighlighting::getKateExtendedAttributeList(const QString &schema, QList<KTextEditor::Attribute::Ptr> &list, KConfig *cfg)
@@ -755,6 +941,23 @@ void KateHighlighting::addCharacterEncoding(const QString &key, const QString &e
     m_additionalData[ key ]->reverseCharacterEncodings[ c ] = encoding;
 }
 
+KateHighlighting *KateHighlighting::takeIndependentCopy()
+{
+    if (!m_independentCopies.isEmpty()) {
+        return m_independentCopies.takeLast();
+    }
+
+    KateHighlighting *copy = new KateHighlighting(KateHlManager::self()->m_repository.definitionForName(iName));
+    copy->use();
+    return copy;
+}
+
+void KateHighlighting::releaseIndependentCopy(KateHighlighting *copy)
+{
+    copy->dropDynamicContexts();
+    m_independentCopies.append(copy);
+}
+
 /**
  * Increase the usage count, and trigger initialization if needed.
  */
@@ -814,7 +1017,7 @@ void KateHighlighting::init()
             false, false, false, KateHlContextModification()));
     }
 
-    // clear domdocument cache
+    // clear parsed definitions, the binary cache on disk stays
     KateHlManager::self()->syntax.clearCache();
 }
 
@@ -1108,6 +1311,14 @@ KateHlItem *KateHighlighting::createKateHlItem(KateSyntaxContextData *data,
         return nullptr;
     }
 
+    // name the rule for the profiler
+    tmpItem->profileName = dataname;
+    if (!stringdata.isEmpty()) {
+        tmpItem->profileName += QStringLiteral(" \"%1\"").arg(stringdata);
+    } else if (!chr.isNull()) {
+        tmpItem->profileName += QStringLiteral(" '%1'").arg(chr1.isNull() ? QString(chr) : QString(chr) + chr1);
+    }
+
     // set lookAhead & dynamic properties
     tmpItem->lookAhead = lookAhead;
     tmpItem->dynamic = dynamic;
@@ -1127,7 +1338,8 @@ KateHlItem *KateHighlighting::createKateHlItem(KateSyntaxContextData *data,
 
 int KateHighlighting::attribute(int ctx) const
 {
-    return m_contexts[ctx]->attr;
+    const KateHlContext *context = contextNum(ctx);
+    return context ? context->attr : 0;
 }
 
 bool KateHighlighting::attributeRequiresSpellchecking(int attr)
@@ -2024,6 +2236,7 @@ int KateHighlighting::addToContextList(const QString &ident, int ctx0)
                 ft, ftc, dynamic, noIndentationBasedFolding,
                 !emptyLineContext.isEmpty(), emptyLineContextModification);
 
+            ctxNew->profileName = ContextNameList.value(i);
             m_contexts.push_back(ctxNew);
 
 #ifdef HIGHLIGHTING_DEBUG
@@ -2224,13 +2437,94 @@ QList<KTextEditor::Attribute::Ptr> KateHighlighting::attributes(const QString &s
 KateHlContext *KateHighlighting::contextNum(int n) const
 {
     if (n >= 0 && n < m_contexts.size()) {
-        return m_contexts[n];
+        // lines might still refer to an evicted dynamic context
+        return m_contexts[n] ? m_contexts[n] : m_evictedContext;
     }
 
     Q_ASSERT(false);
     return nullptr;
 }
 
+void KateHighlighting::setProfilingEnabled(bool enabled)
+{
+    s_profilingEnabled = enabled;
+}
+
+QString KateHighlighting::profileReport(int maxRules) const
+{
+    // all rules and contexts in use, including the dynamic ones
+    QVector<KateHlItem *> rules;
+    QVector<KateHlContext *> contexts;
+    QSet<KateHlItem *> seen;
+    qint64 totalNanoseconds = 0;
+    foreach (KateHlContext *context, m_contexts) {
+        // slot of an evicted dynamic context
+        if (!context) {
+            continue;
+        }
+        if (context->profileInvocations > 0) {
+            contexts.append(context);
+        }
+        foreach (KateHlItem *item, context->items) {
+            if (item->profileInvocations > 0 && !seen.contains(item)) {
+                seen.insert(item);
+                rules.append(item);
+                totalNanoseconds += item->profileNanoseconds;
+            }
+        }
+    }
+
+    std::sort(rules.begin(), rules.end(), [](const KateHlItem *a, const KateHlItem *b) {
+        return a->profileNanoseconds > b->profileNanoseconds;
+    });
+    std::sort(contexts.begin(), contexts.end(), [](const KateHlContext *a, const KateHlContext *b) {
+        return a->profileNanoseconds > b->profileNanoseconds;
+    });
+
+    QString report = QStringLiteral("%1: %2 ms in %3 rules\n").arg(iName).arg(totalNanoseconds / 1000000.0, 0, 'f', 2).arg(rules.size());
+    report += QStringLiteral("Contexts:\n");
+    for (int i = 0; i < qMin(maxRules, contexts.size()); ++i) {
+        const KateHlContext *context = contexts[i];
+        report += QStringLiteral("%1 ms  %2 calls  %3 matches  %4\n")
+                  .arg(context->profileNanoseconds / 1000000.0, 8, 'f', 2)
+                  .arg(context->profileInvocations, 9)
+                  .arg(context->profileHits, 8)
+                  .arg(context->profileName);
+    }
+    report += QStringLiteral("Rules:\n");
+    for (int i = 0; i < qMin(maxRules, rules.size()); ++i) {
+        const KateHlItem *item = rules[i];
+        report += QStringLiteral("%1 ms  %2 calls  %3 matches  %4")
+                  .arg(item->profileNanoseconds / 1000000.0, 8, 'f', 2)
+                  .arg(item->profileInvocations, 9)
+                  .arg(item->profileHits, 8)
+                  .arg(item->profileName);
+        const QString details = item->profileDetails();
+        if (!details.isEmpty()) {
+            report += QStringLiteral(" (%1)").arg(details);
+        }
+        report += QLatin1Char('\n');
+    }
+    return report;
+}
+
+void KateHighlighting::resetProfile()
+{
+    foreach (KateHlContext *context, m_contexts) {
+        if (!context) {
+            continue;
+        }
+        context->profileInvocations = 0;
+        context->profileHits = 0;
+        context->profileNanoseconds = 0;
+        foreach (KateHlItem *item, context->items) {
+            item->profileInvocations = 0;
+            item->profileHits = 0;
+            item->profileNanoseconds = 0;
+        }
+    }
+}
+
 QStringList KateHighlighting::getEmbeddedHighlightingModes() const
 {
     return embeddedHighlightingModes;
@@ -28,6 +28,8 @@
 #include "spellcheck/prefixstore.h"
 #include "range.h"
 
+#include <ktexteditor_export.h>
+
 #include <QVector>
 #include <QList>
 #include <QHash>
@@ -39,6 +41,7 @@
 #include <QPointer>
 #include <QDate>
 #include <QLinkedList>
+#include <QVarLengthArray>
 
 class KConfig;
 
@@ -54,9 +57,6 @@ namespace KTextEditor {
 // same as in kmimemagic, no need to feed more data
 #define KATE_HL_HOWMANY 1024
 
-// min. x seconds between two dynamic contexts reset
-#define KATE_DYNAMIC_CONTEXTS_RESET_DELAY (30 * 1000)
-
 /**
  * describe a modification of the context stack
  */
@@ -131,7 +131,7 @@ typedef QList<KateHlIncludeRule *> KateHlIncludeRules;
 typedef QMap<QString, KateEmbeddedHlInfo> KateEmbeddedHlInfos;
 typedef QMap<KateHlContextModification *, QString> KateHlUnresolvedCtxRefs;
 
-class KateHighlighting
+class KTEXTEDITOR_EXPORT KateHighlighting
 {
 public:
     KateHighlighting(const KSyntaxHighlighting::Definition &def);
@@ -160,13 +160,16 @@ public:
      * @param nextLine The next line, to check if indentation changed for indentation based folding.
      * @param ctxChanged will be set to reflect if the context changed
      * @param tabWidth tab width for indentation based folding, if wanted, else 0
+     * @param contextChanges if given, the context changes of the line are appended
+     * @param arena arena of the block of the line for its attributes, see Kate::TextBuffer::lineArena()
      */
     void doHighlight(const Kate::TextLineData *prevLine,
                      Kate::TextLineData *textLine,
                      const Kate::TextLineData *nextLine,
                      bool &ctxChanged,
                      int tabWidth = 0,
-                     QVector<ContextChange>* contextChanges = nullptr);
+                     QVector<ContextChange>* contextChanges = nullptr,
+                     Kate::TextLineArena *arena = nullptr);
     /**
      * Saves the attribute definitions to the config file.
      *
@@ -306,6 +309,32 @@ public:
     // be carefull: all documents hl should be invalidated after calling this method!
     void dropDynamicContexts();
 
+    /**
+     * Keep the pool of dynamic contexts bounded: once it is full, evict the least recently
+     * used contexts, the ones no line refers to first. Lines of the other documents using
+     * this highlighting that refer to an evicted context lose their highlighting.
+     * Contexts the lines of @p document refer to are kept, if they don't fit, the pool grows.
+     * Must only be called between the highlighting of two lines.
+     * @param document document that is highlighted right now
+     * @return true if lines of other documents lost their highlighting
+     */
+    bool evictDynamicContexts(KTextEditor::DocumentPrivate *document);
+
+    /**
+     * Is the pool of dynamic contexts full, so that evictDynamicContexts() would evict some?
+     * @return pool full?
+     */
+    bool dynamicContextsFull() const;
+
+    /**
+     * Number of dynamic contexts alive.
+     * @return size of the dynamic context pool
+     */
+    int dynamicContextCount() const
+    {
+        return dynamicCtxs.size();
+    }
+
     QString indentation()
     {
         return m_indentation;
@@ -326,6 +355,58 @@ public:
 
     KateHlContext *contextNum(int n) const;
 
+    /**
+     * Number of the contexts read from the definitions, dynamic contexts get numbers behind them.
+     * @return number of non-dynamic contexts
+     */
+    int staticContextCount() const
+    {
+        return base_startctx;
+    }
+
+    /**
+     * Another initialized instance of this highlighting, not shared with any document.
+     * It numbers its contexts and attributes like this one, only the numbers of dynamic contexts
+     * differ. Used to highlight on other threads, as doHighlight() changes the state of the rules.
+     * Hand it back with releaseIndependentCopy(), it is reused until this highlighting is reloaded.
+     * @return highlighting instance, taken from the pool of copies or new
+     */
+    KateHighlighting *takeIndependentCopy();
+
+    /**
+     * Put a copy taken by takeIndependentCopy() back into the pool.
+     * @param copy copy no longer used, its dynamic contexts are dropped
+     */
+    void releaseIndependentCopy(KateHighlighting *copy);
+
+    /**
+     * Enable or disable the rule profiler for all highlightings.
+     * While enabled, doHighlight measures invocations, matches and time of each rule and context.
+     * @param enabled profiler on or off
+     */
+    static void setProfilingEnabled(bool enabled);
+
+    /**
+     * Is the rule profiler enabled?
+     * @return profiler on?
+     */
+    static bool profilingEnabled()
+    {
+        return s_profilingEnabled;
+    }
+
+    /**
+     * Report of the contexts and rules that took most time since the last resetProfile().
+     * @param maxRules number of contexts and of rules to list
+     * @return human readable report, one context or rule per line
+     */
+    QString profileReport(int maxRules = 20) const;
+
+    /**
+     * Reset the profiler numbers of all contexts and rules.
+     */
+    void resetProfile();
+
 private:
     /**
       * 'encoding' must not contain new line characters, i.e. '\n' or '\r'!
@@ -358,6 +439,22 @@ private:
      */
     KateHlContext *generateContextStack(Kate::TextLineData::ContextStack &contextStack, KateHlContextModification modification, int &indexLastContextPreviousLine);
 
+    /**
+     * Shared copy of the given context stack.
+     * Equal stacks handed out by this share their data, that way the highlighting
+     * of a line can check if its end state changed by comparing the data pointers.
+     * @param contextStack context stack to intern
+     * @return interned context stack, the shared null vector for empty ones
+     */
+    Kate::TextLineData::ContextStack internContextStack(const Kate::TextLineData::ContextStack &contextStack);
+
+    /**
+     * Append an attribute to the ones of the line doHighlight() works on.
+     * Merged with the previous one, if it continues it with the same attribute value and no folding.
+     * @param attribute new attribute to append
+     */
+    void appendAttribute(const Kate::TextLineData::Attribute &attribute);
+
     KateHlItem *createKateHlItem(KateSyntaxContextData *data, QList<KTextEditor::Attribute::Ptr> &iDl, QStringList *RegionList, QStringList *ContextList);
     int lookupAttrName(const QString &name, QList<KTextEditor::Attribute::Ptr> &iDl);
 
@@ -368,8 +465,55 @@ private:
 
     QVector<KateHlContext *> m_contexts;
 
+    /**
+     * dynamic contexts by template context and captured arguments
+     */
     QMap< QPair<KateHlContext *, QString>, short> dynamicCtxs;
 
+    /**
+     * key and last use of each dynamic context, by context number - base_startctx,
+     * the key of unused slots has no template context
+     */
+    QVector<QPair<KateHlContext *, QString> > m_dynamicContextKeys;
+    QVector<quint64> m_dynamicContextLastUse;
+    quint64 m_dynamicContextClock;
+
+    /**
+     * size of the dynamic context pool
+     */
+    int m_dynamicContextLimit;
+
+    /**
+     * context numbers of evicted dynamic contexts, to be reused
+     */
+    QVector<short> m_freeDynamicContexts;
+
+    /**
+     * empty context contextNum() returns for the slots of evicted dynamic contexts,
+     * they stay nullptr in m_contexts
+     */
+    KateHlContext *m_evictedContext;
+
+    /**
+     * interned context stacks, by hash of their content
+     */
+    QMultiHash<uint, Kate::TextLineData::ContextStack> m_internedContextStacks;
+
+    /**
+     * attributes of the line doHighlight() works on, kept to reuse the memory
+     */
+    QVector<Kate::TextLineData::Attribute> m_lineAttributes;
+
+    /**
+     * rules that need their cache reset after the current line, used by doHighlight()
+     */
+    QVarLengthArray<KateHlItem *> m_cachingItems;
+
+    /**
+     * unused copies for takeIndependentCopy()
+     */
+    QVector<KateHighlighting *> m_independentCopies;
+
     // make them pointers perhaps
     // NOTE: gets cleaned once makeContextList() finishes
     KateEmbeddedHlInfos embeddedHls;
@@ -412,6 +556,9 @@ private:
     // list of all created items to delete them later
     QList<KateHlItem *> m_hlItemCleanupList;
 
+    // rule profiler enabled?
+    static bool s_profilingEnabled;
+
     /**
      * This class holds the additional properties for one highlight
      * definition, such as comment strings, deliminators etc.
@@ -35,6 +35,8 @@
 #include "katepartdebug.h"
 
 #include <QSet>
+
+#include <algorithm>
 //END
 
 //BEGIN KateHlItem
@@ -52,7 +54,10 @@ KateHlItem::KateHlItem(int attribute, KateHlContextModification context, signed
       alwaysStartEnable(true),
       customStartEnable(false),
       haveCache(false),
-      cachingHandled(false)
+      cachingHandled(false),
+      profileInvocations(0),
+      profileHits(0),
+      profileNanoseconds(0)
 {
 }
 
@@ -181,6 +186,21 @@ int KateHlStringDetect::checkHgl(const QString &text, int offset, int len)
     return 0;
 }
 
+bool KateHlStringDetect::addFirstCharacters(quint64 *asciiChars) const
+{
+    if (strLen == 0) {
+        return true;
+    }
+
+    // insensitive: str is upper case, any char with that upper case matches
+    for (ushort c = 0; c < 128; ++c) {
+        if ((_inSensitive ? QChar(c).toUpper() : QChar(c)) == str[0]) {
+            addFirstCharacter(asciiChars, QChar(c));
+        }
+    }
+    return true;
+}
+
 KateHlItem *KateHlStringDetect::clone(const QStringList *args)
 {
     QString newstr = str;
@@ -273,96 +293,138 @@ int KateHlRangeDetect::checkHgl(const QString &text, int offset, int len)
 KateHlKeyword::KateHlKeyword(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2, bool insensitive, const QString &delims)
     : KateHlItem(attribute, context, regionId, regionId2)
     , _insensitive(insensitive)
-    , minLen(0xFFFFFF)
-    , maxLen(0)
 {
     alwaysStartEnable = false;
     customStartEnable = true;
+
+    m_asciiDelimiters[0] = m_asciiDelimiters[1] = 0;
     foreach (QChar c, delims) {
-        deliminators << c;
+        if (c.unicode() < 128) {
+            m_asciiDelimiters[c.unicode() >> 6] |= Q_UINT64_C(1) << (c.unicode() & 63);
+        } else if (!m_otherDelimiters.contains(c)) {
+            m_otherDelimiters.append(c);
+        }
     }
+
+    // empty trie, just the root
+    const TrieNode root = { 0, 0, false };
+    m_nodes.append(root);
 }
 
 KateHlKeyword::~KateHlKeyword()
 {
-    qDeleteAll(dict);
 }
 
 QSet<QString> KateHlKeyword::allKeywords() const
 {
-    QSet<QString> result;
-    foreach (const QSet<QString>* v, dict) {
-        if (!v) {
-            continue;
-        }
-        result.unite(*v);
-    }
-    return result;
+    return m_keywords;
 }
 
 void KateHlKeyword::addList(const QStringList &list)
 {
     for (int i = 0; i < list.count(); ++i) {
-        int len = list[i].length();
-
-        if (minLen > len) {
-            minLen = len;
+        if (list[i].isEmpty()) {
+            continue;
         }
 
-        if (maxLen < len) {
-            maxLen = len;
+        QString keyword = list[i];
+        for (int c = 0; c < keyword.size(); ++c) {
+            keyword[c] = QChar(foldCase(keyword[c].unicode()));
         }
+        m_keywords.insert(keyword);
+    }
 
-        if (len >= dict.size()) {
-            uint oldSize = dict.size();
-            dict.resize(len + 1);
+    // compile all keywords into the trie
+    QStringList sorted = m_keywords.toList();
+    std::sort(sorted.begin(), sorted.end());
 
-            for (int m = oldSize; m < dict.size(); ++m) {
-                dict[m] = nullptr;
-            }
-        }
+    m_nodes.clear();
+    m_edgeKeys.clear();
+    m_edgeTargets.clear();
+    compileNode(sorted, 0, sorted.size(), 0);
 
-        if (!dict[len]) {
-            dict[len] = new QSet<QString> ();
-        }
+    m_nodes.squeeze();
+    m_edgeKeys.squeeze();
+    m_edgeTargets.squeeze();
+}
 
-        if (!_insensitive) {
-            dict[len]->insert(list[i]);
-        } else {
-            dict[len]->insert(list[i].toLower());
+int KateHlKeyword::compileNode(const QStringList &sorted, int begin, int end, int depth)
+{
+    const int node = m_nodes.size();
+    TrieNode trieNode = { m_edgeKeys.size(), 0, false };
+
+    // sorted, the keyword ending here comes first
+    if (begin < end && sorted[begin].size() == depth) {
+        trieNode.terminal = true;
+        ++begin;
+    }
+
+    // one edge per distinct next character, targets follow once the edges are in place
+    QVector<int> groupStarts;
+    for (int i = begin; i < end; ++i) {
+        if (i == begin || sorted[i][depth] != sorted[i - 1][depth]) {
+            groupStarts.append(i);
+            m_edgeKeys.append(sorted[i][depth].unicode());
+            m_edgeTargets.append(-1);
         }
     }
+    groupStarts.append(end);
+    trieNode.edgeCount = groupStarts.size() - 1;
+    m_nodes.append(trieNode);
+
+    for (int i = 0; i < trieNode.edgeCount; ++i) {
+        m_edgeTargets[trieNode.firstEdge + i] = compileNode(sorted, groupStarts[i], groupStarts[i + 1], depth + 1);
+    }
+
+    return node;
 }
 
 int KateHlKeyword::checkHgl(const QString &text, int offset, int len)
 {
+    const ushort *unicode = reinterpret_cast<const ushort *>(text.unicode());
+    const TrieNode *nodes = m_nodes.constData();
+    const ushort *edgeKeys = m_edgeKeys.constData();
+    const int *edgeTargets = m_edgeTargets.constData();
+
+    // walk the trie until the word ends, no keyword can match once we fall off
+    const TrieNode *node = nodes;
+    const int end = offset + len;
     int offset2 = offset;
-    int wordLen = 0;
-
-    while ((len > wordLen) && !deliminators.contains(text[offset2])) {
-        offset2++;
-        wordLen++;
+    for (; offset2 < end; ++offset2) {
+        const ushort c = unicode[offset2];
+        if (isDelimiter(c)) {
+            break;
+        }
 
-        if (wordLen > maxLen) {
+        const ushort key = foldCase(c);
+        const ushort *first = edgeKeys + node->firstEdge;
+        const ushort *last = first + node->edgeCount;
+        const ushort *edge = (node->edgeCount > 8) ? std::lower_bound(first, last, key) : first;
+        while (edge != last && *edge < key) {
+            ++edge;
+        }
+        if (edge == last || *edge != key) {
             return 0;
         }
-    }
 
-    if (wordLen < minLen || !dict[wordLen]) {
-        return 0;
+        node = nodes + edgeTargets[edge - edgeKeys];
     }
 
-    if (!_insensitive) {
-        if (dict[wordLen]->contains(QString::fromRawData(text.unicode() + offset, wordLen))) {
-            return offset2;
-        }
-    } else {
-        if (dict[wordLen]->contains(QString::fromRawData(text.unicode() + offset, wordLen).toLower())) {
-            return offset2;
+    return (node->terminal && offset2 > offset) ? offset2 : 0;
+}
+
+bool KateHlKeyword::addFirstCharacters(quint64 *asciiChars) const
+{
+    // first level of the trie, delimiters end the word before it starts
+    const TrieNode &root = m_nodes.first();
+    const ushort *first = m_edgeKeys.constData() + root.firstEdge;
+    const ushort *last = first + root.edgeCount;
+    for (ushort c = 0; c < 128; ++c) {
+        if (!isDelimiter(c) && std::binary_search(first, last, foldCase(c))) {
+            addFirstCharacter(asciiChars, QChar(c));
         }
     }
-
-    return 0;
+    return true;
 }
 //END
 
@@ -396,6 +458,14 @@ int KateHlInt::checkHgl(const QString &text, int offset, int len)
 
     return 0;
 }
+
+bool KateHlInt::addFirstCharacters(quint64 *asciiChars) const
+{
+    for (char c = '0'; c <= '9'; ++c) {
+        addFirstCharacter(asciiChars, QLatin1Char(c));
+    }
+    return true;
+}
 //END
 
 //BEGIN KateHlFloat
@@ -481,6 +551,15 @@ int KateHlFloat::checkHgl(const QString &text, int offset, int len)
 
     return 0;
 }
+
+bool KateHlFloat::addFirstCharacters(quint64 *asciiChars) const
+{
+    for (char c = '0'; c <= '9'; ++c) {
+        addFirstCharacter(asciiChars, QLatin1Char(c));
+    }
+    addFirstCharacter(asciiChars, QLatin1Char('.'));
+    return true;
+}
 //END
 
 //BEGIN KateHlCOct
@@ -514,6 +593,12 @@ int KateHlCOct::checkHgl(const QString &text, int offset, int len)
 
     return 0;
 }
+
+bool KateHlCOct::addFirstCharacters(quint64 *asciiChars) const
+{
+    addFirstCharacter(asciiChars, QLatin1Char('0'));
+    return true;
+}
 //END
 
 //BEGIN KateHlCHex
@@ -546,6 +631,12 @@ int KateHlCHex::checkHgl(const QString &text, int offset, int len)
 
     return 0;
 }
+
+bool KateHlCHex::addFirstCharacters(quint64 *asciiChars) const
+{
+    addFirstCharacter(asciiChars, QLatin1Char('0'));
+    return true;
+}
 //END
 
 //BEGIN KateHlCFloat
@@ -608,6 +699,14 @@ int KateHlAnyChar::checkHgl(const QString &text, int offset, int)
 
     return 0;
 }
+
+bool KateHlAnyChar::addFirstCharacters(quint64 *asciiChars) const
+{
+    foreach (QChar c, _charList) {
+        addFirstCharacter(asciiChars, c);
+    }
+    return true;
+}
 //END
 
 //BEGIN KateHlRegExpr
@@ -616,7 +715,266 @@ KateHlRegExpr::KateHlRegExpr(int attribute, KateHlContextModification context, s
     , m_regularExpression (regexp, (insensitive ? QRegularExpression::CaseInsensitiveOption : QRegularExpression::NoPatternOption)
                  | (minimal ? QRegularExpression::InvertedGreedinessOption : QRegularExpression::NoPatternOption))
     , m_handlesLineStart (regexp.startsWith(QLatin1Char('^')))
+    , m_engineRuns(0)
+    , m_prefilterSkips(0)
+{
+    m_firstChars[0] = m_firstChars[1] = 0;
+    m_hasFirstChars = firstCharacters(regexp, insensitive, m_firstChars);
+
+    // we will match a lot, compile it now, with JIT if available
+    m_regularExpression.optimize();
+}
+
+namespace {
+inline void addCharacterRange(quint64 *asciiChars, ushort first, ushort last)
+{
+    for (ushort c = first; c <= last && c < 128; ++c) {
+        asciiChars[c >> 6] |= Q_UINT64_C(1) << (c & 63);
+    }
+}
+
+inline void addOtherCase(quint64 *asciiChars)
+{
+    for (ushort c = 'A'; c <= 'Z'; ++c) {
+        const quint64 upper = Q_UINT64_C(1) << (c & 63);
+        const quint64 lower = Q_UINT64_C(1) << ((c + 32) & 63);
+        if ((asciiChars[c >> 6] & upper) || (asciiChars[(c + 32) >> 6] & lower)) {
+            asciiChars[c >> 6] |= upper;
+            asciiChars[(c + 32) >> 6] |= lower;
+        }
+    }
+}
+
+/**
+ * Characters matched by the escape sequence \\<c>, as far as they are ASCII.
+ * @param single set to the character if the escape stands for exactly that one
+ * @return false for escapes we don't understand
+ */
+bool addEscapedCharacters(quint64 *asciiChars, QChar c, QChar &single)
+{
+    quint64 chars[2] = { 0, 0 };
+    bool complement = false;
+    single = QChar();
+    switch (c.unicode()) {
+    case 'D':
+        complement = true;
+        // fall through
+    case 'd':
+        addCharacterRange(chars, '0', '9');
+        break;
+    case 'W':
+        complement = true;
+        // fall through
+    case 'w':
+        addCharacterRange(chars, '0', '9');
+        addCharacterRange(chars, 'A', 'Z');
+        addCharacterRange(chars, 'a', 'z');
+        addCharacterRange(chars, '_', '_');
+        break;
+    case 'S':
+        complement = true;
+        // fall through
+    case 's':
+        addCharacterRange(chars, '\t', '\r');
+        addCharacterRange(chars, ' ', ' ');
+        break;
+    case 'v':
+        addCharacterRange(chars, '\n', '\r');
+        break;
+    case 't':
+        single = QLatin1Char('\t');
+        break;
+    case 'n':
+        single = QLatin1Char('\n');
+        break;
+    case 'r':
+        single = QLatin1Char('\r');
+        break;
+    case 'f':
+        single = QLatin1Char('\f');
+        break;
+    case 'e':
+        single = QChar(0x1b);
+        break;
+    case 'a':
+        single = QChar(0x07);
+        break;
+    default:
+        // escaped punctuation stands for itself, letters and digits have special meanings
+        if (c.unicode() >= 128 || c.isLetterOrNumber()) {
+            return false;
+        }
+        single = c;
+    }
+
+    if (!single.isNull()) {
+        addCharacterRange(chars, single.unicode(), single.unicode());
+    }
+
+    asciiChars[0] |= complement ? ~chars[0] : chars[0];
+    asciiChars[1] |= complement ? ~chars[1] : chars[1];
+    return true;
+}
+}
+
+bool KateHlRegExpr::firstCharacters(const QString &pattern, bool insensitive, quint64 *asciiChars)
 {
+    const int size = pattern.size();
+
+    // top level alternatives may start with anything
+    int depth = 0;
+    for (int i = 0; i < size; ++i) {
+        const QChar c = pattern[i];
+        if (c == QLatin1Char('\\')) {
+            ++i;
+        } else if (c == QLatin1Char('[')) {
+            // skip the class, a leading ] is part of it
+            ++i;
+            if (i < size && pattern[i] == QLatin1Char('^')) {
+                ++i;
+            }
+            if (i < size && pattern[i] == QLatin1Char(']')) {
+                ++i;
+            }
+            while (i < size && pattern[i] != QLatin1Char(']')) {
+                if (pattern[i] == QLatin1Char('\\')) {
+                    ++i;
+                }
+                ++i;
+            }
+        } else if (c == QLatin1Char('(')) {
+            ++depth;
+        } else if (c == QLatin1Char(')')) {
+            --depth;
+        } else if (c == QLatin1Char('|') && depth == 0) {
+            return false;
+        }
+    }
+
+    // skip line start and word boundaries, they match no character
+    int i = 0;
+    if (i < size && pattern[i] == QLatin1Char('^')) {
+        ++i;
+    }
+    while (i + 1 < size && pattern[i] == QLatin1Char('\\') && (pattern[i + 1] == QLatin1Char('b') || pattern[i + 1] == QLatin1Char('B'))) {
+        i += 2;
+    }
+    if (i >= size) {
+        return false;
+    }
+
+    quint64 chars[2] = { 0, 0 };
+    QChar single;
+    const QChar c = pattern[i];
+    if (c == QLatin1Char('\\')) {
+        if (i + 1 >= size || !addEscapedCharacters(chars, pattern[i + 1], single)) {
+            return false;
+        }
+        i += 2;
+    } else if (c == QLatin1Char('[')) {
+        ++i;
+        const bool negated = (i < size && pattern[i] == QLatin1Char('^'));
+        if (negated) {
+            ++i;
+        }
+
+        // collect the class, a leading ] is part of it
+        quint64 classChars[2] = { 0, 0 };
+        bool first = true;
+        while (true) {
+            if (i >= size) {
+                return false;
+            }
+
+            QChar from = pattern[i];
+            if (from == QLatin1Char(']') && !first) {
+                ++i;
+                break;
+            }
+            first = false;
+
+            // no POSIX classes
+            if (from == QLatin1Char('[') && i + 1 < size && pattern[i + 1] == QLatin1Char(':')) {
+                return false;
+            }
+
+            if (from == QLatin1Char('\\')) {
+                if (i + 1 >= size || !addEscapedCharacters(classChars, pattern[i + 1], from)) {
+                    return false;
+                }
+                i += 2;
+
+                // a class escape like \\d can't start a range
+                if (from.isNull()) {
+                    continue;
+                }
+            } else {
+                ++i;
+            }
+
+            // non-ASCII characters might fold to ASCII ones
+            if (insensitive && from.unicode() >= 128) {
+                return false;
+            }
+
+            // range?
+            if (i + 1 < size && pattern[i] == QLatin1Char('-') && pattern[i + 1] != QLatin1Char(']')) {
+                QChar to = pattern[i + 1];
+                i += 2;
+                if (to == QLatin1Char('\\')) {
+                    if (i >= size || !addEscapedCharacters(classChars, pattern[i], to) || to.isNull()) {
+                        return false;
+                    }
+                    ++i;
+                }
+                if (to < from || (insensitive && to.unicode() >= 128)) {
+                    return false;
+                }
+                addCharacterRange(classChars, from.unicode(), to.unicode());
+            } else {
+                addCharacterRange(classChars, from.unicode(), from.unicode());
+            }
+        }
+
+        if (insensitive) {
+            addOtherCase(classChars);
+        }
+        chars[0] = negated ? ~classChars[0] : classChars[0];
+        chars[1] = negated ? ~classChars[1] : classChars[1];
+    } else if (QStringLiteral(".()[]{}|*+?$").contains(c)) {
+        return false;
+    } else {
+        if (insensitive && c.unicode() >= 128) {
+            return false;
+        }
+        addCharacterRange(chars, c.unicode(), c.unicode());
+        ++i;
+    }
+
+    // optional first element, the next one might start the match as well
+    if (i < size && (pattern[i] == QLatin1Char('?') || pattern[i] == QLatin1Char('*') || pattern[i] == QLatin1Char('{'))) {
+        return false;
+    }
+
+    if (insensitive) {
+        addOtherCase(chars);
+    }
+
+    asciiChars[0] |= chars[0];
+    asciiChars[1] |= chars[1];
+    return true;
+}
+
+bool KateHlRegExpr::addFirstCharacters(quint64 *asciiChars) const
+{
+    asciiChars[0] |= m_firstChars[0];
+    asciiChars[1] |= m_firstChars[1];
+    return m_hasFirstChars;
+}
+
+QString KateHlRegExpr::profileDetails() const
+{
+    return QStringLiteral("%1 regex runs, %2 skipped by first character").arg(m_engineRuns).arg(m_prefilterSkips);
 }
 
 int KateHlRegExpr::checkHgl(const QString &text, int offset, int /*len*/)
@@ -641,7 +999,23 @@ int KateHlRegExpr::checkHgl(const QString &text, int offset, int /*len*/)
      * store result in member variable for later reuse
      */
     if (!haveCache) {
-        m_lastMatch = m_regularExpression.match(text, offset);
+        // no match can start before the next of its first characters, none without one
+        int start = offset;
+        if (m_hasFirstChars) {
+            const ushort *unicode = reinterpret_cast<const ushort *>(text.unicode());
+            const int length = text.size();
+            while (start < length && unicode[start] < 128 && !(m_firstChars[unicode[start] >> 6] & (Q_UINT64_C(1) << (unicode[start] & 63)))) {
+                ++start;
+            }
+        }
+
+        if (start < text.size()) {
+            m_lastMatch = m_regularExpression.match(text, start);
+            ++m_engineRuns;
+        } else {
+            m_lastMatch = QRegularExpressionMatch();
+            ++m_prefilterSkips;
+        }
         haveCache = true;
     }
 
@@ -707,6 +1081,12 @@ int KateHlLineContinue::checkHgl(const QString &text, int offset, int len)
 
     return 0;
 }
+
+bool KateHlLineContinue::addFirstCharacters(quint64 *asciiChars) const
+{
+    addFirstCharacter(asciiChars, m_trailer);
+    return true;
+}
 //END
 
 //BEGIN KateHlCStringChar
@@ -786,6 +1166,12 @@ int KateHlCStringChar::checkHgl(const QString &text, int offset, int len)
 {
     return checkEscapedChar(text, offset, len);
 }
+
+bool KateHlCStringChar::addFirstCharacters(quint64 *asciiChars) const
+{
+    addFirstCharacter(asciiChars, QLatin1Char('\\'));
+    return true;
+}
 //END
 
 //BEGIN KateHlCChar
@@ -820,6 +1206,12 @@ int KateHlCChar::checkHgl(const QString &text, int offset, int len)
 
     return 0;
 }
+
+bool KateHlCChar::addFirstCharacters(quint64 *asciiChars) const
+{
+    addFirstCharacter(asciiChars, QLatin1Char('\''));
+    return true;
+}
 //END
 
 //BEGIN KateHl2CharDetect
@@ -846,6 +1238,10 @@ KateHlContext::KateHlContext(const QString &_hlId, int attribute, KateHlContextM
     noIndentationBasedFolding = _noIndentationBasedFolding;
     emptyLineContext = _emptyLineContext;
     emptyLineContextModification = _emptyLineContextModification;
+    profileInvocations = 0;
+    profileHits = 0;
+    profileNanoseconds = 0;
+    m_firstCharItemsValid = false;
     if (_noIndentationBasedFolding) {
         qCDebug(LOG_KTE) << "**********************_noIndentationBasedFolding is TRUE*****************";
     }
@@ -860,15 +1256,42 @@ KateHlContext *KateHlContext::clone(const QStringList *args)
 
     for (int n = 0; n < items.size(); ++n) {
         KateHlItem *item = items[n];
-        KateHlItem *i = (item->dynamic ? item->clone(args) : item);
+        KateHlItem *i = item;
+        if (item->dynamic) {
+            i = item->clone(args);
+            i->profileName = item->profileName;
+        }
         ret->items.append(i);
     }
 
     ret->dynamicChild = true;
+    ret->profileName = profileName;
 
     return ret;
 }
 
+void KateHlContext::buildFirstCharItems()
+{
+    for (int c = 0; c < 128; ++c) {
+        m_firstCharItems[c] = 0;
+    }
+
+    for (int i = 0; i < qMin(items.size(), 64); ++i) {
+        quint64 asciiChars[2] = { 0, 0 };
+        if (!items[i]->addFirstCharacters(asciiChars)) {
+            asciiChars[0] = asciiChars[1] = ~Q_UINT64_C(0);
+        }
+
+        for (int c = 0; c < 128; ++c) {
+            if (asciiChars[c >> 6] & (Q_UINT64_C(1) << (c & 63))) {
+                m_firstCharItems[c] |= Q_UINT64_C(1) << i;
+            }
+        }
+    }
+
+    m_firstCharItemsValid = true;
+}
+
 KateHlContext::~KateHlContext()
 {
     if (dynamicChild) {
@@ -51,6 +51,33 @@ public:
 
     static void dynamicSubstitute(QString &str, const QStringList *args);
 
+    /**
+     * Add the ASCII characters a match of this item can start with to the
+     * 128 bit set @p asciiChars. Other characters are always tried.
+     * @param asciiChars set of characters, bit c of asciiChars[c / 64]
+     * @return false if any character may start a match, the default
+     */
+    virtual bool addFirstCharacters(quint64 *asciiChars) const
+    {
+        Q_UNUSED(asciiChars)
+        return false;
+    }
+
+    static void addFirstCharacter(quint64 *asciiChars, QChar c)
+    {
+        if (c.unicode() < 128) {
+            asciiChars[c.unicode() >> 6] |= Q_UINT64_C(1) << (c.unicode() & 63);
+        }
+    }
+
+    /**
+     * Item specific numbers for the profiler report, if any.
+     */
+    virtual QString profileDetails() const
+    {
+        return QString();
+    }
+
     QVector<KateHlItem *> subItems;
     int attr;
     KateHlContextModification ctx;
@@ -74,6 +101,13 @@ public:
     bool haveCache;
     // internal for doHighlight, don't set it in the items
     bool cachingHandled;
+
+    // rule as written in the definition, like RegExpr "[a-z]+", for the profiler report
+    QString profileName;
+    // maintained by doHighlight while the profiler is enabled
+    quint64 profileInvocations;
+    quint64 profileHits;
+    qint64 profileNanoseconds;
 };
 
 class KateHlContext
@@ -104,6 +138,33 @@ public:
 
     bool emptyLineContext;
     KateHlContextModification emptyLineContextModification;
+
+    // context name as written in the definition, for the profiler report
+    QString profileName;
+    // maintained by doHighlight while the profiler is enabled, summed over the rules tried in this context
+    quint64 profileInvocations;
+    quint64 profileHits;
+    qint64 profileNanoseconds;
+
+    /**
+     * Items that may start a match with the given ASCII character, as bit set
+     * over the item indices. Items from index 64 on are not covered and always tried.
+     * Built on first use, once all included rules are in place.
+     * @return table of 128 item sets
+     */
+    const quint64 *firstCharItems()
+    {
+        if (!m_firstCharItemsValid) {
+            buildFirstCharItems();
+        }
+        return m_firstCharItems;
+    }
+
+private:
+    void buildFirstCharItems();
+
+    quint64 m_firstCharItems[128];
+    bool m_firstCharItemsValid;
 };
 
 class KateHlIncludeRule
@@ -134,6 +195,11 @@ public:
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
     KateHlItem *clone(const QStringList *args) Q_DECL_OVERRIDE;
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE
+    {
+        addFirstCharacter(asciiChars, sChar);
+        return true;
+    }
 
 private:
     QChar sChar;
@@ -147,6 +213,11 @@ public:
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
     KateHlItem *clone(const QStringList *args) Q_DECL_OVERRIDE;
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE
+    {
+        addFirstCharacter(asciiChars, sChar1);
+        return true;
+    }
 
 private:
     QChar sChar1;
@@ -160,6 +231,7 @@ public:
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
     KateHlItem *clone(const QStringList *args) Q_DECL_OVERRIDE;
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE;
 
 protected:
     const QString str;
@@ -182,6 +254,11 @@ public:
     KateHlRangeDetect(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2, QChar ch1, QChar ch2);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE
+    {
+        addFirstCharacter(asciiChars, sChar1);
+        return true;
+    }
 
 private:
     QChar sChar1;
@@ -197,13 +274,66 @@ public:
 
     void addList(const QStringList &);
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE;
 
 private:
-    QVector< QSet<QString>* > dict;
+    /**
+     * Node of the keyword trie, its edges are m_edgeKeys/m_edgeTargets[firstEdge, firstEdge + edgeCount),
+     * sorted by key.
+     */
+    struct TrieNode {
+        int firstEdge;
+        int edgeCount;
+        bool terminal;
+    };
+
+    /**
+     * Add the node for the keywords @p sorted[begin, end) sharing their first @p depth characters
+     * to the trie, including all nodes below it.
+     * @return index of the new node
+     */
+    int compileNode(const QStringList &sorted, int begin, int end, int depth);
+
+    /**
+     * Case folding of one UTF-16 code unit, for the case insensitive lists.
+     */
+    inline ushort foldCase(ushort c) const
+    {
+        if (!_insensitive) {
+            return c;
+        }
+
+        if (c < 128) {
+            return (c >= 'A' && c <= 'Z') ? ushort(c + ('a' - 'A')) : c;
+        }
+
+        return ushort(QChar::toLower(c));
+    }
+
+    inline bool isDelimiter(ushort c) const
+    {
+        if (c < 128) {
+            return (m_asciiDelimiters[c >> 6] & (Q_UINT64_C(1) << (c & 63))) != 0;
+        }
+
+        return m_otherDelimiters.contains(QChar(c));
+    }
+
+    QSet<QString> m_keywords;
     bool _insensitive;
-    QSet<QChar> deliminators;
-    int minLen;
-    int maxLen;
+
+    /**
+     * bitmap of the ASCII delimiters, the rare other ones are kept in a string
+     */
+    quint64 m_asciiDelimiters[2];
+    QString m_otherDelimiters;
+
+    /**
+     * keyword trie over the (case folded) UTF-16 code units, root is node 0
+     */
+    QVector<TrieNode> m_nodes;
+    QVector<ushort> m_edgeKeys;
+    QVector<int> m_edgeTargets;
 };
 
 class KateHlInt : public KateHlItem
@@ -212,6 +342,7 @@ public:
     KateHlInt(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE;
 };
 
 class KateHlFloat : public KateHlItem
@@ -221,6 +352,7 @@ public:
     virtual ~KateHlFloat() {}
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE;
 };
 
 class KateHlCFloat : public KateHlFloat
@@ -238,6 +370,7 @@ public:
     KateHlCOct(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE;
 };
 
 class KateHlCHex : public KateHlItem
@@ -246,6 +379,7 @@ public:
     KateHlCHex(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE;
 };
 
 class KateHlLineContinue : public KateHlItem
@@ -258,6 +392,7 @@ public:
         return c == QLatin1Char('\0');
     }
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE;
     bool lineContinue() Q_DECL_OVERRIDE
     {
         return true;
@@ -272,6 +407,7 @@ public:
     KateHlCStringChar(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE;
 };
 
 class KateHlCChar : public KateHlItem
@@ -280,6 +416,7 @@ public:
     KateHlCChar(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE;
 };
 
 class KateHlAnyChar : public KateHlItem
@@ -288,12 +425,13 @@ public:
     KateHlAnyChar(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2, const QString &charList);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE;
 
 private:
     const QString _charList;
 };
 
-class KateHlRegExpr : public KateHlItem
+class KTEXTEDITOR_EXPORT KateHlRegExpr : public KateHlItem
 {
 public:
     KateHlRegExpr(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2, const QString &expr, bool insensitive, bool minimal);
@@ -304,6 +442,20 @@ public:
 
     KateHlItem *clone(const QStringList *args) Q_DECL_OVERRIDE;
 
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE;
+
+    QString profileDetails() const Q_DECL_OVERRIDE;
+
+    /**
+     * Determine the ASCII characters a match of @p pattern must start with, from its
+     * leading literal, escape or character class. Gives up on anything fancier.
+     * @param pattern regular expression
+     * @param insensitive pattern is matched case insensitive
+     * @param asciiChars set to add the characters to, bit c of asciiChars[c / 64]
+     * @return false if any character may start a match
+     */
+    static bool firstCharacters(const QString &pattern, bool insensitive, quint64 *asciiChars);
+
 private:
     /**
      * regular expression to match
@@ -320,6 +472,19 @@ private:
      * last match, if any
      */
     QRegularExpressionMatch m_lastMatch;
+
+    /**
+     * ASCII characters a match must start with, if m_hasFirstChars is set,
+     * used to skip the regular expression engine on lines without them
+     */
+    quint64 m_firstChars[2];
+    bool m_hasFirstChars;
+
+    /**
+     * runs of the regular expression engine and runs avoided by the first characters
+     */
+    quint64 m_engineRuns;
+    quint64 m_prefilterSkips;
 };
 
 class KateHlDetectSpaces : public KateHlItem
@@ -336,6 +501,16 @@ public:
         }
         return offset;
     }
+
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE
+    {
+        for (ushort c = 0; c < 128; ++c) {
+            if (QChar(c).isSpace()) {
+                addFirstCharacter(asciiChars, QChar(c));
+            }
+        }
+        return true;
+    }
 };
 
 class KateHlDetectIdentifier : public KateHlItem
@@ -370,6 +545,16 @@ public:
 
         return 0;
     }
+
+    bool addFirstCharacters(quint64 *asciiChars) const Q_DECL_OVERRIDE
+    {
+        for (ushort c = 0; c < 128; ++c) {
+            if (QChar(c).isLetter() || c == '_') {
+                addFirstCharacter(asciiChars, QChar(c));
+            }
+        }
+        return true;
+    }
 };
 
 //END
@@ -22,15 +22,20 @@
 
 #include "katesyntaxmanager.h"
 #include "katedocument.h"
+#include "katebuffer.h"
 #include "kateview.h"
 #include "kateglobal.h"
 #include "katehighlight.h"
+#include "katepartdebug.h"
+
+#include <KTextEditor/Message>
+#include <KLocalizedString>
 
 #include <QUrl>
 
 KateCommands::Highlighting *KateCommands::Highlighting::m_instance = nullptr;
 
-bool KateCommands::Highlighting::exec(KTextEditor::View *view, const QString &cmd, QString &, const KTextEditor::Range &)
+bool KateCommands::Highlighting::exec(KTextEditor::View *view, const QString &cmd, QString &errorMsg, const KTextEditor::Range &)
 {
     if(cmd.startsWith(QLatin1String("reload-highlighting")))
     {
@@ -53,11 +58,56 @@ bool KateCommands::Highlighting::exec(KTextEditor::View *view, const QString &cm
 
         return true;
     }
+    else if(cmd.startsWith(QLatin1String("hl-profile")))
+    {
+        KTextEditor::DocumentPrivate* document = static_cast<KTextEditor::DocumentPrivate*>(view->document());
+        KateHighlighting *highlighting = document->highlight();
+
+        if(highlighting->noHighlighting())
+        {
+            errorMsg = i18n("No highlighting to profile.");
+            return false;
+        }
+
+        // optional argument: number of contexts and rules to list
+        int maxRules = cmd.section(QLatin1Char(' '), 1, 1, QString::SectionSkipEmpty).toInt();
+        if(maxRules <= 0)
+        {
+            maxRules = 20;
+        }
+
+        // highlight the whole document again, with the profiler on
+        const bool wasEnabled = KateHighlighting::profilingEnabled();
+        KateHighlighting::setProfilingEnabled(true);
+        highlighting->resetProfile();
+        document->buffer().invalidateHighlighting();
+        document->buffer().ensureHighlighted(document->lines() - 1, 0);
+        KateHighlighting::setProfilingEnabled(wasEnabled);
+
+        const QString report = highlighting->profileReport(maxRules);
+        qCDebug(LOG_KTE).noquote() << report;
+
+        KTextEditor::Message *message = new KTextEditor::Message(QStringLiteral("<pre>%1</pre>").arg(report.toHtmlEscaped()), KTextEditor::Message::Information);
+        message->setPosition(KTextEditor::Message::AboveView);
+        message->setView(view);
+        document->postMessage(message);
+
+        errorMsg = report.section(QLatin1Char('\n'), 0, 0);
+        return true;
+    }
     
     return true;
 }
 
-bool KateCommands::Highlighting::help(KTextEditor::View*, const QString&, QString&)
+bool KateCommands::Highlighting::help(KTextEditor::View*, const QString &cmd, QString &msg)
 {
+    if(cmd.startsWith(QLatin1String("hl-profile")))
+    {
+        msg = i18n("<p>hl-profile [count]</p>"
+                   "<p>Highlights the whole document again and shows the <i>count</i> contexts and rules "
+                   "of the highlighting that took most time, 20 if not given.</p>");
+        return true;
+    }
+
     return false;
 }
@@ -29,7 +29,7 @@ namespace KateCommands
 class Highlighting : public KTextEditor::Command
 {
     Highlighting()
-        : KTextEditor::Command(QStringList() << QStringLiteral("reload-highlighting") << QStringLiteral("edit-highlighting"))
+        : KTextEditor::Command(QStringList() << QStringLiteral("reload-highlighting") << QStringLiteral("edit-highlighting") << QStringLiteral("hl-profile"))
     {
     }
 
@@ -59,7 +59,7 @@ public:
     bool exec(class KTextEditor::View *view, const QString &cmd, QString &errorMsg,
               const KTextEditor::Range &range = KTextEditor::Range::invalid()) Q_DECL_OVERRIDE;
     
-    /** This command does not have help. @see KTextEditor::Command::help */
+    /** Only hl-profile has help. @see KTextEditor::Command::help */
     bool help(class KTextEditor::View *, const QString &, QString &) Q_DECL_OVERRIDE;
 };
 
@@ -31,12 +31,312 @@
 #include <KConfigGroup>
 
 #include <QApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QDomDocument>
 #include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtEndian>
+
+#include <ksyntaxhighlighting_version.h>
+#include <ktexteditor_version.h>
 
 // use this to turn on over verbose debug output...
 #undef KSD_OVER_VERBOSE
 
+namespace {
+// "KSDC", kate syntax definition cache
+const quint32 KATE_SYNTAX_CACHE_MAGIC = 0x4b534443;
+
+// bump this on any change of the cache layout or of the tree building
+const quint32 KATE_SYNTAX_CACHE_VERSION = 2;
+
+/**
+ * What the cache of a definition is valid for: definitions compiled into resources
+ * change only with the libraries, files with their modification time and size.
+ */
+QString sourceStamp(const QString &identifier)
+{
+    if (identifier.startsWith(QLatin1Char(':'))) {
+        return QStringLiteral("katepart %1, KSyntaxHighlighting %2")
+               .arg(QStringLiteral(KTEXTEDITOR_VERSION_STRING), QStringLiteral(SyntaxHighlighting_VERSION_STRING));
+    }
+
+    const QFileInfo source(identifier);
+    return QStringLiteral("%1 %2").arg(source.lastModified().toMSecsSinceEpoch()).arg(source.size());
+}
+
+/**
+ * The cache consists of little endian 32 bit words, strings are stored as their length
+ * followed by their UTF-16 data, padded to the next word.
+ */
+void appendWord(QByteArray &data, quint32 word)
+{
+    const quint32 littleEndian = qToLittleEndian(word);
+    data.append(reinterpret_cast<const char *>(&littleEndian), sizeof(littleEndian));
+}
+
+void appendString(QByteArray &data, const QString &string)
+{
+    appendWord(data, string.size());
+    for (int i = 0; i < string.size(); ++i) {
+        const quint16 littleEndian = qToLittleEndian(string.at(i).unicode());
+        data.append(reinterpret_cast<const char *>(&littleEndian), sizeof(littleEndian));
+    }
+    if (string.size() % 2) {
+        data.append("\0\0", 2);
+    }
+}
+
+/**
+ * Reads the cache from memory, checks all bounds. After the first error, all reads return 0 or empty strings.
+ */
+class CacheReader
+{
+public:
+    CacheReader(const uchar *data, qint64 size)
+        : m_data(data)
+        , m_words(size / 4)
+        , m_position(0)
+        , m_ok(true)
+    {
+    }
+
+    bool ok() const
+    {
+        return m_ok;
+    }
+
+    /**
+     * Number of words not read so far.
+     */
+    qint64 remaining() const
+    {
+        return m_words - m_position;
+    }
+
+    void setCorrupt()
+    {
+        m_ok = false;
+        m_position = m_words;
+    }
+
+    quint32 word()
+    {
+        if (remaining() < 1) {
+            setCorrupt();
+            return 0;
+        }
+        return qFromLittleEndian<quint32>(m_data + 4 * m_position++);
+    }
+
+    QString string()
+    {
+        const quint32 length = word();
+        const qint64 words = (qint64(length) + 1) / 2;
+        if (words > remaining()) {
+            setCorrupt();
+            return QString();
+        }
+
+        const uchar *utf16 = m_data + 4 * m_position;
+        m_position += words;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        return QString(reinterpret_cast<const QChar *>(utf16), int(length));
+#else
+        QString string(int(length), Qt::Uninitialized);
+        for (quint32 i = 0; i < length; ++i) {
+            string[int(i)] = QChar(qFromLittleEndian<quint16>(utf16 + 2 * i));
+        }
+        return string;
+#endif
+    }
+
+private:
+    const uchar *const m_data;
+    const qint64 m_words;
+    qint64 m_position;
+    bool m_ok;
+};
+}
+
+//BEGIN KateSyntaxTree
+void KateSyntaxTree::build(const QDomElement &root)
+{
+    nodes.clear();
+
+    // breadth first, that way the children of each element are stored one after another
+    QVector<QDomElement> elements;
+    elements.append(root);
+    for (int i = 0; i < elements.size(); ++i) {
+        const QDomElement element = elements[i];
+
+        Node node;
+        node.tagName = element.tagName();
+        node.firstChild = elements.size();
+        node.childCount = 0;
+
+        const QDomNamedNodeMap attributes = element.attributes();
+        node.attributes.reserve(attributes.count());
+        for (int a = 0; a < attributes.count(); ++a) {
+            const QDomAttr attribute = attributes.item(a).toAttr();
+            node.attributes.append(qMakePair(attribute.name(), attribute.value()));
+        }
+
+        // comments and text are skipped, like nextGroup() and nextItem() did on the DOM
+        for (QDomElement child = element.firstChildElement(); !child.isNull(); child = child.nextSiblingElement()) {
+            elements.append(child);
+            ++node.childCount;
+        }
+
+        if (node.childCount == 0) {
+            node.text = element.text();
+        }
+
+        nodes.append(node);
+    }
+}
+
+bool KateSyntaxTree::save(const QString &cacheFile, const QString &identifier) const
+{
+    if (!QDir().mkpath(QFileInfo(cacheFile).absolutePath())) {
+        return false;
+    }
+
+    QSaveFile file(cacheFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    // all strings once, the nodes refer to them by index
+    QStringList strings;
+    QHash<QString, quint32> stringIndex;
+    const auto indexOf = [&strings, &stringIndex](const QString &string) -> quint32 {
+        QHash<QString, quint32>::const_iterator it = stringIndex.constFind(string);
+        if (it != stringIndex.constEnd()) {
+            return it.value();
+        }
+        strings.append(string);
+        return stringIndex[string] = strings.size() - 1;
+    };
+
+    QByteArray nodeData;
+    appendWord(nodeData, nodes.size());
+    foreach (const Node &node, nodes) {
+        appendWord(nodeData, indexOf(node.tagName));
+        appendWord(nodeData, indexOf(node.text));
+        appendWord(nodeData, node.attributes.size());
+        for (int a = 0; a < node.attributes.size(); ++a) {
+            appendWord(nodeData, indexOf(node.attributes[a].first));
+            appendWord(nodeData, indexOf(node.attributes[a].second));
+        }
+        appendWord(nodeData, node.firstChild);
+        appendWord(nodeData, node.childCount);
+    }
+
+    QByteArray data;
+    appendWord(data, KATE_SYNTAX_CACHE_MAGIC);
+    appendWord(data, KATE_SYNTAX_CACHE_VERSION);
+    appendString(data, identifier);
+    appendString(data, sourceStamp(identifier));
+    appendWord(data, strings.size());
+    foreach (const QString &string, strings) {
+        appendString(data, string);
+    }
+    data.append(nodeData);
+
+    return (file.write(data) == data.size()) && file.commit();
+}
+
+bool KateSyntaxTree::load(const QString &cacheFile, const QString &identifier)
+{
+    QFile file(cacheFile);
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+        return false;
+    }
+
+    // read it in place, only the strings are copied out of the mapping
+    QByteArray fallback;
+    const uchar *data = file.map(0, file.size());
+    if (!data) {
+        fallback = file.readAll();
+        data = reinterpret_cast<const uchar *>(fallback.constData());
+    }
+    CacheReader reader(data, file.size());
+
+    // stale or foreign cache?
+    const quint32 magic = reader.word();
+    const quint32 version = reader.word();
+    if (magic != KATE_SYNTAX_CACHE_MAGIC || version != KATE_SYNTAX_CACHE_VERSION
+            || reader.string() != identifier || reader.string() != sourceStamp(identifier)) {
+        return false;
+    }
+
+    // each string takes at least one word, each node at least five, don't trust the counts before checking that
+    const quint32 stringCount = reader.word();
+    if (stringCount > reader.remaining()) {
+        return false;
+    }
+    QVector<QString> strings;
+    strings.reserve(stringCount);
+    for (quint32 i = 0; i < stringCount && reader.ok(); ++i) {
+        strings.append(reader.string());
+    }
+
+    const quint32 nodeCount = reader.word();
+    if (!reader.ok() || nodeCount > reader.remaining() / 5) {
+        return false;
+    }
+
+    nodes.clear();
+    nodes.reserve(nodeCount);
+    for (quint32 i = 0; i < nodeCount && reader.ok(); ++i) {
+        const quint32 tagName = reader.word();
+        const quint32 text = reader.word();
+        const quint32 attributeCount = reader.word();
+        if (tagName >= stringCount || text >= stringCount || attributeCount > reader.remaining() / 2) {
+            reader.setCorrupt();
+            break;
+        }
+
+        Node node;
+        node.tagName = strings[tagName];
+        node.text = strings[text];
+        node.attributes.reserve(attributeCount);
+        for (quint32 a = 0; a < attributeCount; ++a) {
+            const quint32 name = reader.word();
+            const quint32 value = reader.word();
+            if (name >= stringCount || value >= stringCount) {
+                reader.setCorrupt();
+                break;
+            }
+            node.attributes.append(qMakePair(strings[name], strings[value]));
+        }
+
+        const quint32 firstChild = reader.word();
+        const quint32 childCount = reader.word();
+        if (firstChild > nodeCount || childCount > nodeCount - firstChild) {
+            reader.setCorrupt();
+            break;
+        }
+        node.firstChild = firstChild;
+        node.childCount = childCount;
+        nodes.append(node);
+    }
+
+    const bool ok = reader.ok() && !nodes.isEmpty();
+    if (!ok) {
+        nodes.clear();
+    }
+    return ok;
+}
+//END
+
 KateSyntaxDocument::KateSyntaxDocument()
+    : m_currentTree(nullptr)
 {
 }
 
@@ -46,6 +346,20 @@ KateSyntaxDocument::~KateSyntaxDocument()
     clearCache();
 }
 
+QString KateSyntaxDocument::cacheFile(const QString &identifier)
+{
+    if (identifier.isEmpty()) {
+        return QString();
+    }
+
+    // one file per definition, named after the hash of its path, see sourceStamp() for resources
+    const QString base = KTextEditor::EditorPrivate::unitTestMode()
+        ? QStandardPaths::writableLocation(QStandardPaths::TempLocation) + QLatin1String("/katepart5-unittest")
+        : QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QLatin1String("/katepart5");
+    const QByteArray hash = QCryptographicHash::hash(identifier.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return base + QLatin1String("/syntax/") + QString::fromLatin1(hash) + QLatin1String(".cache");
+}
+
 /** If the open hl file is different from the one needed, it opens
     the new one and assign some other things.
     identifier = File name and path of the new xml needed
@@ -53,8 +367,20 @@ KateSyntaxDocument::~KateSyntaxDocument()
 bool KateSyntaxDocument::setIdentifier(const QString &identifier)
 {
     // already existing in cache? be done
-    if (m_domDocuments.contains(identifier)) {
+    QHash<QString, KateSyntaxTree *>::const_iterator it = m_trees.constFind(identifier);
+    if (it != m_trees.constEnd()) {
+        currentFile = identifier;
+        m_currentTree = it.value();
+        return true;
+    }
+
+    // already parsed before? take it from the binary cache
+    const QString cache = cacheFile(identifier);
+    KateSyntaxTree *tree = new KateSyntaxTree();
+    if (!cache.isEmpty() && tree->load(cache, identifier)) {
         currentFile = identifier;
+        m_currentTree = tree;
+        m_trees[currentFile] = tree;
         return true;
     }
 
@@ -63,30 +389,39 @@ bool KateSyntaxDocument::setIdentifier(const QString &identifier)
     if (!f.open(QIODevice::ReadOnly)) {
          // Oh o, we couldn't open the file.
         KMessageBox::error(QApplication::activeWindow(), i18n("Unable to open %1", identifier));
+        delete tree;
         return false;
     }
 
     // try to parse
-    QDomDocument *document = new QDomDocument();
+    QDomDocument document;
     QString errorMsg;
     int line, col;
-    if (!document->setContent(&f, &errorMsg, &line, &col)) {
+    if (!document.setContent(&f, &errorMsg, &line, &col)) {
         KMessageBox::error(QApplication::activeWindow(), i18n("<qt>The error <b>%4</b><br /> has been detected in the file %1 at %2/%3</qt>", identifier,
                                    line, col, i18nc("QXml", errorMsg.toUtf8().data())));
-        delete document;
+        delete tree;
         return false;
     }
 
+    // keep the compact tree only and remember it for the next time
+    tree->build(document.documentElement());
+    if (!cache.isEmpty() && !tree->save(cache, identifier)) {
+        qCDebug(LOG_KTE) << "unable to write syntax definition cache" << cache;
+    }
+
     // cache and be done
     currentFile = identifier;
-    m_domDocuments[currentFile] = document;
+    m_currentTree = tree;
+    m_trees[currentFile] = tree;
     return true;
 }
 
 void KateSyntaxDocument::clearCache()
 {
-    qDeleteAll(m_domDocuments);
-    m_domDocuments.clear();
+    qDeleteAll(m_trees);
+    m_trees.clear();
+    m_currentTree = nullptr;
     currentFile.clear();
     m_data.clear();
 }
@@ -96,30 +431,21 @@ void KateSyntaxDocument::clearCache()
  */
 bool KateSyntaxDocument::nextGroup(KateSyntaxContextData *data)
 {
-    if (!data) {
+    if (!data || !data->tree || data->parent < 0) {
         return false;
     }
 
-    // No group yet so go to first child
-    if (data->currentGroup.isNull()) {
-        // Skip over non-elements. So far non-elements are just comments
-        QDomNode node = data->parent.firstChild();
-        while (node.isComment()) {
-            node = node.nextSibling();
-        }
-
-        data->currentGroup = node.toElement();
+    // No group yet so go to first child, else to the next sibling
+    const KateSyntaxTree::Node &parent = data->tree->nodes[data->parent];
+    if (data->currentGroup < 0) {
+        data->currentGroup = (parent.childCount > 0) ? parent.firstChild : -1;
+    } else if (data->currentGroup + 1 < parent.firstChild + parent.childCount) {
+        ++data->currentGroup;
     } else {
-        // common case, iterate over siblings, skipping comments as we go
-        QDomNode node = data->currentGroup.nextSibling();
-        while (node.isComment()) {
-            node = node.nextSibling();
-        }
-
-        data->currentGroup = node.toElement();
+        data->currentGroup = -1;
     }
 
-    return !data->currentGroup.isNull();
+    return data->currentGroup >= 0;
 }
 
 /**
@@ -127,27 +453,20 @@ bool KateSyntaxDocument::nextGroup(KateSyntaxContextData *data)
  */
 bool KateSyntaxDocument::nextItem(KateSyntaxContextData *data)
 {
-    if (!data) {
+    if (!data || !data->tree || data->currentGroup < 0) {
         return false;
     }
 
-    if (data->item.isNull()) {
-        QDomNode node = data->currentGroup.firstChild();
-        while (node.isComment()) {
-            node = node.nextSibling();
-        }
-
-        data->item = node.toElement();
+    const KateSyntaxTree::Node &group = data->tree->nodes[data->currentGroup];
+    if (data->item < 0) {
+        data->item = (group.childCount > 0) ? group.firstChild : -1;
+    } else if (data->item + 1 < group.firstChild + group.childCount) {
+        ++data->item;
     } else {
-        QDomNode node = data->item.nextSibling();
-        while (node.isComment()) {
-            node = node.nextSibling();
-        }
-
-        data->item = node.toElement();
+        data->item = -1;
     }
 
-    return !data->item.isNull();
+    return data->item >= 0;
 }
 
 /**
@@ -155,35 +474,27 @@ bool KateSyntaxDocument::nextItem(KateSyntaxContextData *data)
  */
 QString KateSyntaxDocument::groupItemData(const KateSyntaxContextData *data, const QString &name)
 {
-    if (!data) {
+    if (!data || !data->tree || data->item < 0) {
         return QString();
     }
 
     // If there's no name just return the tag name of data->item
-    if ((!data->item.isNull()) && (name.isEmpty())) {
-        return data->item.tagName();
+    const KateSyntaxTree::Node &item = data->tree->nodes[data->item];
+    if (name.isEmpty()) {
+        return item.tagName;
     }
 
     // if name is not empty return the value of the attribute name
-    if (!data->item.isNull()) {
-        return data->item.attribute(name);
-    }
-
-    return QString();
-
+    return item.attribute(name);
 }
 
 QString KateSyntaxDocument::groupData(const KateSyntaxContextData *data, const QString &name)
 {
-    if (!data) {
+    if (!data || !data->tree || data->currentGroup < 0) {
         return QString();
     }
 
-    if (!data->currentGroup.isNull()) {
-        return data->currentGroup.attribute(name);
-    } else {
-        return QString();
-    }
+    return data->tree->nodes[data->currentGroup].attribute(name);
 }
 
 void KateSyntaxDocument::freeGroupInfo(KateSyntaxContextData *data)
@@ -196,6 +507,7 @@ KateSyntaxContextData *KateSyntaxDocument::getSubItems(KateSyntaxContextData *da
     KateSyntaxContextData *retval = new KateSyntaxContextData;
 
     if (data != nullptr) {
+        retval->tree = data->tree;
         retval->parent = data->currentGroup;
         retval->currentGroup = data->item;
     }
@@ -203,30 +515,26 @@ KateSyntaxContextData *KateSyntaxDocument::getSubItems(KateSyntaxContextData *da
     return retval;
 }
 
-bool KateSyntaxDocument::getElement(QDomElement &element, const QString &mainGroupName, const QString &config)
+int KateSyntaxDocument::getElement(const QString &mainGroupName, const QString &config) const
 {
 #ifdef KSD_OVER_VERBOSE
     qCDebug(LOG_KTE) << "Looking for \"" << mainGroupName << "\" -> \"" << config << "\".";
 #endif
 
-    QDomNodeList nodes;
-    if (m_domDocuments.contains(currentFile))
-        nodes = m_domDocuments[currentFile]->documentElement().childNodes();
-
-    // Loop over all these child nodes looking for mainGroupName
-    for (int i = 0; i < nodes.count(); i++) {
-        QDomElement elem = nodes.item(i).toElement();
-        if (elem.tagName() == mainGroupName) {
-            // Found mainGroupName ...
-            QDomNodeList subNodes = elem.childNodes();
-
-            // ... so now loop looking for config
-            for (int j = 0; j < subNodes.count(); j++) {
-                QDomElement subElem = subNodes.item(j).toElement();
-                if (subElem.tagName() == config) {
+    if (!m_currentTree) {
+        return -1;
+    }
+
+    // Loop over all the child nodes of the document element looking for mainGroupName
+    const QVector<KateSyntaxTree::Node> &nodes = m_currentTree->nodes;
+    const KateSyntaxTree::Node &root = nodes[0];
+    for (int i = root.firstChild; i < root.firstChild + root.childCount; ++i) {
+        if (nodes[i].tagName == mainGroupName) {
+            // Found mainGroupName, so now loop looking for config
+            for (int j = nodes[i].firstChild; j < nodes[i].firstChild + nodes[i].childCount; ++j) {
+                if (nodes[j].tagName == config) {
                     // Found it!
-                    element = subElem;
-                    return true;
+                    return j;
                 }
             }
 
@@ -234,7 +542,7 @@ bool KateSyntaxDocument::getElement(QDomElement &element, const QString &mainGro
             qCDebug(LOG_KTE) << "WARNING: \"" << config << "\" wasn't found!";
 #endif
 
-            return false;
+            return -1;
         }
     }
 
@@ -242,18 +550,19 @@ bool KateSyntaxDocument::getElement(QDomElement &element, const QString &mainGro
     qCDebug(LOG_KTE) << "WARNING: \"" << mainGroupName << "\" wasn't found!";
 #endif
 
-    return false;
+    return -1;
 }
 
 /**
- * Get the KateSyntaxContextData of the QDomElement Config inside mainGroupName
- * KateSyntaxContextData::item will contain the QDomElement found
+ * Get the KateSyntaxContextData of the element Config inside mainGroupName
+ * KateSyntaxContextData::item will contain the element found
  */
 KateSyntaxContextData *KateSyntaxDocument::getConfig(const QString &mainGroupName, const QString &config)
 {
-    QDomElement element;
-    if (getElement(element, mainGroupName, config)) {
+    const int element = getElement(mainGroupName, config);
+    if (element >= 0) {
         KateSyntaxContextData *data = new KateSyntaxContextData;
+        data->tree = m_currentTree;
         data->item = element;
         return data;
     }
@@ -261,20 +570,38 @@ KateSyntaxContextData *KateSyntaxDocument::getConfig(const QString &mainGroupNam
 }
 
 /**
- * Get the KateSyntaxContextData of the QDomElement Config inside mainGroupName
- * KateSyntaxContextData::parent will contain the QDomElement found
+ * Get the KateSyntaxContextData of the element Config inside mainGroupName
+ * KateSyntaxContextData::parent will contain the element found
  */
 KateSyntaxContextData *KateSyntaxDocument::getGroupInfo(const QString &mainGroupName, const QString &group)
 {
-    QDomElement element;
-    if (getElement(element, mainGroupName, group + QLatin1Char('s'))) {
+    const int element = getElement(mainGroupName, group + QLatin1Char('s'));
+    if (element >= 0) {
         KateSyntaxContextData *data = new KateSyntaxContextData;
+        data->tree = m_currentTree;
         data->parent = element;
         return data;
     }
     return nullptr;
 }
 
+int KateSyntaxDocument::findList(int node, const QString &type) const
+{
+    const KateSyntaxTree::Node &parent = m_currentTree->nodes[node];
+    for (int i = parent.firstChild; i < parent.firstChild + parent.childCount; ++i) {
+        const KateSyntaxTree::Node &child = m_currentTree->nodes[i];
+        if (child.tagName == QLatin1String("list") && child.attribute(QStringLiteral("name")) == type) {
+            return i;
+        }
+
+        const int list = findList(i, type);
+        if (list >= 0) {
+            return list;
+        }
+    }
+    return -1;
+}
+
 /**
  * Returns a list with all the keywords inside the list type
  */
@@ -288,44 +615,38 @@ QStringList &KateSyntaxDocument::finddata(const QString &mainGroup, const QStrin
         m_data.clear();
     }
 
-    if (!m_domDocuments.contains(currentFile))
+    if (!m_currentTree)
         return m_data;
 
-    for (QDomNode node = m_domDocuments[currentFile]->documentElement().firstChild(); !node.isNull(); node = node.nextSibling()) {
-        QDomElement elem = node.toElement();
-        if (elem.tagName() == mainGroup) {
+    const QVector<KateSyntaxTree::Node> &nodes = m_currentTree->nodes;
+    const KateSyntaxTree::Node &root = nodes[0];
+    for (int i = root.firstChild; i < root.firstChild + root.childCount; ++i) {
+        if (nodes[i].tagName == mainGroup) {
 #ifdef KSD_OVER_VERBOSE
             qCDebug(LOG_KTE) << "\"" << mainGroup << "\" found.";
 #endif
 
-            QDomNodeList nodelist1 = elem.elementsByTagName(QStringLiteral("list"));
-
-            for (int l = 0; l < nodelist1.count(); l++) {
-                if (nodelist1.item(l).toElement().attribute(QStringLiteral("name")) == type) {
+            const int list = findList(i, type);
+            if (list >= 0) {
 #ifdef KSD_OVER_VERBOSE
-                    qCDebug(LOG_KTE) << "List with attribute name=\"" << type << "\" found.";
+                qCDebug(LOG_KTE) << "List with attribute name=\"" << type << "\" found.";
 #endif
 
-                    QDomNodeList childlist = nodelist1.item(l).toElement().childNodes();
-
-                    for (int i = 0; i < childlist.count(); i++) {
-                        QString element = childlist.item(i).toElement().text().trimmed();
-                        if (element.isEmpty()) {
-                            continue;
-                        }
+                for (int j = nodes[list].firstChild; j < nodes[list].firstChild + nodes[list].childCount; ++j) {
+                    QString element = nodes[j].text.trimmed();
+                    if (element.isEmpty()) {
+                        continue;
+                    }
 
 #ifdef KSD_OVER_VERBOSE
-                        if (i < 6) {
-                            qCDebug(LOG_KTE) << "\"" << element << "\" added to the list \"" << type << "\"";
-                        } else if (i == 6) {
-                            qCDebug(LOG_KTE) << "... The list continues ...";
-                        }
-#endif
-
-                        m_data += element;
+                    if (j - nodes[list].firstChild < 6) {
+                        qCDebug(LOG_KTE) << "\"" << element << "\" added to the list \"" << type << "\"";
+                    } else if (j - nodes[list].firstChild == 6) {
+                        qCDebug(LOG_KTE) << "... The list continues ...";
                     }
+#endif
 
-                    break;
+                    m_data += element;
                 }
             }
             break;
@@ -21,26 +21,102 @@
 #ifndef __KATE_SYNTAXDOCUMENT_H__
 #define __KATE_SYNTAXDOCUMENT_H__
 
+#include <ktexteditor_export.h>
+
 #include <QList>
 #include <QStringList>
-#include <QDomDocument>
+#include <QVector>
+#include <QPair>
 #include <QHash>
 
+class QDomElement;
+
 /**
- * Class holding the data around the current QDomElement
+ * Compact element tree of one syntax definition file.
+ * Holds the elements only, children of an element are stored one after another,
+ * that way it can be written to and read from the binary cache as flat table.
+ */
+class KateSyntaxTree
+{
+public:
+    struct Node {
+        QString tagName;
+        /**
+         * text of elements without child elements, empty for the others
+         */
+        QString text;
+        QVector<QPair<QString, QString> > attributes;
+        int firstChild;
+        int childCount;
+
+        /**
+         * Value of the attribute @p name, empty if not set, like QDomElement::attribute().
+         */
+        QString attribute(const QString &name) const
+        {
+            for (int i = 0; i < attributes.size(); ++i) {
+                if (attributes[i].first == name) {
+                    return attributes[i].second;
+                }
+            }
+            return QString();
+        }
+    };
+
+    /**
+     * Build the tree from the document element of a parsed definition.
+     * @param root document element
+     */
+    void build(const QDomElement &root);
+
+    /**
+     * Write the tree to the binary cache file @p cacheFile, tagged with the
+     * modification time and size of the definition file it was built from,
+     * or with the library versions for definitions compiled into resources.
+     * @return success
+     */
+    bool save(const QString &cacheFile, const QString &identifier) const;
+
+    /**
+     * Read the tree from the binary cache file @p cacheFile, the file is mapped
+     * into memory and read in place, only the strings get copied. Fails if the
+     * cache belongs to another version of the definition file, to an other cache
+     * format or is corrupt.
+     * @return success
+     */
+    bool load(const QString &cacheFile, const QString &identifier);
+
+    /**
+     * all elements, the document element is the first one
+     */
+    QVector<Node> nodes;
+};
+
+/**
+ * Class holding the data around the current element
+ * Elements are indices into the tree, -1 for none.
  */
 class KateSyntaxContextData
 {
 public:
-    QDomElement parent;
-    QDomElement currentGroup;
-    QDomElement item;
+    KateSyntaxContextData()
+        : tree(nullptr)
+        , parent(-1)
+        , currentGroup(-1)
+        , item(-1)
+    {
+    }
+
+    const KateSyntaxTree *tree;
+    int parent;
+    int currentGroup;
+    int item;
 };
 
 /**
  * Store and manage the information about Syntax Highlighting.
  */
-class KateSyntaxDocument
+class KTEXTEDITOR_EXPORT KateSyntaxDocument
 {
 public:
     /**
@@ -56,13 +132,21 @@ public:
     /**
      * If the open hl file is different from the one needed, it opens
      * the new one and assign some other things.
+     * The parsed file is kept in a binary cache, next time it is read from there.
      * @param identifier file name and path of the new xml needed
      * @return success
      */
     bool setIdentifier(const QString &identifier);
+
+    /**
+     * Binary cache file used for the given definition file.
+     * @param identifier file name and path of the xml
+     * @return cache file name, empty for an empty identifier
+     */
+    static QString cacheFile(const QString &identifier);
     
     /**
-     * Clear internal QDomDocument cache
+     * Clear internal definition cache
      */
     void clearCache();
 
@@ -90,14 +174,14 @@ public:
     KateSyntaxContextData *getSubItems(KateSyntaxContextData *data);
 
     /**
-     * Get the KateSyntaxContextData of the DomElement Config inside mainGroupName
+     * Get the KateSyntaxContextData of the element Config inside mainGroupName
      * It just fills KateSyntaxContextData::item
      */
     KateSyntaxContextData *getConfig(const QString &mainGroupName, const QString &config);
 
     /**
-     * Get the KateSyntaxContextData of the QDomElement Config inside mainGroupName
-     * KateSyntaxContextData::parent will contain the QDomElement found
+     * Get the KateSyntaxContextData of the element Config inside mainGroupName
+     * KateSyntaxContextData::parent will contain the element found
      */
     KateSyntaxContextData *getGroupInfo(const QString &mainGroupName, const QString &group);
 
@@ -109,9 +193,15 @@ public:
 private:
     /**
      * Used by getConfig and getGroupInfo to traverse the xml nodes and
-     * evenually return the found element
+     * evenually return the found element, -1 if there is none
+     */
+    int getElement(const QString &mainGroupName, const QString &config) const;
+
+    /**
+     * Find the first element "list" named @p type below @p node, in document order.
+     * @return the list element, -1 if there is none
      */
-    bool getElement(QDomElement &element, const QString &mainGroupName, const QString &config);
+    int findList(int node, const QString &type) const;
 
     /**
      * current parsed filename
@@ -124,9 +214,14 @@ private:
     QStringList m_data;
     
     /**
-     * internal cache for domdocuments
+     * tree of the current file, nullptr if none
+     */
+    const KateSyntaxTree *m_currentTree;
+
+    /**
+     * internal cache for the parsed files, the DOM is not kept
      */
-    QHash<QString, QDomDocument *> m_domDocuments;
+    QHash<QString, KateSyntaxTree *> m_trees;
 };
 
 #endif
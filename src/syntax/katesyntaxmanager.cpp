@@ -60,13 +60,9 @@ KateHlManager::KateHlManager()
     , m_config(KTextEditor::EditorPrivate::unitTestMode() ? QString() :QStringLiteral("katesyntaxhighlightingrc")
         , KTextEditor::EditorPrivate::unitTestMode() ? KConfig::SimpleConfig : KConfig::NoGlobals) // skip config for unit tests!
     , commonSuffixes({QStringLiteral(".orig"), QStringLiteral(".new"), QStringLiteral("~"), QStringLiteral(".bak"), QStringLiteral(".BAK")})
-    , dynamicCtxsCount(0)
-    , forceNoDCReset(false)
 {
     // Let's build the Mode List
     setupModeList();
-
-    lastCtxsReset.start();
 }
 
 KateHlManager::~KateHlManager()
@@ -679,32 +675,14 @@ QString KateHlManager::nameForIdentifier(const QString &identifier)
     return QString();
 }
 
-bool KateHlManager::resetDynamicCtxs()
-{
-    if (forceNoDCReset) {
-        return false;
-    }
-
-    if (lastCtxsReset.elapsed() < KATE_DYNAMIC_CONTEXTS_RESET_DELAY) {
-        return false;
-    }
-
-    foreach (KateHighlighting *hl, hlList) {
-        hl->dropDynamicContexts();
-    }
-
-    dynamicCtxsCount = 0;
-    lastCtxsReset.start();
-
-    return true;
-}
-
 void KateHlManager::reload()
 {
     // clear syntax document cache
     syntax.clearCache();
 
-    resetDynamicCtxs();
+    foreach (KateHighlighting *hl, hlList) {
+        hl->dropDynamicContexts();
+    }
 
     for(int i = 0; i < highlights(); i++)
     {
@@ -83,22 +83,6 @@ public:
     QString hlSection(int n);
     bool hlHidden(int n);
 
-    void incDynamicCtxs()
-    {
-        ++dynamicCtxsCount;
-    }
-    int countDynamicCtxs()
-    {
-        return dynamicCtxsCount;
-    }
-    void setForceNoDCReset(bool b)
-    {
-        forceNoDCReset = b;
-    }
-
-    // be carefull: all documents hl should be invalidated after having successfully called this method!
-    bool resetDynamicCtxs();
-    
     void reload();
 
 Q_SIGNALS:
@@ -157,10 +141,6 @@ private:
     QStringList commonSuffixes;
 
     KateSyntaxDocument syntax;
-
-    int dynamicCtxsCount;
-    QTime lastCtxsReset;
-    bool forceNoDCReset;
 };
 
 #endif
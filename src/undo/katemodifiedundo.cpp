@@ -52,6 +52,19 @@ KateModifiedRemoveText::KateModifiedRemoveText(KTextEditor::DocumentPrivate *doc
     }
 }
 
+KateModifiedReplaceText::KateModifiedReplaceText(KTextEditor::DocumentPrivate *document, int line, const QVector<Kate::TextReplacement> &replacements, const QStringList &removedTexts)
+    : KateEditReplaceTextUndo(document, line, replacements, removedTexts)
+{
+    setFlag(RedoLine1Modified);
+    Kate::TextLine tl = document->plainKateTextLine(line);
+    Q_ASSERT(tl);
+    if (tl->markedAsModified()) {
+        setFlag(UndoLine1Modified);
+    } else {
+        setFlag(UndoLine1Saved);
+    }
+}
+
 KateModifiedWrapLine::KateModifiedWrapLine(KTextEditor::DocumentPrivate *document, int line, int col, int len, bool newLine)
     : KateEditWrapLineUndo(document, line, col, len, newLine)
 {
@@ -182,6 +195,18 @@ void KateModifiedRemoveText::undo()
     tl->markAsSavedOnDisk(isFlagSet(UndoLine1Saved));
 }
 
+void KateModifiedReplaceText::undo()
+{
+    KateEditReplaceTextUndo::undo();
+
+    KTextEditor::DocumentPrivate *doc = document();
+    Kate::TextLine tl = doc->plainKateTextLine(line());
+    Q_ASSERT(tl);
+
+    tl->markAsModified(isFlagSet(UndoLine1Modified));
+    tl->markAsSavedOnDisk(isFlagSet(UndoLine1Saved));
+}
+
 void KateModifiedWrapLine::undo()
 {
     KateEditWrapLineUndo::undo();
@@ -254,6 +279,18 @@ void KateModifiedInsertText::redo()
     tl->markAsSavedOnDisk(isFlagSet(RedoLine1Saved));
 }
 
+void KateModifiedReplaceText::redo()
+{
+    KateEditReplaceTextUndo::redo();
+
+    KTextEditor::DocumentPrivate *doc = document();
+    Kate::TextLine tl = doc->plainKateTextLine(line());
+    Q_ASSERT(tl);
+
+    tl->markAsModified(isFlagSet(RedoLine1Modified));
+    tl->markAsSavedOnDisk(isFlagSet(RedoLine1Saved));
+}
+
 void KateModifiedUnWrapLine::redo()
 {
     KateEditUnWrapLineUndo::redo();
@@ -359,6 +396,34 @@ void KateModifiedRemoveText::updateUndoSavedOnDiskFlag(QBitArray &lines)
     }
 }
 
+void KateModifiedReplaceText::updateRedoSavedOnDiskFlag(QBitArray &lines)
+{
+    if (line() >= lines.size()) {
+        lines.resize(line() + 1);
+    }
+
+    if (!lines.testBit(line())) {
+        lines.setBit(line());
+
+        unsetFlag(RedoLine1Modified);
+        setFlag(RedoLine1Saved);
+    }
+}
+
+void KateModifiedReplaceText::updateUndoSavedOnDiskFlag(QBitArray &lines)
+{
+    if (line() >= lines.size()) {
+        lines.resize(line() + 1);
+    }
+
+    if (!lines.testBit(line())) {
+        lines.setBit(line());
+
+        unsetFlag(UndoLine1Modified);
+        setFlag(UndoLine1Saved);
+    }
+}
+
 void KateModifiedWrapLine::updateRedoSavedOnDiskFlag(QBitArray &lines)
 {
     if (line() + 1 >= lines.size()) {
@@ -61,6 +61,25 @@ public:
     void updateRedoSavedOnDiskFlag(QBitArray &lines) Q_DECL_OVERRIDE;
 };
 
+class KateModifiedReplaceText : public KateEditReplaceTextUndo
+{
+public:
+    KateModifiedReplaceText(KTextEditor::DocumentPrivate *document, int line, const QVector<Kate::TextReplacement> &replacements, const QStringList &removedTexts);
+
+    /**
+     * @copydoc KateUndo::undo()
+     */
+    void undo() Q_DECL_OVERRIDE;
+
+    /**
+     * @copydoc KateUndo::redo()
+     */
+    void redo() Q_DECL_OVERRIDE;
+
+    void updateUndoSavedOnDiskFlag(QBitArray &lines) Q_DECL_OVERRIDE;
+    void updateRedoSavedOnDiskFlag(QBitArray &lines) Q_DECL_OVERRIDE;
+};
+
 class KateModifiedWrapLine : public KateEditWrapLineUndo
 {
 public:
@@ -55,6 +55,14 @@ KateEditRemoveTextUndo::KateEditRemoveTextUndo(KTextEditor::DocumentPrivate *doc
 {
 }
 
+KateEditReplaceTextUndo::KateEditReplaceTextUndo(KTextEditor::DocumentPrivate *document, int line, const QVector<Kate::TextReplacement> &replacements, const QStringList &removedTexts)
+    : KateUndo(document)
+    , m_line(line)
+    , m_replacements(replacements)
+    , m_removedTexts(removedTexts)
+{
+}
+
 KateEditWrapLineUndo::KateEditWrapLineUndo(KTextEditor::DocumentPrivate *document, int line, int col, int len, bool newLine)
     : KateUndo(document)
     , m_line(line)
@@ -102,6 +110,11 @@ bool KateEditRemoveTextUndo::isEmpty() const
     return len() == 0;
 }
 
+bool KateEditReplaceTextUndo::isEmpty() const
+{
+    return m_replacements.isEmpty();
+}
+
 bool KateUndo::mergeWith(const KateUndo * /*undo*/)
 {
     return false;
@@ -149,6 +162,23 @@ void KateEditRemoveTextUndo::undo()
     doc->editInsertText(m_line, m_col, m_text);
 }
 
+void KateEditReplaceTextUndo::undo()
+{
+    KTextEditor::DocumentPrivate *doc = document();
+
+    // replace the new texts by the removed ones, columns shifted by the earlier replacements
+    QVector<Kate::TextReplacement> inverse;
+    inverse.reserve(m_replacements.size());
+    int shift = 0;
+    for (int i = 0; i < m_replacements.size(); ++i) {
+        const Kate::TextReplacement &replacement = m_replacements.at(i);
+        inverse.append({replacement.column + shift, replacement.text.size(), m_removedTexts.at(i)});
+        shift += replacement.text.size() - replacement.length;
+    }
+
+    doc->editReplaceText(m_line, inverse);
+}
+
 void KateEditWrapLineUndo::undo()
 {
     KTextEditor::DocumentPrivate *doc = document();
@@ -205,6 +235,13 @@ void KateEditUnWrapLineUndo::redo()
     doc->editUnWrapLine(m_line, m_removeLine, m_len);
 }
 
+void KateEditReplaceTextUndo::redo()
+{
+    KTextEditor::DocumentPrivate *doc = document();
+
+    doc->editReplaceText(m_line, m_replacements);
+}
+
 void KateEditWrapLineUndo::redo()
 {
     KTextEditor::DocumentPrivate *doc = document();
@@ -29,6 +29,8 @@
 #include <ktexteditor/range.h>
 #include <QBitArray>
 
+#include "katetextblock.h"
+
 class KateUndoManager;
 namespace KTextEditor { class DocumentPrivate; }
 
@@ -66,6 +68,7 @@ public:
         editInsertLine,
         editRemoveLine,
         editMarkLineAutoWrapped,
+        editReplaceText,
         editInvalid
     };
 
@@ -258,6 +261,46 @@ private:
     QString m_text;
 };
 
+class KateEditReplaceTextUndo : public KateUndo
+{
+public:
+    KateEditReplaceTextUndo(KTextEditor::DocumentPrivate *document, int line, const QVector<Kate::TextReplacement> &replacements, const QStringList &removedTexts);
+
+    /**
+     * @copydoc KateUndo::isEmpty()
+     */
+    bool isEmpty() const Q_DECL_OVERRIDE;
+
+    /**
+     * @copydoc KateUndo::undo()
+     */
+    void undo() Q_DECL_OVERRIDE;
+
+    /**
+     * @copydoc KateUndo::redo()
+     */
+    void redo() Q_DECL_OVERRIDE;
+
+    /**
+     * @copydoc KateUndo::type()
+     */
+    KateUndo::UndoType type() const Q_DECL_OVERRIDE
+    {
+        return KateUndo::editReplaceText;
+    }
+
+protected:
+    inline int line() const
+    {
+        return m_line;
+    }
+
+private:
+    const int m_line;
+    QVector<Kate::TextReplacement> m_replacements;
+    QStringList m_removedTexts;
+};
+
 class KateEditMarkLineAutoWrappedUndo : public KateUndo
 {
 public:
@@ -156,6 +156,13 @@ void KateUndoManager::slotTextRemoved(int line, int col, const QString &s)
     }
 }
 
+void KateUndoManager::slotTextReplaced(int line, const QVector<Kate::TextReplacement> &replacements, const QStringList &removedTexts)
+{
+    if (m_editCurrentUndo != nullptr) { // do we care about notifications?
+        addUndoItem(new KateModifiedReplaceText(m_document, line, replacements, removedTexts));
+    }
+}
+
 void KateUndoManager::slotMarkLineAutoWrapped(int line, bool autowrapped)
 {
     if (m_editCurrentUndo != nullptr) { // do we care about notifications?
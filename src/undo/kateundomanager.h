@@ -26,6 +26,8 @@
 
 #include <QList>
 
+#include "katetextblock.h"
+
 namespace KTextEditor { class DocumentPrivate; }
 class KateUndo;
 class KateUndoGroup;
@@ -158,6 +160,11 @@ public Q_SLOTS:
      */
     void slotTextRemoved(int line, int col, const QString &s);
 
+    /**
+     * Notify KateUndoManager that several parts of a line were replaced.
+     */
+    void slotTextReplaced(int line, const QVector<Kate::TextReplacement> &replacements, const QStringList &removedTexts);
+
     /**
      * Notify KateUndoManager that a line was marked as autowrapped.
      */
@@ -28,10 +28,13 @@
 #include "katetextline.h"
 #include "katesyntaxmanager.h"
 #include "katerenderer.h"
+#include "kateglobal.h"
+#include "kateshapingcache.h"
 #include "katecmd.h"
 #include "katepartdebug.h"
 
 #include <KLocalizedString>
+#include <KTextEditor/Message>
 
 #include <QRegExp>
 
@@ -185,6 +188,9 @@ bool KateCommands::CoreCommands::help(KTextEditor::View *, const QString &cmd, Q
     } else   if (realcmd == QLatin1String("print")) {
         msg = i18n("<p>Open the Print dialog to print the current document.</p>");
         return true;
+    } else if (realcmd == QLatin1String("render-stats")) {
+        msg = i18n("<p>Show statistics of the rendering, like the hit rate of the layouts shared by all views and the lines the view painted anew.</p>");
+        return true;
     } else {
         return false;
     }
@@ -290,6 +296,18 @@ bool KateCommands::CoreCommands::exec(KTextEditor::View *view,
     } else if (cmd == QLatin1String("print")) {
         v->print();
         return true;
+    } else if (cmd == QLatin1String("render-stats")) {
+        const QString report = KTextEditor::EditorPrivate::self()->shapingCache()->statistics()
+                               + QLatin1Char('\n') + v->paintStatistics();
+        qCDebug(LOG_KTE).noquote() << report;
+
+        KTextEditor::Message *message = new KTextEditor::Message(QStringLiteral("<pre>%1</pre>").arg(report.toHtmlEscaped()), KTextEditor::Message::Information);
+        message->setPosition(KTextEditor::Message::AboveView);
+        message->setView(v);
+        v->doc()->postMessage(message);
+
+        errorMsg = report.section(QLatin1Char('\n'), 0, 0);
+        return true;
     }
 
     // ALL commands that take a string argument
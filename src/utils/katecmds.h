@@ -54,7 +54,7 @@ class CoreCommands : public KTextEditor::Command
           << QStringLiteral("set-indent-pasted-text") << QStringLiteral("set-word-wrap") << QStringLiteral("set-word-wrap-column")
           << QStringLiteral("set-replace-tabs-save") << QStringLiteral("set-remove-trailing-spaces")
           << QStringLiteral("set-highlight") << QStringLiteral("set-mode") << QStringLiteral("set-show-indent")
-          << QStringLiteral("print"))
+          << QStringLiteral("print") << QStringLiteral("render-stats"))
     {
     }
     
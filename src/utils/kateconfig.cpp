@@ -82,6 +82,8 @@ KateViewConfig *KateViewConfig::s_global = nullptr;
 KateRendererConfig *KateRendererConfig::s_global = nullptr;
 
 KateGlobalConfig::KateGlobalConfig()
+    : m_backgroundLoadingLimit(32)
+    , m_parallelHighlightingLimit(0)
 {
     s_global = this;
 
@@ -98,6 +100,8 @@ namespace
 {
 const char KEY_PROBER_TYPE[] = "Encoding Prober Type";
 const char KEY_FALLBACK_ENCODING[] = "Fallback Encoding";
+const char KEY_BACKGROUND_LOADING_LIMIT[] = "Background Loading Limit";
+const char KEY_PARALLEL_HIGHLIGHTING_LIMIT[] = "Parallel Highlighting Limit";
 }
 
 void KateGlobalConfig::readConfig(const KConfigGroup &config)
@@ -106,6 +110,8 @@ void KateGlobalConfig::readConfig(const KConfigGroup &config)
 
     setProberType((KEncodingProber::ProberType)config.readEntry(KEY_PROBER_TYPE, (int)KEncodingProber::Universal));
     setFallbackEncoding(config.readEntry(KEY_FALLBACK_ENCODING, ""));
+    setBackgroundLoadingLimit(config.readEntry(KEY_BACKGROUND_LOADING_LIMIT, 32));
+    setParallelHighlightingLimit(config.readEntry(KEY_PARALLEL_HIGHLIGHTING_LIMIT, 0));
 
     configEnd();
 }
@@ -114,6 +120,8 @@ void KateGlobalConfig::writeConfig(KConfigGroup &config)
 {
     config.writeEntry(KEY_PROBER_TYPE, (int)proberType());
     config.writeEntry(KEY_FALLBACK_ENCODING, fallbackEncoding());
+    config.writeEntry(KEY_BACKGROUND_LOADING_LIMIT, backgroundLoadingLimit());
+    config.writeEntry(KEY_PARALLEL_HIGHLIGHTING_LIMIT, parallelHighlightingLimit());
 }
 
 void KateGlobalConfig::updateConfig()
@@ -131,6 +139,20 @@ void KateGlobalConfig::setProberType(KEncodingProber::ProberType proberType)
     configEnd();
 }
 
+void KateGlobalConfig::setBackgroundLoadingLimit(int limit)
+{
+    configStart();
+    m_backgroundLoadingLimit = qMax(0, limit);
+    configEnd();
+}
+
+void KateGlobalConfig::setParallelHighlightingLimit(int limit)
+{
+    configStart();
+    m_parallelHighlightingLimit = qMax(0, limit);
+    configEnd();
+}
+
 const QString &KateGlobalConfig::fallbackEncoding() const
 {
     return m_fallbackEncoding;
@@ -141,9 +141,33 @@ public:
     const QString &fallbackEncoding() const;
     bool setFallbackEncoding(const QString &encoding);
 
+    /**
+     * Files of at least this size in megabytes are loaded in the background,
+     * 0 disables background loading.
+     */
+    int backgroundLoadingLimit() const
+    {
+        return m_backgroundLoadingLimit;
+    }
+
+    void setBackgroundLoadingLimit(int limit);
+
+    /**
+     * Highlighting at least this many lines at once speculatively highlights chunks
+     * of them in the thread pool first, 0 disables parallel highlighting.
+     */
+    int parallelHighlightingLimit() const
+    {
+        return m_parallelHighlightingLimit;
+    }
+
+    void setParallelHighlightingLimit(int limit);
+
 private:
     KEncodingProber::ProberType m_proberType;
     QString m_fallbackEncoding;
+    int m_backgroundLoadingLimit;
+    int m_parallelHighlightingLimit;
 
 private:
     static KateGlobalConfig *s_global;
@@ -37,6 +37,8 @@
 #include "kateconfig.h"
 #include "katescriptmanager.h"
 #include "katebuffer.h"
+#include "katehighlightingscheduler.h"
+#include "kateshapingcache.h"
 #include "katewordcompletion.h"
 #include "katekeywordcompletion.h"
 #include "spellcheck/spellcheck.h"
@@ -180,6 +182,16 @@ KTextEditor::EditorPrivate::EditorPrivate(QPointer<KTextEditor::EditorPrivate> &
     //
     m_hlManager = new KateHlManager();
 
+    //
+    // background highlighting of all documents
+    //
+    m_highlightingScheduler = new KateHighlightingScheduler();
+
+    //
+    // layouts shared by all views
+    //
+    m_shapingCache = new KateShapingCache();
+
     //
     // mode man
     //
@@ -249,7 +261,9 @@ KTextEditor::EditorPrivate::~EditorPrivate()
 
     // cu managers
     delete m_scriptManager;
+    delete m_highlightingScheduler;
     delete m_hlManager;
+    delete m_shapingCache;
 
     delete m_spellCheckManager;
 
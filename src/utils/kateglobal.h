@@ -54,6 +54,8 @@ namespace KTextEditor { class ViewPrivate; }
 class KateScriptManager;
 class KDirWatch;
 class KateHlManager;
+class KateHighlightingScheduler;
+class KateShapingCache;
 class KateSpellCheckManager;
 class KateWordCompletionModel;
 class KateAbstractInputModeFactory;
@@ -311,6 +313,24 @@ public:
         return m_hlManager;
     }
 
+    /**
+     * background highlighting of all documents
+     * @return highlighting scheduler
+     */
+    KateHighlightingScheduler *highlightingScheduler()
+    {
+        return m_highlightingScheduler;
+    }
+
+    /**
+     * layouts of lines shared by all views
+     * @return shaping cache
+     */
+    KateShapingCache *shapingCache()
+    {
+        return m_shapingCache;
+    }
+
     /**
      * command manager
      * @return command manager
@@ -505,6 +525,16 @@ private:
      */
     KateHlManager *m_hlManager;
 
+    /**
+     * highlighting scheduler
+     */
+    KateHighlightingScheduler *m_highlightingScheduler;
+
+    /**
+     * shaping cache
+     */
+    KateShapingCache *m_shapingCache;
+
     /**
      * command manager
      */
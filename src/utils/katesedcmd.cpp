@@ -259,11 +259,60 @@ void KateCommands::SedReplace::InteractiveSedReplacer::replaceCurrentMatch()
 
 void KateCommands::SedReplace::InteractiveSedReplacer::replaceAllRemaining()
 {
-    m_doc->editBegin();
-    while (currentMatch().isValid()) {
-        replaceCurrentMatch();
+    // Find all remaining matches in the unchanged document first, then replace them in one go.
+    QVector<KTextEditor::Range> matchRanges;
+    QStringList replacementTexts;
+    int newlinesAdded = 0;
+    for (;;) {
+        const QVector<KTextEditor::Range> captureRanges = fullCurrentMatch();
+        if (captureRanges.isEmpty() || !captureRanges.first().isValid() || captureRanges.first().start().line() > m_endLine) {
+            break;
+        }
+        const KTextEditor::Range currentMatch = captureRanges.first();
+
+        QStringList captureTexts;
+        foreach (const KTextEditor::Range &captureRange, captureRanges) {
+            captureTexts << m_doc->text(captureRange);
+        }
+        const QString replacementText = m_regExpSearch.buildReplacement(m_replacePattern, captureTexts, 0);
+        const int matchNewlines = currentMatch.end().line() - currentMatch.start().line();
+
+        matchRanges << currentMatch;
+        replacementTexts << replacementText;
+        newlinesAdded += replacementText.count(QLatin1Char('\n')) - matchNewlines;
+
+        // Continue directly after the match, the positions still refer to the unchanged document.
+        const int moveChar = currentMatch.isEmpty() ? 1 : 0; // if the search was for \s*, make sure we advance a char
+        m_currentSearchPos = KTextEditor::Cursor(currentMatch.end().line(), currentMatch.end().column() + moveChar);
+        if (m_onlyOnePerLine) {
+            // Drop down to next line.
+            m_currentSearchPos = KTextEditor::Cursor(m_currentSearchPos.line() + 1, 0);
+        }
+
+        m_numReplacementsDone++;
+        if (m_lastChangedLineNum != currentMatch.start().line()) {
+            // Counting "swallowed" lines as being "touched".
+            m_numLinesTouched += matchNewlines + 1;
+        }
+        m_lastChangedLineNum = m_currentSearchPos.line();
     }
+
+    if (matchRanges.isEmpty()) {
+        return;
+    }
+
+    m_doc->editBegin();
+    const QVector<KTextEditor::Range> replacedRanges = m_doc->replaceTexts(matchRanges, replacementTexts);
     m_doc->editEnd();
+
+    // Map the search position and end line to the changed document.
+    const int moveChar = matchRanges.last().isEmpty() ? 1 : 0;
+    m_currentSearchPos = KTextEditor::Cursor(replacedRanges.last().end().line(), replacedRanges.last().end().column() + moveChar);
+    if (m_onlyOnePerLine) {
+        m_currentSearchPos = KTextEditor::Cursor(m_currentSearchPos.line() + 1, 0);
+    }
+    m_lastChangedLineNum = m_currentSearchPos.line();
+    m_endLine += newlinesAdded;
 }
 
 QString KateCommands::SedReplace::InteractiveSedReplacer::currentMatchReplacementConfirmationMessage()
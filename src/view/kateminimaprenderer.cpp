@@ -0,0 +1,225 @@
+/*  This file is part of the KDE libraries and the Kate part.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "kateminimaprenderer.h"
+
+#include <QMetaObject>
+#include <QPainter>
+
+static const unsigned char characterOpacity[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // <- 15
+    0, 0, 0, 0, 0, 0, 0, 0, 255, 0, 255, 0, 0, 0, 0, 0,  // <- 31
+    0, 125, 41, 221, 138, 195, 218, 21, 142, 142, 137, 137, 97, 87, 87, 140,  // <- 47
+    223, 164, 183, 190, 191, 193, 214, 158, 227, 216, 103, 113, 146, 140, 146, 149,  // <- 63
+    248, 204, 240, 174, 217, 197, 178, 205, 209, 176, 168, 211, 160, 246, 238, 218,  // <- 79
+    195, 229, 227, 196, 167, 212, 188, 238, 197, 169, 189, 158, 21, 151, 115, 90,  // <- 95
+    15, 192, 209, 153, 208, 187, 162, 221, 183, 149, 161, 191, 146, 203, 167, 182,  // <- 111
+    208, 203, 139, 166, 158, 167, 157, 189, 164, 179, 156, 167, 145, 166, 109, 0,  // <- 127
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // <- 143
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // <- 159
+    0, 125, 184, 187, 146, 201, 127, 203, 89, 194, 156, 141, 117, 87, 202, 88,  // <- 175
+    115, 165, 118, 121, 85, 190, 236, 87, 88, 111, 151, 140, 194, 191, 203, 148,  // <- 191
+    215, 215, 222, 224, 223, 234, 230, 192, 208, 208, 216, 217, 187, 187, 194, 195,  // <- 207
+    228, 255, 228, 228, 235, 239, 237, 150, 255, 222, 222, 229, 232, 180, 197, 225,  // <- 223
+    208, 208, 216, 217, 212, 230, 218, 170, 202, 202, 211, 204, 156, 156, 165, 159,  // <- 239
+    214, 194, 197, 197, 206, 206, 201, 132, 214, 183, 183, 192, 187, 195, 227, 198
+};
+
+KateMiniMapGeometry::KateMiniMapGeometry()
+    : width(0)
+    , height(0)
+    , lineWidth(0)
+    , pixelMargin(0)
+    , charIncrement(1)
+    , lineIncrement(1)
+    , lineDivisor(1)
+    , devicePixelRatio(1.0)
+    , markers(false)
+{
+}
+
+bool KateMiniMapGeometry::sameScale(const KateMiniMapGeometry &other) const
+{
+    return width == other.width && lineWidth == other.lineWidth && pixelMargin == other.pixelMargin
+           && charIncrement == other.charIncrement && lineIncrement == other.lineIncrement
+           && lineDivisor == other.lineDivisor && devicePixelRatio == other.devicePixelRatio && markers == other.markers
+           && textColor == other.textColor && selectionColor == other.selectionColor
+           && modifiedLineColor == other.modifiedLineColor && savedLineColor == other.savedLineColor;
+}
+
+KateMiniMapRenderer::KateMiniMapRenderer(QObject *receiver, const char *member)
+    : m_receiver(receiver)
+    , m_member(member)
+{
+    setAutoDelete(false);
+}
+
+void KateMiniMapRenderer::run()
+{
+    for (int i = 0; i < tiles.size(); ++i) {
+        renderTile(tiles[i]);
+    }
+
+    // the receiver waits for us before it goes away
+    QMetaObject::invokeMethod(m_receiver, m_member, Qt::QueuedConnection);
+    m_done.release();
+}
+
+void KateMiniMapRenderer::wait()
+{
+    m_done.acquire();
+    m_done.release();
+}
+
+// This function is optimized for being called in sequence.
+QColor KateMiniMapRenderer::charColor(const KateMiniMapLine &line, int &attributeIndex, int x, QChar ch) const
+{
+    QColor color = geometry.textColor;
+
+    bool styleFound = false;
+
+    // Query the decorations, that is, things like search highlighting, or the
+    // KDevelop DUChain highlighting, for a color to use
+    foreach (const QTextLayout::FormatRange &range, line.decorations) {
+        if (range.start <= x && range.start + range.length > x) {
+            // If there's a different background color set (search markers, ...)
+            // use that, otherwise use the foreground color.
+            if (range.format.hasProperty(QTextFormat::BackgroundBrush)) {
+                color = range.format.background().color();
+            } else {
+                color = range.format.foreground().color();
+            }
+            styleFound = true;
+            break;
+        }
+    }
+
+    // If there's no decoration set for the current character (this will mostly be the case for
+    // plain Kate), query the styles, that is, the default kate syntax highlighting.
+    if (!styleFound) {
+        const Kate::TextLineData::Attributes &attributes = line.attributes;
+
+        // go to the block containing x
+        while ((attributeIndex < attributes.size()) &&
+                ((attributes[attributeIndex].offset + attributes[attributeIndex].length) < x)) {
+            ++attributeIndex;
+        }
+        if ((attributeIndex < attributes.size()) && (x < attributes[attributeIndex].offset + attributes[attributeIndex].length)) {
+            const int attribute = attributes[attributeIndex].attributeValue;
+            color = attributeColors.value(attribute, attributeColors.value(0, geometry.textColor));
+        }
+    }
+
+    // Query how much "blackness" the character has.
+    // This causes for example a dot or a dash to appear less intense
+    // than an A or similar.
+    // This gives the pixels created a bit of structure, which makes it look more
+    // like real text.
+    color.setAlpha((ch.unicode() < 256) ? characterOpacity[ch.unicode()] : 1.0);
+
+    return color;
+}
+
+void KateMiniMapRenderer::renderTile(KateMiniMapTile &tile) const
+{
+    const int firstRow = tile.index * TileRows;
+    const int charIncrement = geometry.charIncrement;
+    const int lineWidth = geometry.lineWidth;
+    const int pixelMargin = geometry.pixelMargin;
+
+    // same pixel layout as the whole pixmap, just shifted by the tile's first row
+    tile.image = QImage(geometry.width * geometry.devicePixelRatio, TileRows, QImage::Format_ARGB32_Premultiplied);
+    tile.image.fill(Qt::transparent);
+
+    QPainter painter;
+    if (!painter.begin(&tile.image)) {
+        return;
+    }
+
+    for (int i = 0; i < tile.lines.size(); ++i) {
+        const KateMiniMapLine &line = tile.lines[i];
+        const QString &lineText = line.text;
+        const int pixelY = (tile.firstDrawnLine + i) / charIncrement - firstRow;
+        int attributeIndex = 0;
+
+        // Draw selection if it is on an empty line
+        if (lineText.size() == 0 && line.selectionStart == 0 && line.selectionEnd > 0) {
+            painter.setPen(geometry.selectionColor);
+            painter.drawLine(pixelMargin, pixelY, pixelMargin + lineWidth - 1, pixelY);
+        }
+
+        // Iterate over the line to draw the background
+        int selStartX = -1;
+        int selEndX = -1;
+        int pixelX = pixelMargin; // use this to control the offset of the text from the left
+        for (int x = 0; (x < lineText.size() && x < lineWidth); x += charIncrement) {
+            if (pixelX >= lineWidth + pixelMargin) {
+                break;
+            }
+            // Query the selection and draw it behind the character
+            if (line.selectionStart >= 0 && x >= line.selectionStart && x < line.selectionEnd) {
+                if (selStartX == -1) selStartX = pixelX;
+                selEndX = pixelX;
+                if (lineText.size() - 1 == x) {
+                    selEndX = lineWidth + pixelMargin - 1;
+                }
+            }
+
+            if (lineText[x] == QLatin1Char('\t')) {
+                pixelX += qMax(4 / charIncrement, 1); // FIXME: tab width...
+            } else {
+                pixelX++;
+            }
+        }
+
+        if (selStartX != -1) {
+            painter.setPen(geometry.selectionColor);
+            painter.drawLine(selStartX, pixelY, selEndX, pixelY);
+        }
+
+        // Iterate over all the characters in the current line
+        pixelX = pixelMargin;
+        for (int x = 0; (x < lineText.size() && x < lineWidth); x += charIncrement) {
+            if (pixelX >= lineWidth + pixelMargin) {
+                break;
+            }
+
+            // draw the pixels
+            if (lineText[x] == QLatin1Char(' ')) {
+                pixelX++;
+            } else if (lineText[x] == QLatin1Char('\t')) {
+                pixelX += qMax(4 / charIncrement, 1); // FIXME: tab width...
+            } else {
+                painter.setPen(charColor(line, attributeIndex, x, lineText[x]));
+
+                // Actually draw the pixel with the color queried from the renderer.
+                painter.drawPoint(pixelX, pixelY);
+
+                pixelX++;
+            }
+        }
+    }
+
+    // Draw line modification marker map.
+    for (int i = 0; i < tile.markers.size(); ++i) {
+        if (tile.markers[i] != NoMarker) {
+            const QColor &col = (tile.markers[i] == ModifiedMarker) ? geometry.modifiedLineColor : geometry.savedLineColor;
+            painter.fillRect(2, geometry.markerRowOfLine(tile.firstMarkerLine + i) - firstRow, 3, 1, col);
+        }
+    }
+}
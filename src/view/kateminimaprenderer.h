@@ -0,0 +1,185 @@
+/*  This file is part of the KDE libraries and the Kate part.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KATE_MINIMAP_RENDERER_H
+#define KATE_MINIMAP_RENDERER_H
+
+#include "katetextline.h"
+
+#include <QColor>
+#include <QImage>
+#include <QList>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QString>
+#include <QTextLayout>
+#include <QVector>
+
+/**
+ * Everything of a document line the minimap draws, copied on the GUI thread.
+ */
+struct KateMiniMapLine {
+    QString text;
+    Kate::TextLineData::Attributes attributes;
+    QList<QTextLayout::FormatRange> decorations;
+
+    /**
+     * selected columns: from selectionStart up to, not including, selectionEnd
+     * selectionStart is -1 if nothing of the line is selected
+     */
+    int selectionStart;
+    int selectionEnd;
+};
+
+/**
+ * Scale and colors of the minimap, all tiles of one pixmap share them.
+ */
+struct KateMiniMapGeometry {
+    KateMiniMapGeometry();
+
+    /**
+     * Tiles painted with @p other fit into a pixmap of this geometry,
+     * that is everything but the height is equal.
+     */
+    bool sameScale(const KateMiniMapGeometry &other) const;
+
+    /**
+     * Pixel row of the text of a visible line.
+     */
+    int rowOfLine(int virtualLine) const
+    {
+        return virtualLine / lineIncrement / charIncrement;
+    }
+
+    /**
+     * Pixel row of the modification marker of a visible line.
+     */
+    int markerRowOfLine(int virtualLine) const
+    {
+        return virtualLine / lineDivisor;
+    }
+
+    bool isValid() const
+    {
+        return width > 0;
+    }
+
+    int width;
+    int height;
+    int lineWidth;
+    int pixelMargin;
+    int charIncrement;
+    int lineIncrement;
+    int lineDivisor;
+    qreal devicePixelRatio;
+    bool markers;
+
+    QColor textColor;
+    QColor selectionColor;
+    QColor modifiedLineColor;
+    QColor savedLineColor;
+};
+
+/**
+ * One tile of the minimap: a band of TileRows pixel rows.
+ */
+struct KateMiniMapTile {
+    int index;
+
+    /**
+     * drawn lines, every lineIncrement-th visible line, from firstDrawnLine on
+     */
+    int firstDrawnLine;
+    QVector<KateMiniMapLine> lines;
+
+    /**
+     * modification state of the visible lines from firstMarkerLine on,
+     * see Marker
+     */
+    int firstMarkerLine;
+    QVector<char> markers;
+
+    /**
+     * the painted tile
+     */
+    QImage image;
+};
+
+/**
+ * Paints tiles of the minimap from line snapshots, in the global thread pool.
+ *
+ * The scroll bar fills in the tiles on the GUI thread, the renderer
+ * invokes the given slot of the scroll bar once all are painted.
+ */
+class KateMiniMapRenderer : public QRunnable
+{
+public:
+    /**
+     * Pixel rows per tile.
+     */
+    static const int TileRows = 32;
+
+    /**
+     * Modification state of a line.
+     */
+    enum Marker {
+        NoMarker = 0,
+        ModifiedMarker,
+        SavedMarker
+    };
+
+    /**
+     * @param receiver object to notify once the tiles are painted
+     * @param member slot of @p receiver to invoke, queued
+     */
+    KateMiniMapRenderer(QObject *receiver, const char *member);
+
+    void run() Q_DECL_OVERRIDE;
+
+    /**
+     * Paint one tile into its image, needs no GUI thread.
+     */
+    void renderTile(KateMiniMapTile &tile) const;
+
+    /**
+     * Block until run() is done.
+     */
+    void wait();
+
+    KateMiniMapGeometry geometry;
+
+    /**
+     * foreground color per attribute of the highlighting
+     */
+    QVector<QColor> attributeColors;
+
+    QVector<KateMiniMapTile> tiles;
+
+private:
+    QColor charColor(const KateMiniMapLine &line, int &attributeIndex, int x, QChar ch) const;
+
+    QObject *const m_receiver;
+    const char *const m_member;
+
+    /**
+     * released once all tiles are painted
+     */
+    QSemaphore m_done;
+};
+
+#endif
@@ -2033,6 +2033,21 @@ void KTextEditor::ViewPrivate::updateView(bool changed)
     m_viewInternal->m_leftBorder->update();
 }
 
+qint64 KTextEditor::ViewPrivate::paintedLineCount() const
+{
+    return m_viewInternal->paintedLineCount();
+}
+
+qint64 KTextEditor::ViewPrivate::reusedLineCount() const
+{
+    return m_viewInternal->reusedLineCount();
+}
+
+QString KTextEditor::ViewPrivate::paintStatistics() const
+{
+    return m_viewInternal->paintStatistics();
+}
+
 //END
 
 void KTextEditor::ViewPrivate::slotHlChanged()
@@ -3270,6 +3285,11 @@ void KTextEditor::ViewPrivate::notifyAboutRangeChange(int startLine, int endLine
     qCDebug(LOG_KTE) << "trigger attribute changed from" << startLine << "to" << endLine << "rangeWithAttribute" << rangeWithAttribute;
 #endif
 
+    // the attribute may have been changed in place, merge it again
+    if (rangeWithAttribute) {
+        m_renderer->clearMergedAttributes();
+    }
+
     // first call:
     if (!m_delayedUpdateTriggered) {
         m_delayedUpdateTriggered = true;
@@ -3321,6 +3341,9 @@ void KTextEditor::ViewPrivate::slotDelayedUpdateOfView()
     if (m_lineToUpdateMin != -1 && m_lineToUpdateMax != -1) {
         tagLines(m_lineToUpdateMin, m_lineToUpdateMax, true);
         updateView(true);
+
+        // the minimap shows these lines, too
+        m_viewInternal->m_lineScroll->invalidateMiniMapLines(m_lineToUpdateMin, m_lineToUpdateMax);
     }
 
     // reset flags
@@ -3632,7 +3655,7 @@ QList<KTextEditor::AttributeBlock> KTextEditor::ViewPrivate::lineAttributes(int
         return attribs;
     }
 
-    const QVector<Kate::TextLineData::Attribute> &intAttrs = kateLine->attributesList();
+    const Kate::TextLineData::Attributes &intAttrs = kateLine->attributesList();
     for (int i = 0; i < intAttrs.size(); ++i) {
         if (intAttrs[i].length > 0 && intAttrs[i].attributeValue > 0) {
             attribs << KTextEditor::AttributeBlock(
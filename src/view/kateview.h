@@ -334,6 +334,14 @@ public:
     void repaintText(bool paintOnlyDirty = false);
 
     void updateView(bool changed = false);
+
+    /**
+     * Lines of the text area painted anew and lines reused from their
+     * backing store, since the view got created.
+     */
+    qint64 paintedLineCount() const;
+    qint64 reusedLineCount() const;
+    QString paintStatistics() const;
     //END
 
     //
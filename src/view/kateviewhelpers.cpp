@@ -50,6 +50,7 @@
 
 #include <QRegExp>
 #include <QTextCodec>
+#include <QThreadPool>
 #include <QTimer>
 #include <QVariant>
 #include <QtAlgorithms>
@@ -76,25 +77,6 @@ static const int s_lineWidth = 100;
 static const int s_pixelMargin = 8;
 static const int s_linePixelIncLimit = 6;
 
-const unsigned char KateScrollBar::characterOpacity[256] = {
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // <- 15
-    0, 0, 0, 0, 0, 0, 0, 0, 255, 0, 255, 0, 0, 0, 0, 0,  // <- 31
-    0, 125, 41, 221, 138, 195, 218, 21, 142, 142, 137, 137, 97, 87, 87, 140,  // <- 47
-    223, 164, 183, 190, 191, 193, 214, 158, 227, 216, 103, 113, 146, 140, 146, 149,  // <- 63
-    248, 204, 240, 174, 217, 197, 178, 205, 209, 176, 168, 211, 160, 246, 238, 218,  // <- 79
-    195, 229, 227, 196, 167, 212, 188, 238, 197, 169, 189, 158, 21, 151, 115, 90,  // <- 95
-    15, 192, 209, 153, 208, 187, 162, 221, 183, 149, 161, 191, 146, 203, 167, 182,  // <- 111
-    208, 203, 139, 166, 158, 167, 157, 189, 164, 179, 156, 167, 145, 166, 109, 0,  // <- 127
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // <- 143
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // <- 159
-    0, 125, 184, 187, 146, 201, 127, 203, 89, 194, 156, 141, 117, 87, 202, 88,  // <- 175
-    115, 165, 118, 121, 85, 190, 236, 87, 88, 111, 151, 140, 194, 191, 203, 148,  // <- 191
-    215, 215, 222, 224, 223, 234, 230, 192, 208, 208, 216, 217, 187, 187, 194, 195,  // <- 207
-    228, 255, 228, 228, 235, 239, 237, 150, 255, 222, 222, 229, 232, 180, 197, 225,  // <- 223
-    208, 208, 216, 217, 212, 230, 218, 170, 202, 202, 211, 204, 156, 156, 165, 159,  // <- 239
-    214, 194, 197, 197, 206, 206, 201, 132, 214, 183, 183, 192, 187, 195, 227, 198
-};
-
 KateScrollBar::KateScrollBar(Qt::Orientation orientation, KateViewInternal *parent)
     : QScrollBar(orientation, parent->m_view)
     , m_middleMouseDown(false)
@@ -108,6 +90,9 @@ KateScrollBar::KateScrollBar(Qt::Orientation orientation, KateViewInternal *pare
     , m_miniMapAll(true)
     , m_miniMapWidth(40)
     , m_grooveHeight(height())
+    , m_allTilesDirty(true)
+    , m_miniMapRenderer(nullptr)
+    , m_miniMapTilesRendered(0)
     , m_linesModified(0)
 {
     connect(this, SIGNAL(valueChanged(int)), this, SLOT(sliderMaybeMoved(int)));
@@ -129,18 +114,36 @@ KateScrollBar::KateScrollBar(Qt::Orientation orientation, KateViewInternal *pare
 KateScrollBar::~KateScrollBar()
 {
     delete m_textPreview;
+
+    // the worker may still use us to report back
+    if (m_miniMapRenderer) {
+        m_miniMapRenderer->wait();
+        delete m_miniMapRenderer;
+    }
 }
 
 void KateScrollBar::setShowMiniMap(bool b)
 {
     if (b && !m_showMiniMap) {
-        connect(m_view, SIGNAL(selectionChanged(KTextEditor::View*)), &m_updateTimer, SLOT(start()), Qt::UniqueConnection);
-        connect(m_doc, SIGNAL(textChanged(KTextEditor::Document*)), &m_updateTimer, SLOT(start()), Qt::UniqueConnection);
-        connect(m_view, SIGNAL(delayedUpdateOfView()), &m_updateTimer, SLOT(start()), Qt::UniqueConnection);
+        // only the tiles showing changed lines get painted again
+        connect(m_view, SIGNAL(selectionChanged(KTextEditor::View*)), this, SLOT(miniMapSelectionChanged()), Qt::UniqueConnection);
+        connect(&m_doc->buffer(), SIGNAL(lineWrapped(KTextEditor::Cursor)), this, SLOT(miniMapLineWrapped(KTextEditor::Cursor)), Qt::UniqueConnection);
+        connect(&m_doc->buffer(), SIGNAL(lineUnwrapped(int)), this, SLOT(miniMapLineUnwrapped(int)), Qt::UniqueConnection);
+        connect(&m_doc->buffer(), SIGNAL(textInserted(KTextEditor::Cursor,QString)), this, SLOT(miniMapTextInserted(KTextEditor::Cursor)), Qt::UniqueConnection);
+        connect(&m_doc->buffer(), SIGNAL(textRemoved(KTextEditor::Range,QString)), this, SLOT(miniMapTextRemoved(KTextEditor::Range)), Qt::UniqueConnection);
+        connect(&m_doc->buffer(), SIGNAL(textReplaced(int,QVector<Kate::TextReplacement>,QStringList)), this, SLOT(miniMapLineChanged(int)), Qt::UniqueConnection);
+        connect(&m_doc->buffer(), SIGNAL(tagLines(int,int)), this, SLOT(miniMapLinesChanged(int,int)), Qt::UniqueConnection);
+        connect(m_doc, SIGNAL(documentSavedOrUploaded(KTextEditor::Document*,bool)), this, SLOT(invalidateMiniMap()), Qt::UniqueConnection);
+        connect(&(m_view->textFolding()), SIGNAL(foldingRangesChanged()), this, SLOT(invalidateMiniMap()), Qt::UniqueConnection);
         connect(&m_updateTimer, SIGNAL(timeout()), this, SLOT(updatePixmap()), Qt::UniqueConnection);
-        connect(&(m_view->textFolding()), SIGNAL(foldingRangesChanged()), &m_updateTimer, SLOT(start()), Qt::UniqueConnection);
+        m_miniMapSelection = m_view->selectionRange();
+        invalidateMiniMap();
     } else if (!b) {
         disconnect(&m_updateTimer);
+        disconnect(m_view, SIGNAL(selectionChanged(KTextEditor::View*)), this, SLOT(miniMapSelectionChanged()));
+        disconnect(&m_doc->buffer(), nullptr, this, nullptr);
+        disconnect(m_doc, SIGNAL(documentSavedOrUploaded(KTextEditor::Document*,bool)), this, SLOT(invalidateMiniMap()));
+        disconnect(&(m_view->textFolding()), SIGNAL(foldingRangesChanged()), this, SLOT(invalidateMiniMap()));
     }
 
     m_showMiniMap = b;
@@ -377,63 +380,9 @@ void KateScrollBar::hideTextPreview()
     delete m_textPreview;
 }
 
-// This function is optimized for bing called in sequence.
-const QColor KateScrollBar::charColor(const QVector<Kate::TextLineData::Attribute> &attributes, int &attributeIndex,
-                                      const QList<QTextLayout::FormatRange> &decorations,
-                                      const QColor &defaultColor, int x, QChar ch)
+KateMiniMapGeometry KateScrollBar::miniMapGeometry()
 {
-    QColor color = defaultColor;
-
-    bool styleFound = false;
-
-    // Query the decorations, that is, things like search highlighting, or the
-    // KDevelop DUChain highlighting, for a color to use
-    foreach (const QTextLayout::FormatRange &range, decorations) {
-        if (range.start <= x && range.start + range.length > x) {
-            // If there's a different background color set (search markers, ...)
-            // use that, otherwise use the foreground color.
-            if (range.format.hasProperty(QTextFormat::BackgroundBrush)) {
-                color = range.format.background().color();
-            } else {
-                color = range.format.foreground().color();
-            }
-            styleFound = true;
-            break;
-        }
-    }
-
-    // If there's no decoration set for the current character (this will mostly be the case for
-    // plain Kate), query the styles, that is, the default kate syntax highlighting.
-    if (!styleFound) {
-        // go to the block containing x
-        while ((attributeIndex < attributes.size()) &&
-                ((attributes[attributeIndex].offset + attributes[attributeIndex].length) < x)) {
-            ++attributeIndex;
-        }
-        if ((attributeIndex < attributes.size()) && (x < attributes[attributeIndex].offset + attributes[attributeIndex].length)) {
-            color = m_view->renderer()->attribute(attributes[attributeIndex].attributeValue)->foreground().color();
-        }
-    }
-
-    // Query how much "blackness" the character has.
-    // This causes for example a dot or a dash to appear less intense
-    // than an A or similar.
-    // This gives the pixels created a bit of structure, which makes it look more
-    // like real text.
-    color.setAlpha((ch.unicode() < 256) ? characterOpacity[ch.unicode()] : 1.0);
-
-    return color;
-}
-
-void KateScrollBar::updatePixmap()
-{
-    //QTime time;
-    //time.start();
-
-    if (!m_showMiniMap) {
-        // make sure no time is wasted if the option is disabled
-        return;
-    }
+    KateMiniMapGeometry geometry;
 
     // For performance reason, only every n-th line will be drawn if the widget is
     // sufficiently small compared to the amount of lines in the document.
@@ -467,130 +416,289 @@ void KateScrollBar::updatePixmap()
     //qCDebug(LOG_KTE) << "l" << lineIncrement << "c" << charIncrement << "d" << lineDivisor;
     //qCDebug(LOG_KTE) << "pixmap" << pixmapLineCount << pixmapLineWidth << "docLines" << m_view->textFolding().visibleLines() << "height" << m_grooveHeight;
 
+    geometry.width = pixmapLineWidth;
+    geometry.height = pixmapLineCount;
+    geometry.lineWidth = s_lineWidth;
+    geometry.pixelMargin = s_pixelMargin;
+    geometry.charIncrement = charIncrement;
+    geometry.lineIncrement = lineIncrement;
+    geometry.lineDivisor = lineDivisor;
+    geometry.devicePixelRatio = m_view->devicePixelRatio();
+
+    // Draw line modification marker map.
+    // Disable this if the document is really huge,
+    // since it requires querying every line.
+    geometry.markers = m_doc->lines() < 50000;
+
     const QColor backgroundColor = m_view->defaultStyleAttribute(KTextEditor::dsNormal)->background().color();
-    const QColor defaultTextColor = m_view->defaultStyleAttribute(KTextEditor::dsNormal)->foreground().color();
-    const QColor selectionBgColor = m_view->renderer()->config()->selectionColor();
-    QColor modifiedLineColor = m_view->renderer()->config()->modifiedLineColor();
-    QColor savedLineColor = m_view->renderer()->config()->savedLineColor();
+    geometry.textColor = m_view->defaultStyleAttribute(KTextEditor::dsNormal)->foreground().color();
+    geometry.selectionColor = m_view->renderer()->config()->selectionColor();
+    geometry.modifiedLineColor = m_view->renderer()->config()->modifiedLineColor();
+    geometry.savedLineColor = m_view->renderer()->config()->savedLineColor();
     // move the modified line color away from the background color
-    modifiedLineColor.setHsv(modifiedLineColor.hue(), 255, 255 - backgroundColor.value() / 3);
-    savedLineColor.setHsv(savedLineColor.hue(), 100, 255 - backgroundColor.value() / 3);
+    geometry.modifiedLineColor.setHsv(geometry.modifiedLineColor.hue(), 255, 255 - backgroundColor.value() / 3);
+    geometry.savedLineColor.setHsv(geometry.savedLineColor.hue(), 100, 255 - backgroundColor.value() / 3);
+
+    return geometry;
+}
 
-    // increase dimensions by ratio
-    m_pixmap = QPixmap(pixmapLineWidth * m_view->devicePixelRatio(), pixmapLineCount * m_view->devicePixelRatio());
-    m_pixmap.fill(QColor("transparent"));
+void KateScrollBar::snapshotMiniMapTile(KateMiniMapTile &tile, const KateMiniMapGeometry &geometry, int docLineCount)
+{
+    const int firstRow = tile.index * KateMiniMapRenderer::TileRows;
+    const int endRow = firstRow + KateMiniMapRenderer::TileRows;
 
-    // The text currently selected in the document, to be drawn later.
+    // The text currently selected in the document, drawn behind the text.
     const KTextEditor::Range &selection = m_view->selectionRange();
 
-    QPainter painter;
-    if (painter.begin(&m_pixmap)) {
-        // Do not force updates of the highlighting if the document is very large
-        bool simpleMode = m_doc->lines() > 7500;
+    // Do not force updates of the highlighting if the document is very large
+    bool simpleMode = m_doc->lines() > 7500;
 
-        int pixelY = 0;
-        int drawnLines = 0;
+    // every lineIncrement-th visible line gets drawn, charIncrement of them per pixel row
+    tile.firstDrawnLine = firstRow * geometry.charIncrement;
+    tile.lines.clear();
+    for (int drawnLine = tile.firstDrawnLine; drawnLine < endRow * geometry.charIncrement; ++drawnLine) {
+        const int virtualLine = drawnLine * geometry.lineIncrement;
+        if (virtualLine >= docLineCount) {
+            break;
+        }
 
-        // Iterate over all visible lines, drawing them.
-        for (int virtualLine = 0; virtualLine < docLineCount; virtualLine += lineIncrement) {
+        int realLineNumber = m_view->textFolding().visibleLineToLine(virtualLine);
 
-            int realLineNumber = m_view->textFolding().visibleLineToLine(virtualLine);
-            QString lineText = m_doc->line(realLineNumber);
+        if (!simpleMode) {
+            m_doc->buffer().requestHighlighting(realLineNumber, 64, KateHighlightingScheduler::LookaheadPriority);
+        }
+        const Kate::TextLine &kateline = m_doc->plainKateTextLine(realLineNumber);
+
+        KateMiniMapLine line;
+        line.text = kateline->string();
+        line.attributes = kateline->attributesList();
+        line.decorations = m_view->renderer()->decorationsForLine(kateline, realLineNumber);
+
+        // selected columns, as selection.contains() would tell
+        line.selectionStart = -1;
+        line.selectionEnd = -1;
+        if (selection.start().line() <= realLineNumber && selection.end().line() >= realLineNumber) {
+            line.selectionStart = (selection.start().line() == realLineNumber) ? selection.start().column() : 0;
+            line.selectionEnd = (selection.end().line() == realLineNumber) ? selection.end().column() : INT_MAX;
+        }
 
-            if (!simpleMode) {
-                m_doc->buffer().ensureHighlighted(realLineNumber);
+        tile.lines.append(line);
+    }
+
+    tile.markers.clear();
+    tile.firstMarkerLine = qMin(firstRow * geometry.lineDivisor, docLineCount);
+    if (geometry.markers) {
+        const int endMarkerLine = qMin(endRow * geometry.lineDivisor, docLineCount);
+        tile.markers.reserve(endMarkerLine - tile.firstMarkerLine);
+        for (int lineno = tile.firstMarkerLine; lineno < endMarkerLine; ++lineno) {
+            int realLineNo = m_view->textFolding().visibleLineToLine(lineno);
+            const Kate::TextLine &line = m_doc->plainKateTextLine(realLineNo);
+            if (line->markedAsModified()) {
+                tile.markers.append(KateMiniMapRenderer::ModifiedMarker);
+            } else if (line->markedAsSavedOnDisk()) {
+                tile.markers.append(KateMiniMapRenderer::SavedMarker);
+            } else {
+                tile.markers.append(KateMiniMapRenderer::NoMarker);
             }
-            const Kate::TextLine &kateline = m_doc->plainKateTextLine(realLineNumber);
+        }
+    }
+}
 
-            const QVector<Kate::TextLineData::Attribute> &attributes = kateline->attributesList();
-            QList< QTextLayout::FormatRange > decorations = m_view->renderer()->decorationsForLine(kateline, realLineNumber);
-            int attributeIndex = 0;
+void KateScrollBar::updatePixmap()
+{
+    //QTime time;
+    //time.start();
 
-            // Draw selection if it is on an empty line
-            if (selection.contains(KTextEditor::Cursor(realLineNumber, 0)) && lineText.size() == 0) {
-                painter.setPen(selectionBgColor);
-                painter.drawLine(s_pixelMargin, pixelY, s_pixelMargin + s_lineWidth - 1, pixelY);
-            }
+    if (!m_showMiniMap) {
+        // make sure no time is wasted if the option is disabled
+        return;
+    }
 
-            // Iterate over the line to draw the background
-            int selStartX = -1;
-            int selEndX = -1;
-            int pixelX = s_pixelMargin; // use this to control the offset of the text from the left
-            for (int x = 0; (x < lineText.size() && x < s_lineWidth); x += charIncrement) {
-                if (pixelX >= s_lineWidth + s_pixelMargin) {
-                    break;
-                }
-                // Query the selection and draw it behind the character
-                if (selection.contains(KTextEditor::Cursor(realLineNumber, x))) {
-                    if (selStartX == -1) selStartX = pixelX;
-                    selEndX = pixelX;
-                    if (lineText.size() - 1 == x) {
-                        selEndX = s_lineWidth + s_pixelMargin-1;
-                    }
-                }
+    // one batch of tiles at a time, the next one starts once the last got composed
+    if (m_miniMapRenderer) {
+        return;
+    }
 
-                if (lineText[x] == QLatin1Char('\t')) {
-                    pixelX += qMax(4 / charIncrement, 1); // FIXME: tab width...
-                } else {
-                    pixelX++;
-                }
-            }
+    const KateMiniMapGeometry geometry = miniMapGeometry();
+    const int tileCount = (geometry.height + KateMiniMapRenderer::TileRows - 1) / KateMiniMapRenderer::TileRows;
+
+    // another scale or colors: all tiles need to be painted again
+    if (m_allTilesDirty || !geometry.sameScale(m_miniMapGeometry)) {
+        m_dirtyTiles.fill(true, tileCount);
+        m_allTilesDirty = false;
+    } else if (m_dirtyTiles.size() != tileCount) {
+        // just more or less lines at the end, the tiles beyond the old height are new
+        const int oldCount = m_dirtyTiles.size();
+        m_dirtyTiles.resize(tileCount);
+        if (tileCount > oldCount) {
+            m_dirtyTiles.fill(true, oldCount, tileCount);
+        }
+    }
+
+    // the new height needs a new pixmap, even if nothing is dirty
+    if (m_dirtyTiles.count(true) == 0 && geometry.height == m_miniMapGeometry.height) {
+        return;
+    }
+
+    // copy the lines of the dirty tiles, the worker paints them
+    m_miniMapRenderer = new KateMiniMapRenderer(this, "miniMapTilesPainted");
+    m_miniMapRenderer->geometry = geometry;
 
-            if (selStartX != -1) {
-                painter.setPen(selectionBgColor);
-                painter.drawLine(selStartX, pixelY, selEndX, pixelY);
+    const int docLineCount = m_view->textFolding().visibleLines();
+    int maxAttribute = 0;
+    for (int i = 0; i < tileCount; ++i) {
+        if (!m_dirtyTiles.testBit(i)) {
+            continue;
+        }
+
+        KateMiniMapTile tile;
+        tile.index = i;
+        snapshotMiniMapTile(tile, geometry, docLineCount);
+        foreach (const KateMiniMapLine &line, tile.lines) {
+            for (const Kate::TextLineData::Attribute &attribute : line.attributes) {
+                maxAttribute = qMax(maxAttribute, int(attribute.attributeValue));
             }
+        }
+        m_miniMapRenderer->tiles.append(tile);
+        m_dirtyTiles.clearBit(i);
+    }
 
-            // Iterate over all the characters in the current line
-            pixelX = s_pixelMargin;
-            for (int x = 0; (x < lineText.size() && x < s_lineWidth); x += charIncrement) {
-                if (pixelX >= s_lineWidth + s_pixelMargin) {
-                    break;
-                }
+    // the renderer's attributes must not be touched in the worker
+    m_miniMapRenderer->attributeColors.reserve(maxAttribute + 1);
+    for (int i = 0; i <= maxAttribute; ++i) {
+        m_miniMapRenderer->attributeColors.append(m_view->renderer()->attribute(i)->foreground().color());
+    }
 
-                // draw the pixels
-                if (lineText[x] == QLatin1Char(' ')) {
-                    pixelX++;
-                } else if (lineText[x] == QLatin1Char('\t')) {
-                    pixelX += qMax(4 / charIncrement, 1); // FIXME: tab width...
-                } else {
-                    painter.setPen(charColor(attributes, attributeIndex, decorations, defaultTextColor, x, lineText[x]));
+    QThreadPool::globalInstance()->start(m_miniMapRenderer);
 
-                    // Actually draw the pixel with the color queried from the renderer.
-                    painter.drawPoint(pixelX, pixelY);
+    //qCDebug(LOG_KTE) << time.elapsed();
+}
 
-                    pixelX++;
-                }
+void KateScrollBar::miniMapTilesPainted()
+{
+    if (!m_miniMapRenderer) {
+        return;
+    }
 
-            }
-            drawnLines++;
-            if (((drawnLines) % charIncrement) == 0) {
-                pixelY++;
-            }
+    KateMiniMapRenderer *renderer = m_miniMapRenderer;
+    m_miniMapRenderer = nullptr;
+    renderer->wait();
+
+    const KateMiniMapGeometry &geometry = renderer->geometry;
 
+    // increase dimensions by ratio, keep the tiles still valid for the new size
+    const QSize size(geometry.width * geometry.devicePixelRatio, geometry.height * geometry.devicePixelRatio);
+    if (m_miniMapImage.size() != size || !geometry.sameScale(m_miniMapGeometry)) {
+        QImage image(size, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+        if (!m_miniMapImage.isNull() && geometry.sameScale(m_miniMapGeometry)) {
+            QPainter painter(&image);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            painter.drawImage(0, 0, m_miniMapImage);
         }
-        //qCDebug(LOG_KTE) << drawnLines;
-        // Draw line modification marker map.
-        // Disable this if the document is really huge,
-        // since it requires querying every line.
-        if (m_doc->lines() < 50000) {
-            for (int lineno = 0; lineno < docLineCount; lineno++) {
-                int realLineNo = m_view->textFolding().visibleLineToLine(lineno);
-                const Kate::TextLine &line = m_doc->plainKateTextLine(realLineNo);
-                const QColor & col = line->markedAsModified() ? modifiedLineColor : savedLineColor;
-                if (line->markedAsModified() || line->markedAsSavedOnDisk()) {
-                    painter.fillRect(2, lineno / lineDivisor, 3, 1, col);
-                }
-            }
+        m_miniMapImage = image;
+    }
+    m_miniMapGeometry = geometry;
+
+    QPainter painter;
+    if (painter.begin(&m_miniMapImage)) {
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        foreach (const KateMiniMapTile &tile, renderer->tiles) {
+            painter.drawImage(0, tile.index * KateMiniMapRenderer::TileRows, tile.image);
         }
+        painter.end();
     }
+    m_miniMapTilesRendered += renderer->tiles.size();
+    delete renderer;
 
     // set right ratio
-    m_pixmap.setDevicePixelRatio(m_view->devicePixelRatio());
+    m_pixmap = QPixmap::fromImage(m_miniMapImage);
+    m_pixmap.setDevicePixelRatio(geometry.devicePixelRatio);
 
-    //qCDebug(LOG_KTE) << time.elapsed();
     // Redraw the scrollbar widget with the updated pixmap.
     update();
+
+    // anything changed meanwhile is queued in the dirty tiles or the geometry
+    updatePixmap();
+}
+
+void KateScrollBar::invalidateMiniMapLines(int from, int to)
+{
+    if (!m_showMiniMap) {
+        return;
+    }
+
+    m_updateTimer.start();
+
+    // no tiles yet, all get painted anyway
+    if (m_allTilesDirty || !m_miniMapGeometry.isValid() || m_dirtyTiles.isEmpty()) {
+        return;
+    }
+
+    const int lastTile = m_dirtyTiles.size() - 1;
+    const int fromLine = m_view->textFolding().lineToVisibleLine(qMax(0, from));
+    const int fromRow = qMin(m_miniMapGeometry.rowOfLine(fromLine), m_miniMapGeometry.markerRowOfLine(fromLine));
+    const int fromTile = qMin(fromRow / KateMiniMapRenderer::TileRows, lastTile);
+    int toTile = lastTile;
+    if (to >= 0) {
+        const int toLine = m_view->textFolding().lineToVisibleLine(to);
+        const int toRow = qMax(m_miniMapGeometry.rowOfLine(toLine), m_miniMapGeometry.markerRowOfLine(toLine));
+        toTile = qMin(toRow / KateMiniMapRenderer::TileRows, lastTile);
+    }
+
+    if (fromTile <= toTile) {
+        m_dirtyTiles.fill(true, fromTile, toTile + 1);
+    }
+}
+
+void KateScrollBar::miniMapLineWrapped(const KTextEditor::Cursor &position)
+{
+    // all lines below moved
+    invalidateMiniMapLines(position.line(), -1);
+}
+
+void KateScrollBar::miniMapLineUnwrapped(int line)
+{
+    invalidateMiniMapLines(line - 1, -1);
+}
+
+void KateScrollBar::miniMapTextInserted(const KTextEditor::Cursor &position)
+{
+    invalidateMiniMapLines(position.line(), position.line());
+}
+
+void KateScrollBar::miniMapTextRemoved(const KTextEditor::Range &range)
+{
+    invalidateMiniMapLines(range.start().line(), range.end().line());
+}
+
+void KateScrollBar::miniMapLineChanged(int line)
+{
+    invalidateMiniMapLines(line, line);
+}
+
+void KateScrollBar::miniMapLinesChanged(int start, int end)
+{
+    invalidateMiniMapLines(start, end);
+}
+
+void KateScrollBar::miniMapSelectionChanged()
+{
+    // the lines of the old and of the new selection
+    const KTextEditor::Range selection = m_view->selectionRange();
+    if (m_miniMapSelection.isValid()) {
+        invalidateMiniMapLines(m_miniMapSelection.start().line(), m_miniMapSelection.end().line());
+    }
+    if (selection.isValid()) {
+        invalidateMiniMapLines(selection.start().line(), selection.end().line());
+    }
+    m_miniMapSelection = selection;
+}
+
+void KateScrollBar::invalidateMiniMap()
+{
+    m_allTilesDirty = true;
+    m_updateTimer.start();
 }
 
 void KateScrollBar::miniMapPaintEvent(QPaintEvent *e)
@@ -1839,7 +1947,8 @@ void KateIconBorder::paintBorder(int /*x*/, int y, int /*width*/, int height)
                         anyFolded = true;
                     }
 
-                Kate::TextLine tl = m_doc->kateTextLine(realLine);
+                m_doc->buffer().requestHighlighting(realLine, 64, KateHighlightingScheduler::priorityForView(m_view));
+                Kate::TextLine tl = m_doc->plainKateTextLine(realLine);
 
                 if (!startingRanges.isEmpty() || tl->markedAsFoldingStart()) {
                     if (anyFolded) {
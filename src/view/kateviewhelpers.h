@@ -25,6 +25,8 @@
 #include <KLineEdit>
 #include <KActionMenu>
 
+#include <QBitArray>
+#include <QImage>
 #include <QPixmap>
 #include <QPointer>
 #include <QColor>
@@ -36,8 +38,10 @@
 #include <QTextLayout>
 
 #include <ktexteditor/cursor.h>
+#include <ktexteditor/range.h>
 #include <ktexteditor_export.h>
 #include "katetextline.h"
+#include "kateminimaprenderer.h"
 
 namespace KTextEditor { class DocumentPrivate; }
 namespace KTextEditor { class ViewPrivate; }
@@ -65,7 +69,7 @@ class QVBoxLayout;
  *
  * Also, it adds some useful indicators on the scrollbar.
  */
-class KateScrollBar : public QScrollBar
+class KTEXTEDITOR_EXPORT KateScrollBar : public QScrollBar
 {
     Q_OBJECT
 
@@ -114,9 +118,32 @@ public:
 
     inline void queuePixmapUpdate()
     {
-        m_updateTimer.start();
+        invalidateMiniMap();
     }
 
+    /**
+     * Minimap tiles painted so far.
+     */
+    qint64 miniMapTilesRendered() const
+    {
+        return m_miniMapTilesRendered;
+    }
+
+    /**
+     * Some minimap tiles are being painted in the background.
+     */
+    bool miniMapBusy() const
+    {
+        return m_miniMapRenderer;
+    }
+
+    /**
+     * Mark the tiles showing the given lines dirty.
+     * @param from first changed line
+     * @param to last changed line, -1 up to the end, e.g. if lines moved
+     */
+    void invalidateMiniMapLines(int from, int to);
+
 Q_SIGNALS:
     void sliderMMBMoved(int value);
 
@@ -139,6 +166,28 @@ public Q_SLOTS:
 
 private Q_SLOTS:
     void showTextPreview();
+
+    /**
+     * Compose the tiles painted by the worker into the minimap.
+     */
+    void miniMapTilesPainted();
+
+    /**
+     * Repaint the minimap tiles showing the changed lines.
+     */
+    void miniMapLineWrapped(const KTextEditor::Cursor &position);
+    void miniMapLineUnwrapped(int line);
+    void miniMapTextInserted(const KTextEditor::Cursor &position);
+    void miniMapTextRemoved(const KTextEditor::Range &range);
+    void miniMapLineChanged(int line);
+    void miniMapLinesChanged(int start, int end);
+    void miniMapSelectionChanged();
+
+    /**
+     * Repaint all minimap tiles, e.g. after folding or colors changed.
+     */
+    void invalidateMiniMap();
+
 private:
     void showTextPreviewDelayed();
     void hideTextPreview();
@@ -151,9 +200,15 @@ private:
 
     int minimapYToStdY(int y);
 
-    const QColor charColor(const QVector<Kate::TextLineData::Attribute> &attributes, int &attributeIndex,
-                           const QList<QTextLayout::FormatRange> &decorations,
-                           const QColor &defaultColor, int x, QChar ch);
+    /**
+     * Scale and colors the minimap needs now.
+     */
+    KateMiniMapGeometry miniMapGeometry();
+
+    /**
+     * Copy the lines shown in a tile.
+     */
+    void snapshotMiniMapTile(KateMiniMapTile &tile, const KateMiniMapGeometry &geometry, int docLineCount);
 
     bool m_middleMouseDown;
     bool m_leftMouseDown;
@@ -173,6 +228,17 @@ private:
 
     QPixmap m_pixmap;
     int     m_grooveHeight;
+
+    // the minimap as composed of its tiles, m_pixmap is its copy for painting
+    QImage m_miniMapImage;
+    KateMiniMapGeometry m_miniMapGeometry;
+    QBitArray m_dirtyTiles;
+    bool m_allTilesDirty;
+    KTextEditor::Range m_miniMapSelection;
+
+    // tiles being painted in the background, at most one batch at a time
+    KateMiniMapRenderer *m_miniMapRenderer;
+    qint64 m_miniMapTilesRendered;
     QRect   m_stdGroveRect;
     QRect   m_mapGroveRect;
     QRect   m_mapSliderRect;
@@ -182,8 +248,6 @@ private:
     // lists of lines added/removed recently to avoid scrollbar flickering
     QHash<int, int> m_linesAdded;
     int m_linesModified;
-
-    static const unsigned char characterOpacity[256];
 };
 
 class KateIconBorder : public QWidget
@@ -93,6 +93,8 @@ KateViewInternal::KateViewInternal(KTextEditor::ViewPrivate *view)
     , m_preserveX(false)
     , m_preservedX(0)
     , m_cachedMaxStartPos(-1, -1)
+    , m_paintedLineCount(0)
+    , m_reusedLineCount(0)
     , m_dragScrollTimer(this)
     , m_scrollTimer(this)
     , m_cursorTimer(this)
@@ -206,6 +208,10 @@ KateViewInternal::KateViewInternal(KTextEditor::ViewPrivate *view)
     connect(&m_scrollTimer, SIGNAL(timeout()),
             this, SLOT(scrollTimeout()));
 
+    // placeholders of very long lines get replaced once laid out in the background
+    connect(m_layoutCache, SIGNAL(lineLaidOut(int)),
+            this, SLOT(lineLaidOut(int)));
+
     connect(&m_cursorTimer, SIGNAL(timeout()),
             this, SLOT(cursorTimeout()));
 
@@ -555,6 +561,12 @@ void KateViewInternal::updateView(bool changed, int viewLinesScrolled)
     }
 }
 
+void KateViewInternal::lineLaidOut(int line)
+{
+    tagLines(line, line, true);
+    updateView(true);
+}
+
 void KateViewInternal::doUpdateView(bool changed, int viewLinesScrolled)
 {
     if (!isVisible() && !viewLinesScrolled && !changed) {
@@ -1987,10 +1999,11 @@ void KateViewInternal::updateCursor(const KTextEditor::Cursor &newCursor, bool f
     updateBracketMarks();
 
     // It's efficient enough to just tag them both without checking to see if they're on the same view line
+    // only the current line highlighting changed, nothing reaches into the next lines
     /*  kdDebug()<<"oldDisplayCursor:"<<oldDisplayCursor<<endl;
       kdDebug()<<"m_displayCursor:"<<m_displayCursor<<endl;*/
-    tagLine(oldDisplayCursor);
-    tagLine(m_displayCursor);
+    tagLine(oldDisplayCursor, false);
+    tagLine(m_displayCursor, false);
 
     updateMicroFocus();
 
@@ -2085,7 +2098,7 @@ void KateViewInternal::updateBracketMarks()
     m_bmLastFlashPos->setPosition(KTextEditor::Cursor::invalid());
 }
 
-bool KateViewInternal::tagLine(const KTextEditor::Cursor &virtualCursor)
+bool KateViewInternal::tagLine(const KTextEditor::Cursor &virtualCursor, bool tagNextLine)
 {
     // FIXME may be a more efficient way for this
     if ((int)m_view->textFolding().visibleLineToLine(virtualCursor.line()) > doc()->lastLine()) {
@@ -2098,7 +2111,7 @@ bool KateViewInternal::tagLine(const KTextEditor::Cursor &virtualCursor)
         cache()->viewLine(viewLine).setDirty();
 
         // tag one line more because of overlapping things like _, bug 335079
-        if (viewLine+1 < cache()->viewCacheLineCount()) {
+        if (tagNextLine && viewLine+1 < cache()->viewCacheLineCount()) {
             cache()->viewLine(viewLine+1).setDirty();
         }
 
@@ -2195,6 +2208,7 @@ void KateViewInternal::tagAll()
 {
     // clear the cache...
     cache()->clear();
+    m_lineBackingStores.clear();
 
     m_leftBorder->updateFont();
     m_leftBorder->update();
@@ -2202,11 +2216,37 @@ void KateViewInternal::tagAll()
 
 void KateViewInternal::paintCursor()
 {
-    if (tagLine(m_displayCursor)) {
-        updateDirty();    //paintText (0,0,width(), height(), true);
+    // the caret is painted over the reused lines, no need to tag them
+    const QRect rect = caretRect();
+    if (!rect.isEmpty()) {
+        update(rect);
     }
 }
 
+QRect KateViewInternal::caretRect()
+{
+    const int viewLine = cache()->displayViewLine(m_displayCursor, true);
+    if (viewLine < 0 || viewLine >= cache()->viewCacheLineCount()) {
+        return QRect();
+    }
+
+    const int h = renderer()->lineHeight();
+    const KateTextLayout &line = cache()->viewLine(viewLine);
+    if (!line.isValid()) {
+        return QRect(0, viewLine * h, width(), h);
+    }
+
+    // wide enough for all caret styles, block carets cover the character
+    int caretWidth = renderer()->spaceWidth();
+    if (m_cursor.column() < line.endCol()) {
+        caretWidth = qMax(caretWidth, qAbs(renderer()->cursorToX(line, m_cursor.column() + 1) - renderer()->cursorToX(line, m_cursor.column())));
+    }
+
+    // right-to-left text puts the caret left of the position
+    const int x = renderer()->cursorToX(line, m_cursor, true) - startX();
+    return QRect(x - caretWidth - 1, viewLine * h, 2 * caretWidth + 2, h).intersected(rect());
+}
+
 // Point in content coordinates
 void KateViewInternal::placeCursor(const QPoint &p, bool keepSelection, bool updateSelection)
 {
@@ -2889,8 +2929,12 @@ void KateViewInternal::updateDirty()
     QRegion updateRegion;
 
     {
+        // the line after a dirty one is updated, too: it may show parts of
+        // the dirty one, like _, bug 335079. paintEvent() reuses it if not.
+        bool previousDirty = false;
         for (int i = 0; i < cache()->viewCacheLineCount(); ++i) {
-            if (cache()->viewLine(i).isDirty()) {
+            const bool dirty = cache()->viewLine(i).isDirty();
+            if (dirty || previousDirty) {
                 if (currentRectStart == -1) {
                     currentRectStart = h * i;
                     currentRectEnd = h;
@@ -2903,6 +2947,7 @@ void KateViewInternal::updateDirty()
                 currentRectStart = -1;
                 currentRectEnd = -1;
             }
+            previousDirty = dirty;
         }
     }
 
@@ -2933,83 +2978,159 @@ void KateViewInternal::paintEvent(QPaintEvent *e)
     }
 
     const QRect &unionRect = e->rect();
+    const QRegion &region = e->region();
 
-    int xStart = startX() + unionRect.x();
-    int xEnd = xStart + unionRect.width();
-    uint h = renderer()->lineHeight();
-    uint startz = (unionRect.y() / h);
-    uint endz = startz + 1 + (unionRect.height() / h);
-    uint lineRangesSize = cache()->viewCacheLineCount();
+    const int h = renderer()->lineHeight();
+    const int startz = (unionRect.y() / h);
+    const int endz = startz + 1 + (unionRect.height() / h);
+    const int lineRangesSize = cache()->viewCacheLineCount();
     const KTextEditor::Cursor pos = m_cursor;
 
     QPainter paint(this);
     paint.setRenderHints(QPainter::Antialiasing);
 
-    paint.save();
-
     renderer()->setCaretStyle(m_currentInputMode->caretStyle());
     renderer()->setShowTabs(doc()->config()->showTabs());
     renderer()->setShowTrailingSpaces(doc()->config()->showSpaces());
 
-    int sy = startz * h;
-    paint.translate(unionRect.x(), startz * h);
+    m_lineBackingStores.resize(lineRangesSize);
 
-    for (uint z = startz; z <= endz; z++) {
-        paint.save();
+    for (int z = startz; z <= endz; z++) {
+        const QRect lineRect(0, z * h, width(), h);
+
+        // the region may consist of some lines far apart, like the old and the new cursor line
+        if (!region.intersects(lineRect)) {
+            continue;
+        }
 
         if ((z >= lineRangesSize) || (cache()->viewLine(z).line() == -1)) {
             if (!(z >= lineRangesSize)) {
                 cache()->viewLine(z).setDirty(false);
             }
 
-            paint.fillRect(0, 0, unionRect.width(), h, renderer()->config()->backgroundColor());
-        } else {
-            //qCDebug(LOG_KTE)<<"KateViewInternal::paintEvent(QPaintEvent *e):cache()->viewLine"<<z;
-            KateTextLayout &thisLine = cache()->viewLine(z);
-
-            /* If viewLine() returns non-zero, then a document line was split
-               in several visual lines, and we're trying to paint visual line
-               that is not the first.  In that case, this line was already
-               painted previously, since KateRenderer::paintTextLine paints
-               all visual lines.
-               Except if we're at the start of the region that needs to
-               be painted -- when no previous calls to paintTextLine were made.
-            */
-            if (!thisLine.viewLine() || z == startz) {
-                //qDebug() << "paint text: line: " << thisLine.line() << " viewLine " << thisLine.viewLine() << " x: " << unionRect.x() << " y: " << unionRect.y() << " width: " << xEnd-xStart << " height: " << h << endl;
-
-                // first: paint our line
-                paint.translate(QPoint(0, h * - thisLine.viewLine()));
-                paint.setClipRect(QRect(0, 0, unionRect.width(), h * thisLine.kateLineLayout()->viewLineCount()));
-                renderer()->paintTextLine(paint, thisLine.kateLineLayout(), xStart, xEnd, &pos);
-                paint.translate(0, h * thisLine.viewLine());
-
-                // second: paint previous line elements, that span into our line like _, bug 335079
-                if (z > 0) {
-                    KateTextLayout &previousLine = cache()->viewLine(z-1);
-                    paint.translate(QPoint(0, h * - (previousLine.viewLine() + 1)));
-                    renderer()->paintTextLine(paint, previousLine.kateLineLayout(), xStart, xEnd, &pos);
-                    paint.translate(0, h * (previousLine.viewLine() + 1));
-                }
+            paint.fillRect(lineRect, renderer()->config()->backgroundColor());
+            continue;
+        }
 
-                /**
-                 * line painted, reset and state + mark line as non-dirty
-                 */
-                thisLine.setDirty(false);
-            }
+        //qCDebug(LOG_KTE)<<"KateViewInternal::paintEvent(QPaintEvent *e):cache()->viewLine"<<z;
+        KateTextLayout &thisLine = cache()->viewLine(z);
+        LineBackingStore &store = m_lineBackingStores[z];
+
+        /**
+         * paint the line into its backing store, if anything of it changed
+         * mark line as non-dirty afterwards
+         */
+        if (debugPainting || thisLine.isDirty() || !isBackingStoreValid(store, z)) {
+            paintBackingStore(store, z);
+            thisLine.setDirty(false);
+            ++m_paintedLineCount;
+        } else {
+            ++m_reusedLineCount;
         }
 
-        paint.restore();
-        paint.translate(0, h);
-        sy += h;
+        paint.drawPixmap(lineRect.topLeft(), store.pixmap);
+
+        // the caret blinks, it is not part of the backing store
+        if (renderer()->drawCaret() && isCurrentViewLine(thisLine)) {
+            paint.save();
+            paint.setClipRect(lineRect);
+            paint.translate(0, h * (z - thisLine.viewLine()));
+            renderer()->paintCaret(paint, thisLine.kateLineLayout(), startX(), startX() + width(), pos);
+            paint.restore();
+        }
     }
 
-    paint.restore();
     if (m_textAnimation) {
         m_textAnimation->draw(paint);
     }
 }
 
+KateViewInternal::LineBackingStore::LineBackingStore()
+    : viewLine(-1)
+    , startX(0)
+    , currentLine(false)
+    , paintSerial(0)
+{
+}
+
+bool KateViewInternal::isCurrentViewLine(const KateTextLayout &line) const
+{
+    return line.line() == m_cursor.line() && line.kateLineLayout()->viewLineForColumn(m_cursor.column()) == line.viewLine();
+}
+
+bool KateViewInternal::isBackingStoreValid(const LineBackingStore &store, int z) const
+{
+    const KateTextLayout &thisLine = cache()->viewLine(z);
+    if (store.pixmap.isNull() || store.lineLayout != thisLine.kateLineLayout() || store.layout != thisLine.kateLineLayout()->sharedLayout()
+            || store.viewLine != thisLine.viewLine() || store.startX != startX() || store.currentLine != isCurrentViewLine(thisLine)
+            || store.paintSerial != renderer()->paintSerial()) {
+        return false;
+    }
+
+    const qreal ratio = devicePixelRatio();
+    if (store.pixmap.devicePixelRatio() != ratio || store.pixmap.size() != QSize(width() * ratio, renderer()->lineHeight() * ratio)) {
+        return false;
+    }
+
+    // the previous line may reach into this one
+    const QSharedPointer<QTextLayout> previousLayout = (z > 0 && cache()->viewLine(z - 1).isValid()) ? cache()->viewLine(z - 1).kateLineLayout()->sharedLayout() : QSharedPointer<QTextLayout>();
+    return store.previousLayout == previousLayout;
+}
+
+void KateViewInternal::paintBackingStore(LineBackingStore &store, int z)
+{
+    KateTextLayout &thisLine = cache()->viewLine(z);
+    const KTextEditor::Cursor pos = m_cursor;
+    const int h = renderer()->lineHeight();
+    const int xStart = startX();
+    const int xEnd = xStart + width();
+    const qreal ratio = devicePixelRatio();
+
+    store.lineLayout = thisLine.kateLineLayout();
+    store.layout = thisLine.kateLineLayout()->sharedLayout();
+    store.viewLine = thisLine.viewLine();
+    store.previousLayout = (z > 0 && cache()->viewLine(z - 1).isValid()) ? cache()->viewLine(z - 1).kateLineLayout()->sharedLayout() : QSharedPointer<QTextLayout>();
+    store.startX = xStart;
+    store.currentLine = isCurrentViewLine(thisLine);
+    store.paintSerial = renderer()->paintSerial();
+
+    const QSize size(width() * ratio, h * ratio);
+    if (store.pixmap.size() != size) {
+        store.pixmap = QPixmap(size);
+    }
+    store.pixmap.setDevicePixelRatio(ratio);
+    store.pixmap.fill(renderer()->config()->backgroundColor());
+
+    QPainter paint(&store.pixmap);
+    paint.setRenderHints(QPainter::Antialiasing);
+
+    // first: paint our view line and the one above, its glyphs may reach into ours
+    // the other view lines of a wrapped line are skipped, they have backing stores of their own
+    paint.setClipRect(QRect(0, 0, width(), h));
+    paint.translate(QPoint(0, h * - thisLine.viewLine()));
+    renderer()->paintTextLine(paint, thisLine.kateLineLayout(), xStart, xEnd, &pos, KateRenderer::SkipDrawCaret,
+                              QRect(0, h * (thisLine.viewLine() - 1), width(), 2 * h));
+    paint.translate(0, h * thisLine.viewLine());
+
+    // second: paint previous line elements, that span into our line like _, bug 335079
+    if (z > 0) {
+        KateTextLayout &previousLine = cache()->viewLine(z-1);
+        if (previousLine.isValid() && previousLine.kateLineLayout() != thisLine.kateLineLayout()) {
+            paint.translate(QPoint(0, h * - (previousLine.viewLine() + 1)));
+            renderer()->paintTextLine(paint, previousLine.kateLineLayout(), xStart, xEnd, &pos, KateRenderer::SkipDrawCaret,
+                                      QRect(0, h * previousLine.viewLine(), width(), 2 * h));
+            paint.translate(0, h * (previousLine.viewLine() + 1));
+        }
+    }
+}
+
+QString KateViewInternal::paintStatistics() const
+{
+    const qint64 lines = m_paintedLineCount + m_reusedLineCount;
+    return QStringLiteral("View: %1 lines painted, %2 lines reused, %3% reused")
+           .arg(m_paintedLineCount).arg(m_reusedLineCount).arg(lines ? (100 * m_reusedLineCount / lines) : 0);
+}
+
 void KateViewInternal::resizeEvent(QResizeEvent *e)
 {
     bool expandedHorizontally = width() > e->oldSize().width();
@@ -42,6 +42,8 @@
 #include <QWidget>
 #include <QSet>
 #include <QPointer>
+#include <QPixmap>
+#include <QVector>
 
 namespace KTextEditor
 {
@@ -101,7 +103,7 @@ private:
 
     //BEGIN TAG & CLEAR & UPDATE STUFF
 public:
-    bool tagLine(const KTextEditor::Cursor &virtualCursor);
+    bool tagLine(const KTextEditor::Cursor &virtualCursor, bool tagNextLine = true);
 
     bool tagLines(int start, int end, bool realLines = false);
     // cursors not const references as they are manipulated within
@@ -120,6 +122,9 @@ private Q_SLOTS:
     // Updates the view and requests a redraw.
     void updateView(bool changed = false, int viewLinesScrolled = 0);
 
+    // Replaces the placeholder layout of a very long line.
+    void lineLaidOut(int line);
+
 private:
     // Actually performs the updating, but doesn't call update().
     void doUpdateView(bool changed = false, int viewLinesScrolled = 0);
@@ -395,6 +400,60 @@ public:
 private:
     QPointer<KateTextAnimation> m_textAnimation;
 
+    //
+    // painted view lines, reused by paintEvent() as long as they are up to date
+    //
+public:
+    /**
+     * View lines painted anew, since the view got created.
+     */
+    qint64 paintedLineCount() const
+    {
+        return m_paintedLineCount;
+    }
+
+    /**
+     * View lines copied from their backing store instead of being painted.
+     */
+    qint64 reusedLineCount() const
+    {
+        return m_reusedLineCount;
+    }
+
+    QString paintStatistics() const;
+
+private:
+    /**
+     * Painted view line, without the caret. The layouts are kept to notice a
+     * line that got laid out anew or moved, the previous line's layout because
+     * glyphs like _ reach into the next line.
+     */
+    struct LineBackingStore {
+        LineBackingStore();
+
+        KateLineLayoutPtr lineLayout;
+        QSharedPointer<QTextLayout> layout;
+        int viewLine;
+        QSharedPointer<QTextLayout> previousLayout;
+        int startX;
+        bool currentLine;
+        uint paintSerial;
+        QPixmap pixmap;
+    };
+
+    bool isCurrentViewLine(const KateTextLayout &line) const;
+    bool isBackingStoreValid(const LineBackingStore &store, int z) const;
+    void paintBackingStore(LineBackingStore &store, int z);
+
+    /**
+     * Area of the caret, its blinking repaints nothing else.
+     */
+    QRect caretRect();
+
+    QVector<LineBackingStore> m_lineBackingStores;
+    qint64 m_paintedLineCount;
+    qint64 m_reusedLineCount;
+
 private Q_SLOTS:
     void doDragScroll();
     void startDragScroll();